@@ -74,6 +74,7 @@
 #include <sys/dsl_crypt.h>
 #include <sys/dsl_scan.h>
 #include <sys/btree.h>
+#include <sys/brt.h>
 #include <zfs_comutil.h>
 #include <sys/zstd/zstd.h>
 
@@ -1965,6 +1966,23 @@ dump_ddt(ddt_t *ddt, enum ddt_type type, enum ddt_class class)
 	(void) printf("\n");
 }
 
+static void
+dump_ddt_log(ddt_t *ddt)
+{
+	if (!ddt_log_enabled(ddt) || ddt_log_idle(ddt))
+		return;
+
+	for (int n = 0; n < DDT_LOGS; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		(void) printf("DDT-log-%s-%d: %llu entries, %llu bytes, %s\n",
+		    zio_checksum_table[ddt->ddt_checksum].ci_name, n,
+		    (u_longlong_t)avl_numnodes(&ddl->ddl_tree),
+		    (u_longlong_t)ddl->ddl_length,
+		    ddl == ddt->ddt_log_active ? "active" : "flushing");
+	}
+}
+
 static void
 dump_all_ddts(spa_t *spa)
 {
@@ -1982,6 +2000,7 @@ dump_all_ddts(spa_t *spa)
 				dump_ddt(ddt, type, class);
 			}
 		}
+		dump_ddt_log(ddt);
 	}
 
 	ddt_get_dedup_stats(spa, &dds_total);
@@ -4852,6 +4871,8 @@ typedef struct zdb_cb {
 	uint64_t	zcb_checkpoint_size;
 	uint64_t	zcb_dedup_asize;
 	uint64_t	zcb_dedup_blocks;
+	uint64_t	zcb_clone_asize;
+	uint64_t	zcb_clone_blocks;
 	uint64_t	zcb_psize_count[SPA_MAX_FOR_16M];
 	uint64_t	zcb_lsize_count[SPA_MAX_FOR_16M];
 	uint64_t	zcb_asize_count[SPA_MAX_FOR_16M];
@@ -5187,6 +5208,14 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 				ddt_remove(ddt, dde);
 		}
 		ddt_exit(ddt);
+	} else if (brt_entry_decref(zcb->zcb_spa, bp)) {
+		/*
+		 * This block is cloned and we have not yet seen its last
+		 * reference; only the last one claims it.
+		 */
+		refcnt = 1;
+		zcb->zcb_clone_asize += BP_GET_ASIZE(bp);
+		zcb->zcb_clone_blocks++;
 	}
 
 	VERIFY3U(zio_wait(zio_claim(NULL, zcb->zcb_spa,
@@ -5501,46 +5530,112 @@ zdb_load_obsolete_counts(vdev_t *vd)
 	return (counts);
 }
 
+static void
+zdb_ddt_leak_entry(spa_t *spa, zdb_cb_t *zcb, enum zio_checksum checksum,
+    ddt_entry_t *dde)
+{
+	ddt_t *ddt = spa->spa_ddt[checksum];
+	ddt_phys_t *ddp = dde->dde_phys;
+	blkptr_t blk;
+	int p;
+
+	ASSERT(ddt_phys_total_refcnt(dde) > 1);
+
+	for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+		if (ddp->ddp_phys_birth == 0)
+			continue;
+		ddt_bp_create(checksum, &dde->dde_key, ddp, &blk);
+		if (p == DDT_PHYS_DITTO) {
+			zdb_count_block(zcb, NULL, &blk, ZDB_OT_DITTO);
+		} else {
+			zcb->zcb_dedup_asize +=
+			    BP_GET_ASIZE(&blk) * (ddp->ddp_refcnt - 1);
+			zcb->zcb_dedup_blocks++;
+		}
+	}
+	ddt_enter(ddt);
+	VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
+	ddt_exit(ddt);
+}
+
+/*
+ * Entries which have been logged but not flushed yet aren't in the ZAPs,
+ * or not in the ZAP for their current class.
+ */
+static void
+zdb_ddt_leak_init_log(spa_t *spa, zdb_cb_t *zcb)
+{
+	ddt_entry_t dde;
+	blkptr_t blk;
+
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+
+		if (!ddt_log_enabled(ddt))
+			continue;
+
+		for (int n = 0; n < DDT_LOGS; n++) {
+			avl_tree_t *t = &ddt->ddt_log[n].ddl_tree;
+
+			for (ddt_log_entry_t *ddle = avl_first(t);
+			    ddle != NULL; ddle = AVL_NEXT(t, ddle)) {
+				boolean_t loaded;
+
+				dde.dde_key = ddle->ddle_key;
+				bcopy(ddle->ddle_phys, dde.dde_phys,
+				    sizeof (dde.dde_phys));
+				if (ddt_phys_total_refcnt(&dde) <= 1)
+					continue;
+
+				/* Already counted while walking the ZAPs */
+				ddt_bp_create(c, &dde.dde_key, NULL, &blk);
+				ddt_enter(ddt);
+				loaded = (ddt_lookup(ddt, &blk,
+				    B_FALSE) != NULL);
+				ddt_exit(ddt);
+				if (!loaded)
+					zdb_ddt_leak_entry(spa, zcb, c, &dde);
+			}
+		}
+	}
+}
+
 static void
 zdb_ddt_leak_init(spa_t *spa, zdb_cb_t *zcb)
 {
 	ddt_bookmark_t ddb;
 	ddt_entry_t dde;
+	boolean_t logged = B_FALSE;
 	int error;
-	int p;
 
 	ASSERT(!dump_opt['L']);
 
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		if (ddt_log_enabled(spa->spa_ddt[c]))
+			logged = B_TRUE;
+	}
+
+	/*
+	 * ddt_walk() returns the logged state of the entries, which may be
+	 * in a different class than the ZAP they're in, so with the log we
+	 * have to look at the unique ones too.
+	 */
 	bzero(&ddb, sizeof (ddb));
 	while ((error = ddt_walk(spa, &ddb, &dde)) == 0) {
-		blkptr_t blk;
-		ddt_phys_t *ddp = dde.dde_phys;
-
-		if (ddb.ddb_class == DDT_CLASS_UNIQUE)
+		if (ddb.ddb_class == DDT_CLASS_UNIQUE && !logged)
 			return;
 
-		ASSERT(ddt_phys_total_refcnt(&dde) > 1);
-
-		for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
-			if (ddp->ddp_phys_birth == 0)
-				continue;
-			ddt_bp_create(ddb.ddb_checksum,
-			    &dde.dde_key, ddp, &blk);
-			if (p == DDT_PHYS_DITTO) {
-				zdb_count_block(zcb, NULL, &blk, ZDB_OT_DITTO);
-			} else {
-				zcb->zcb_dedup_asize +=
-				    BP_GET_ASIZE(&blk) * (ddp->ddp_refcnt - 1);
-				zcb->zcb_dedup_blocks++;
-			}
+		if (ddt_phys_total_refcnt(&dde) <= 1) {
+			ASSERT(logged);
+			continue;
 		}
-		ddt_t *ddt = spa->spa_ddt[ddb.ddb_checksum];
-		ddt_enter(ddt);
-		VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
-		ddt_exit(ddt);
+
+		zdb_ddt_leak_entry(spa, zcb, ddb.ddb_checksum, &dde);
 	}
 
 	ASSERT(error == ENOENT);
+
+	zdb_ddt_leak_init_log(spa, zcb);
 }
 
 typedef struct checkpoint_sm_exclude_entry_arg {
@@ -6276,8 +6371,9 @@ dump_block_stats(spa_t *spa)
 	    metaslab_class_get_alloc(spa_special_class(spa)) +
 	    metaslab_class_get_alloc(spa_dedup_class(spa)) +
 	    get_unflushed_alloc_space(spa);
-	total_found = tzb->zb_asize - zcb.zcb_dedup_asize +
-	    zcb.zcb_removing_size + zcb.zcb_checkpoint_size;
+	total_found = tzb->zb_asize - zcb.zcb_dedup_asize -
+	    zcb.zcb_clone_asize + zcb.zcb_removing_size +
+	    zcb.zcb_checkpoint_size;
 
 	if (total_found == total_alloc && !dump_opt['L']) {
 		(void) printf("\n\tNo leaks (block sum matches space"
@@ -6315,6 +6411,9 @@ dump_block_stats(spa_t *spa)
 	    "bp deduped:", (u_longlong_t)zcb.zcb_dedup_asize,
 	    (u_longlong_t)zcb.zcb_dedup_blocks,
 	    (double)zcb.zcb_dedup_asize / tzb->zb_asize + 1.0);
+	(void) printf("\t%-16s %14llu    count: %6llu\n",
+	    "bp cloned:", (u_longlong_t)zcb.zcb_clone_asize,
+	    (u_longlong_t)zcb.zcb_clone_blocks);
 	(void) printf("\t%-16s %14llu     used: %5.2f%%\n", "Normal class:",
 	    (u_longlong_t)norm_alloc, 100.0 * norm_alloc / norm_space);
 
@@ -7228,6 +7327,7 @@ dump_mos_leaks(spa_t *spa)
 	mos_obj_refd(spa->spa_pool_props_object);
 	mos_obj_refd(spa->spa_config_object);
 	mos_obj_refd(spa->spa_ddt_stat_object);
+	mos_obj_refd(spa->spa_brt->brt_object);
 	mos_obj_refd(spa->spa_feat_desc_obj);
 	mos_obj_refd(spa->spa_feat_enabled_txg_obj);
 	mos_obj_refd(spa->spa_feat_for_read_obj);
@@ -7296,6 +7396,12 @@ dump_mos_leaks(spa_t *spa)
 		}
 	}
 
+	for (uint64_t cksum = 0; cksum < ZIO_CHECKSUM_FUNCTIONS; cksum++) {
+		ddt_t *ddt = spa->spa_ddt[cksum];
+		for (int n = 0; n < DDT_LOGS; n++)
+			mos_obj_refd(ddt->ddt_log[n].ddl_object);
+	}
+
 	/*
 	 * Visit all allocated objects and make sure they are referenced.
 	 */
@@ -6266,9 +6266,21 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 	ret = zpool_vdev_attach(zhp, old_disk, new_disk, nvroot, replacing,
 	    rebuild);
 
-	if (ret == 0 && wait)
-		ret = zpool_wait(zhp,
-		    replacing ? ZPOOL_WAIT_REPLACE : ZPOOL_WAIT_RESILVER);
+	if (ret == 0 && wait) {
+		zpool_wait_activity_t activity = ZPOOL_WAIT_RESILVER;
+		char *type = NULL;
+		nvlist_t *tgt;
+
+		if (replacing) {
+			activity = ZPOOL_WAIT_REPLACE;
+		} else if ((tgt = zpool_find_vdev(zhp, old_disk, NULL, NULL,
+		    NULL)) != NULL &&
+		    nvlist_lookup_string(tgt, ZPOOL_CONFIG_TYPE, &type) == 0 &&
+		    strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
+			activity = ZPOOL_WAIT_RAIDZ_EXPAND;
+		}
+		ret = zpool_wait(zhp, activity);
+	}
 
 	nvlist_free(props);
 	nvlist_free(nvroot);
@@ -7661,6 +7673,88 @@ print_removal_status(zpool_handle_t *zhp, pool_removal_stat_t *prs)
 	}
 }
 
+/*
+ * Print out detailed raidz expansion status.
+ */
+static void
+print_raidz_expand_status(zpool_handle_t *zhp, pool_raidz_expand_stat_t *pres)
+{
+	char copied_buf[7], total_buf[7], rate_buf[7];
+	time_t start, end;
+	nvlist_t *config, *nvroot;
+	nvlist_t **child;
+	uint_t children;
+	char *vdev_name;
+
+	if (pres == NULL || pres->pres_state == DSS_NONE)
+		return;
+
+	/*
+	 * Determine name of vdev.
+	 */
+	config = zpool_get_config(zhp, NULL);
+	nvroot = fnvlist_lookup_nvlist(config, ZPOOL_CONFIG_VDEV_TREE);
+	verify(nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) == 0);
+	assert(pres->pres_expanding_vdev < children);
+	vdev_name = zpool_vdev_name(g_zfs, zhp,
+	    child[pres->pres_expanding_vdev], VDEV_NAME_TYPE_ID);
+
+	(void) printf(gettext("expand: "));
+
+	start = pres->pres_start_time;
+	end = pres->pres_end_time;
+	zfs_nicenum(pres->pres_reflowed, copied_buf, sizeof (copied_buf));
+
+	if (pres->pres_state == DSS_FINISHED) {
+		uint64_t minutes_taken = (end - start) / 60;
+
+		(void) printf(gettext("Expansion of vdev %s reflowed %s "
+		    "in %lluh%um, completed on %s"),
+		    vdev_name, copied_buf,
+		    (u_longlong_t)(minutes_taken / 60),
+		    (uint_t)(minutes_taken % 60),
+		    ctime((time_t *)&end));
+	} else {
+		uint64_t copied, total, elapsed, mins_left, hours_left;
+		double fraction_done;
+		uint_t rate;
+
+		assert(pres->pres_state == DSS_SCANNING);
+
+		(void) printf(gettext(
+		    "Expansion of %s in progress since %s"),
+		    vdev_name, ctime(&start));
+
+		copied = pres->pres_reflowed > 0 ? pres->pres_reflowed : 1;
+		total = pres->pres_to_reflow;
+		fraction_done = (double)copied / total;
+
+		elapsed = time(NULL) - pres->pres_start_time;
+		elapsed = elapsed > 0 ? elapsed : 1;
+		rate = copied / elapsed;
+		rate = rate > 0 ? rate : 1;
+		mins_left = ((total - copied) / rate) / 60;
+		hours_left = mins_left / 60;
+
+		zfs_nicenum(copied, copied_buf, sizeof (copied_buf));
+		zfs_nicenum(total, total_buf, sizeof (total_buf));
+		zfs_nicenum(rate, rate_buf, sizeof (rate_buf));
+
+		(void) printf(gettext("    %s reflowed out of %s at %s/s, "
+		    "%.2f%% done"),
+		    copied_buf, total_buf, rate_buf, 100 * fraction_done);
+		if (hours_left < (30 * 24)) {
+			(void) printf(gettext(", %lluh%um to go\n"),
+			    (u_longlong_t)hours_left, (uint_t)(mins_left % 60));
+		} else {
+			(void) printf(gettext(
+			    ", (reflow is slow, no estimated time)\n"));
+		}
+	}
+	free(vdev_name);
+}
+
 static void
 print_checkpoint_status(pool_checkpoint_stat_t *pcs)
 {
@@ -7773,6 +7867,7 @@ print_dedup_stats(nvlist_t *config)
 	ddt_histogram_t *ddh;
 	ddt_stat_t *dds;
 	ddt_object_t *ddo;
+	uint64_t log_entries = 0, log_size = 0;
 	uint_t c;
 	char dspace[6], mspace[6];
 
@@ -7785,9 +7880,14 @@ print_dedup_stats(nvlist_t *config)
 	    (uint64_t **)&ddo, &c) != 0)
 		return;
 
+	(void) nvlist_lookup_uint64(config, ZPOOL_CONFIG_DDT_LOG_ENTRIES,
+	    &log_entries);
+	(void) nvlist_lookup_uint64(config, ZPOOL_CONFIG_DDT_LOG_SIZE,
+	    &log_size);
+
 	(void) printf("\n");
 	(void) printf(gettext(" dedup: "));
-	if (ddo->ddo_count == 0) {
+	if (ddo->ddo_count == 0 && log_entries == 0) {
 		(void) printf(gettext("no DDT entries\n"));
 		return;
 	}
@@ -7799,6 +7899,12 @@ print_dedup_stats(nvlist_t *config)
 	    dspace,
 	    mspace);
 
+	if (nvlist_exists(config, ZPOOL_CONFIG_DDT_LOG_ENTRIES)) {
+		zfs_nicebytes(log_size, dspace, sizeof (dspace));
+		(void) printf("DDT log entries %llu, size %s on disk\n",
+		    (u_longlong_t)log_entries, dspace);
+	}
+
 	verify(nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_STATS,
 	    (uint64_t **)&dds, &c) == 0);
 	verify(nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_HISTOGRAM,
@@ -8212,6 +8318,7 @@ status_callback(zpool_handle_t *zhp, void *data)
 		uint_t nspares, nl2cache;
 		pool_checkpoint_stat_t *pcs = NULL;
 		pool_removal_stat_t *prs = NULL;
+		pool_raidz_expand_stat_t *pres = NULL;
 
 		print_scan_status(zhp, nvroot);
 
@@ -8219,6 +8326,10 @@ status_callback(zpool_handle_t *zhp, void *data)
 		    ZPOOL_CONFIG_REMOVAL_STATS, (uint64_t **)&prs, &c);
 		print_removal_status(zhp, prs);
 
+		(void) nvlist_lookup_uint64_array(nvroot,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t **)&pres, &c);
+		print_raidz_expand_status(zhp, pres);
+
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_CHECKPOINT_STATS, (uint64_t **)&pcs, &c);
 		print_checkpoint_status(pcs);
@@ -9885,8 +9996,9 @@ print_wait_status_row(wait_data_t *wd, zpool_handle_t *zhp, int row)
 	pool_checkpoint_stat_t *pcs = NULL;
 	pool_scan_stat_t *pss = NULL;
 	pool_removal_stat_t *prs = NULL;
+	pool_raidz_expand_stat_t *pres = NULL;
 	char *headers[] = {"DISCARD", "FREE", "INITIALIZE", "REPLACE",
-	    "REMOVE", "RESILVER", "SCRUB", "TRIM"};
+	    "REMOVE", "RESILVER", "SCRUB", "TRIM", "RAIDZ_EXPAND"};
 	int col_widths[ZPOOL_WAIT_NUM_ACTIVITIES];
 
 	/* Calculate the width of each column */
@@ -9931,6 +10043,12 @@ print_wait_status_row(wait_data_t *wd, zpool_handle_t *zhp, int row)
 		bytes_rem[ZPOOL_WAIT_REMOVE] = prs->prs_to_copy -
 		    prs->prs_copied;
 
+	(void) nvlist_lookup_uint64_array(nvroot,
+	    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t **)&pres, &c);
+	if (pres != NULL && pres->pres_state == DSS_SCANNING)
+		bytes_rem[ZPOOL_WAIT_RAIDZ_EXPAND] = pres->pres_to_reflow -
+		    pres->pres_reflowed;
+
 	(void) nvlist_lookup_uint64_array(nvroot,
 	    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&pss, &c);
 	if (pss != NULL && pss->pss_state == DSS_SCANNING &&
@@ -10083,7 +10201,7 @@ zpool_do_wait(int argc, char **argv)
 		{
 			static char *col_subopts[] = { "discard", "free",
 			    "initialize", "replace", "remove", "resilver",
-			    "scrub", "trim", NULL };
+			    "scrub", "trim", "raidz_expand", NULL };
 
 			/* Reset activities array */
 			bzero(&wd.wd_enabled, sizeof (wd.wd_enabled));
@@ -36,6 +36,7 @@
  *
  * 	Group vdevs
  * 		raidz[1|2]=(...)
+ * 		draid[1|2|3][:<data>d][:<spares>s]=(...)
  * 		mirror=(...)
  *
  * 	Hot spares
@@ -259,6 +260,23 @@ is_spare(nvlist_t *config, const char *path)
 	return (B_FALSE);
 }
 
+/*
+ * Determine if the given name is that of a dRAID distributed spare,
+ * draid<parity>-<vdev id>-<spare id>.
+ */
+static boolean_t
+is_draid_spare(const char *name)
+{
+	unsigned long long parity, vdev_id, spare_id;
+	int n = 0;
+
+	if (sscanf(name, VDEV_TYPE_DRAID "%llu-%llu-%llu%n",
+	    &parity, &vdev_id, &spare_id, &n) != 3)
+		return (B_FALSE);
+
+	return (name[n] == '\0');
+}
+
 /*
  * Create a leaf vdev.  Determine if this is a file or a device.  If it's a
  * device, fill in the device id to make a complete nvlist.  Valid forms for a
@@ -267,6 +285,7 @@ is_spare(nvlist_t *config, const char *path)
  *	/dev/xxx	Complete disk path
  *	/xxx		Full path to file
  *	xxx		Shorthand for <zfs_vdev_paths>/xxx
+ *	draidP-N-S	Distributed spare S of the dRAID vdev N
  */
 static nvlist_t *
 make_leaf_vdev(nvlist_t *props, const char *arg, uint64_t is_log)
@@ -279,6 +298,20 @@ make_leaf_vdev(nvlist_t *props, const char *arg, uint64_t is_log)
 	uint64_t ashift = 0;
 	int err;
 
+	/*
+	 * Distributed spares are provided by their dRAID vdev, there is no
+	 * device or file to check.
+	 */
+	if (is_draid_spare(arg)) {
+		verify(nvlist_alloc(&vdev, NV_UNIQUE_NAME, 0) == 0);
+		verify(nvlist_add_string(vdev, ZPOOL_CONFIG_PATH, arg) == 0);
+		verify(nvlist_add_string(vdev, ZPOOL_CONFIG_TYPE,
+		    VDEV_TYPE_DRAID_SPARE) == 0);
+		verify(nvlist_add_uint64(vdev, ZPOOL_CONFIG_IS_LOG,
+		    is_log) == 0);
+		return (vdev);
+	}
+
 	/*
 	 * Determine what type of vdev this is, and put the full path into
 	 * 'path'.  We detect whether this is a device of file afterwards by
@@ -511,7 +544,8 @@ get_replication(nvlist_t *nvroot, boolean_t fatal)
 			rep.zprl_type = type;
 			rep.zprl_children = 0;
 
-			if (strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
+			if (strcmp(type, VDEV_TYPE_RAIDZ) == 0 ||
+			    strcmp(type, VDEV_TYPE_DRAID) == 0) {
 				verify(nvlist_lookup_uint64(nv,
 				    ZPOOL_CONFIG_NPARITY,
 				    &rep.zprl_parity) == 0);
@@ -1103,9 +1137,67 @@ is_device_in_use(nvlist_t *config, nvlist_t *nv, boolean_t force,
 	return (anyinuse);
 }
 
+/*
+ * Parse a dRAID vdev type, draid[<parity>][:<data>d][:<spares>s].  The
+ * parity defaults to 1 and the number of spares to 0; the number of data
+ * disks is returned as 0 when not given, in which case it depends on the
+ * number of children.
+ */
+static boolean_t
+draid_config_by_type(const char *type, uint64_t *nparity, uint64_t *ndata,
+    uint64_t *nspares)
+{
+	const char *p = type + strlen(VDEV_TYPE_DRAID);
+	char *end;
+
+	if (strncmp(type, VDEV_TYPE_DRAID, strlen(VDEV_TYPE_DRAID)) != 0)
+		return (B_FALSE);
+
+	*nparity = 1;
+	*ndata = 0;
+	*nspares = 0;
+
+	if (*p != '\0' && *p != ':') {
+		if (*p == '0')
+			return (B_FALSE); /* no zero prefixes allowed */
+
+		errno = 0;
+		*nparity = strtoull(p, &end, 10);
+		if (errno != 0 || *nparity < 1 || *nparity > 3)
+			return (B_FALSE);
+		p = end;
+	}
+
+	while (*p == ':') {
+		uint64_t value;
+
+		p++;
+		if (!isdigit(*p))
+			return (B_FALSE);
+
+		errno = 0;
+		value = strtoull(p, &end, 10);
+		if (errno != 0 || value >= 255)
+			return (B_FALSE);
+
+		if (*end == 'd' && value > 0)
+			*ndata = value;
+		else if (*end == 's')
+			*nspares = value;
+		else
+			return (B_FALSE);
+
+		p = end + 1;
+	}
+
+	return (*p == '\0');
+}
+
 static const char *
 is_grouping(const char *type, int *mindev, int *maxdev)
 {
+	uint64_t nparity, ndata, nspares;
+
 	if (strncmp(type, "raidz", 5) == 0) {
 		const char *p = type + 5;
 		char *end;
@@ -1130,6 +1222,14 @@ is_grouping(const char *type, int *mindev, int *maxdev)
 		return (VDEV_TYPE_RAIDZ);
 	}
 
+	if (draid_config_by_type(type, &nparity, &ndata, &nspares)) {
+		if (mindev != NULL)
+			*mindev = nparity + MAX(ndata, 1) + nspares;
+		if (maxdev != NULL)
+			*maxdev = 255;
+		return (VDEV_TYPE_DRAID);
+	}
+
 	if (maxdev != NULL)
 		*maxdev = INT_MAX;
 
@@ -1202,6 +1302,7 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 		 */
 		if ((type = is_grouping(argv[0], &mindev, &maxdev)) != NULL) {
 			nvlist_t **child = NULL;
+			const char *grouping = argv[0];
 			int c, children = 0;
 
 			if (strcmp(type, VDEV_TYPE_SPARE) == 0) {
@@ -1354,6 +1455,25 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 					    ZPOOL_CONFIG_NPARITY,
 					    mindev - 1) == 0);
 				}
+				if (strcmp(type, VDEV_TYPE_DRAID) == 0) {
+					uint64_t nparity, ndata, nspares;
+
+					verify(draid_config_by_type(grouping,
+					    &nparity, &ndata, &nspares));
+					if (ndata == 0) {
+						ndata = MIN(8, children -
+						    nparity - nspares);
+					}
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_NPARITY,
+					    nparity) == 0);
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_DRAID_NDATA,
+					    ndata) == 0);
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_DRAID_NSPARES,
+					    nspares) == 0);
+				}
 				verify(nvlist_add_nvlist_array(nv,
 				    ZPOOL_CONFIG_CHILDREN, child,
 				    children) == 0);
@@ -107,6 +107,7 @@
 #include <sys/vdev_impl.h>
 #include <sys/vdev_file.h>
 #include <sys/vdev_initialize.h>
+#include <sys/vdev_draid.h>
 #include <sys/vdev_raidz.h>
 #include <sys/vdev_trim.h>
 #include <sys/spa_impl.h>
@@ -116,10 +117,13 @@
 #include <sys/dsl_destroy.h>
 #include <sys/dsl_scan.h>
 #include <sys/zio_checksum.h>
+#include <sys/blake3.h>
+#include <sys/sha2.h>
 #include <sys/zfs_refcount.h>
 #include <sys/zfeature.h>
 #include <sys/dsl_userhold.h>
 #include <sys/abd.h>
+#include <sys/zfs_pattern.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -169,6 +173,9 @@ typedef struct ztest_shared_opts {
 	int zo_mirrors;
 	int zo_raidz;
 	int zo_raidz_parity;
+	char zo_raid_type[8];
+	int zo_draid_data;
+	int zo_draid_spares;
 	int zo_datasets;
 	int zo_threads;
 	uint64_t zo_passtime;
@@ -179,6 +186,7 @@ typedef struct ztest_shared_opts {
 	uint64_t zo_maxloops;
 	uint64_t zo_metaslab_force_ganging;
 	int zo_mmp_test;
+	int zo_raidz_expand_test;
 	int zo_special_vdevs;
 	int zo_dump_dbgmsg;
 } ztest_shared_opts_t;
@@ -193,6 +201,9 @@ static const ztest_shared_opts_t ztest_opts_defaults = {
 	.zo_mirrors = 2,
 	.zo_raidz = 4,
 	.zo_raidz_parity = 1,
+	.zo_raid_type = VDEV_TYPE_RAIDZ,
+	.zo_draid_data = 0,		/* children less parity, spares */
+	.zo_draid_spares = 1,
 	.zo_vdev_size = SPA_MINDEVSIZE * 4,	/* 256m default size */
 	.zo_datasets = 7,
 	.zo_threads = 23,
@@ -241,6 +252,7 @@ enum ztest_io_type {
 	ZTEST_IO_TRUNCATE,
 	ZTEST_IO_SETATTR,
 	ZTEST_IO_REWRITE,
+	ZTEST_IO_CLONE,
 	ZTEST_IO_TYPES
 };
 
@@ -267,9 +279,9 @@ typedef struct bufwad {
  * still need to map from object ID to rangelock_t.
  */
 typedef enum {
-	RL_READER,
-	RL_WRITER,
-	RL_APPEND
+	ZTRL_READER,
+	ZTRL_WRITER,
+	ZTRL_APPEND
 } rl_type_t;
 
 typedef struct rll {
@@ -364,6 +376,7 @@ ztest_func_t ztest_mmp_enable_disable;
 ztest_func_t ztest_scrub;
 ztest_func_t ztest_dsl_dataset_promote_busy;
 ztest_func_t ztest_vdev_attach_detach;
+ztest_func_t ztest_vdev_raidz_attach;
 ztest_func_t ztest_vdev_LUN_growth;
 ztest_func_t ztest_vdev_add_remove;
 ztest_func_t ztest_vdev_class_add;
@@ -420,6 +433,7 @@ ztest_info_t ztest_info[] = {
 	ZTI_INIT(ztest_spa_upgrade, 1, &zopt_rarely),
 	ZTI_INIT(ztest_dsl_dataset_promote_busy, 1, &zopt_rarely),
 	ZTI_INIT(ztest_vdev_attach_detach, 1, &zopt_sometimes),
+	ZTI_INIT(ztest_vdev_raidz_attach, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_vdev_LUN_growth, 1, &zopt_rarely),
 	ZTI_INIT(ztest_vdev_add_remove, 1, &ztest_opts.zo_vdevtime),
 	ZTI_INIT(ztest_vdev_class_add, 1, &ztest_opts.zo_vdevtime),
@@ -470,6 +484,7 @@ typedef struct ztest_shared {
 
 static char ztest_dev_template[] = "%s/%s.%llua";
 static char ztest_aux_template[] = "%s/%s.%s.%llu";
+static char ztest_expand_template[] = "%s/%s.%llux%llu";
 ztest_shared_t *ztest_shared;
 
 static spa_t *ztest_spa = NULL;
@@ -691,6 +706,9 @@ usage(boolean_t requested)
 	    "\t[-m mirror_copies (default: %d)]\n"
 	    "\t[-r raidz_disks (default: %d)]\n"
 	    "\t[-R raidz_parity (default: %d)]\n"
+	    "\t[-K raid_kind (default: %s)] raidz|draid\n"
+	    "\t[-D draid_data (default: %d)] use 0 for all but parity+spares\n"
+	    "\t[-S draid_spares (default: %d)]\n"
 	    "\t[-d datasets (default: %d)]\n"
 	    "\t[-t threads (default: %d)]\n"
 	    "\t[-g gang_block_threshold (default: %s)]\n"
@@ -699,6 +717,7 @@ usage(boolean_t requested)
 	    "\t[-p pool_name (default: %s)]\n"
 	    "\t[-f dir (default: %s)] file directory for vdev files\n"
 	    "\t[-M] Multi-host simulate pool imported on remote host\n"
+	    "\t[-X] attach disks to a raidz vdev while running\n"
 	    "\t[-V] verbose (use multiple times for ever more blather)\n"
 	    "\t[-E] use existing pool instead of creating new one\n"
 	    "\t[-T time (default: %llu sec)] total run time\n"
@@ -718,6 +737,9 @@ usage(boolean_t requested)
 	    zo->zo_mirrors,				/* -m */
 	    zo->zo_raidz,				/* -r */
 	    zo->zo_raidz_parity,			/* -R */
+	    zo->zo_raid_type,				/* -K */
+	    zo->zo_draid_data,				/* -D */
+	    zo->zo_draid_spares,			/* -S */
 	    zo->zo_datasets,				/* -d */
 	    zo->zo_threads,				/* -t */
 	    nice_force_ganging,				/* -g */
@@ -784,7 +806,7 @@ process_options(int argc, char **argv)
 	bcopy(&ztest_opts_defaults, zo, sizeof (*zo));
 
 	while ((opt = getopt(argc, argv,
-	    "v:s:a:m:r:R:d:t:g:i:k:p:f:MVET:P:hF:B:C:o:G")) != EOF) {
+	    "v:s:a:m:r:R:K:D:S:d:t:g:i:k:p:f:MXVET:P:hF:B:C:o:G")) != EOF) {
 		value = 0;
 		switch (opt) {
 		case 'v':
@@ -793,6 +815,8 @@ process_options(int argc, char **argv)
 		case 'm':
 		case 'r':
 		case 'R':
+		case 'D':
+		case 'S':
 		case 'd':
 		case 't':
 		case 'g':
@@ -822,6 +846,19 @@ process_options(int argc, char **argv)
 		case 'R':
 			zo->zo_raidz_parity = MIN(MAX(value, 1), 3);
 			break;
+		case 'K':
+			if (strcmp(optarg, VDEV_TYPE_RAIDZ) != 0 &&
+			    strcmp(optarg, VDEV_TYPE_DRAID) != 0)
+				usage(B_FALSE);
+			(void) strlcpy(zo->zo_raid_type, optarg,
+			    sizeof (zo->zo_raid_type));
+			break;
+		case 'D':
+			zo->zo_draid_data = value;
+			break;
+		case 'S':
+			zo->zo_draid_spares = MIN(value, 100);
+			break;
 		case 'd':
 			zo->zo_datasets = MAX(1, value);
 			break;
@@ -857,6 +894,9 @@ process_options(int argc, char **argv)
 		case 'M':
 			zo->zo_mmp_test = 1;
 			break;
+		case 'X':
+			zo->zo_raidz_expand_test = 1;
+			break;
 		case 'V':
 			zo->zo_verbose++;
 			break;
@@ -897,6 +937,27 @@ process_options(int argc, char **argv)
 
 	zo->zo_raidz_parity = MIN(zo->zo_raidz_parity, zo->zo_raidz - 1);
 
+	/*
+	 * A dRAID vdev is always a top-level vdev and needs room for its
+	 * parity, at least one data disk and its distributed spares.
+	 */
+	if (strcmp(zo->zo_raid_type, VDEV_TYPE_DRAID) == 0) {
+		zo->zo_mirrors = 0;
+		zo->zo_raidz = MAX(zo->zo_raidz, zo->zo_raidz_parity + 1 +
+		    MAX(zo->zo_draid_data, 1) + zo->zo_draid_spares);
+		zo->zo_raidz_parity = MAX(zo->zo_raidz_parity, 1);
+	}
+
+	/*
+	 * Only a top-level RAID-Z vdev can be expanded.
+	 */
+	if (zo->zo_raidz_expand_test) {
+		(void) strlcpy(zo->zo_raid_type, VDEV_TYPE_RAIDZ,
+		    sizeof (zo->zo_raid_type));
+		zo->zo_mirrors = 0;
+		zo->zo_raidz = MAX(zo->zo_raidz, zo->zo_raidz_parity + 1);
+	}
+
 	zo->zo_vdevtime =
 	    (zo->zo_vdevs > 0 ? zo->zo_time * NANOSEC / zo->zo_vdevs :
 	    UINT64_MAX >> 2);
@@ -1049,6 +1110,8 @@ make_vdev_raidz(char *path, char *aux, char *pool, size_t size,
     uint64_t ashift, int r)
 {
 	nvlist_t *raidz, **child;
+	boolean_t draid = strcmp(ztest_opts.zo_raid_type,
+	    VDEV_TYPE_DRAID) == 0;
 	int c;
 
 	if (r < 2)
@@ -1060,9 +1123,20 @@ make_vdev_raidz(char *path, char *aux, char *pool, size_t size,
 
 	VERIFY(nvlist_alloc(&raidz, NV_UNIQUE_NAME, 0) == 0);
 	VERIFY(nvlist_add_string(raidz, ZPOOL_CONFIG_TYPE,
-	    VDEV_TYPE_RAIDZ) == 0);
+	    draid ? VDEV_TYPE_DRAID : VDEV_TYPE_RAIDZ) == 0);
 	VERIFY(nvlist_add_uint64(raidz, ZPOOL_CONFIG_NPARITY,
 	    ztest_opts.zo_raidz_parity) == 0);
+	if (draid) {
+		uint64_t ndata = ztest_opts.zo_draid_data;
+
+		if (ndata == 0) {
+			ndata = r - ztest_opts.zo_raidz_parity -
+			    ztest_opts.zo_draid_spares;
+		}
+		fnvlist_add_uint64(raidz, ZPOOL_CONFIG_DRAID_NDATA, ndata);
+		fnvlist_add_uint64(raidz, ZPOOL_CONFIG_DRAID_NSPARES,
+		    ztest_opts.zo_draid_spares);
+	}
 	VERIFY(nvlist_add_nvlist_array(raidz, ZPOOL_CONFIG_CHILDREN,
 	    child, r) == 0);
 
@@ -1383,7 +1457,7 @@ ztest_rll_lock(rll_t *rll, rl_type_t type)
 {
 	mutex_enter(&rll->rll_lock);
 
-	if (type == RL_READER) {
+	if (type == ZTRL_READER) {
 		while (rll->rll_writer != NULL)
 			(void) cv_wait(&rll->rll_cv, &rll->rll_lock);
 		rll->rll_readers++;
@@ -1839,7 +1913,7 @@ ztest_replay_remove(void *arg1, void *arg2, boolean_t byteswap)
 	    zap_lookup(os, lr->lr_doid, name, sizeof (object), 1, &object));
 	ASSERT(object != 0);
 
-	ztest_object_lock(zd, object, RL_WRITER);
+	ztest_object_lock(zd, object, ZTRL_WRITER);
 
 	VERIFY3U(0, ==, dmu_object_info(os, object, &doi));
 
@@ -1909,8 +1983,8 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 	if (bt->bt_magic != BT_MAGIC)
 		bt = NULL;
 
-	ztest_object_lock(zd, lr->lr_foid, RL_READER);
-	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, RL_WRITER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
+	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, ZTRL_WRITER);
 
 	VERIFY3U(0, ==, dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
 
@@ -1952,8 +2026,22 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 			    DMU_READ_PREFETCH : DMU_READ_NO_PREFETCH;
 			ztest_block_tag_t rbt;
 
-			VERIFY(dmu_read(os, lr->lr_foid, offset,
-			    sizeof (rbt), &rbt, prefetch) == 0);
+			if (ztest_random(4) == 0 && !os->os_encrypted &&
+			    length == doi.doi_data_block_size) {
+				/* Occasionally read it with Direct I/O */
+				void *dbuf = umem_alloc(length, UMEM_NOFAIL);
+				dnode_t *dn;
+
+				VERIFY0(dnode_hold(os, lr->lr_foid, FTAG, &dn));
+				VERIFY0(dmu_read_direct_by_dnode(dn, offset,
+				    length, dbuf));
+				dnode_rele(dn, FTAG);
+				bcopy(dbuf, &rbt, sizeof (rbt));
+				umem_free(dbuf, length);
+			} else {
+				VERIFY(dmu_read(os, lr->lr_foid, offset,
+				    sizeof (rbt), &rbt, prefetch) == 0);
+			}
 			if (rbt.bt_magic == BT_MAGIC) {
 				ztest_bt_verify(&rbt, os, lr->lr_foid, 0,
 				    offset, gen, txg, crtxg);
@@ -1982,6 +2070,17 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 
 	if (abuf == NULL) {
 		dmu_write(os, lr->lr_foid, offset, length, data, tx);
+	} else if (ztest_random(2) == 0 &&
+	    os->os_dedup_checksum == ZIO_CHECKSUM_OFF) {
+		/*
+		 * Issue the write immediately with Direct I/O; it must
+		 * complete before the range lock is dropped.
+		 */
+		zio_t *dio = zio_root(dmu_objset_spa(os), NULL, NULL,
+		    ZIO_FLAG_CANFAIL);
+		bcopy(data, abuf->b_data, length);
+		VERIFY0(dmu_write_direct_by_dbuf(dio, db, offset, abuf, tx));
+		(void) zio_wait(dio);
 	} else {
 		bcopy(data, abuf->b_data, length);
 		dmu_assign_arcbuf_by_dbuf(db, offset, abuf, tx);
@@ -2012,9 +2111,9 @@ ztest_replay_truncate(void *arg1, void *arg2, boolean_t byteswap)
 	if (byteswap)
 		byteswap_uint64_array(lr, sizeof (*lr));
 
-	ztest_object_lock(zd, lr->lr_foid, RL_READER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
 	rl = ztest_range_lock(zd, lr->lr_foid, lr->lr_offset, lr->lr_length,
-	    RL_WRITER);
+	    ZTRL_WRITER);
 
 	tx = dmu_tx_create(os);
 
@@ -2054,7 +2153,7 @@ ztest_replay_setattr(void *arg1, void *arg2, boolean_t byteswap)
 	if (byteswap)
 		byteswap_uint64_array(lr, sizeof (*lr));
 
-	ztest_object_lock(zd, lr->lr_foid, RL_WRITER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_WRITER);
 
 	VERIFY3U(0, ==, dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
 
@@ -2136,6 +2235,7 @@ zil_replay_func_t *ztest_replay_vector[TX_MAX_TYPE] = {
 	NULL,			/* TX_MKDIR_ATTR */
 	NULL,			/* TX_MKDIR_ACL_ATTR */
 	NULL,			/* TX_WRITE2 */
+	NULL,			/* TX_CLONE_RANGE */
 };
 
 /*
@@ -2178,7 +2278,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
 	ASSERT3P(zio, !=, NULL);
 	ASSERT3U(size, !=, 0);
 
-	ztest_object_lock(zd, object, RL_READER);
+	ztest_object_lock(zd, object, ZTRL_READER);
 	error = dmu_bonus_hold(os, object, FTAG, &db);
 	if (error) {
 		ztest_object_unlock(zd, object);
@@ -2203,7 +2303,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
 
 	if (buf != NULL) {	/* immediate write */
 		zgd->zgd_lr = (struct zfs_locked_range *)ztest_range_lock(zd,
-		    object, offset, size, RL_READER);
+		    object, offset, size, ZTRL_READER);
 
 		error = dmu_read(os, object, offset, size, buf,
 		    DMU_READ_NO_PREFETCH);
@@ -2218,7 +2318,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
 		}
 
 		zgd->zgd_lr = (struct zfs_locked_range *)ztest_range_lock(zd,
-		    object, offset, size, RL_READER);
+		    object, offset, size, ZTRL_READER);
 
 		error = dmu_buf_hold(os, object, offset, zgd, &db,
 		    DMU_READ_NO_PREFETCH);
@@ -2295,7 +2395,7 @@ ztest_lookup(ztest_ds_t *zd, ztest_od_t *od, int count)
 			ASSERT(od->od_object != 0);
 			ASSERT(missing == 0);	/* there should be no gaps */
 
-			ztest_object_lock(zd, od->od_object, RL_READER);
+			ztest_object_lock(zd, od->od_object, ZTRL_READER);
 			VERIFY3U(0, ==, dmu_bonus_hold(zd->zd_os,
 			    od->od_object, FTAG, &db));
 			dmu_object_info_from_db(db, &doi);
@@ -2468,8 +2568,8 @@ ztest_prealloc(ztest_ds_t *zd, uint64_t object, uint64_t offset, uint64_t size)
 
 	txg_wait_synced(dmu_objset_pool(os), 0);
 
-	ztest_object_lock(zd, object, RL_READER);
-	rl = ztest_range_lock(zd, object, offset, size, RL_WRITER);
+	ztest_object_lock(zd, object, ZTRL_READER);
+	rl = ztest_range_lock(zd, object, offset, size, ZTRL_WRITER);
 
 	tx = dmu_tx_create(os);
 
@@ -2489,6 +2589,47 @@ ztest_prealloc(ztest_ds_t *zd, uint64_t object, uint64_t offset, uint64_t size)
 	ztest_object_unlock(zd, object);
 }
 
+/*
+ * Replace a block with a clone of itself.  The contents don't change, so
+ * this can be mixed freely with the other i/o types, but every clone
+ * takes a BRT reference on the block, which is dropped again when the
+ * old block pointer is freed.
+ */
+static int
+ztest_clone(ztest_ds_t *zd, uint64_t object, uint64_t offset, uint64_t size)
+{
+	objset_t *os = zd->zd_os;
+	dmu_tx_t *tx;
+	blkptr_t bp;
+	size_t nbps;
+	rl_t *rl;
+	int error;
+
+	if (!spa_feature_is_enabled(dmu_objset_spa(os),
+	    SPA_FEATURE_BLOCK_CLONING))
+		return (SET_ERROR(EOPNOTSUPP));
+
+	ztest_object_lock(zd, object, ZTRL_READER);
+	rl = ztest_range_lock(zd, object, offset, size, ZTRL_WRITER);
+
+	error = dmu_read_l0_bps(os, object, offset, size, &bp, &nbps);
+	if (error == 0) {
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_write(tx, object, offset, size);
+		if (ztest_tx_assign(tx, TXG_WAIT, FTAG) != 0) {
+			dmu_brt_clone(os, object, offset, size, tx, &bp, nbps);
+			dmu_tx_commit(tx);
+		} else {
+			error = SET_ERROR(ENOSPC);
+		}
+	}
+
+	ztest_range_unlock(rl);
+	ztest_object_unlock(zd, object);
+
+	return (error);
+}
+
 static void
 ztest_io(ztest_ds_t *zd, uint64_t object, uint64_t offset)
 {
@@ -2567,6 +2708,11 @@ ztest_io(ztest_ds_t *zd, uint64_t object, uint64_t offset)
 
 		(void) ztest_write(zd, object, offset, blocksize, data);
 		break;
+
+	case ZTEST_IO_CLONE:
+		(void) ztest_clone(zd, object, P2ALIGN(offset, blocksize),
+		    blocksize);
+		break;
 	}
 
 	(void) pthread_rwlock_unlock(&zd->zd_zilog_lock);
@@ -2809,6 +2955,10 @@ ztest_spa_upgrade(ztest_ds_t *zd, uint64_t id)
 	if (ztest_opts.zo_mmp_test)
 		return;
 
+	/* dRAID requires a pool with feature flags */
+	if (strcmp(ztest_opts.zo_raid_type, VDEV_TYPE_DRAID) == 0)
+		return;
+
 	mutex_enter(&ztest_vdev_lock);
 	name = kmem_asprintf("%s_upgrade", ztest_opts.zo_pool);
 
@@ -2883,6 +3033,7 @@ ztest_spa_checkpoint(spa_t *spa)
 	case ZFS_ERR_DEVRM_IN_PROGRESS:
 	case ZFS_ERR_DISCARDING_CHECKPOINT:
 	case ZFS_ERR_CHECKPOINT_EXISTS:
+	case ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS:
 		break;
 	case ENOSPC:
 		ztest_record_enospc(FTAG);
@@ -3134,6 +3285,7 @@ ztest_vdev_aux_add_remove(ztest_ds_t *zd, uint64_t id)
 	char *aux;
 	char *path;
 	uint64_t guid = 0;
+	boolean_t dspare = B_FALSE;
 	int error;
 
 	if (ztest_opts.zo_mmp_test)
@@ -3157,7 +3309,11 @@ ztest_vdev_aux_add_remove(ztest_ds_t *zd, uint64_t id)
 		/*
 		 * Pick a random device to remove.
 		 */
-		guid = sav->sav_vdevs[ztest_random(sav->sav_count)]->vdev_guid;
+		vdev_t *svd = sav->sav_vdevs[ztest_random(sav->sav_count)];
+
+		/* dRAID spares cannot be removed; try anyway */
+		dspare = (svd->vdev_ops == &vdev_draid_spare_ops);
+		guid = svd->vdev_guid;
 	} else {
 		/*
 		 * Find an unused device we can add.
@@ -3207,6 +3363,9 @@ ztest_vdev_aux_add_remove(ztest_ds_t *zd, uint64_t id)
 
 		error = spa_vdev_remove(spa, guid, B_FALSE);
 
+		if (error == ENOTSUP && dspare)
+			error = 0;
+
 		switch (error) {
 		case 0:
 		case EBUSY:
@@ -3321,6 +3480,72 @@ ztest_split_pool(ztest_ds_t *zd, uint64_t id)
 	mutex_exit(&ztest_vdev_lock);
 }
 
+/*
+ * Attach a new disk to the first RAID-Z vdev, so that the rest of the
+ * workload runs while it is being expanded.  The other vdev tests assume
+ * that every RAID-Z vdev has the same number of children, so this is only
+ * done with -X, which disables them.
+ */
+/* ARGSUSED */
+void
+ztest_vdev_raidz_attach(ztest_ds_t *zd, uint64_t id)
+{
+	spa_t *spa = ztest_spa;
+	vdev_t *tvd;
+	nvlist_t *root;
+	char *newpath;
+	uint64_t guid, children, ashift;
+	size_t size = ztest_opts.zo_vdev_size;
+	int error;
+
+	if (!ztest_opts.zo_raidz_expand_test)
+		return;
+
+	newpath = umem_alloc(MAXPATHLEN, UMEM_NOFAIL);
+
+	mutex_enter(&ztest_vdev_lock);
+	spa_config_enter(spa, SCL_VDEV, FTAG, RW_READER);
+
+	tvd = spa->spa_root_vdev->vdev_child[0];
+	if (ztest_device_removal_active || spa->spa_raidz_expand != NULL ||
+	    tvd->vdev_ops != &vdev_raidz_ops ||
+	    tvd->vdev_children >= 2 * ztest_opts.zo_raidz) {
+		spa_config_exit(spa, SCL_VDEV, FTAG);
+		goto out;
+	}
+
+	guid = tvd->vdev_guid;
+	children = tvd->vdev_children;
+	ashift = tvd->vdev_ashift;
+	for (uint64_t c = 0; c < children; c++)
+		size = MAX(size, tvd->vdev_child[c]->vdev_psize);
+
+	spa_config_exit(spa, SCL_VDEV, FTAG);
+
+	(void) snprintf(newpath, MAXPATHLEN, ztest_expand_template,
+	    ztest_opts.zo_dir, ztest_opts.zo_pool, 0ULL,
+	    (u_longlong_t)children);
+
+	root = make_vdev_root(newpath, NULL, NULL, size, ashift, NULL,
+	    0, 0, 1);
+	error = spa_vdev_attach(spa, guid, root, B_FALSE, B_FALSE);
+	nvlist_free(root);
+
+	if (ztest_opts.zo_verbose >= 1) {
+		(void) printf("raidz attach %s to width %llu, error %d\n",
+		    newpath, (u_longlong_t)children + 1, error);
+	}
+
+	if (error != 0 && error != EBUSY &&
+	    error != ZFS_ERR_CHECKPOINT_EXISTS &&
+	    error != ZFS_ERR_DISCARDING_CHECKPOINT &&
+	    error != ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS)
+		fatal(0, "raidz attach (%s) returned %d", newpath, error);
+out:
+	mutex_exit(&ztest_vdev_lock);
+	umem_free(newpath, MAXPATHLEN);
+}
+
 /*
  * Verify that we can attach and detach devices.
  */
@@ -3346,7 +3571,7 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 	int oldvd_is_log;
 	int error, expected_error;
 
-	if (ztest_opts.zo_mmp_test)
+	if (ztest_opts.zo_mmp_test || ztest_opts.zo_raidz_expand_test)
 		return;
 
 	oldpath = umem_alloc(MAXPATHLEN, UMEM_NOFAIL);
@@ -3396,9 +3621,10 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 		oldvd = oldvd->vdev_child[leaf / ztest_opts.zo_raidz];
 	}
 
-	/* pick a child out of the raidz group */
+	/* pick a child out of the raidz or draid group */
 	if (ztest_opts.zo_raidz > 1) {
-		ASSERT(oldvd->vdev_ops == &vdev_raidz_ops);
+		ASSERT(oldvd->vdev_ops == &vdev_raidz_ops ||
+		    oldvd->vdev_ops == &vdev_draid_ops);
 		ASSERT(oldvd->vdev_children == ztest_opts.zo_raidz);
 		oldvd = oldvd->vdev_child[leaf % ztest_opts.zo_raidz];
 	}
@@ -3463,6 +3689,14 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 		 */
 		vdev_reopen(newvd);
 		newsize = vdev_get_min_asize(newvd);
+
+		/*
+		 * A distributed spare is as large as the children of its
+		 * dRAID vdev, which may have grown since the spare was
+		 * opened.  It always fits in place of one of them.
+		 */
+		if (newvd->vdev_ops == &vdev_draid_spare_ops)
+			newsize = MAX(newsize, oldsize);
 	} else {
 		/*
 		 * Make newsize a little bigger or smaller than oldsize.
@@ -3488,6 +3722,10 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 		expected_error = ENOTSUP;
 	else if (newvd_is_spare && (!replacing || oldvd_is_log))
 		expected_error = ENOTSUP;
+	else if (newvd_is_spare &&
+	    newvd->vdev_ops == &vdev_draid_spare_ops &&
+	    vdev_draid_spare_get_parent(newvd) != oldvd->vdev_top)
+		expected_error = ENOTSUP;
 	else if (newvd == oldvd)
 		expected_error = replacing ? 0 : EBUSY;
 	else if (vdev_lookup_by_path(rvd, newpath) != NULL)
@@ -3502,17 +3740,33 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 	spa_config_exit(spa, SCL_ALL, FTAG);
 
 	/*
-	 * Build the nvlist describing newpath.
+	 * Build the nvlist describing newpath.  Distributed spares are not
+	 * backed by a file of their own.
 	 */
-	root = make_vdev_root(newpath, NULL, NULL, newvd == NULL ? newsize : 0,
-	    ashift, NULL, 0, 0, 1);
+	if (newvd_is_spare && strncmp(newpath, VDEV_TYPE_DRAID,
+	    strlen(VDEV_TYPE_DRAID)) == 0) {
+		nvlist_t *dspare = fnvlist_alloc();
+
+		fnvlist_add_string(dspare, ZPOOL_CONFIG_TYPE,
+		    VDEV_TYPE_DRAID_SPARE);
+		fnvlist_add_string(dspare, ZPOOL_CONFIG_PATH, newpath);
+		root = fnvlist_alloc();
+		fnvlist_add_string(root, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT);
+		fnvlist_add_nvlist_array(root, ZPOOL_CONFIG_CHILDREN,
+		    &dspare, 1);
+		fnvlist_free(dspare);
+	} else {
+		root = make_vdev_root(newpath, NULL, NULL,
+		    newvd == NULL ? newsize : 0, ashift, NULL, 0, 0, 1);
+	}
 
 	/*
 	 * When supported select either a healing or sequential resilver.
 	 */
 	boolean_t rebuilding = B_FALSE;
 	if (pvd->vdev_ops == &vdev_mirror_ops ||
-	    pvd->vdev_ops ==  &vdev_root_ops) {
+	    pvd->vdev_ops == &vdev_root_ops ||
+	    pvd->vdev_ops == &vdev_draid_ops) {
 		rebuilding = !!ztest_random(2);
 	}
 
@@ -3780,9 +4034,11 @@ ztest_vdev_LUN_growth(ztest_ds_t *zd, uint64_t id)
 
 	/*
 	 * We only try to expand the vdev if it's healthy, less than 4x its
-	 * original size, and it has a valid psize.
+	 * original size, it has a valid psize, and it is not in the middle
+	 * of a raidz expansion (which defers growth until it completes).
 	 */
 	if (tvd->vdev_state != VDEV_STATE_HEALTHY ||
+	    tvd->vdev_rz_expanding ||
 	    psize == 0 || psize >= 4 * ztest_opts.zo_vdev_size) {
 		spa_config_exit(spa, SCL_STATE, spa);
 		mutex_exit(&ztest_vdev_lock);
@@ -5512,7 +5768,7 @@ ztest_verify_dnode_bt(ztest_ds_t *zd, uint64_t id)
 		dmu_object_info_t doi;
 		dmu_buf_t *db;
 
-		ztest_object_lock(zd, obj, RL_READER);
+		ztest_object_lock(zd, obj, ZTRL_READER);
 		if (dmu_bonus_hold(os, obj, FTAG, &db) != 0) {
 			ztest_object_unlock(zd, obj);
 			continue;
@@ -5753,9 +6009,10 @@ ztest_fault_inject(ztest_ds_t *zd, uint64_t id)
 	 * Device removal is in progress, fault injection must be disabled
 	 * until it completes and the pool is scrubbed.  The fault injection
 	 * strategy for damaging blocks does not take in to account evacuated
-	 * blocks which may have already been damaged.
+	 * blocks which may have already been damaged.  The same is true of
+	 * blocks which are reflowed by a RAID-Z expansion.
 	 */
-	if (ztest_device_removal_active) {
+	if (ztest_device_removal_active || ztest_opts.zo_raidz_expand_test) {
 		mutex_exit(&ztest_vdev_lock);
 		goto out;
 	}
@@ -6281,6 +6538,13 @@ ztest_random_concrete_vdev_leaf(vdev_t *vd)
 	if (vd == NULL)
 		return (NULL);
 
+	/*
+	 * Distributed spares are initialized and trimmed through the
+	 * children of their dRAID vdev.
+	 */
+	if (vd->vdev_ops == &vdev_draid_spare_ops)
+		return (NULL);
+
 	if (vd->vdev_children == 0)
 		return (vd);
 
@@ -7095,6 +7359,15 @@ ztest_run(ztest_shared_t *zs)
 	 * what tests were running when the previous pass was terminated.
 	 */
 	kernel_init(SPA_MODE_READ | SPA_MODE_WRITE);
+
+	/*
+	 * Cycle through all available BLAKE3 and SHA-2 implementations to
+	 * verify that they produce the same checksums.
+	 */
+	VERIFY0(blake3_impl_set("cycle"));
+	VERIFY0(sha256_impl_set("cycle"));
+	VERIFY0(sha512_impl_set("cycle"));
+
 	error = spa_open(ztest_opts.zo_pool, &spa, FTAG);
 	if (error) {
 		VERIFY3S(error, ==, ENOENT);
@@ -7108,6 +7381,7 @@ ztest_run(ztest_shared_t *zs)
 	ztest_spa = spa;
 
 	VERIFY0(vdev_raidz_impl_set("cycle"));
+	VERIFY0(zfs_pattern_impl_set("cycle"));
 
 	dmu_objset_stats_t dds;
 	VERIFY0(ztest_dmu_objset_own(ztest_opts.zo_pool,
@@ -0,0 +1,62 @@
+dnl #
+dnl # 4.5 API change
+dnl # Added file_operations->clone_file_range for FICLONE/FICLONERANGE.
+dnl #
+dnl # 4.20 API change
+dnl # Replaced ->clone_file_range and ->dedupe_file_range with a single
+dnl # ->remap_file_range, which copy_file_range() also uses.
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_SRC_VFS_CLONE_FILE_RANGE], [
+	ZFS_LINUX_TEST_SRC([vfs_clone_file_range], [
+		#include <linux/fs.h>
+
+		int clone_file_range(struct file *src_file, loff_t src_off,
+		    struct file *dst_file, loff_t dst_off, u64 len)
+		    { return (0); }
+
+		static const struct file_operations
+		    fops __attribute__ ((unused)) = {
+			.clone_file_range = clone_file_range,
+		};
+	],[])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_VFS_CLONE_FILE_RANGE], [
+	AC_MSG_CHECKING([whether fops->clone_file_range() is available])
+	ZFS_LINUX_TEST_RESULT([vfs_clone_file_range], [
+		AC_MSG_RESULT([yes])
+		AC_DEFINE(HAVE_VFS_CLONE_FILE_RANGE, 1,
+		    [fops->clone_file_range() is available])
+	],[
+		AC_MSG_RESULT([no])
+	])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_SRC_VFS_REMAP_FILE_RANGE], [
+	ZFS_LINUX_TEST_SRC([vfs_remap_file_range], [
+		#include <linux/fs.h>
+
+		loff_t remap_file_range(struct file *src_file, loff_t src_off,
+		    struct file *dst_file, loff_t dst_off, loff_t len,
+		    unsigned int flags) { return (0); }
+
+		static const struct file_operations
+		    fops __attribute__ ((unused)) = {
+			.remap_file_range = remap_file_range,
+		};
+	],[
+		unsigned int flags __attribute__ ((unused)) =
+		    REMAP_FILE_DEDUP | REMAP_FILE_CAN_SHORTEN;
+	])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_VFS_REMAP_FILE_RANGE], [
+	AC_MSG_CHECKING([whether fops->remap_file_range() is available])
+	ZFS_LINUX_TEST_RESULT([vfs_remap_file_range], [
+		AC_MSG_RESULT([yes])
+		AC_DEFINE(HAVE_VFS_REMAP_FILE_RANGE, 1,
+		    [fops->remap_file_range() is available])
+	],[
+		AC_MSG_RESULT([no])
+	])
+])
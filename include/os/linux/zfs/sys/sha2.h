@@ -96,6 +96,18 @@ extern void SHA2Update(SHA2_CTX *, const void *, size_t);
 
 extern void SHA2Final(void *, SHA2_CTX *);
 
+extern void sha2_impl_init(void);
+
+extern void sha2_impl_fini(void);
+
+/*
+ * Select the SHA-256 or SHA-512 implementation by name: "fastest", "cycle"
+ * or one of the supported implementations.
+ */
+extern int sha256_impl_set(const char *);
+
+extern int sha512_impl_set(const char *);
+
 extern void SHA256Init(SHA256_CTX *);
 
 extern void SHA256Update(SHA256_CTX *, const void *, size_t);
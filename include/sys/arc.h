@@ -97,6 +97,11 @@ typedef enum arc_strategy {
 	ARC_STRATEGY_META_BALANCED	= 1, /* Evict data buffers if needed */
 } arc_strategy_t;
 
+typedef enum arc_policy {
+	ARC_POLICY_ARC			= 0, /* Adaptive replacement only */
+	ARC_POLICY_TINYLFU		= 1, /* Frequency-based MFU admission */
+} arc_policy_t;
+
 typedef enum arc_flags
 {
 	/*
@@ -873,6 +873,11 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_raw_size;
 	kstat_named_t arcstat_cached_only_in_progress;
 	kstat_named_t arcstat_abd_chunk_waste_size;
+	/*
+	 * Number of times the TinyLFU policy kept a block out of the MFU
+	 * because it was used less often than the block it would evict.
+	 */
+	kstat_named_t arcstat_admit_rejected;
 } arc_stats_t;
 
 typedef struct arc_evict_waiter {
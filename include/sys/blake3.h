@@ -0,0 +1,95 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Based on the BLAKE3 reference implementation, which is dedicated to
+ * the public domain (CC0 1.0) by Jack O'Connor and Samuel Neves.
+ */
+
+#ifndef	_SYS_BLAKE3_H
+#define	_SYS_BLAKE3_H
+
+#ifdef  _KERNEL
+#include <sys/types.h>
+#else
+#include <stdint.h>
+#include <stdlib.h>
+#endif
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	BLAKE3_KEY_LEN		32
+#define	BLAKE3_OUT_LEN		32
+#define	BLAKE3_BLOCK_LEN	64
+#define	BLAKE3_CHUNK_LEN	1024
+#define	BLAKE3_MAX_DEPTH	54
+
+typedef struct {
+	uint32_t cv[8];
+	uint64_t chunk_counter;
+	uint8_t buf[BLAKE3_BLOCK_LEN];
+	uint8_t buf_len;
+	uint8_t blocks_compressed;
+	uint8_t flags;
+} blake3_chunk_state_t;
+
+typedef struct {
+	uint32_t key[8];
+	blake3_chunk_state_t chunk;
+	uint8_t cv_stack_len;
+	/*
+	 * The stack holds one chaining value per level of the tree, plus
+	 * one extra for the lazily merged chunk.  See Blake3_Update().
+	 */
+	uint8_t cv_stack[(BLAKE3_MAX_DEPTH + 1) * BLAKE3_OUT_LEN];
+} BLAKE3_CTX;
+
+/* init the context for a plain hash */
+extern void Blake3_Init(BLAKE3_CTX *ctx);
+
+/* init the context for a keyed hash (MAC) */
+extern void Blake3_InitKeyed(BLAKE3_CTX *ctx,
+    const uint8_t key[BLAKE3_KEY_LEN]);
+
+/* process the input bytes */
+extern void Blake3_Update(BLAKE3_CTX *ctx, const void *input, size_t len);
+
+/* finalize and output BLAKE3_OUT_LEN bytes */
+extern void Blake3_Final(const BLAKE3_CTX *ctx, uint8_t *out);
+
+/* finalize and output an arbitrary number of bytes (XOF) */
+extern void Blake3_FinalSeq(const BLAKE3_CTX *ctx, uint8_t *out,
+    size_t out_len);
+
+/* select and benchmark the implementations */
+extern void blake3_impl_init(void);
+extern void blake3_impl_fini(void);
+
+/* set the implementation by name: "fastest", "cycle" or an impl name */
+extern int blake3_impl_set(const char *name);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_BLAKE3_H */
@@ -0,0 +1,103 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_BRT_H
+#define	_SYS_BRT_H
+
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/fs/zfs.h>
+#include <sys/zio.h>
+#include <sys/dmu.h>
+#include <sys/avl.h>
+#include <sys/list.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Block reference table (BRT).
+ *
+ * The BRT records the additional references held on a block by clones of
+ * it.  Entries are keyed by the first DVA of the block; the ZAP key is
+ * { vdev, offset } and the value is { refcount, dsize }, where refcount
+ * counts only the extra references (a block that is referenced once is
+ * not in the table at all).
+ */
+#define	BRT_KEY_WORDS	2
+#define	BRT_VALUE_WORDS	2
+
+typedef struct brt_entry {
+	uint64_t	bre_vdev;	/* DVA[0] vdev */
+	uint64_t	bre_offset;	/* DVA[0] offset */
+	uint64_t	bre_refcount;	/* number of extra references */
+	uint64_t	bre_dsize;	/* deflated size of the block */
+	boolean_t	bre_dirty;	/* on brt_dirty list */
+	avl_node_t	bre_node;
+	list_node_t	bre_dirty_node;
+} brt_entry_t;
+
+/*
+ * Clones made in open context are collected per txg and only applied to
+ * the table at the start of spa_sync() for that txg; see
+ * brt_pending_apply().
+ */
+typedef struct brt_pending_entry {
+	blkptr_t	bpe_bp;
+	uint64_t	bpe_count;
+	avl_node_t	bpe_node;
+} brt_pending_entry_t;
+
+struct brt {
+	spa_t		*brt_spa;
+	krwlock_t	brt_lock;		/* tree, dirty list, saved */
+	avl_tree_t	brt_tree;		/* all entries, by DVA */
+	list_t		brt_dirty;		/* entries to write out */
+	uint64_t	brt_ndirty;		/* entries on brt_dirty */
+	uint64_t	brt_object;		/* MOS ZAP, 0 if none */
+	uint64_t	brt_saved;		/* dsize saved by clones */
+	kmutex_t	brt_pending_lock[TXG_SIZE];
+	avl_tree_t	brt_pending_tree[TXG_SIZE];
+};
+
+extern void brt_init(void);
+extern void brt_fini(void);
+
+extern void brt_create(spa_t *spa);
+extern int brt_load(spa_t *spa);
+extern void brt_unload(spa_t *spa);
+extern void brt_sync(spa_t *spa, uint64_t txg);
+
+extern void brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx);
+extern void brt_pending_remove(spa_t *spa, const blkptr_t *bp,
+    uint64_t txg);
+extern void brt_pending_apply(spa_t *spa, uint64_t txg);
+
+extern boolean_t brt_entry_decref(spa_t *spa, const blkptr_t *bp);
+extern uint64_t brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp);
+extern uint64_t brt_get_dspace(spa_t *spa);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_BRT_H */
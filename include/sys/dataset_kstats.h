@@ -38,6 +38,10 @@ typedef struct dataset_aggsum_stats_t {
 	aggsum_t das_nread;
 	aggsum_t das_nunlinks;
 	aggsum_t das_nunlinked;
+	aggsum_t das_ncompressed;
+	aggsum_t das_nincompressible;
+	aggsum_t das_ncompress_aborted;
+	aggsum_t das_nelided;
 } dataset_aggsum_stats_t;
 
 typedef struct dataset_kstat_values {
@@ -56,6 +60,21 @@ typedef struct dataset_kstat_values {
 	 * entry is removed from the unlinked set
 	 */
 	kstat_named_t dkv_nunlinked;
+	/*
+	 * Data blocks written with compression enabled, split by whether
+	 * they were stored compressed, were run through the compressor but
+	 * did not shrink enough, or were rejected by the cheap early abort
+	 * probes (see zfs_compress_early_abort) without running it.
+	 */
+	kstat_named_t dkv_ncompressed;
+	kstat_named_t dkv_nincompressible;
+	kstat_named_t dkv_ncompress_aborted;
+	/*
+	 * Data blocks that needed no allocation because they were all
+	 * zeroes (holes) or small enough after compression to be embedded
+	 * in the block pointer, e.g. blocks of a repeated pattern.
+	 */
+	kstat_named_t dkv_nelided;
 } dataset_kstat_values_t;
 
 typedef struct dataset_kstats {
@@ -65,11 +84,15 @@ typedef struct dataset_kstats {
 
 void dataset_kstats_create(dataset_kstats_t *, objset_t *);
 void dataset_kstats_destroy(dataset_kstats_t *);
+void dataset_kstats_attach(dataset_kstats_t *, objset_t *);
 
 void dataset_kstats_update_write_kstats(dataset_kstats_t *, int64_t);
 void dataset_kstats_update_read_kstats(dataset_kstats_t *, int64_t);
 
 void dataset_kstats_update_nunlinks_kstat(dataset_kstats_t *, int64_t);
 void dataset_kstats_update_nunlinked_kstat(dataset_kstats_t *, int64_t);
+void dataset_kstats_update_compress_kstats(dataset_kstats_t *, boolean_t,
+    boolean_t);
+void dataset_kstats_update_nelided_kstat(dataset_kstats_t *);
 
 #endif /* _SYS_DATASET_KSTATS_H */
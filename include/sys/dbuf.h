@@ -162,6 +162,21 @@ typedef struct dbuf_dirty_record {
 			boolean_t dr_nopwrite;
 			boolean_t dr_has_raw_params;
 
+			/*
+			 * Set when the override was issued by a Direct I/O
+			 * write rather than by dmu_sync() on behalf of the
+			 * ZIL; see dmu_write_direct_by_dnode().
+			 */
+			boolean_t dr_diowrite;
+
+			/*
+			 * Set when the override is a block cloned from
+			 * elsewhere in the pool; see dmu_brt_clone().  Until
+			 * the buffer is read, dr_data is NULL and the dbuf
+			 * is in the NOFILL state.
+			 */
+			boolean_t dr_brtwrite;
+
 			/*
 			 * If dr_has_raw_params is set, the following crypt
 			 * params will be set on the BP that's written.
@@ -297,6 +312,12 @@ typedef struct dmu_buf_impl {
 	 */
 	uint8_t db_pending_evict;
 
+	/*
+	 * This dbuf was written by Direct I/O.  Evict it, and its ARC
+	 * buffer, once the refcount drops to 0 rather than caching it.
+	 */
+	uint8_t db_uncached;
+
 	uint8_t db_dirtycnt;
 } dmu_buf_impl_t;
 
@@ -346,6 +367,7 @@ dmu_buf_impl_t *dbuf_find(struct objset *os, uint64_t object, uint8_t level,
 int dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags);
 void dmu_buf_will_not_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
+void dmu_buf_will_clone(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx);
 void dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx);
 dbuf_dirty_record_t *dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
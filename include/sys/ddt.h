@@ -131,6 +131,80 @@ struct ddt_entry {
 	avl_node_t	dde_node;
 };
 
+/*
+ * In-core and on-disk bookmark for DDT walks
+ */
+typedef struct ddt_bookmark {
+	uint64_t	ddb_class;
+	uint64_t	ddb_type;
+	uint64_t	ddb_checksum;
+	uint64_t	ddb_cursor;
+} ddt_bookmark_t;
+
+/*
+ * DDT log.  With the ddt_log feature, changes to the DDT are appended to a
+ * log object instead of being applied to the ZAP objects right away, and
+ * are flushed from the log into the ZAPs a few at a time over many txgs.
+ * Each log record holds the complete new state of an entry (a record
+ * without any phys is a removal), so the last record for a key wins when
+ * the log is replayed.  There are two logs per DDT: changes are appended
+ * to the active one while the other one is being flushed, and they swap
+ * roles once it has been flushed completely.
+ */
+#define	DDT_LOGS		2
+#define	DDT_LOG_VERSION		1
+
+typedef struct ddt_log_record {
+	ddt_key_t	ddlr_key;
+	ddt_phys_t	ddlr_phys[DDT_PHYS_TYPES];
+} ddt_log_record_t;
+
+/* Bonus buffer of a log object */
+typedef struct ddt_log_phys {
+	uint64_t	ddlp_version;
+	uint64_t	ddlp_length;	/* bytes of records */
+	uint64_t	ddlp_first_txg;	/* txg the log became active */
+	uint64_t	ddlp_pad[5];
+} ddt_log_phys_t;
+
+/*
+ * ddle_ztype of a log entry which isn't in any ZAP object, or for which
+ * that isn't known (after replaying the log on import).
+ */
+#define	DDT_TYPE_NONE		DDT_TYPES
+#define	DDT_TYPE_UNKNOWN	(DDT_TYPES + 1)
+
+/*
+ * In-core log entry: the latest logged state of an entry, and which ZAP
+ * object currently holds it.
+ */
+typedef struct ddt_log_entry {
+	ddt_key_t	ddle_key;
+	ddt_phys_t	ddle_phys[DDT_PHYS_TYPES];
+	uint8_t		ddle_ztype;
+	uint8_t		ddle_zclass;
+	avl_node_t	ddle_node;
+} ddt_log_entry_t;
+
+typedef struct ddt_log {
+	uint64_t	ddl_object;
+	uint64_t	ddl_length;
+	uint64_t	ddl_first_txg;
+	avl_tree_t	ddl_tree;
+} ddt_log_t;
+
+/*
+ * Bloom filter of the keys in the ZAP objects, so ddt_lookup() can skip
+ * reading them for new blocks.  Keys are never removed, so a hit may be
+ * stale, but a miss is certain.  It's built by walking the ZAPs a bit at
+ * a time after import and isn't used until it's complete.
+ */
+enum ddt_filter_state {
+	DDT_FILTER_NONE = 0,
+	DDT_FILTER_BUILDING,
+	DDT_FILTER_READY
+};
+
 /*
  * In-core ddt
  */
@@ -147,17 +221,19 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
 	avl_node_t	ddt_node;
-};
 
-/*
- * In-core and on-disk bookmark for DDT walks
- */
-typedef struct ddt_bookmark {
-	uint64_t	ddb_class;
-	uint64_t	ddb_type;
-	uint64_t	ddb_checksum;
-	uint64_t	ddb_cursor;
-} ddt_bookmark_t;
+	ddt_log_t	ddt_log[DDT_LOGS];
+	ddt_log_t	*ddt_log_active;
+	ddt_log_t	*ddt_log_flushing;
+	ddt_log_record_t *ddt_log_wbuf;		/* records not written yet */
+	uint64_t	ddt_log_wbuf_count;
+
+	enum ddt_filter_state ddt_filter_state;
+	uint64_t	*ddt_filter;
+	uint64_t	ddt_filter_bits;	/* power of 2 */
+	uint64_t	ddt_filter_capacity;	/* entries it was sized for */
+	ddt_bookmark_t	ddt_filter_cursor;	/* ZAP walk while building */
+};
 
 /*
  * Ops vector to access a specific DDT object type.
@@ -239,6 +315,7 @@ extern ddt_entry_t *ddt_repair_start(ddt_t *ddt, const blkptr_t *bp);
 extern void ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde);
 
 extern int ddt_entry_compare(const void *x1, const void *x2);
+extern int ddt_key_compare(const ddt_key_t *k1, const ddt_key_t *k2);
 
 extern void ddt_create(spa_t *spa);
 extern int ddt_load(spa_t *spa);
@@ -250,6 +327,30 @@ extern int ddt_object_update(ddt_t *ddt, enum ddt_type type,
 
 extern const ddt_ops_t ddt_zap_ops;
 
+extern void ddt_flush_entry(ddt_t *ddt, ddt_entry_t *dde,
+    enum ddt_type otype, enum ddt_class oclass, dmu_tx_t *tx);
+
+extern void ddt_log_init(void);
+extern void ddt_log_fini(void);
+extern void ddt_log_alloc(ddt_t *ddt);
+extern void ddt_log_free(ddt_t *ddt);
+extern int ddt_log_load(ddt_t *ddt);
+extern boolean_t ddt_log_enabled(ddt_t *ddt);
+extern boolean_t ddt_log_empty(ddt_t *ddt);
+extern boolean_t ddt_log_idle(ddt_t *ddt);
+extern ddt_log_entry_t *ddt_log_find(ddt_t *ddt, const ddt_key_t *ddk);
+extern boolean_t ddt_log_entry_is_live(const ddt_log_entry_t *ddle);
+extern void ddt_log_create(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_append(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx);
+extern void ddt_log_sync(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_stats(spa_t *spa, uint64_t *entries, uint64_t *bytes);
+
+extern void ddt_filter_add(ddt_t *ddt, const ddt_key_t *ddk);
+extern boolean_t ddt_filter_may_contain(ddt_t *ddt, const ddt_key_t *ddk);
+extern void ddt_filter_sync(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_filter_free(ddt_t *ddt);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -49,6 +49,7 @@ extern krwlock_t os_lock;
 struct dsl_pool;
 struct dsl_dataset;
 struct dmu_tx;
+struct dataset_kstats;
 
 #define	OBJSET_PHYS_SIZE_V1	1024
 #define	OBJSET_PHYS_SIZE_V2	2048
@@ -126,6 +127,7 @@ struct objset {
 	zfs_cache_type_t os_primary_cache;
 	zfs_cache_type_t os_secondary_cache;
 	zfs_sync_type_t os_sync;
+	zfs_direct_type_t os_direct;
 	zfs_redundant_metadata_type_t os_redundant_metadata;
 	uint64_t os_recordsize;
 	/*
@@ -184,6 +186,12 @@ struct objset {
 	void *os_user_ptr;
 	sa_os_t *os_sa;
 
+	/*
+	 * Kstats of the current owner, updated as its blocks are written.
+	 * Set by dataset_kstats_attach() and cleared on disown.
+	 */
+	struct dataset_kstats *os_dataset_kstats;
+
 	/* kernel thread to upgrade this dataset */
 	kmutex_t os_upgrade_lock;
 	taskqid_t os_upgrade_id;
@@ -0,0 +1,97 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_VDEV_DRAID_H
+#define	_SYS_VDEV_DRAID_H
+
+#include <sys/types.h>
+#include <sys/nvpair.h>
+#include <sys/range_tree.h>
+#include <sys/vdev_impl.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Limits on the dRAID layout.  A child index must fit in the uint8_t
+ * permutation table, so there can be at most 255 children.
+ */
+#define	VDEV_DRAID_MAXPARITY	3
+#define	VDEV_DRAID_MIN_CHILDREN	2
+#define	VDEV_DRAID_MAX_CHILDREN	UINT8_MAX
+#define	VDEV_DRAID_MAX_SPARES	100
+
+/*
+ * Every child is divided into rows of VDEV_DRAID_ROWHEIGHT bytes.  A slice
+ * is the smallest number of rows which holds a whole number of redundancy
+ * groups; all of the rows of a slice are laid out using the same
+ * permutation of the children.  There are VDEV_DRAID_NPERMS permutations
+ * which are used by consecutive slices in turn.
+ */
+#define	VDEV_DRAID_ROWHEIGHT	(1ULL << 24)
+#define	VDEV_DRAID_NPERMS	256
+#define	VDEV_DRAID_SEED		0xd7a1d5eedULL
+
+typedef struct vdev_draid_config {
+	uint64_t	vdc_ndata;	/* data columns per group */
+	uint64_t	vdc_nparity;	/* parity columns per group */
+	uint64_t	vdc_nspares;	/* distributed spares */
+	uint64_t	vdc_children;	/* all children, incl. spare space */
+	uint64_t	vdc_ngroups;	/* redundancy groups per slice */
+	uint64_t	vdc_groupwidth;	/* vdc_ndata + vdc_nparity */
+	uint64_t	vdc_ndisks;	/* vdc_children - vdc_nspares */
+	uint64_t	vdc_groupsz;	/* logical bytes in one group */
+	uint64_t	vdc_devslicesz;	/* bytes of one slice on a child */
+	uint64_t	vdc_nperms;	/* permutations in vdc_perms */
+	uint8_t		*vdc_perms;	/* vdc_nperms x vdc_children */
+} vdev_draid_config_t;
+
+/*
+ * Private data of a distributed spare.
+ */
+typedef struct vdev_draid_spare {
+	vdev_t		*vds_draid_vdev;	/* dRAID vdev providing space */
+	uint64_t	vds_top_id;		/* its top-level vdev id */
+	uint64_t	vds_spare_id;		/* spare column in each row */
+} vdev_draid_spare_t;
+
+extern int vdev_draid_config_alloc(nvlist_t *, vdev_draid_config_t **);
+extern void vdev_draid_config_free(vdev_draid_config_t *);
+extern void vdev_draid_config_generate(vdev_t *, nvlist_t *);
+
+extern uint64_t vdev_draid_asize_to_psize(vdev_t *, uint64_t);
+extern uint64_t vdev_draid_group_end(vdev_t *, uint64_t);
+extern uint64_t vdev_draid_min_asize(vdev_t *);
+extern uint64_t vdev_draid_alloc_adjust(vdev_t *, range_tree_t *, uint64_t,
+    uint64_t);
+
+extern int vdev_draid_spare_create(nvlist_t *, vdev_t *, uint64_t);
+extern int vdev_draid_spare_parse(const char *, uint64_t *, uint64_t *,
+    uint64_t *);
+extern vdev_t *vdev_draid_spare_get_parent(vdev_t *);
+extern nvlist_t *vdev_draid_read_config_spare(vdev_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* _SYS_VDEV_DRAID_H */
@@ -71,7 +71,8 @@ extern uint32_t zfs_vdev_async_write_max_active;
 typedef int	vdev_open_func_t(vdev_t *vd, uint64_t *size, uint64_t *max_size,
     uint64_t *ashift, uint64_t *pshift);
 typedef void	vdev_close_func_t(vdev_t *vd);
-typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize);
+typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 typedef void	vdev_io_start_func_t(zio_t *zio);
 typedef void	vdev_io_done_func_t(zio_t *zio);
 typedef void	vdev_state_change_func_t(vdev_t *vd, int, int);
@@ -85,10 +86,11 @@ typedef void	vdev_remap_func_t(vdev_t *vd, uint64_t offset, uint64_t size,
     vdev_remap_cb_t callback, void *arg);
 /*
  * Given a target vdev, translates the logical range "in" to the physical
- * range "res"
+ * range "res".  A vdev which can only translate a leading part of "in" in
+ * one go returns the rest of it in "remain", which is otherwise empty.
  */
 typedef void vdev_xlation_func_t(vdev_t *cvd, const range_seg64_t *in,
-    range_seg64_t *res);
+    range_seg64_t *res, range_seg64_t *remain);
 
 typedef const struct vdev_ops {
 	vdev_open_func_t		*vdev_op_open;
@@ -325,6 +327,9 @@ struct vdev {
 	kthread_t	*vdev_rebuild_thread;
 	vdev_rebuild_t	vdev_rebuild_config;
 
+	/* RAID-Z expansion, see vdev_raidz.c */
+	boolean_t	vdev_rz_expanding;
+
 	/* For limiting outstanding I/Os (initialize, TRIM, rebuild) */
 	kmutex_t	vdev_initialize_io_lock;
 	kcondvar_t	vdev_initialize_io_cv;
@@ -577,6 +582,8 @@ extern vdev_ops_t vdev_root_ops;
 extern vdev_ops_t vdev_mirror_ops;
 extern vdev_ops_t vdev_replacing_ops;
 extern vdev_ops_t vdev_raidz_ops;
+extern vdev_ops_t vdev_draid_ops;
+extern vdev_ops_t vdev_draid_spare_ops;
 extern vdev_ops_t vdev_disk_ops;
 extern vdev_ops_t vdev_file_ops;
 extern vdev_ops_t vdev_missing_ops;
@@ -588,8 +595,8 @@ extern vdev_ops_t vdev_indirect_ops;
  * Common size functions
  */
 extern void vdev_default_xlate(vdev_t *vd, const range_seg64_t *in,
-    range_seg64_t *out);
-extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize);
+    range_seg64_t *out, range_seg64_t *remain);
+extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize, uint64_t txg);
 extern uint64_t vdev_get_min_asize(vdev_t *vd);
 extern void vdev_set_min_asize(vdev_t *vd);
 
@@ -26,13 +26,21 @@
 #define	_SYS_VDEV_RAIDZ_H
 
 #include <sys/types.h>
+#include <sys/txg.h>
+#include <sys/zfs_rlock.h>
 
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
 struct zio;
+struct zio_vsd_ops;
 struct raidz_map;
+struct vdev;
+struct spa;
+struct dmu_tx;
+struct nvlist;
+struct pool_raidz_expand_stat;
 #if !defined(_KERNEL)
 struct kernel_param {};
 #endif
@@ -45,6 +53,79 @@ struct raidz_map *vdev_raidz_map_alloc(struct zio *, uint64_t, uint64_t,
 void vdev_raidz_map_free(struct raidz_map *);
 void vdev_raidz_generate_parity(struct raidz_map *);
 int vdev_raidz_reconstruct(struct raidz_map *, const int *, int);
+void vdev_raidz_io_issue(struct zio *, struct raidz_map *);
+void vdev_raidz_io_done(struct zio *);
+void vdev_raidz_state_change(struct vdev *, int, int);
+extern const struct zio_vsd_ops vdev_raidz_vsd_ops;
+
+/*
+ * On-disk state of the most recent expansion of a RAID-Z vdev, stored in
+ * its top-level vdev ZAP.  The reflow offset itself is kept in the vdev
+ * config, see vdev_raidz_config_generate().
+ */
+typedef struct vdev_raidz_expand_phys {
+	uint64_t	vrep_state;		/* dsl_scan_state_t */
+	uint64_t	vrep_start_time;	/* time_t */
+	uint64_t	vrep_end_time;		/* time_t */
+	uint64_t	vrep_reflowed;		/* bytes, once finished */
+} vdev_raidz_expand_phys_t;
+
+/*
+ * In-core state of an expansion ("reflow") of a RAID-Z vdev.  All of the
+ * offsets are byte offsets into the RAID-Z vdev.  The sectors below
+ * vre_offset have been copied to their place in the new, wider layout and
+ * the sectors above it are only in the old one.
+ */
+typedef struct vdev_raidz_expand {
+	uint64_t	vre_vdev_id;
+	kmutex_t	vre_lock;
+
+	/*
+	 * The reflow offset, vre_offset, only moves while the range being
+	 * reflowed is locked as writer in vre_rangelock.  Every I/O to an
+	 * expanding vdev holds its range as reader.
+	 */
+	zfs_rangelock_t	vre_rangelock;
+	uint64_t	vre_offset;
+
+	/*
+	 * A reflow offset which has been recorded by a txg that finished
+	 * syncing.  Should we crash, we resume at or above this offset, so
+	 * reads above it must use the old layout and writes between here
+	 * and vre_offset go to both layouts.  Only moves while the range
+	 * it passes over is locked as writer.
+	 */
+	uint64_t	vre_offset_durable;
+
+	/* The reflow offset in the config being synced, and pending ones. */
+	uint64_t	vre_offset_synced;
+	uint64_t	vre_offset_pertxg[TXG_SIZE];
+
+	vdev_raidz_expand_phys_t vre_phys;
+} vdev_raidz_expand_t;
+
+/*
+ * Private data of a RAID-Z vdev.  Each completed expansion adds a child,
+ * and the blocks born at or after its txg are as wide as the vdev was
+ * after it.  vd_expand_lock protects vd_expand_txgs and the number of
+ * children which hold data, see vdev_raidz_get_logical_width().
+ */
+typedef struct vdev_raidz {
+	krwlock_t	vd_expand_lock;
+	uint64_t	vd_nexpansions;
+	uint64_t	*vd_expand_txgs;	/* ascending, vd_nexpansions */
+	vdev_raidz_expand_t vn_vre;
+} vdev_raidz_t;
+
+int vdev_raidz_config_alloc(struct nvlist *, vdev_raidz_t **);
+void vdev_raidz_config_free(vdev_raidz_t *);
+void vdev_raidz_config_generate(struct vdev *, struct nvlist *);
+uint64_t vdev_raidz_get_logical_width(struct vdev *, uint64_t);
+int vdev_raidz_load(struct vdev *);
+void vdev_raidz_attach_sync(void *, struct dmu_tx *);
+void vdev_raidz_expand_sync(struct spa *, struct dmu_tx *);
+void spa_start_raidz_expansion_thread(struct spa *);
+int spa_raidz_expand_get_stats(struct spa *, struct pool_raidz_expand_stat *);
 
 /*
  * vdev_raidz_math interface
@@ -126,6 +126,9 @@ typedef struct raidz_map {
 	uintptr_t rm_reports;		/* # of referencing checksum reports */
 	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
 	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
+	uint8_t	rm_skipzero;		/* zero fill skipped sectors */
+	struct zfs_locked_range *rm_lr;	/* held while the vdev expands */
+	struct raidz_expanded *rm_expanded; /* layout of an expanded block */
 	const raidz_impl_ops_t *rm_ops;	/* RAIDZ math operations */
 	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
 } raidz_map_t;
@@ -0,0 +1,73 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_ZFS_PATTERN_H
+#define	_SYS_ZFS_PATTERN_H
+
+#include <sys/types.h>
+#include <sys/abd.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Detection of blocks consisting of a single repeated 64-bit word, of which
+ * all-zero blocks are the most common case.
+ */
+typedef boolean_t (*zfs_pattern_match_f)(const void *, size_t, uint64_t);
+typedef boolean_t (*zfs_pattern_will_work_f)(void);
+
+typedef struct zfs_pattern_ops {
+	/* B_TRUE if every 64-bit word of the buffer equals the pattern */
+	zfs_pattern_match_f match;
+	zfs_pattern_will_work_f is_supported;
+	const char *name;
+} zfs_pattern_ops_t;
+
+extern void zfs_pattern_init(void);
+extern void zfs_pattern_fini(void);
+extern int zfs_pattern_impl_set(const char *);
+
+extern boolean_t zfs_pattern_abd(abd_t *, size_t, uint64_t *);
+extern boolean_t zfs_pattern_match_scalar(const void *, size_t, uint64_t);
+
+#if defined(__x86_64)
+#if defined(HAVE_SSE2)
+extern const zfs_pattern_ops_t zfs_pattern_sse2_impl;
+#endif
+#if defined(HAVE_AVX2)
+extern const zfs_pattern_ops_t zfs_pattern_avx2_impl;
+#endif
+#if defined(HAVE_AVX512F)
+extern const zfs_pattern_ops_t zfs_pattern_avx512f_impl;
+#endif
+#endif
+
+#if defined(__aarch64__)
+extern const zfs_pattern_ops_t zfs_pattern_aarch64_neon_impl;
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_PATTERN_H */
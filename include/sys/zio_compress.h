@@ -59,6 +59,7 @@ enum zio_compress {
 
 /* Compression algorithms that have levels */
 #define	ZIO_COMPRESS_HASLEVEL(compress)	((compress == ZIO_COMPRESS_ZSTD || \
+					compress == ZIO_COMPRESS_LZ4 || \
 					(compress >= ZIO_COMPRESS_GZIP_1 && \
 					compress <= ZIO_COMPRESS_GZIP_9)))
 
@@ -118,6 +119,49 @@ enum zio_zstd_levels {
 	ZIO_ZSTD_LEVEL_LEVELS
 };
 
+/*
+ * lz4-1 is the regular compressor, lz4-2 to lz4-9 the high compression one
+ * searching more candidates at each level, and lz4-fast-N the regular one
+ * with an acceleration of N.  All of them write standard lz4 blocks.
+ */
+enum zio_lz4_levels {
+	ZIO_LZ4_LEVEL_INHERIT = 0,
+	ZIO_LZ4_LEVEL_1,
+#define	ZIO_LZ4_LEVEL_DEFAULT	ZIO_LZ4_LEVEL_1
+	ZIO_LZ4_LEVEL_2,
+#define	ZIO_LZ4_LEVEL_HC_MIN	ZIO_LZ4_LEVEL_2
+	ZIO_LZ4_LEVEL_3,
+	ZIO_LZ4_LEVEL_4,
+	ZIO_LZ4_LEVEL_5,
+	ZIO_LZ4_LEVEL_6,
+	ZIO_LZ4_LEVEL_7,
+	ZIO_LZ4_LEVEL_8,
+	ZIO_LZ4_LEVEL_9,
+#define	ZIO_LZ4_LEVEL_MAX	ZIO_LZ4_LEVEL_9
+	ZIO_LZ4_LEVEL_RESERVE = 101, /* Leave room for new positive levels */
+	ZIO_LZ4_LEVEL_FAST, /* Fast levels use acceleration */
+	ZIO_LZ4_LEVEL_FAST_2,
+	ZIO_LZ4_LEVEL_FAST_3,
+	ZIO_LZ4_LEVEL_FAST_4,
+	ZIO_LZ4_LEVEL_FAST_5,
+	ZIO_LZ4_LEVEL_FAST_6,
+	ZIO_LZ4_LEVEL_FAST_7,
+	ZIO_LZ4_LEVEL_FAST_8,
+	ZIO_LZ4_LEVEL_FAST_9,
+	ZIO_LZ4_LEVEL_FAST_10,
+	ZIO_LZ4_LEVEL_FAST_20,
+	ZIO_LZ4_LEVEL_FAST_30,
+	ZIO_LZ4_LEVEL_FAST_40,
+	ZIO_LZ4_LEVEL_FAST_50,
+	ZIO_LZ4_LEVEL_FAST_60,
+	ZIO_LZ4_LEVEL_FAST_70,
+	ZIO_LZ4_LEVEL_FAST_80,
+	ZIO_LZ4_LEVEL_FAST_90,
+	ZIO_LZ4_LEVEL_FAST_100,
+#define	ZIO_LZ4_LEVEL_FAST_MAX	ZIO_LZ4_LEVEL_FAST_100
+	ZIO_LZ4_LEVEL_LEVELS
+};
+
 /* Forward Declaration to avoid visibility problems */
 struct zio_prop;
 
@@ -185,6 +229,8 @@ extern int lz4_decompress_zfs(void *src, void *dst, size_t s_len, size_t d_len,
  */
 extern size_t zio_compress_data(enum zio_compress c, abd_t *src, void *dst,
     size_t s_len, uint8_t level);
+extern size_t zio_compress_data_abortable(enum zio_compress c, abd_t *src,
+    void *dst, size_t s_len, uint8_t level, boolean_t *aborted);
 extern int zio_decompress_data(enum zio_compress c, abd_t *src, void *dst,
     size_t s_len, size_t d_len, uint8_t *level);
 extern int zio_decompress_data_buf(enum zio_compress c, void *src, void *dst,
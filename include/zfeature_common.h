@@ -76,6 +76,12 @@ typedef enum spa_feature {
 	SPA_FEATURE_LIVELIST,
 	SPA_FEATURE_DEVICE_REBUILD,
 	SPA_FEATURE_ZSTD_COMPRESS,
+	SPA_FEATURE_BLOCK_CLONING,
+	SPA_FEATURE_DRAID,
+	SPA_FEATURE_RAIDZ_EXPANSION,
+	SPA_FEATURE_BLAKE3,
+	SPA_FEATURE_LZ4_LEVELS,
+	SPA_FEATURE_DDT_LOG,
 	SPA_FEATURES
 } spa_feature_t;
 
@@ -114,6 +114,18 @@ extern void SHA2Update(SHA2_CTX *, const void *, size_t);
 
 extern void SHA2Final(void *, SHA2_CTX *);
 
+extern void sha2_impl_init(void);
+
+extern void sha2_impl_fini(void);
+
+/*
+ * Select the SHA-256 or SHA-512 implementation by name: "fastest", "cycle"
+ * or one of the supported implementations.
+ */
+extern int sha256_impl_set(const char *);
+
+extern int sha512_impl_set(const char *);
+
 #ifdef _SHA2_IMPL
 /*
  * The following types/functions are all private to the implementation
@@ -960,6 +960,7 @@ zpool_name_valid(libzfs_handle_t *hdl, boolean_t isopen, const char *pool)
 	if (ret == 0 && !isopen &&
 	    (strncmp(pool, "mirror", 6) == 0 ||
 	    strncmp(pool, "raidz", 5) == 0 ||
+	    strncmp(pool, "draid", 5) == 0 ||
 	    strncmp(pool, "spare", 5) == 0 ||
 	    strcmp(pool, "log") == 0)) {
 		if (hdl != NULL)
@@ -1497,7 +1498,8 @@ zpool_add(zpool_handle_t *zhp, nvlist_t *nvroot)
 		case EINVAL:
 			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
 			    "invalid config; a pool with removing/removed "
-			    "vdevs does not support adding raidz vdevs"));
+			    "vdevs does not support adding raidz or dRAID "
+			    "vdevs"));
 			(void) zfs_error(hdl, EZFS_BADDEV, msg);
 			break;
 
@@ -2657,12 +2659,33 @@ zpool_find_vdev_by_physpath(zpool_handle_t *zhp, const char *ppath,
 }
 
 /*
- * Determine if we have an "interior" top-level vdev (i.e mirror/raidz).
+ * Determine if the name is that of a dRAID distributed spare, which is a leaf
+ * vdev despite sharing the "draid" prefix of its parent.
+ */
+static boolean_t
+zpool_vdev_is_draid_spare(const char *name)
+{
+	unsigned long long parity, vdev_id, spare_id;
+	int n = 0;
+
+	if (sscanf(name, VDEV_TYPE_DRAID "%llu-%llu-%llu%n",
+	    &parity, &vdev_id, &spare_id, &n) != 3)
+		return (B_FALSE);
+
+	return (name[n] == '\0');
+}
+
+/*
+ * Determine if we have an "interior" top-level vdev (i.e mirror/raidz/draid).
  */
 static boolean_t
 zpool_vdev_is_interior(const char *name)
 {
+	if (zpool_vdev_is_draid_spare(name))
+		return (B_FALSE);
+
 	if (strncmp(name, VDEV_TYPE_RAIDZ, strlen(VDEV_TYPE_RAIDZ)) == 0 ||
+	    strncmp(name, VDEV_TYPE_DRAID, strlen(VDEV_TYPE_DRAID)) == 0 ||
 	    strncmp(name, VDEV_TYPE_SPARE, strlen(VDEV_TYPE_SPARE)) == 0 ||
 	    strncmp(name,
 	    VDEV_TYPE_REPLACING, strlen(VDEV_TYPE_REPLACING)) == 0 ||
@@ -2779,6 +2802,7 @@ vdev_get_physpaths(nvlist_t *nv, char *physpath, size_t phypath_size,
 		}
 	} else if (strcmp(type, VDEV_TYPE_MIRROR) == 0 ||
 	    strcmp(type, VDEV_TYPE_RAIDZ) == 0 ||
+	    strcmp(type, VDEV_TYPE_DRAID) == 0 ||
 	    strcmp(type, VDEV_TYPE_REPLACING) == 0 ||
 	    (is_spare = (strcmp(type, VDEV_TYPE_SPARE) == 0))) {
 		nvlist_t **child;
@@ -3227,9 +3251,20 @@ zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
 				    "cannot replace a replacing device"));
 			}
 		} else {
-			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
-			    "can only attach to mirrors and top-level "
-			    "disks"));
+			char *type = NULL;
+
+			(void) nvlist_lookup_string(tgt, ZPOOL_CONFIG_TYPE,
+			    &type);
+			if (type != NULL &&
+			    strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
+				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+				    "the raidz_expansion feature must be "
+				    "enabled to attach to a raidz vdev"));
+			} else {
+				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+				    "can only attach to mirrors, raidz and "
+				    "top-level disks"));
+			}
 		}
 		(void) zfs_error(hdl, EZFS_BADTARGET, msg);
 		break;
@@ -3245,7 +3280,7 @@ zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
 
 	case EBUSY:
 		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN, "%s is busy, "
-		    "or device removal is in progress"),
+		    "or device removal, initialize or TRIM is in progress"),
 		    new_disk);
 		(void) zfs_error(hdl, EZFS_BADDEV, msg);
 		break;
@@ -3965,9 +4000,11 @@ zpool_vdev_name(libzfs_handle_t *hdl, zpool_handle_t *zhp, nvlist_t *nv,
 		path = type;
 
 		/*
-		 * If it's a raidz device, we need to stick in the parity level.
+		 * If it's a raidz or draid device, we need to stick in the
+		 * parity level.
 		 */
-		if (strcmp(path, VDEV_TYPE_RAIDZ) == 0) {
+		if (strcmp(path, VDEV_TYPE_RAIDZ) == 0 ||
+		    strcmp(path, VDEV_TYPE_DRAID) == 0) {
 			verify(nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY,
 			    &value) == 0);
 			(void) snprintf(buf, sizeof (buf), "%s%llu", path,
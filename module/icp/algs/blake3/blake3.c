@@ -0,0 +1,485 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Based on the BLAKE3 reference implementation, which is dedicated to
+ * the public domain (CC0 1.0) by Jack O'Connor and Samuel Neves.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/blake3.h>
+#include "blake3_impl.h"
+
+/*
+ * BLAKE3 hashes the input in 1KiB chunks, which form the leaves of a
+ * binary tree of chaining values.  Chunks and parent nodes of the same
+ * level are independent, so an implementation's hash_many() may process
+ * several of them at once.  To keep the stack usage bounded we never
+ * hand more than one implementation degree's worth of chunks to a single
+ * subtree; larger inputs are merged through the chaining value stack.
+ */
+
+typedef struct {
+	uint32_t input_cv[8];
+	uint64_t counter;
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	uint8_t block_len;
+	uint8_t flags;
+} output_t;
+
+static inline uint64_t
+round_down_to_power_of_2(uint64_t x)
+{
+	uint64_t p = 1;
+
+	while ((x >>= 1) != 0)
+		p <<= 1;
+	return (p);
+}
+
+static void
+chunk_state_init(blake3_chunk_state_t *self, const uint32_t key[8],
+    uint8_t flags)
+{
+	memcpy(self->cv, key, BLAKE3_KEY_LEN);
+	self->chunk_counter = 0;
+	memset(self->buf, 0, BLAKE3_BLOCK_LEN);
+	self->buf_len = 0;
+	self->blocks_compressed = 0;
+	self->flags = flags;
+}
+
+static void
+chunk_state_reset(blake3_chunk_state_t *self, const uint32_t key[8],
+    uint64_t chunk_counter)
+{
+	memcpy(self->cv, key, BLAKE3_KEY_LEN);
+	self->chunk_counter = chunk_counter;
+	self->blocks_compressed = 0;
+	memset(self->buf, 0, BLAKE3_BLOCK_LEN);
+	self->buf_len = 0;
+}
+
+static size_t
+chunk_state_len(const blake3_chunk_state_t *self)
+{
+	return ((BLAKE3_BLOCK_LEN * (size_t)self->blocks_compressed) +
+	    ((size_t)self->buf_len));
+}
+
+static size_t
+chunk_state_fill_buf(blake3_chunk_state_t *self, const uint8_t *input,
+    size_t input_len)
+{
+	size_t take = BLAKE3_BLOCK_LEN - ((size_t)self->buf_len);
+
+	if (take > input_len)
+		take = input_len;
+	memcpy(&self->buf[self->buf_len], input, take);
+	self->buf_len += (uint8_t)take;
+	return (take);
+}
+
+static uint8_t
+chunk_state_maybe_start_flag(const blake3_chunk_state_t *self)
+{
+	if (self->blocks_compressed == 0)
+		return (BLAKE3_CHUNK_START);
+	else
+		return (0);
+}
+
+static output_t
+make_output(const uint32_t input_cv[8], const uint8_t *block,
+    uint8_t block_len, uint64_t counter, uint8_t flags)
+{
+	output_t ret;
+
+	memcpy(ret.input_cv, input_cv, 32);
+	memcpy(ret.block, block, BLAKE3_BLOCK_LEN);
+	ret.block_len = block_len;
+	ret.counter = counter;
+	ret.flags = flags;
+	return (ret);
+}
+
+static void
+output_chaining_value(const blake3_impl_ops_t *ops, const output_t *self,
+    uint8_t *cv)
+{
+	uint32_t cv_words[8];
+
+	memcpy(cv_words, self->input_cv, 32);
+	ops->compress_in_place(cv_words, self->block, self->block_len,
+	    self->counter, self->flags);
+	blake3_store_cv_words(cv, cv_words);
+}
+
+static void
+output_root_bytes(const blake3_impl_ops_t *ops, const output_t *self,
+    uint8_t *out, size_t out_len)
+{
+	uint64_t output_block_counter = 0;
+	uint8_t wide_buf[64];
+
+	while (out_len > 0) {
+		size_t memcpy_len;
+
+		ops->compress_xof(self->input_cv, self->block, self->block_len,
+		    output_block_counter, self->flags | BLAKE3_ROOT, wide_buf);
+		memcpy_len = MIN(out_len, sizeof (wide_buf));
+		memcpy(out, wide_buf, memcpy_len);
+		out += memcpy_len;
+		out_len -= memcpy_len;
+		output_block_counter += 1;
+	}
+}
+
+static void
+chunk_state_update(const blake3_impl_ops_t *ops, blake3_chunk_state_t *self,
+    const uint8_t *input, size_t input_len)
+{
+	if (self->buf_len > 0) {
+		size_t take = chunk_state_fill_buf(self, input, input_len);
+		input += take;
+		input_len -= take;
+		if (input_len > 0) {
+			ops->compress_in_place(self->cv, self->buf,
+			    BLAKE3_BLOCK_LEN, self->chunk_counter,
+			    self->flags | chunk_state_maybe_start_flag(self));
+			self->blocks_compressed += 1;
+			self->buf_len = 0;
+			memset(self->buf, 0, BLAKE3_BLOCK_LEN);
+		}
+	}
+
+	while (input_len > BLAKE3_BLOCK_LEN) {
+		ops->compress_in_place(self->cv, input, BLAKE3_BLOCK_LEN,
+		    self->chunk_counter,
+		    self->flags | chunk_state_maybe_start_flag(self));
+		self->blocks_compressed += 1;
+		input += BLAKE3_BLOCK_LEN;
+		input_len -= BLAKE3_BLOCK_LEN;
+	}
+
+	(void) chunk_state_fill_buf(self, input, input_len);
+}
+
+static output_t
+chunk_state_output(const blake3_chunk_state_t *self)
+{
+	uint8_t block_flags =
+	    self->flags | chunk_state_maybe_start_flag(self) | BLAKE3_CHUNK_END;
+
+	return (make_output(self->cv, self->buf, self->buf_len,
+	    self->chunk_counter, block_flags));
+}
+
+static output_t
+parent_output(const uint8_t block[BLAKE3_BLOCK_LEN], const uint32_t key[8],
+    uint8_t flags)
+{
+	return (make_output(key, block, BLAKE3_BLOCK_LEN, 0,
+	    flags | BLAKE3_PARENT));
+}
+
+/*
+ * Hash input_len bytes of whole chunks, writing one chaining value per
+ * chunk to out.  Returns the number of chaining values written.
+ */
+static size_t
+compress_chunks_parallel(const blake3_impl_ops_t *ops, const uint8_t *input,
+    size_t input_len, const uint32_t key[8], uint64_t chunk_counter,
+    uint8_t flags, uint8_t *out)
+{
+	const uint8_t *chunks_array[BLAKE3_MAX_SIMD_DEGREE];
+	size_t chunks_array_len = 0;
+
+	ASSERT0(input_len % BLAKE3_CHUNK_LEN);
+	ASSERT3U(input_len, <=, BLAKE3_MAX_SIMD_DEGREE * BLAKE3_CHUNK_LEN);
+
+	while (input_len > 0) {
+		chunks_array[chunks_array_len++] = input;
+		input += BLAKE3_CHUNK_LEN;
+		input_len -= BLAKE3_CHUNK_LEN;
+	}
+
+	ops->hash_many(chunks_array, chunks_array_len,
+	    BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, key, chunk_counter, B_TRUE,
+	    flags, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, out);
+
+	return (chunks_array_len);
+}
+
+/*
+ * Combine pairs of chaining values into their parents.  An odd one out is
+ * passed through unchanged.  Returns the number of chaining values written.
+ */
+static size_t
+compress_parents_parallel(const blake3_impl_ops_t *ops,
+    const uint8_t *child_chaining_values, size_t num_chaining_values,
+    const uint32_t key[8], uint8_t flags, uint8_t *out)
+{
+	const uint8_t *parents_array[BLAKE3_MAX_SIMD_DEGREE / 2];
+	size_t parents_array_len = 0;
+
+	while (num_chaining_values - (2 * parents_array_len) >= 2) {
+		parents_array[parents_array_len] = &child_chaining_values[
+		    2 * parents_array_len * BLAKE3_OUT_LEN];
+		parents_array_len += 1;
+	}
+
+	ops->hash_many(parents_array, parents_array_len, 1, key, 0, B_FALSE,
+	    flags | BLAKE3_PARENT, 0, 0, out);
+
+	if (num_chaining_values > 2 * parents_array_len) {
+		memcpy(&out[parents_array_len * BLAKE3_OUT_LEN],
+		    &child_chaining_values[2 * parents_array_len *
+		    BLAKE3_OUT_LEN], BLAKE3_OUT_LEN);
+		return (parents_array_len + 1);
+	} else {
+		return (parents_array_len);
+	}
+}
+
+/*
+ * Hash a complete subtree of at least two and at most
+ * BLAKE3_MAX_SIMD_DEGREE chunks down to the two chaining values which are
+ * the children of its root.  The root itself is not compressed, because
+ * it might be the root of the whole tree and need the BLAKE3_ROOT flag.
+ */
+static void
+compress_subtree_to_parent_node(const blake3_impl_ops_t *ops,
+    const uint8_t *input, size_t input_len, const uint32_t key[8],
+    uint64_t chunk_counter, uint8_t flags, uint8_t out[2 * BLAKE3_OUT_LEN])
+{
+	uint8_t cv_array[BLAKE3_MAX_SIMD_DEGREE * BLAKE3_OUT_LEN];
+	uint8_t out_array[BLAKE3_MAX_SIMD_DEGREE * BLAKE3_OUT_LEN / 2];
+	size_t num_cvs;
+
+	num_cvs = compress_chunks_parallel(ops, input, input_len, key,
+	    chunk_counter, flags, cv_array);
+	ASSERT3U(num_cvs, >=, 2);
+
+	while (num_cvs > 2) {
+		num_cvs = compress_parents_parallel(ops, cv_array, num_cvs,
+		    key, flags, out_array);
+		memcpy(cv_array, out_array, num_cvs * BLAKE3_OUT_LEN);
+	}
+	memcpy(out, cv_array, 2 * BLAKE3_OUT_LEN);
+}
+
+static void
+hasher_init_base(BLAKE3_CTX *ctx, const uint32_t key[8], uint8_t flags)
+{
+	memcpy(ctx->key, key, BLAKE3_KEY_LEN);
+	chunk_state_init(&ctx->chunk, key, flags);
+	ctx->cv_stack_len = 0;
+}
+
+/*
+ * As described in the reference implementation, we only merge chaining
+ * values when we know that more input follows, so that the root of the
+ * tree can be finalized with the BLAKE3_ROOT flag.  The number of
+ * chaining values left on the stack after merging is the number of set
+ * bits in the total number of chunks so far.
+ */
+static void
+hasher_merge_cv_stack(const blake3_impl_ops_t *ops, BLAKE3_CTX *ctx,
+    uint64_t total_len)
+{
+	size_t post_merge_stack_len = 0;
+
+	for (; total_len != 0; total_len &= total_len - 1)
+		post_merge_stack_len++;
+
+	while (ctx->cv_stack_len > post_merge_stack_len) {
+		uint8_t *parent_node =
+		    &ctx->cv_stack[(ctx->cv_stack_len - 2) * BLAKE3_OUT_LEN];
+		output_t output =
+		    parent_output(parent_node, ctx->key, ctx->chunk.flags);
+		output_chaining_value(ops, &output, parent_node);
+		ctx->cv_stack_len -= 1;
+	}
+}
+
+static void
+hasher_push_cv(const blake3_impl_ops_t *ops, BLAKE3_CTX *ctx,
+    uint8_t new_cv[BLAKE3_OUT_LEN], uint64_t chunk_counter)
+{
+	hasher_merge_cv_stack(ops, ctx, chunk_counter);
+	memcpy(&ctx->cv_stack[ctx->cv_stack_len * BLAKE3_OUT_LEN], new_cv,
+	    BLAKE3_OUT_LEN);
+	ctx->cv_stack_len += 1;
+}
+
+void
+Blake3_Init(BLAKE3_CTX *ctx)
+{
+	hasher_init_base(ctx, blake3_iv, 0);
+}
+
+void
+Blake3_InitKeyed(BLAKE3_CTX *ctx, const uint8_t key[BLAKE3_KEY_LEN])
+{
+	uint32_t key_words[8];
+
+	for (int i = 0; i < 8; i++)
+		key_words[i] = blake3_load32(&key[i * 4]);
+	hasher_init_base(ctx, key_words, BLAKE3_KEYED_HASH);
+}
+
+void
+Blake3_Update(BLAKE3_CTX *ctx, const void *input, size_t input_len)
+{
+	const blake3_impl_ops_t *ops = blake3_impl_get_ops();
+	const uint8_t *input_bytes = (const uint8_t *)input;
+	size_t max_subtree_len = ops->degree * BLAKE3_CHUNK_LEN;
+
+	if (input_len == 0)
+		return;
+
+	/* Finish off a partial chunk first. */
+	if (chunk_state_len(&ctx->chunk) > 0) {
+		size_t take = BLAKE3_CHUNK_LEN - chunk_state_len(&ctx->chunk);
+		if (take > input_len)
+			take = input_len;
+		chunk_state_update(ops, &ctx->chunk, input_bytes, take);
+		input_bytes += take;
+		input_len -= take;
+
+		/* If there's more input, the chunk is complete. */
+		if (input_len == 0)
+			return;
+
+		output_t output = chunk_state_output(&ctx->chunk);
+		uint8_t chunk_cv[BLAKE3_OUT_LEN];
+		output_chaining_value(ops, &output, chunk_cv);
+		hasher_push_cv(ops, ctx, chunk_cv, ctx->chunk.chunk_counter);
+		chunk_state_reset(&ctx->chunk, ctx->key,
+		    ctx->chunk.chunk_counter + 1);
+	}
+
+	/*
+	 * Hash as many whole subtrees as we can, keeping back at least one
+	 * byte for the chunk state since it might be the root.  A subtree
+	 * must be a power of two chunks in size, and must start at a
+	 * multiple of its size.
+	 */
+	while (input_len > BLAKE3_CHUNK_LEN) {
+		uint64_t subtree_len = round_down_to_power_of_2(input_len);
+		uint64_t count_so_far =
+		    ctx->chunk.chunk_counter * BLAKE3_CHUNK_LEN;
+
+		subtree_len = MIN(subtree_len, max_subtree_len);
+		while ((((uint64_t)(subtree_len - 1)) & count_so_far) != 0)
+			subtree_len /= 2;
+
+		uint64_t subtree_chunks = subtree_len / BLAKE3_CHUNK_LEN;
+		if (subtree_len <= BLAKE3_CHUNK_LEN) {
+			blake3_chunk_state_t chunk_state;
+			uint8_t cv[BLAKE3_OUT_LEN];
+
+			chunk_state_init(&chunk_state, ctx->key,
+			    ctx->chunk.flags);
+			chunk_state.chunk_counter = ctx->chunk.chunk_counter;
+			chunk_state_update(ops, &chunk_state, input_bytes,
+			    subtree_len);
+			output_t output = chunk_state_output(&chunk_state);
+			output_chaining_value(ops, &output, cv);
+			hasher_push_cv(ops, ctx, cv, chunk_state.chunk_counter);
+		} else {
+			uint8_t cv_pair[2 * BLAKE3_OUT_LEN];
+
+			compress_subtree_to_parent_node(ops, input_bytes,
+			    subtree_len, ctx->key, ctx->chunk.chunk_counter,
+			    ctx->chunk.flags, cv_pair);
+			hasher_push_cv(ops, ctx, cv_pair,
+			    ctx->chunk.chunk_counter);
+			hasher_push_cv(ops, ctx, &cv_pair[BLAKE3_OUT_LEN],
+			    ctx->chunk.chunk_counter + (subtree_chunks / 2));
+		}
+		ctx->chunk.chunk_counter += subtree_chunks;
+		input_bytes += subtree_len;
+		input_len -= subtree_len;
+	}
+
+	/* Buffer what is left, and merge what we can. */
+	if (input_len > 0) {
+		chunk_state_update(ops, &ctx->chunk, input_bytes, input_len);
+		hasher_merge_cv_stack(ops, ctx, ctx->chunk.chunk_counter);
+	}
+}
+
+void
+Blake3_FinalSeq(const BLAKE3_CTX *ctx, uint8_t *out, size_t out_len)
+{
+	const blake3_impl_ops_t *ops = blake3_impl_get_ops();
+	size_t cvs_remaining;
+	output_t output;
+
+	if (out_len == 0)
+		return;
+
+	/* If the subtree stack is empty, the chunk is the root. */
+	if (ctx->cv_stack_len == 0) {
+		output = chunk_state_output(&ctx->chunk);
+		output_root_bytes(ops, &output, out, out_len);
+		return;
+	}
+
+	/*
+	 * Otherwise merge the whole stack, starting with the current chunk
+	 * or, if that is empty, with the top two entries of the stack.
+	 */
+	if (chunk_state_len(&ctx->chunk) > 0) {
+		cvs_remaining = ctx->cv_stack_len;
+		output = chunk_state_output(&ctx->chunk);
+	} else {
+		cvs_remaining = ctx->cv_stack_len - 2;
+		output = parent_output(&ctx->cv_stack[cvs_remaining * 32],
+		    ctx->key, ctx->chunk.flags);
+	}
+	while (cvs_remaining > 0) {
+		uint8_t parent_block[BLAKE3_BLOCK_LEN];
+
+		cvs_remaining -= 1;
+		memcpy(parent_block, &ctx->cv_stack[cvs_remaining * 32], 32);
+		output_chaining_value(ops, &output, &parent_block[32]);
+		output = parent_output(parent_block, ctx->key,
+		    ctx->chunk.flags);
+	}
+	output_root_bytes(ops, &output, out, out_len);
+}
+
+void
+Blake3_Final(const BLAKE3_CTX *ctx, uint8_t *out)
+{
+	Blake3_FinalSeq(ctx, out, BLAKE3_OUT_LEN);
+}
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(Blake3_Init);
+EXPORT_SYMBOL(Blake3_InitKeyed);
+EXPORT_SYMBOL(Blake3_Update);
+EXPORT_SYMBOL(Blake3_Final);
+EXPORT_SYMBOL(Blake3_FinalSeq);
+#endif
@@ -0,0 +1,383 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/blake3.h>
+#include <sys/simd.h>
+#include "blake3_impl.h"
+
+/* BLAKE3 implementation that contains the fastest methods */
+static blake3_impl_ops_t blake3_fastest_impl = {
+	.name = "fastest"
+};
+
+/* All compiled in implementations */
+static const blake3_impl_ops_t *blake3_all_impl[] = {
+	&blake3_generic_impl,
+#if defined(__x86_64) && defined(HAVE_SSE2)
+	&blake3_sse2_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3) && \
+	defined(HAVE_SSE4_1)
+	&blake3_sse41_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX) && defined(HAVE_AVX2)
+	&blake3_avx2_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512F)
+	&blake3_avx512_impl,
+#endif
+};
+
+/* Indicate that benchmark has been completed */
+static boolean_t blake3_impl_initialized = B_FALSE;
+
+/* Select BLAKE3 implementation */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX-1)
+
+#define	BLAKE3_IMPL_READ(i) (*(volatile uint32_t *) &(i))
+
+static uint32_t icp_blake3_impl = IMPL_FASTEST;
+static uint32_t user_sel_impl = IMPL_FASTEST;
+
+/* Hold all supported implementations */
+static size_t blake3_supp_impl_cnt = 0;
+static blake3_impl_ops_t *blake3_supp_impl[ARRAY_SIZE(blake3_all_impl)];
+
+#if defined(_KERNEL)
+static kstat_t *blake3_kstat;
+
+/* Throughput of each supported implementation in B/s */
+static uint64_t blake3_stat_data[ARRAY_SIZE(blake3_all_impl) + 1];
+static uint32_t blake3_fastest_id;
+#endif
+
+/*
+ * Returns the BLAKE3 operations.  When a SIMD implementation is not
+ * allowed in the current context, then fallback to the generic one.
+ */
+const blake3_impl_ops_t *
+blake3_impl_get_ops(void)
+{
+	if (!kfpu_allowed())
+		return (&blake3_generic_impl);
+
+	const blake3_impl_ops_t *ops = NULL;
+	const uint32_t impl = BLAKE3_IMPL_READ(icp_blake3_impl);
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		ASSERT(blake3_impl_initialized);
+		ops = &blake3_fastest_impl;
+		break;
+	case IMPL_CYCLE:
+		/* Cycle through supported implementations */
+		ASSERT(blake3_impl_initialized);
+		ASSERT3U(blake3_supp_impl_cnt, >, 0);
+		static size_t cycle_impl_idx = 0;
+		size_t idx = (++cycle_impl_idx) % blake3_supp_impl_cnt;
+		ops = blake3_supp_impl[idx];
+		break;
+	default:
+		ASSERT3U(impl, <, blake3_supp_impl_cnt);
+		ASSERT3U(blake3_supp_impl_cnt, >, 0);
+		if (impl < ARRAY_SIZE(blake3_all_impl))
+			ops = blake3_supp_impl[impl];
+		break;
+	}
+
+	ASSERT3P(ops, !=, NULL);
+
+	return (ops);
+}
+
+#if defined(_KERNEL)
+/*
+ * BLAKE3 kstats
+ */
+static int
+blake3_kstat_headers(char *buf, size_t size)
+{
+	(void) snprintf(buf, size, "%-17s%-15s\n", "implementation", "B/s");
+
+	return (0);
+}
+
+static int
+blake3_kstat_data(char *buf, size_t size, void *data)
+{
+	uint64_t *curr_stat = (uint64_t *)data;
+	ptrdiff_t id = curr_stat - blake3_stat_data;
+
+	if (id == blake3_supp_impl_cnt) {
+		(void) snprintf(buf, size, "%-17s%-15s\n", "fastest",
+		    blake3_supp_impl[blake3_fastest_id]->name);
+	} else {
+		(void) snprintf(buf, size, "%-17s%-15llu\n",
+		    blake3_supp_impl[id]->name, (u_longlong_t)*curr_stat);
+	}
+
+	return (0);
+}
+
+static void *
+blake3_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	if (n <= blake3_supp_impl_cnt)
+		ksp->ks_private = (void *) (blake3_stat_data + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+#define	BLAKE3_BENCH_NS	(MSEC2NSEC(50))		/* 50ms */
+
+/*
+ * Measure the throughput of each supported implementation on a 128KiB
+ * buffer, and make the best one the "fastest".
+ */
+static void
+blake3_benchmark(void)
+{
+	static const size_t data_size = 1 << SPA_OLD_MAXBLOCKSHIFT;
+	uint8_t digest[BLAKE3_OUT_LEN];
+	uint64_t run_bw, run_time_ns, best_run = 0;
+	BLAKE3_CTX *ctx;
+	hrtime_t start;
+	uint8_t *databuf;
+	size_t i;
+
+	databuf = vmem_alloc(data_size, KM_SLEEP);
+	ctx = kmem_alloc(sizeof (*ctx), KM_SLEEP);
+
+	for (i = 0; i < data_size / sizeof (uint64_t); i++)
+		((uint64_t *)databuf)[i] = (uintptr_t)(databuf+i); /* warm-up */
+
+	for (i = 0; i < blake3_supp_impl_cnt; i++) {
+		uint64_t run_count = 0;
+
+		/* temporarily set an implementation */
+		icp_blake3_impl = i;
+
+		kpreempt_disable();
+		start = gethrtime();
+		do {
+			for (int l = 0; l < 4; l++, run_count++) {
+				Blake3_Init(ctx);
+				Blake3_Update(ctx, databuf, data_size);
+				Blake3_Final(ctx, digest);
+			}
+
+			run_time_ns = gethrtime() - start;
+		} while (run_time_ns < BLAKE3_BENCH_NS);
+		kpreempt_enable();
+
+		run_bw = data_size * run_count * NANOSEC;
+		run_bw /= run_time_ns;	/* B/s */
+		blake3_stat_data[i] = run_bw;
+
+		if (run_bw > best_run) {
+			best_run = run_bw;
+			blake3_fastest_id = i;
+		}
+	}
+
+	kmem_free(ctx, sizeof (*ctx));
+	vmem_free(databuf, data_size);
+
+	memcpy(&blake3_fastest_impl, blake3_supp_impl[blake3_fastest_id],
+	    sizeof (blake3_fastest_impl));
+}
+#endif /* _KERNEL */
+
+/*
+ * Initialize and benchmark all supported implementations.
+ */
+void
+blake3_impl_init(void)
+{
+	blake3_impl_ops_t *curr_impl;
+	int i, c;
+
+	/* Move supported implementations into blake3_supp_impl */
+	for (i = 0, c = 0; i < ARRAY_SIZE(blake3_all_impl); i++) {
+		curr_impl = (blake3_impl_ops_t *)blake3_all_impl[i];
+
+		if (curr_impl->is_supported())
+			blake3_supp_impl[c++] = (blake3_impl_ops_t *)curr_impl;
+	}
+	blake3_supp_impl_cnt = c;
+
+#if defined(_KERNEL)
+	blake3_benchmark();
+
+	/* Install kstats for all implementations */
+	blake3_kstat = kstat_create("zfs", 0, "blake3_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (blake3_kstat != NULL) {
+		blake3_kstat->ks_data = NULL;
+		blake3_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(blake3_kstat,
+		    blake3_kstat_headers,
+		    blake3_kstat_data,
+		    blake3_kstat_addr);
+		kstat_install(blake3_kstat);
+	}
+#else
+	/*
+	 * Skip the benchmark in user space to avoid impacting libzpool
+	 * consumers (zdb, zhack, zinject, ztest).  The last implementation
+	 * is assumed to be the fastest and used by default.
+	 */
+	memcpy(&blake3_fastest_impl,
+	    blake3_supp_impl[blake3_supp_impl_cnt - 1],
+	    sizeof (blake3_fastest_impl));
+#endif /* _KERNEL */
+
+	strlcpy(blake3_fastest_impl.name, "fastest", BLAKE3_IMPL_NAME_MAX);
+
+	/* Finish initialization */
+	atomic_swap_32(&icp_blake3_impl, user_sel_impl);
+	blake3_impl_initialized = B_TRUE;
+}
+
+void
+blake3_impl_fini(void)
+{
+#if defined(_KERNEL)
+	if (blake3_kstat != NULL) {
+		kstat_delete(blake3_kstat);
+		blake3_kstat = NULL;
+	}
+#endif
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} blake3_impl_opts[] = {
+		{ "cycle",	IMPL_CYCLE },
+		{ "fastest",	IMPL_FASTEST },
+};
+
+/*
+ * Function sets desired BLAKE3 implementation.
+ *
+ * If we are called before init(), user preference will be saved in
+ * user_sel_impl, and applied in later init() call. This occurs when module
+ * parameter is specified on module load. Otherwise, directly update
+ * icp_blake3_impl.
+ *
+ * @val		Name of BLAKE3 implementation to use
+ */
+int
+blake3_impl_set(const char *val)
+{
+	int err = -EINVAL;
+	char req_name[BLAKE3_IMPL_NAME_MAX];
+	uint32_t impl = BLAKE3_IMPL_READ(user_sel_impl);
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(val, BLAKE3_IMPL_NAME_MAX);
+	if (i == 0 || i >= BLAKE3_IMPL_NAME_MAX)
+		return (err);
+
+	strlcpy(req_name, val, BLAKE3_IMPL_NAME_MAX);
+	while (i > 0 && isspace(req_name[i-1]))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(blake3_impl_opts); i++) {
+		if (strcmp(req_name, blake3_impl_opts[i].name) == 0) {
+			impl = blake3_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	/* check all supported impl if init() was already called */
+	if (err != 0 && blake3_impl_initialized) {
+		/* check all supported implementations */
+		for (i = 0; i < blake3_supp_impl_cnt; i++) {
+			if (strcmp(req_name, blake3_supp_impl[i]->name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (blake3_impl_initialized)
+			atomic_swap_32(&icp_blake3_impl, impl);
+		else
+			atomic_swap_32(&user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(blake3_impl_init);
+EXPORT_SYMBOL(blake3_impl_fini);
+EXPORT_SYMBOL(blake3_impl_set);
+#endif
+
+#if defined(_KERNEL) && defined(__linux__)
+
+static int
+icp_blake3_impl_set(const char *val, zfs_kernel_param_t *kp)
+{
+	return (blake3_impl_set(val));
+}
+
+static int
+icp_blake3_impl_get(char *buffer, zfs_kernel_param_t *kp)
+{
+	int i, cnt = 0;
+	char *fmt;
+	const uint32_t impl = BLAKE3_IMPL_READ(icp_blake3_impl);
+
+	ASSERT(blake3_impl_initialized);
+
+	/* list mandatory options */
+	for (i = 0; i < ARRAY_SIZE(blake3_impl_opts); i++) {
+		fmt = (impl == blake3_impl_opts[i].sel) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, blake3_impl_opts[i].name);
+	}
+
+	/* list all supported implementations */
+	for (i = 0; i < blake3_supp_impl_cnt; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, blake3_supp_impl[i]->name);
+	}
+
+	return (cnt);
+}
+
+module_param_call(icp_blake3_impl, icp_blake3_impl_set, icp_blake3_impl_get,
+    NULL, 0644);
+MODULE_PARM_DESC(icp_blake3_impl, "Select BLAKE3 implementation.");
+#endif
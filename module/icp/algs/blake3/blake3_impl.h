@@ -0,0 +1,141 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_BLAKE3_IMPL_H
+#define	_BLAKE3_IMPL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <sys/blake3.h>
+#include <sys/simd.h>
+
+/* internal flags */
+enum blake3_flags {
+	BLAKE3_CHUNK_START		= 1 << 0,
+	BLAKE3_CHUNK_END		= 1 << 1,
+	BLAKE3_PARENT			= 1 << 2,
+	BLAKE3_ROOT			= 1 << 3,
+	BLAKE3_KEYED_HASH		= 1 << 4,
+	BLAKE3_DERIVE_KEY_CONTEXT	= 1 << 5,
+	BLAKE3_DERIVE_KEY_MATERIAL	= 1 << 6,
+};
+
+/* the widest implementation hashes this many chunks at once */
+#define	BLAKE3_MAX_SIMD_DEGREE	16
+
+extern const uint32_t blake3_iv[8];
+extern const uint8_t blake3_msg_schedule[7][16];
+
+/*
+ * Methods used to define a BLAKE3 implementation
+ *
+ * @compress_in_place	Compress one block into the chaining value
+ * @compress_xof	Compress one block and output 64 bytes
+ * @hash_many		Hash num_inputs inputs of blocks blocks each, storing
+ *			one chaining value per input in out; this is where
+ *			the SIMD implementations get their parallelism
+ * @is_supported	Whether the implementation works on this CPU
+ * @degree		Number of inputs hash_many processes at once
+ */
+typedef void (*blake3_compress_in_place_f)(uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+    uint64_t counter, uint8_t flags);
+
+typedef void (*blake3_compress_xof_f)(const uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+    uint64_t counter, uint8_t flags, uint8_t out[64]);
+
+typedef void (*blake3_hash_many_f)(const uint8_t * const *inputs,
+    size_t num_inputs, size_t blocks, const uint32_t key[8],
+    uint64_t counter, boolean_t increment_counter, uint8_t flags,
+    uint8_t flags_start, uint8_t flags_end, uint8_t *out);
+
+typedef boolean_t (*blake3_is_supported_f)(void);
+
+#define	BLAKE3_IMPL_NAME_MAX	(16)
+
+typedef struct blake3_impl_ops {
+	blake3_compress_in_place_f compress_in_place;
+	blake3_compress_xof_f compress_xof;
+	blake3_hash_many_f hash_many;
+	blake3_is_supported_f is_supported;
+	size_t degree;
+	char name[BLAKE3_IMPL_NAME_MAX];
+} blake3_impl_ops_t;
+
+extern const blake3_impl_ops_t blake3_generic_impl;
+
+#if defined(__x86_64) && defined(HAVE_SSE2)
+extern const blake3_impl_ops_t blake3_sse2_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3) && \
+	defined(HAVE_SSE4_1)
+extern const blake3_impl_ops_t blake3_sse41_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX) && defined(HAVE_AVX2)
+extern const blake3_impl_ops_t blake3_avx2_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512F)
+extern const blake3_impl_ops_t blake3_avx512_impl;
+#endif
+
+/*
+ * Returns the implementation to use for the next operation.  When a SIMD
+ * implementation is not allowed in the current context the generic one
+ * is returned.
+ */
+extern const blake3_impl_ops_t *blake3_impl_get_ops(void);
+
+static inline uint32_t
+blake3_load32(const void *src)
+{
+	const uint8_t *p = (const uint8_t *)src;
+
+	return (((uint32_t)p[0] << 0) | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline void
+blake3_store32(void *dst, uint32_t w)
+{
+	uint8_t *p = (uint8_t *)dst;
+
+	p[0] = (uint8_t)(w >> 0);
+	p[1] = (uint8_t)(w >> 8);
+	p[2] = (uint8_t)(w >> 16);
+	p[3] = (uint8_t)(w >> 24);
+}
+
+static inline void
+blake3_store_cv_words(uint8_t bytes_out[32], const uint32_t cv_words[8])
+{
+	for (int i = 0; i < 8; i++)
+		blake3_store32(&bytes_out[i * 4], cv_words[i]);
+}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _BLAKE3_IMPL_H */
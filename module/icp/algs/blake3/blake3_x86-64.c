@@ -0,0 +1,498 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#if defined(__x86_64) && defined(HAVE_SSE2)
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#include "blake3_impl.h"
+
+/*
+ * The SIMD implementations hash several chunks (or parents) at once, one
+ * per vector lane.  The state and the message are kept transposed, so
+ * that row i holds word i of every input.  One G function mixes a column
+ * or diagonal of every input at the same time, and it is written as a
+ * single asm statement which loads its operands from, and stores them
+ * back to memory.  No vector register is live between two statements.
+ *
+ * Inputs which don't fill all lanes are handed down to the next narrower
+ * implementation, and finally to the generic one.
+ */
+typedef struct blake3_row {
+	uint32_t w[16];
+} __attribute__((aligned(64))) blake3_row_t;
+
+typedef void (*blake3_round_f)(blake3_row_t v[16], const blake3_row_t m[16],
+    const uint8_t *s);
+
+#define	BLAKE3_ROUND(g, v, m, s)					\
+{									\
+	g(&v[0], &v[4], &v[8], &v[12], &m[s[0]], &m[s[1]]);		\
+	g(&v[1], &v[5], &v[9], &v[13], &m[s[2]], &m[s[3]]);		\
+	g(&v[2], &v[6], &v[10], &v[14], &m[s[4]], &m[s[5]]);		\
+	g(&v[3], &v[7], &v[11], &v[15], &m[s[6]], &m[s[7]]);		\
+	g(&v[0], &v[5], &v[10], &v[15], &m[s[8]], &m[s[9]]);		\
+	g(&v[1], &v[6], &v[11], &v[12], &m[s[10]], &m[s[11]]);		\
+	g(&v[2], &v[7], &v[8], &v[13], &m[s[12]], &m[s[13]]);		\
+	g(&v[3], &v[4], &v[9], &v[14], &m[s[14]], &m[s[15]]);		\
+}
+
+#define	BLAKE3_G_OPERANDS						\
+	: [a] "+m" (*a), [b] "+m" (*b), [c] "+m" (*c), [d] "+m" (*d)	\
+	: [x] "m" (*x), [y] "m" (*y)					\
+	: BLAKE3_G_CLOBBERS
+
+/*
+ * The kernel is built without SIMD support so the compiler never uses
+ * these registers, and it doesn't accept them as clobbers.  In user space
+ * they must be declared.
+ */
+#if defined(_KERNEL)
+#define	BLAKE3_G_CLOBBERS
+#else
+#define	BLAKE3_G_CLOBBERS						\
+	"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6"
+#endif
+
+/* Byte shuffles rotating each 32-bit word right by 16 and 8 bits */
+static const uint8_t blake3_rot16[32] __attribute__((aligned(32))) = {
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13
+};
+static const uint8_t blake3_rot8[32] __attribute__((aligned(32))) = {
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12
+};
+
+/*
+ * SSE2: 4 lanes, rotations are done with shifts
+ */
+#define	SSE2_ROTR(r, n)							\
+	"movdqa %%" #r ", %%xmm4\n"					\
+	"psrld $" #n ", %%" #r "\n"					\
+	"pslld $(32-" #n "), %%xmm4\n"					\
+	"por %%xmm4, %%" #r "\n"
+
+static void
+blake3_g_sse2(blake3_row_t *a, blake3_row_t *b, blake3_row_t *c,
+    blake3_row_t *d, const blake3_row_t *x, const blake3_row_t *y)
+{
+	asm volatile(
+	    "movdqa %[a], %%xmm0\n"
+	    "movdqa %[b], %%xmm1\n"
+	    "movdqa %[c], %%xmm2\n"
+	    "movdqa %[d], %%xmm3\n"
+	    "paddd %%xmm1, %%xmm0\n"
+	    "paddd %[x], %%xmm0\n"
+	    "pxor %%xmm0, %%xmm3\n"
+	    SSE2_ROTR(xmm3, 16)
+	    "paddd %%xmm3, %%xmm2\n"
+	    "pxor %%xmm2, %%xmm1\n"
+	    SSE2_ROTR(xmm1, 12)
+	    "paddd %%xmm1, %%xmm0\n"
+	    "paddd %[y], %%xmm0\n"
+	    "pxor %%xmm0, %%xmm3\n"
+	    SSE2_ROTR(xmm3, 8)
+	    "paddd %%xmm3, %%xmm2\n"
+	    "pxor %%xmm2, %%xmm1\n"
+	    SSE2_ROTR(xmm1, 7)
+	    "movdqa %%xmm0, %[a]\n"
+	    "movdqa %%xmm1, %[b]\n"
+	    "movdqa %%xmm2, %[c]\n"
+	    "movdqa %%xmm3, %[d]\n"
+	    BLAKE3_G_OPERANDS);
+}
+
+static void
+blake3_round_sse2(blake3_row_t v[16], const blake3_row_t m[16],
+    const uint8_t *s)
+{
+	BLAKE3_ROUND(blake3_g_sse2, v, m, s);
+}
+
+/*
+ * SSE4.1: 4 lanes, the byte-sized rotations use pshufb (SSSE3)
+ */
+#if defined(HAVE_SSSE3) && defined(HAVE_SSE4_1)
+static void
+blake3_g_sse41(blake3_row_t *a, blake3_row_t *b, blake3_row_t *c,
+    blake3_row_t *d, const blake3_row_t *x, const blake3_row_t *y)
+{
+	asm volatile(
+	    "movdqa %[a], %%xmm0\n"
+	    "movdqa %[b], %%xmm1\n"
+	    "movdqa %[c], %%xmm2\n"
+	    "movdqa %[d], %%xmm3\n"
+	    "movdqa %[r16], %%xmm5\n"
+	    "movdqa %[r8], %%xmm6\n"
+	    "paddd %%xmm1, %%xmm0\n"
+	    "paddd %[x], %%xmm0\n"
+	    "pxor %%xmm0, %%xmm3\n"
+	    "pshufb %%xmm5, %%xmm3\n"
+	    "paddd %%xmm3, %%xmm2\n"
+	    "pxor %%xmm2, %%xmm1\n"
+	    SSE2_ROTR(xmm1, 12)
+	    "paddd %%xmm1, %%xmm0\n"
+	    "paddd %[y], %%xmm0\n"
+	    "pxor %%xmm0, %%xmm3\n"
+	    "pshufb %%xmm6, %%xmm3\n"
+	    "paddd %%xmm3, %%xmm2\n"
+	    "pxor %%xmm2, %%xmm1\n"
+	    SSE2_ROTR(xmm1, 7)
+	    "movdqa %%xmm0, %[a]\n"
+	    "movdqa %%xmm1, %[b]\n"
+	    "movdqa %%xmm2, %[c]\n"
+	    "movdqa %%xmm3, %[d]\n"
+	    : [a] "+m" (*a), [b] "+m" (*b), [c] "+m" (*c), [d] "+m" (*d)
+	    : [x] "m" (*x), [y] "m" (*y),
+	    [r16] "m" (blake3_rot16), [r8] "m" (blake3_rot8)
+	    : BLAKE3_G_CLOBBERS);
+}
+
+static void
+blake3_round_sse41(blake3_row_t v[16], const blake3_row_t m[16],
+    const uint8_t *s)
+{
+	BLAKE3_ROUND(blake3_g_sse41, v, m, s);
+}
+#endif /* HAVE_SSSE3 && HAVE_SSE4_1 */
+
+/*
+ * AVX2: 8 lanes
+ */
+#if defined(HAVE_AVX) && defined(HAVE_AVX2)
+#define	AVX2_ROTR(r, n)							\
+	"vpsrld $" #n ", %%" #r ", %%ymm4\n"				\
+	"vpslld $(32-" #n "), %%" #r ", %%" #r "\n"			\
+	"vpor %%ymm4, %%" #r ", %%" #r "\n"
+
+static void
+blake3_g_avx2(blake3_row_t *a, blake3_row_t *b, blake3_row_t *c,
+    blake3_row_t *d, const blake3_row_t *x, const blake3_row_t *y)
+{
+	asm volatile(
+	    "vmovdqa %[a], %%ymm0\n"
+	    "vmovdqa %[b], %%ymm1\n"
+	    "vmovdqa %[c], %%ymm2\n"
+	    "vmovdqa %[d], %%ymm3\n"
+	    "vpaddd %%ymm1, %%ymm0, %%ymm0\n"
+	    "vpaddd %[x], %%ymm0, %%ymm0\n"
+	    "vpxor %%ymm0, %%ymm3, %%ymm3\n"
+	    "vpshufb %[r16], %%ymm3, %%ymm3\n"
+	    "vpaddd %%ymm3, %%ymm2, %%ymm2\n"
+	    "vpxor %%ymm2, %%ymm1, %%ymm1\n"
+	    AVX2_ROTR(ymm1, 12)
+	    "vpaddd %%ymm1, %%ymm0, %%ymm0\n"
+	    "vpaddd %[y], %%ymm0, %%ymm0\n"
+	    "vpxor %%ymm0, %%ymm3, %%ymm3\n"
+	    "vpshufb %[r8], %%ymm3, %%ymm3\n"
+	    "vpaddd %%ymm3, %%ymm2, %%ymm2\n"
+	    "vpxor %%ymm2, %%ymm1, %%ymm1\n"
+	    AVX2_ROTR(ymm1, 7)
+	    "vmovdqa %%ymm0, %[a]\n"
+	    "vmovdqa %%ymm1, %[b]\n"
+	    "vmovdqa %%ymm2, %[c]\n"
+	    "vmovdqa %%ymm3, %[d]\n"
+	    : [a] "+m" (*a), [b] "+m" (*b), [c] "+m" (*c), [d] "+m" (*d)
+	    : [x] "m" (*x), [y] "m" (*y),
+	    [r16] "m" (blake3_rot16), [r8] "m" (blake3_rot8)
+	    : BLAKE3_G_CLOBBERS);
+}
+
+static void
+blake3_round_avx2(blake3_row_t v[16], const blake3_row_t m[16],
+    const uint8_t *s)
+{
+	BLAKE3_ROUND(blake3_g_avx2, v, m, s);
+}
+#endif /* HAVE_AVX && HAVE_AVX2 */
+
+/*
+ * AVX-512: 16 lanes, with native rotations
+ */
+#if defined(HAVE_AVX512F)
+static void
+blake3_g_avx512(blake3_row_t *a, blake3_row_t *b, blake3_row_t *c,
+    blake3_row_t *d, const blake3_row_t *x, const blake3_row_t *y)
+{
+	asm volatile(
+	    "vmovdqa32 %[a], %%zmm0\n"
+	    "vmovdqa32 %[b], %%zmm1\n"
+	    "vmovdqa32 %[c], %%zmm2\n"
+	    "vmovdqa32 %[d], %%zmm3\n"
+	    "vpaddd %%zmm1, %%zmm0, %%zmm0\n"
+	    "vpaddd %[x], %%zmm0, %%zmm0\n"
+	    "vpxord %%zmm0, %%zmm3, %%zmm3\n"
+	    "vprord $16, %%zmm3, %%zmm3\n"
+	    "vpaddd %%zmm3, %%zmm2, %%zmm2\n"
+	    "vpxord %%zmm2, %%zmm1, %%zmm1\n"
+	    "vprord $12, %%zmm1, %%zmm1\n"
+	    "vpaddd %%zmm1, %%zmm0, %%zmm0\n"
+	    "vpaddd %[y], %%zmm0, %%zmm0\n"
+	    "vpxord %%zmm0, %%zmm3, %%zmm3\n"
+	    "vprord $8, %%zmm3, %%zmm3\n"
+	    "vpaddd %%zmm3, %%zmm2, %%zmm2\n"
+	    "vpxord %%zmm2, %%zmm1, %%zmm1\n"
+	    "vprord $7, %%zmm1, %%zmm1\n"
+	    "vmovdqa32 %%zmm0, %[a]\n"
+	    "vmovdqa32 %%zmm1, %[b]\n"
+	    "vmovdqa32 %%zmm2, %[c]\n"
+	    "vmovdqa32 %%zmm3, %[d]\n"
+	    BLAKE3_G_OPERANDS);
+}
+
+static void
+blake3_round_avx512(blake3_row_t v[16], const blake3_row_t m[16],
+    const uint8_t *s)
+{
+	BLAKE3_ROUND(blake3_g_avx512, v, m, s);
+}
+#endif /* HAVE_AVX512F */
+
+/*
+ * Hash exactly lanes inputs of blocks blocks each.  The transposed message
+ * is provided by the caller to keep the frame size of each function in
+ * check.
+ */
+noinline static void
+blake3_hash_group(size_t lanes, blake3_round_f round, blake3_row_t m[16],
+    const uint8_t * const *inputs, size_t blocks, const uint32_t key[8],
+    uint64_t counter, boolean_t increment_counter, uint8_t flags,
+    uint8_t flags_start, uint8_t flags_end, uint8_t *out)
+{
+	blake3_row_t v[16];
+	uint8_t block_flags = flags | flags_start;
+	size_t i, j, b, r;
+
+	/* the chaining values live in rows 0-7 between blocks */
+	for (i = 0; i < 8; i++)
+		for (j = 0; j < lanes; j++)
+			v[i].w[j] = key[i];
+
+	for (b = 0; b < blocks; b++) {
+		if (b + 1 == blocks)
+			block_flags |= flags_end;
+
+		for (i = 0; i < 16; i++) {
+			for (j = 0; j < lanes; j++) {
+				m[i].w[j] = blake3_load32(
+				    &inputs[j][b * BLAKE3_BLOCK_LEN + i * 4]);
+			}
+		}
+
+		for (j = 0; j < lanes; j++) {
+			uint64_t ctr = counter + (increment_counter ? j : 0);
+
+			for (i = 0; i < 4; i++)
+				v[i + 8].w[j] = blake3_iv[i];
+			v[12].w[j] = (uint32_t)ctr;
+			v[13].w[j] = (uint32_t)(ctr >> 32);
+			v[14].w[j] = BLAKE3_BLOCK_LEN;
+			v[15].w[j] = block_flags;
+		}
+
+		for (r = 0; r < 7; r++)
+			round(v, m, blake3_msg_schedule[r]);
+
+		for (i = 0; i < 8; i++)
+			for (j = 0; j < lanes; j++)
+				v[i].w[j] ^= v[i + 8].w[j];
+
+		block_flags = flags;
+	}
+
+	for (j = 0; j < lanes; j++)
+		for (i = 0; i < 8; i++)
+			blake3_store32(&out[j * BLAKE3_OUT_LEN + i * 4],
+			    v[i].w[j]);
+}
+
+typedef struct blake3_simd_step {
+	size_t lanes;
+	blake3_round_f round;
+} blake3_simd_step_t;
+
+/*
+ * Hash as many inputs as possible with each step in turn, from the
+ * widest to the narrowest, and leave the rest to the generic code.
+ */
+static void
+blake3_hash_many_x86(const blake3_simd_step_t *steps, size_t nsteps,
+    boolean_t avx, const uint8_t * const *inputs, size_t num_inputs,
+    size_t blocks, const uint32_t key[8], uint64_t counter,
+    boolean_t increment_counter, uint8_t flags, uint8_t flags_start,
+    uint8_t flags_end, uint8_t *out)
+{
+	blake3_row_t m[16];
+
+	kfpu_begin();
+	for (size_t s = 0; s < nsteps; s++) {
+		size_t lanes = steps[s].lanes;
+
+		while (num_inputs >= lanes) {
+			blake3_hash_group(lanes, steps[s].round, m, inputs,
+			    blocks, key, counter, increment_counter, flags,
+			    flags_start, flags_end, out);
+			if (increment_counter)
+				counter += lanes;
+			inputs += lanes;
+			num_inputs -= lanes;
+			out = &out[lanes * BLAKE3_OUT_LEN];
+		}
+	}
+	if (avx)
+		asm volatile("vzeroupper");
+	kfpu_end();
+
+	blake3_generic_impl.hash_many(inputs, num_inputs, blocks, key,
+	    counter, increment_counter, flags, flags_start, flags_end, out);
+}
+
+/*
+ * Single blocks are compressed with the generic code, only hash_many()
+ * benefits from the wider registers.
+ */
+static void
+blake3_compress_in_place_x86(uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+    uint64_t counter, uint8_t flags)
+{
+	blake3_generic_impl.compress_in_place(cv, block, block_len, counter,
+	    flags);
+}
+
+static void
+blake3_compress_xof_x86(const uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+    uint64_t counter, uint8_t flags, uint8_t out[64])
+{
+	blake3_generic_impl.compress_xof(cv, block, block_len, counter, flags,
+	    out);
+}
+
+/* The steps of the wider implementations, the 4-lane one comes last */
+#if defined(HAVE_SSSE3) && defined(HAVE_SSE4_1)
+#define	BLAKE3_STEP_4	{ 4, blake3_round_sse41 }
+#else
+#define	BLAKE3_STEP_4	{ 4, blake3_round_sse2 }
+#endif
+#define	BLAKE3_STEP_8	{ 8, blake3_round_avx2 }
+#define	BLAKE3_STEP_16	{ 16, blake3_round_avx512 }
+
+#define	BLAKE3_DEFINE_HASH_MANY(impl, avx, ...)				\
+static void								\
+blake3_hash_many_##impl(const uint8_t * const *inputs,			\
+    size_t num_inputs, size_t blocks, const uint32_t key[8],		\
+    uint64_t counter, boolean_t increment_counter, uint8_t flags,	\
+    uint8_t flags_start, uint8_t flags_end, uint8_t *out)		\
+{									\
+	static const blake3_simd_step_t steps[] = { __VA_ARGS__ };	\
+									\
+	blake3_hash_many_x86(steps, ARRAY_SIZE(steps), avx, inputs,	\
+	    num_inputs, blocks, key, counter, increment_counter, flags,	\
+	    flags_start, flags_end, out);				\
+}
+
+BLAKE3_DEFINE_HASH_MANY(sse2, B_FALSE, { 4, blake3_round_sse2 })
+
+static boolean_t
+blake3_is_sse2_supported(void)
+{
+	return (kfpu_allowed() && zfs_sse2_available());
+}
+
+const blake3_impl_ops_t blake3_sse2_impl = {
+	.compress_in_place = blake3_compress_in_place_x86,
+	.compress_xof = blake3_compress_xof_x86,
+	.hash_many = blake3_hash_many_sse2,
+	.is_supported = blake3_is_sse2_supported,
+	.degree = 4,
+	.name = "sse2"
+};
+
+#if defined(HAVE_SSSE3) && defined(HAVE_SSE4_1)
+BLAKE3_DEFINE_HASH_MANY(sse41, B_FALSE, { 4, blake3_round_sse41 })
+
+static boolean_t
+blake3_is_sse41_supported(void)
+{
+	return (kfpu_allowed() && zfs_sse2_available() &&
+	    zfs_ssse3_available() && zfs_sse4_1_available());
+}
+
+const blake3_impl_ops_t blake3_sse41_impl = {
+	.compress_in_place = blake3_compress_in_place_x86,
+	.compress_xof = blake3_compress_xof_x86,
+	.hash_many = blake3_hash_many_sse41,
+	.is_supported = blake3_is_sse41_supported,
+	.degree = 4,
+	.name = "sse41"
+};
+#endif /* HAVE_SSSE3 && HAVE_SSE4_1 */
+
+#if defined(HAVE_AVX) && defined(HAVE_AVX2)
+BLAKE3_DEFINE_HASH_MANY(avx2, B_TRUE, BLAKE3_STEP_8, BLAKE3_STEP_4)
+
+static boolean_t
+blake3_is_avx2_supported(void)
+{
+	return (kfpu_allowed() && zfs_avx_available() &&
+	    zfs_avx2_available() && zfs_ssse3_available() &&
+	    zfs_sse4_1_available());
+}
+
+const blake3_impl_ops_t blake3_avx2_impl = {
+	.compress_in_place = blake3_compress_in_place_x86,
+	.compress_xof = blake3_compress_xof_x86,
+	.hash_many = blake3_hash_many_avx2,
+	.is_supported = blake3_is_avx2_supported,
+	.degree = 8,
+	.name = "avx2"
+};
+#endif /* HAVE_AVX && HAVE_AVX2 */
+
+#if defined(HAVE_AVX512F)
+#if defined(HAVE_AVX) && defined(HAVE_AVX2)
+BLAKE3_DEFINE_HASH_MANY(avx512, B_TRUE, BLAKE3_STEP_16, BLAKE3_STEP_8,
+    BLAKE3_STEP_4)
+#else
+BLAKE3_DEFINE_HASH_MANY(avx512, B_TRUE, BLAKE3_STEP_16, BLAKE3_STEP_4)
+#endif
+
+static boolean_t
+blake3_is_avx512_supported(void)
+{
+	return (kfpu_allowed() && zfs_avx512f_available() &&
+	    zfs_avx2_available() && zfs_ssse3_available() &&
+	    zfs_sse4_1_available());
+}
+
+const blake3_impl_ops_t blake3_avx512_impl = {
+	.compress_in_place = blake3_compress_in_place_x86,
+	.compress_xof = blake3_compress_xof_x86,
+	.hash_many = blake3_hash_many_avx512,
+	.is_supported = blake3_is_avx512_supported,
+	.degree = 16,
+	.name = "avx512"
+};
+#endif /* HAVE_AVX512F */
+
+#endif /* __x86_64 && HAVE_SSE2 */
@@ -0,0 +1,522 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#define	_SHA2_IMPL
+#include <sys/sha2.h>
+#include <sha2/sha2_impl.h>
+
+/* All compiled in SHA-256 implementations */
+static const sha2_impl_ops_t *sha256_all_impl[] = {
+	&sha256_generic_impl,
+#if defined(__x86_64)
+	&sha256_x86_64_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_SHA_NI) && defined(HAVE_SSSE3) && \
+	defined(HAVE_SSE4_1)
+	&sha256_shani_impl,
+#endif
+};
+
+/* All compiled in SHA-384/512 implementations */
+static const sha2_impl_ops_t *sha512_all_impl[] = {
+	&sha512_generic_impl,
+#if defined(__x86_64)
+	&sha512_x86_64_impl,
+#endif
+};
+
+#define	SHA2_IMPL_MAX	(MAX(ARRAY_SIZE(sha256_all_impl),		\
+	ARRAY_SIZE(sha512_all_impl)))
+
+/* Select SHA2 implementation */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX-1)
+
+#define	SHA2_IMPL_READ(i) (*(volatile uint32_t *) &(i))
+
+/*
+ * SHA-256 and SHA-384/512 have separate sets of implementations, each
+ * selected and benchmarked on its own.
+ */
+typedef struct sha2_impl_sel {
+	uint64_t mech;
+	const sha2_impl_ops_t **all_impl;
+	size_t all_impl_cnt;
+
+	/* Implementation used when SIMD is not allowed */
+	const sha2_impl_ops_t *integer_impl;
+
+	/* Implementation that contains the fastest methods */
+	sha2_impl_ops_t fastest_impl;
+
+	/* Hold all supported implementations */
+	size_t supp_impl_cnt;
+	const sha2_impl_ops_t *supp_impl[SHA2_IMPL_MAX];
+
+	uint32_t icp_impl;
+	uint32_t user_sel_impl;
+	size_t cycle_impl_idx;
+
+	/* Indicate that benchmark has been completed */
+	boolean_t initialized;
+
+#if defined(_KERNEL)
+	kstat_t *kstat;
+
+	/* Throughput of each supported implementation in B/s */
+	uint64_t stat_data[SHA2_IMPL_MAX + 1];
+	uint32_t fastest_id;
+#endif
+} sha2_impl_sel_t;
+
+#if defined(__x86_64)
+#define	SHA256_INTEGER_IMPL	(&sha256_x86_64_impl)
+#define	SHA512_INTEGER_IMPL	(&sha512_x86_64_impl)
+#else
+#define	SHA256_INTEGER_IMPL	(&sha256_generic_impl)
+#define	SHA512_INTEGER_IMPL	(&sha512_generic_impl)
+#endif
+
+static sha2_impl_sel_t sha256_sel = {
+	.mech = SHA256_MECH_INFO_TYPE,
+	.all_impl = sha256_all_impl,
+	.all_impl_cnt = ARRAY_SIZE(sha256_all_impl),
+	.integer_impl = SHA256_INTEGER_IMPL,
+	.icp_impl = IMPL_FASTEST,
+	.user_sel_impl = IMPL_FASTEST,
+};
+
+static sha2_impl_sel_t sha512_sel = {
+	.mech = SHA512_MECH_INFO_TYPE,
+	.all_impl = sha512_all_impl,
+	.all_impl_cnt = ARRAY_SIZE(sha512_all_impl),
+	.integer_impl = SHA512_INTEGER_IMPL,
+	.icp_impl = IMPL_FASTEST,
+	.user_sel_impl = IMPL_FASTEST,
+};
+
+/*
+ * Returns the SHA2 operations.  When a SIMD implementation is not
+ * allowed in the current context, or before the implementations have
+ * been initialized, fallback to the integer one.
+ */
+static const sha2_impl_ops_t *
+sha2_impl_get_ops(sha2_impl_sel_t *sel)
+{
+	if (!kfpu_allowed())
+		return (sel->integer_impl);
+
+	const sha2_impl_ops_t *ops = NULL;
+	const uint32_t impl = SHA2_IMPL_READ(sel->icp_impl);
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		if (!sel->initialized)
+			return (sel->integer_impl);
+		ops = &sel->fastest_impl;
+		break;
+	case IMPL_CYCLE:
+		/* Cycle through supported implementations */
+		if (!sel->initialized)
+			return (sel->integer_impl);
+		ASSERT3U(sel->supp_impl_cnt, >, 0);
+		size_t idx = (++sel->cycle_impl_idx) % sel->supp_impl_cnt;
+		ops = sel->supp_impl[idx];
+		break;
+	default:
+		ASSERT3U(impl, <, sel->supp_impl_cnt);
+		ASSERT3U(sel->supp_impl_cnt, >, 0);
+		if (impl < sel->supp_impl_cnt)
+			ops = sel->supp_impl[impl];
+		break;
+	}
+
+	ASSERT3P(ops, !=, NULL);
+
+	return (ops);
+}
+
+const sha2_impl_ops_t *
+sha256_impl_get_ops(void)
+{
+	return (sha2_impl_get_ops(&sha256_sel));
+}
+
+const sha2_impl_ops_t *
+sha512_impl_get_ops(void)
+{
+	return (sha2_impl_get_ops(&sha512_sel));
+}
+
+#if defined(_KERNEL)
+/*
+ * SHA2 kstats
+ */
+static int
+sha2_kstat_headers(char *buf, size_t size)
+{
+	(void) snprintf(buf, size, "%-17s%-15s\n", "implementation", "B/s");
+
+	return (0);
+}
+
+static int
+sha2_kstat_data(sha2_impl_sel_t *sel, char *buf, size_t size, void *data)
+{
+	uint64_t *curr_stat = (uint64_t *)data;
+	ptrdiff_t id = curr_stat - sel->stat_data;
+
+	if (id == sel->supp_impl_cnt) {
+		(void) snprintf(buf, size, "%-17s%-15s\n", "fastest",
+		    sel->supp_impl[sel->fastest_id]->name);
+	} else {
+		(void) snprintf(buf, size, "%-17s%-15llu\n",
+		    sel->supp_impl[id]->name, (u_longlong_t)*curr_stat);
+	}
+
+	return (0);
+}
+
+static void *
+sha2_kstat_addr(sha2_impl_sel_t *sel, kstat_t *ksp, loff_t n)
+{
+	if (n <= sel->supp_impl_cnt)
+		ksp->ks_private = (void *) (sel->stat_data + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+static int
+sha256_kstat_data(char *buf, size_t size, void *data)
+{
+	return (sha2_kstat_data(&sha256_sel, buf, size, data));
+}
+
+static void *
+sha256_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	return (sha2_kstat_addr(&sha256_sel, ksp, n));
+}
+
+static int
+sha512_kstat_data(char *buf, size_t size, void *data)
+{
+	return (sha2_kstat_data(&sha512_sel, buf, size, data));
+}
+
+static void *
+sha512_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	return (sha2_kstat_addr(&sha512_sel, ksp, n));
+}
+
+#define	SHA2_BENCH_NS	(MSEC2NSEC(50))		/* 50ms */
+
+/*
+ * Measure the throughput of each supported implementation on a 128KiB
+ * buffer, and make the best one the "fastest".
+ */
+static void
+sha2_benchmark(sha2_impl_sel_t *sel)
+{
+	static const size_t data_size = 1 << SPA_OLD_MAXBLOCKSHIFT;
+	uint8_t digest[SHA512_DIGEST_LENGTH];
+	uint64_t run_bw, run_time_ns, best_run = 0;
+	SHA2_CTX *ctx;
+	hrtime_t start;
+	uint8_t *databuf;
+	size_t i;
+
+	databuf = vmem_alloc(data_size, KM_SLEEP);
+	ctx = kmem_alloc(sizeof (*ctx), KM_SLEEP);
+
+	for (i = 0; i < data_size / sizeof (uint64_t); i++)
+		((uint64_t *)databuf)[i] = (uintptr_t)(databuf+i); /* warm-up */
+
+	for (i = 0; i < sel->supp_impl_cnt; i++) {
+		uint64_t run_count = 0;
+
+		/* temporarily set an implementation */
+		sel->icp_impl = i;
+
+		kpreempt_disable();
+		start = gethrtime();
+		do {
+			for (int l = 0; l < 4; l++, run_count++) {
+				SHA2Init(sel->mech, ctx);
+				SHA2Update(ctx, databuf, data_size);
+				SHA2Final(digest, ctx);
+			}
+
+			run_time_ns = gethrtime() - start;
+		} while (run_time_ns < SHA2_BENCH_NS);
+		kpreempt_enable();
+
+		run_bw = data_size * run_count * NANOSEC;
+		run_bw /= run_time_ns;	/* B/s */
+		sel->stat_data[i] = run_bw;
+
+		if (run_bw > best_run) {
+			best_run = run_bw;
+			sel->fastest_id = i;
+		}
+	}
+
+	kmem_free(ctx, sizeof (*ctx));
+	vmem_free(databuf, data_size);
+
+	memcpy(&sel->fastest_impl, sel->supp_impl[sel->fastest_id],
+	    sizeof (sel->fastest_impl));
+}
+#endif /* _KERNEL */
+
+/*
+ * Initialize and benchmark all supported implementations.
+ */
+static void
+sha2_impl_sel_init(sha2_impl_sel_t *sel)
+{
+	const sha2_impl_ops_t *curr_impl;
+	int i, c;
+
+	/* Move supported implementations into supp_impl */
+	for (i = 0, c = 0; i < sel->all_impl_cnt; i++) {
+		curr_impl = sel->all_impl[i];
+
+		if (curr_impl->is_supported())
+			sel->supp_impl[c++] = curr_impl;
+	}
+	sel->supp_impl_cnt = c;
+
+#if defined(_KERNEL)
+	sha2_benchmark(sel);
+#else
+	/*
+	 * Skip the benchmark in user space to avoid impacting libzpool
+	 * consumers (zdb, zhack, zinject, ztest).  The last implementation
+	 * is assumed to be the fastest and used by default.
+	 */
+	memcpy(&sel->fastest_impl, sel->supp_impl[sel->supp_impl_cnt - 1],
+	    sizeof (sel->fastest_impl));
+#endif /* _KERNEL */
+
+	strlcpy(sel->fastest_impl.name, "fastest", SHA2_IMPL_NAME_MAX);
+
+	/* Finish initialization */
+	atomic_swap_32(&sel->icp_impl, sel->user_sel_impl);
+	sel->initialized = B_TRUE;
+}
+
+void
+sha2_impl_init(void)
+{
+	sha2_impl_sel_init(&sha256_sel);
+	sha2_impl_sel_init(&sha512_sel);
+
+#if defined(_KERNEL)
+	/* Install kstats for all implementations */
+	sha256_sel.kstat = kstat_create("zfs", 0, "sha256_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (sha256_sel.kstat != NULL) {
+		sha256_sel.kstat->ks_data = NULL;
+		sha256_sel.kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(sha256_sel.kstat,
+		    sha2_kstat_headers,
+		    sha256_kstat_data,
+		    sha256_kstat_addr);
+		kstat_install(sha256_sel.kstat);
+	}
+
+	sha512_sel.kstat = kstat_create("zfs", 0, "sha512_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (sha512_sel.kstat != NULL) {
+		sha512_sel.kstat->ks_data = NULL;
+		sha512_sel.kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(sha512_sel.kstat,
+		    sha2_kstat_headers,
+		    sha512_kstat_data,
+		    sha512_kstat_addr);
+		kstat_install(sha512_sel.kstat);
+	}
+#endif
+}
+
+void
+sha2_impl_fini(void)
+{
+#if defined(_KERNEL)
+	if (sha256_sel.kstat != NULL) {
+		kstat_delete(sha256_sel.kstat);
+		sha256_sel.kstat = NULL;
+	}
+	if (sha512_sel.kstat != NULL) {
+		kstat_delete(sha512_sel.kstat);
+		sha512_sel.kstat = NULL;
+	}
+#endif
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} sha2_impl_opts[] = {
+		{ "cycle",	IMPL_CYCLE },
+		{ "fastest",	IMPL_FASTEST },
+};
+
+/*
+ * Function sets desired SHA2 implementation.
+ *
+ * If we are called before init(), user preference will be saved in
+ * user_sel_impl, and applied in later init() call. This occurs when module
+ * parameter is specified on module load. Otherwise, directly update
+ * icp_impl.
+ *
+ * @val		Name of SHA2 implementation to use
+ */
+static int
+sha2_impl_set(sha2_impl_sel_t *sel, const char *val)
+{
+	int err = -EINVAL;
+	char req_name[SHA2_IMPL_NAME_MAX];
+	uint32_t impl = SHA2_IMPL_READ(sel->user_sel_impl);
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(val, SHA2_IMPL_NAME_MAX);
+	if (i == 0 || i >= SHA2_IMPL_NAME_MAX)
+		return (err);
+
+	strlcpy(req_name, val, SHA2_IMPL_NAME_MAX);
+	while (i > 0 && isspace(req_name[i-1]))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(sha2_impl_opts); i++) {
+		if (strcmp(req_name, sha2_impl_opts[i].name) == 0) {
+			impl = sha2_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	/* check all supported impl if init() was already called */
+	if (err != 0 && sel->initialized) {
+		/* check all supported implementations */
+		for (i = 0; i < sel->supp_impl_cnt; i++) {
+			if (strcmp(req_name, sel->supp_impl[i]->name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (sel->initialized)
+			atomic_swap_32(&sel->icp_impl, impl);
+		else
+			atomic_swap_32(&sel->user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+int
+sha256_impl_set(const char *val)
+{
+	return (sha2_impl_set(&sha256_sel, val));
+}
+
+int
+sha512_impl_set(const char *val)
+{
+	return (sha2_impl_set(&sha512_sel, val));
+}
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(sha256_impl_set);
+EXPORT_SYMBOL(sha512_impl_set);
+#endif
+
+#if defined(_KERNEL) && defined(__linux__)
+
+static int
+sha2_impl_get(sha2_impl_sel_t *sel, char *buffer)
+{
+	int i, cnt = 0;
+	char *fmt;
+	const uint32_t impl = SHA2_IMPL_READ(sel->icp_impl);
+
+	ASSERT(sel->initialized);
+
+	/* list mandatory options */
+	for (i = 0; i < ARRAY_SIZE(sha2_impl_opts); i++) {
+		fmt = (impl == sha2_impl_opts[i].sel) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, sha2_impl_opts[i].name);
+	}
+
+	/* list all supported implementations */
+	for (i = 0; i < sel->supp_impl_cnt; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, sel->supp_impl[i]->name);
+	}
+
+	return (cnt);
+}
+
+static int
+icp_sha256_impl_set(const char *val, zfs_kernel_param_t *kp)
+{
+	return (sha256_impl_set(val));
+}
+
+static int
+icp_sha256_impl_get(char *buffer, zfs_kernel_param_t *kp)
+{
+	return (sha2_impl_get(&sha256_sel, buffer));
+}
+
+static int
+icp_sha512_impl_set(const char *val, zfs_kernel_param_t *kp)
+{
+	return (sha512_impl_set(val));
+}
+
+static int
+icp_sha512_impl_get(char *buffer, zfs_kernel_param_t *kp)
+{
+	return (sha2_impl_get(&sha512_sel, buffer));
+}
+
+module_param_call(icp_sha256_impl, icp_sha256_impl_set, icp_sha256_impl_get,
+    NULL, 0644);
+MODULE_PARM_DESC(icp_sha256_impl, "Select SHA-256 implementation.");
+
+module_param_call(icp_sha512_impl, icp_sha512_impl_set, icp_sha512_impl_get,
+    NULL, 0644);
+MODULE_PARM_DESC(icp_sha512_impl, "Select SHA-384/512 implementation.");
+#endif
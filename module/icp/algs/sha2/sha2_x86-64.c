@@ -0,0 +1,226 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#if defined(__x86_64)
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#define	_SHA2_IMPL
+#include <sys/sha2.h>
+#include <sha2/sha2_impl.h>
+
+/*
+ * Integer-only implementations from the OpenSSL assembly in
+ * asm-x86_64/sha2.  They don't touch the FPU, so they are also used when
+ * SIMD is not allowed in the current context.
+ */
+extern void SHA256TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
+extern void SHA512TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
+
+static boolean_t
+sha2_x86_64_is_supported(void)
+{
+	return (B_TRUE);
+}
+
+const sha2_impl_ops_t sha256_x86_64_impl = {
+	.transform = SHA256TransformBlocks,
+	.is_supported = sha2_x86_64_is_supported,
+	.name = "x86_64"
+};
+
+const sha2_impl_ops_t sha512_x86_64_impl = {
+	.transform = SHA512TransformBlocks,
+	.is_supported = sha2_x86_64_is_supported,
+	.name = "x86_64"
+};
+
+#if defined(HAVE_SHA_NI) && defined(HAVE_SSSE3) && defined(HAVE_SSE4_1)
+
+/* Byte shuffle converting big endian 32-bit words */
+static const uint8_t sha2_bswap32[16] __attribute__((aligned(16))) = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static const uint32_t sha256_k[64] __attribute__((aligned(16))) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*
+ * The kernel is built without SIMD support so the compiler never uses
+ * these registers, and it doesn't accept them as clobbers.  In user space
+ * they must be declared.
+ */
+#if defined(_KERNEL)
+#define	SHA256_NI_CLOBBERS	"memory"
+#else
+#define	SHA256_NI_CLOBBERS						\
+	"memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",	\
+	"xmm6", "xmm7", "xmm8", "xmm9", "xmm10"
+#endif
+
+/*
+ * Four rounds with the SHA extensions.  %xmm1 and %xmm2 hold the state as
+ * ABEF and CDGH, %xmm3-%xmm6 the last sixteen words of the message
+ * schedule, and %xmm0 is the implicit operand of sha256rnds2.
+ */
+#define	SHA256_NI_LOAD(m, off)						\
+	"movdqu " #off "(%[in]), %%xmm" #m "\n"				\
+	"pshufb %%xmm8, %%xmm" #m "\n"
+
+#define	SHA256_NI_RNDS(m, off)						\
+	"movdqa %%xmm" #m ", %%xmm0\n"					\
+	"paddd " #off "(%[k]), %%xmm0\n"				\
+	"sha256rnds2 %%xmm1, %%xmm2\n"					\
+	"pshufd $0x0e, %%xmm0, %%xmm0\n"				\
+	"sha256rnds2 %%xmm2, %%xmm1\n"
+
+/* Schedule the next four words into n, from p (oldest) to m */
+#define	SHA256_NI_MSG2(p, m, n)						\
+	"movdqa %%xmm" #m ", %%xmm7\n"					\
+	"palignr $4, %%xmm" #p ", %%xmm7\n"				\
+	"paddd %%xmm7, %%xmm" #n "\n"					\
+	"sha256msg2 %%xmm" #m ", %%xmm" #n "\n"
+
+#define	SHA256_NI_MSG1(p, m)						\
+	"sha256msg1 %%xmm" #m ", %%xmm" #p "\n"
+
+static void
+sha256_shani_transform(SHA2_CTX *ctx, const void *in, size_t num)
+{
+	if (num == 0)
+		return;
+
+	kfpu_begin();
+	asm volatile(
+	    /* load the state as ABEF and CDGH */
+	    "movdqu 0(%[state]), %%xmm1\n"
+	    "movdqu 16(%[state]), %%xmm2\n"
+	    "pshufd $0xb1, %%xmm1, %%xmm1\n"
+	    "pshufd $0x1b, %%xmm2, %%xmm2\n"
+	    "movdqa %%xmm1, %%xmm7\n"
+	    "palignr $8, %%xmm2, %%xmm1\n"
+	    "pblendw $0xf0, %%xmm7, %%xmm2\n"
+	    "movdqa %[bswap], %%xmm8\n"
+
+	    "1:\n"
+	    "movdqa %%xmm1, %%xmm9\n"
+	    "movdqa %%xmm2, %%xmm10\n"
+
+	    SHA256_NI_LOAD(3, 0)
+	    SHA256_NI_RNDS(3, 0)
+	    SHA256_NI_LOAD(4, 16)
+	    SHA256_NI_RNDS(4, 16)
+	    SHA256_NI_MSG1(3, 4)
+	    SHA256_NI_LOAD(5, 32)
+	    SHA256_NI_RNDS(5, 32)
+	    SHA256_NI_MSG1(4, 5)
+	    SHA256_NI_LOAD(6, 48)
+	    SHA256_NI_RNDS(6, 48)
+	    SHA256_NI_MSG2(5, 6, 3)
+	    SHA256_NI_MSG1(5, 6)
+
+	    SHA256_NI_RNDS(3, 64)
+	    SHA256_NI_MSG2(6, 3, 4)
+	    SHA256_NI_MSG1(6, 3)
+	    SHA256_NI_RNDS(4, 80)
+	    SHA256_NI_MSG2(3, 4, 5)
+	    SHA256_NI_MSG1(3, 4)
+	    SHA256_NI_RNDS(5, 96)
+	    SHA256_NI_MSG2(4, 5, 6)
+	    SHA256_NI_MSG1(4, 5)
+	    SHA256_NI_RNDS(6, 112)
+	    SHA256_NI_MSG2(5, 6, 3)
+	    SHA256_NI_MSG1(5, 6)
+
+	    SHA256_NI_RNDS(3, 128)
+	    SHA256_NI_MSG2(6, 3, 4)
+	    SHA256_NI_MSG1(6, 3)
+	    SHA256_NI_RNDS(4, 144)
+	    SHA256_NI_MSG2(3, 4, 5)
+	    SHA256_NI_MSG1(3, 4)
+	    SHA256_NI_RNDS(5, 160)
+	    SHA256_NI_MSG2(4, 5, 6)
+	    SHA256_NI_MSG1(4, 5)
+	    SHA256_NI_RNDS(6, 176)
+	    SHA256_NI_MSG2(5, 6, 3)
+	    SHA256_NI_MSG1(5, 6)
+
+	    SHA256_NI_RNDS(3, 192)
+	    SHA256_NI_MSG2(6, 3, 4)
+	    SHA256_NI_MSG1(6, 3)
+	    SHA256_NI_RNDS(4, 208)
+	    SHA256_NI_MSG2(3, 4, 5)
+	    SHA256_NI_RNDS(5, 224)
+	    SHA256_NI_MSG2(4, 5, 6)
+	    SHA256_NI_RNDS(6, 240)
+
+	    "paddd %%xmm9, %%xmm1\n"
+	    "paddd %%xmm10, %%xmm2\n"
+	    "add $64, %[in]\n"
+	    "dec %[num]\n"
+	    "jnz 1b\n"
+
+	    /* store the state back as ABCD and EFGH */
+	    "pshufd $0x1b, %%xmm1, %%xmm1\n"
+	    "pshufd $0xb1, %%xmm2, %%xmm2\n"
+	    "movdqa %%xmm1, %%xmm7\n"
+	    "pblendw $0xf0, %%xmm2, %%xmm1\n"
+	    "palignr $8, %%xmm7, %%xmm2\n"
+	    "movdqu %%xmm1, 0(%[state])\n"
+	    "movdqu %%xmm2, 16(%[state])\n"
+	    : [in] "+r" (in), [num] "+r" (num)
+	    : [state] "r" (ctx->state.s32), [k] "r" (sha256_k),
+	    [bswap] "m" (sha2_bswap32)
+	    : SHA256_NI_CLOBBERS);
+	kfpu_end();
+}
+
+static boolean_t
+sha256_shani_is_supported(void)
+{
+	return (kfpu_allowed() && zfs_shani_available() &&
+	    zfs_ssse3_available() && zfs_sse4_1_available());
+}
+
+const sha2_impl_ops_t sha256_shani_impl = {
+	.transform = sha256_shani_transform,
+	.is_supported = sha256_shani_is_supported,
+	.name = "shani"
+};
+#endif /* HAVE_SHA_NI && HAVE_SSSE3 && HAVE_SSE4_1 */
+
+#endif /* __x86_64 */
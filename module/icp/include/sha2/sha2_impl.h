@@ -57,6 +57,44 @@ typedef struct sha2_hmac_ctx {
 	SHA2_CTX		hc_ocontext;	/* outer SHA2 context */
 } sha2_hmac_ctx_t;
 
+/*
+ * Methods used to define a SHA-256 or SHA-512 implementation
+ *
+ * @transform		Compress num consecutive blocks into the state of ctx
+ * @is_supported	Whether the implementation works on this CPU
+ */
+typedef void (*sha2_transform_f)(SHA2_CTX *ctx, const void *in, size_t num);
+typedef boolean_t (*sha2_is_supported_f)(void);
+
+#define	SHA2_IMPL_NAME_MAX	(16)
+
+typedef struct sha2_impl_ops {
+	sha2_transform_f transform;
+	sha2_is_supported_f is_supported;
+	char name[SHA2_IMPL_NAME_MAX];
+} sha2_impl_ops_t;
+
+extern const sha2_impl_ops_t sha256_generic_impl;
+extern const sha2_impl_ops_t sha512_generic_impl;
+
+#if defined(__x86_64)
+extern const sha2_impl_ops_t sha256_x86_64_impl;
+extern const sha2_impl_ops_t sha512_x86_64_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_SHA_NI) && defined(HAVE_SSSE3) && \
+	defined(HAVE_SSE4_1)
+extern const sha2_impl_ops_t sha256_shani_impl;
+#endif
+
+/*
+ * Return the implementation to use for the next SHA-256 (or SHA-384/512)
+ * update.  Before sha2_impl_init() has run, or when SIMD is not allowed
+ * in the current context, an implementation using only integer
+ * registers is returned.
+ */
+extern const sha2_impl_ops_t *sha256_impl_get_ops(void);
+extern const sha2_impl_ops_t *sha512_impl_get_ops(void);
+
 #ifdef	__cplusplus
 }
 #endif
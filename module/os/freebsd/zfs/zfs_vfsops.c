@@ -1100,6 +1100,8 @@ zfsvfs_setup(zfsvfs_t *zfsvfs, boolean_t mounting)
 	dmu_objset_set_user(zfsvfs->z_os, zfsvfs);
 	mutex_exit(&zfsvfs->z_os->os_user_ptr_lock);
 
+	dataset_kstats_attach(&zfsvfs->z_kstat, zfsvfs->z_os);
+
 	return (0);
 }
 
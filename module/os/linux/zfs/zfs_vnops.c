@@ -417,6 +417,30 @@ mappedread(struct inode *ip, int nbytes, uio_t *uio)
 unsigned long zfs_read_chunk_size = 1024 * 1024; /* Tunable */
 unsigned long zfs_delete_blocks = DMU_MAX_DELETEBLKCNT;
 
+/*
+ * Returns B_TRUE if whole-block I/O to this file should bypass the ARC,
+ * as determined by the "direct" property and the O_DIRECT flag.  Files
+ * which are mmapped always use the buffered paths so that the page cache
+ * is kept coherent.
+ */
+static boolean_t
+zfs_direct_enabled(znode_t *zp, int ioflag)
+{
+	zfsvfs_t *zfsvfs = ZTOZSB(zp);
+
+	if (zp->z_is_mapped || !ISP2(zp->z_blksz))
+		return (B_FALSE);
+
+	switch (zfsvfs->z_os->os_direct) {
+	case ZFS_DIRECT_ALWAYS:
+		return (B_TRUE);
+	case ZFS_DIRECT_STANDARD:
+		return (!!(ioflag & O_DIRECT));
+	default:
+		return (B_FALSE);
+	}
+}
+
 /*
  * Read bytes from specified file into supplied buffer.
  *
@@ -501,6 +525,13 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 	ssize_t n = MIN(uio->uio_resid, zp->z_size - uio->uio_loffset);
 	ssize_t start_resid = n;
 
+	/*
+	 * Encrypted blocks must be decrypted through the ARC, so they are
+	 * never read directly.
+	 */
+	boolean_t direct = zfs_direct_enabled(zp, ioflag) &&
+	    !zfsvfs->z_os->os_encrypted;
+
 #ifdef HAVE_UIO_ZEROCOPY
 	xuio_t *xuio = NULL;
 	if ((uio->uio_extflg == UIO_XUIO) &&
@@ -539,6 +570,11 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 
 		if (zp->z_is_mapped && !(ioflag & O_DIRECT)) {
 			error = mappedread(ip, nbytes, uio);
+		} else if (direct && nbytes >= zp->z_blksz &&
+		    P2PHASE(uio->uio_loffset, zp->z_blksz) == 0) {
+			nbytes = P2ALIGN(nbytes, zp->z_blksz);
+			error = dmu_read_uio_direct(sa_get_db(zp->z_sa_hdl),
+			    uio, nbytes);
 		} else {
 			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
 			    uio, nbytes);
@@ -647,6 +683,16 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 	int max_blksz = zfsvfs->z_max_blksz;
 	xuio_t *xuio = NULL;
 
+	/*
+	 * Full-block Direct I/O writes are issued as soon as the data is
+	 * assigned to the dbuf, as children of 'dio'.  Deduplicated datasets
+	 * always take the buffered path so the DDT is updated in syncing
+	 * context.
+	 */
+	boolean_t direct = zfs_direct_enabled(zp, ioflag) &&
+	    zfsvfs->z_os->os_dedup_checksum == ZIO_CHECKSUM_OFF;
+	zio_t *dio = NULL;
+
 	/*
 	 * Pre-fault the pages to ensure slow (eg NFS) pages
 	 * don't hold up txg.
@@ -746,7 +792,7 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 			    aiov->iov_len == arc_buf_size(abuf)));
 			i_iov++;
 #endif
-		} else if (n >= max_blksz && woff >= zp->z_size &&
+		} else if (n >= max_blksz && (woff >= zp->z_size || direct) &&
 		    P2PHASE(woff, max_blksz) == 0 &&
 		    zp->z_blksz == max_blksz) {
 			/*
@@ -866,8 +912,20 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 				xuio_stat_wbuf_copied();
 			} else {
 				ASSERT(xuio || tx_bytes == max_blksz);
-				error = dmu_assign_arcbuf_by_dbuf(
-				    sa_get_db(zp->z_sa_hdl), woff, abuf, tx);
+				if (direct && xuio == NULL) {
+					if (dio == NULL) {
+						dio = zio_root(
+						    dmu_objset_spa(zfsvfs->z_os),
+						    NULL, NULL, ZIO_FLAG_CANFAIL);
+					}
+					error = dmu_write_direct_by_dbuf(dio,
+					    sa_get_db(zp->z_sa_hdl), woff, abuf,
+					    tx);
+				} else {
+					error = dmu_assign_arcbuf_by_dbuf(
+					    sa_get_db(zp->z_sa_hdl), woff,
+					    abuf, tx);
+				}
 				if (error != 0) {
 					dmu_return_arcbuf(abuf);
 					dmu_tx_commit(tx);
@@ -958,6 +1016,15 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 		}
 	}
 
+	/*
+	 * Direct I/O writes must be on disk before the range lock is dropped,
+	 * so that a later write to the same block cannot race with them.
+	 * A failed write is not reported here; the block is still dirty and
+	 * will be written again when its txg syncs.
+	 */
+	if (dio != NULL)
+		(void) zio_wait(dio);
+
 	zfs_inode_update(zp);
 	zfs_rangelock_exit(lr);
 
@@ -1018,6 +1085,220 @@ zfs_write_simple(znode_t *zp, const void *data, size_t len,
 	return (error);
 }
 
+/*
+ * Clone a range of one file into another file of the same file system,
+ * sharing the underlying blocks instead of copying the data; see
+ * dmu_brt_clone().  Both offsets must be aligned to the source's block
+ * size, and the length must be too unless the range ends at the source's
+ * end of file and covers the rest of the destination.
+ *
+ *	IN:	inzp	- znode of file to clone from
+ *		inoff	- offset to clone from
+ *		outzp	- znode of file to clone to
+ *		outoff	- offset to clone to
+ *		lenp	- number of bytes to clone
+ *		cr	- credentials of caller
+ *
+ *	OUT:	lenp	- number of bytes cloned; a range which starts at or
+ *			  past the source's end of file clones nothing
+ *
+ *	RETURN:	0 if success
+ *		error code if failure
+ *
+ * Timestamps:
+ *	outzp - ctime|mtime updated if byte count > 0
+ */
+int
+zfs_clone_range(znode_t *inzp, uint64_t inoff, znode_t *outzp,
+    uint64_t outoff, uint64_t *lenp, cred_t *cr)
+{
+	zfsvfs_t *zfsvfs = ZTOZSB(inzp);
+	zfs_locked_range_t *inlr, *outlr;
+	uint64_t len = *lenp, done = 0;
+	int error = 0;
+
+	*lenp = 0;
+	if (len == 0)
+		return (0);
+
+	/*
+	 * The VFS only clones within a single super block, and therefore
+	 * a single dataset.
+	 */
+	if (ZTOZSB(outzp) != zfsvfs)
+		return (SET_ERROR(EXDEV));
+
+	ZFS_ENTER(zfsvfs);
+	ZFS_VERIFY_ZP(inzp);
+	ZFS_VERIFY_ZP(outzp);
+
+	objset_t *os = zfsvfs->z_os;
+	zilog_t *zilog = zfsvfs->z_log;
+
+	/*
+	 * Blocks of encrypted datasets cannot be shared, since their
+	 * encryption parameters are tied to the object they belong to.
+	 */
+	if (!spa_feature_is_enabled(dmu_objset_spa(os),
+	    SPA_FEATURE_BLOCK_CLONING) || os->os_encrypted) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(EOPNOTSUPP));
+	}
+
+	if (zfs_is_readonly(zfsvfs)) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(EROFS));
+	}
+
+	if (outzp->z_pflags & (ZFS_IMMUTABLE | ZFS_READONLY | ZFS_APPENDONLY)) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(EPERM));
+	}
+
+	if (inzp == outzp && inoff < outoff + len && outoff < inoff + len) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(EINVAL));
+	}
+
+	/*
+	 * Lock the ranges in a consistent order, so that two clones in
+	 * opposite directions cannot deadlock.
+	 */
+	if (inzp->z_id < outzp->z_id ||
+	    (inzp->z_id == outzp->z_id && inoff < outoff)) {
+		inlr = zfs_rangelock_enter(&inzp->z_rangelock, inoff, len,
+		    RL_READER);
+		outlr = zfs_rangelock_enter(&outzp->z_rangelock, outoff, len,
+		    RL_WRITER);
+	} else {
+		outlr = zfs_rangelock_enter(&outzp->z_rangelock, outoff, len,
+		    RL_WRITER);
+		inlr = zfs_rangelock_enter(&inzp->z_rangelock, inoff, len,
+		    RL_READER);
+	}
+
+	uint64_t blksz = inzp->z_blksz;
+
+	if (inoff >= inzp->z_size)
+		goto unlock;
+	if (len > inzp->z_size - inoff)
+		len = inzp->z_size - inoff;
+
+	if (inoff % blksz != 0 || outoff % blksz != 0 || (len % blksz != 0 &&
+	    (inoff + len != inzp->z_size || outoff + len < outzp->z_size))) {
+		error = SET_ERROR(EINVAL);
+		goto unlock;
+	}
+
+	sa_bulk_attr_t bulk[3];
+	int count = 0;
+	uint64_t mtime[2], ctime[2];
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_MTIME(zfsvfs), NULL, &mtime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CTIME(zfsvfs), NULL, &ctime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_SIZE(zfsvfs), NULL,
+	    &outzp->z_size, 8);
+
+	/*
+	 * Each chunk is cloned in its own transaction, which is limited to
+	 * DMU_MAX_ACCESS like any other, and logged as a single record,
+	 * which must fit in a log block.
+	 */
+	size_t maxblocks = MIN(zil_max_log_data(zilog) / sizeof (blkptr_t),
+	    MAX(DMU_MAX_ACCESS / blksz, 1));
+	blkptr_t *bps = vmem_alloc(sizeof (blkptr_t) * maxblocks, KM_SLEEP);
+
+	while (len > 0) {
+		uint64_t size = MIN(len, maxblocks * blksz);
+		size_t nbps;
+
+		error = dmu_read_l0_bps(os, inzp->z_id, inoff, size, bps,
+		    &nbps);
+		if (error == EAGAIN) {
+			/*
+			 * Some of the source blocks are still dirty, so we
+			 * don't know where they will end up.  Wait for them
+			 * to be written; our range lock keeps them from
+			 * being dirtied again.
+			 */
+			txg_wait_synced(dmu_objset_pool(os), 0);
+			error = dmu_read_l0_bps(os, inzp->z_id, inoff, size,
+			    bps, &nbps);
+		}
+		if (error != 0)
+			break;
+
+		dmu_tx_t *tx = dmu_tx_create(os);
+		dmu_tx_hold_sa(tx, outzp->z_sa_hdl, B_FALSE);
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)sa_get_db(outzp->z_sa_hdl);
+		DB_DNODE_ENTER(db);
+		dmu_tx_hold_write_by_dnode(tx, DB_DNODE(db), outoff, size);
+		DB_DNODE_EXIT(db);
+		zfs_sa_upgrade_txholds(tx, outzp);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error != 0) {
+			dmu_tx_abort(tx);
+			break;
+		}
+
+		/*
+		 * A destination which is still a single block (e.g. a newly
+		 * created file) takes on the source's block size.
+		 */
+		if (outzp->z_blksz < blksz)
+			zfs_grow_blocksize(outzp, blksz, tx);
+		if (outzp->z_blksz != blksz) {
+			dmu_tx_commit(tx);
+			error = SET_ERROR(EINVAL);
+			break;
+		}
+
+		dmu_brt_clone(os, outzp->z_id, outoff, size, tx, bps, nbps);
+
+		zfs_tstamp_update_setup(outzp, CONTENT_MODIFIED, mtime, ctime);
+
+		/*
+		 * Update the file size (zp_size) if it has changed;
+		 * account for possible concurrent updates.
+		 */
+		uint64_t end_size;
+		while ((end_size = outzp->z_size) < outoff + size) {
+			(void) atomic_cas_64(&outzp->z_size, end_size,
+			    outoff + size);
+		}
+
+		error = sa_bulk_update(outzp->z_sa_hdl, bulk, count, tx);
+
+		zfs_log_clone_range(zilog, tx, TX_CLONE_RANGE, outzp, outoff,
+		    size, blksz, bps, nbps);
+		dmu_tx_commit(tx);
+
+		if (error != 0)
+			break;
+
+		inoff += size;
+		outoff += size;
+		len -= size;
+		done += size;
+	}
+
+	vmem_free(bps, sizeof (blkptr_t) * maxblocks);
+
+	if (done > 0) {
+		zfs_inode_update(outzp);
+		if (os->os_sync == ZFS_SYNC_ALWAYS)
+			zil_commit(zilog, outzp->z_id);
+		error = 0;
+	}
+
+unlock:
+	zfs_rangelock_exit(outlr);
+	zfs_rangelock_exit(inlr);
+
+	*lenp = done;
+	ZFS_EXIT(zfsvfs);
+	return (error);
+}
+
 /*
  * Drop a reference on the passed inode asynchronously. This ensures
  * that the caller will never drop the last reference on an inode in
@@ -814,6 +814,90 @@ zpl_fallocate(struct file *filp, int mode, loff_t offset, loff_t len)
 	    mode, offset, len);
 }
 
+#if defined(HAVE_VFS_REMAP_FILE_RANGE) || defined(HAVE_VFS_CLONE_FILE_RANGE)
+/*
+ * Clone a file range for FICLONE, FICLONERANGE and, since 4.20, for
+ * copy_file_range(2) within a file system.  A length of zero means up to
+ * the end of the source file.  Returns the number of bytes cloned.
+ */
+static loff_t
+zpl_clone_file_range_common(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, uint64_t len)
+{
+	struct inode *src_ip = file_inode(src_file);
+	struct inode *dst_ip = file_inode(dst_file);
+	cred_t *cr = CRED();
+	fstrans_cookie_t cookie;
+	uint64_t cloned;
+	int error;
+
+	if (src_off < 0 || dst_off < 0)
+		return (-EINVAL);
+
+	if (len == 0) {
+		loff_t src_size = i_size_read(src_ip);
+
+		if (src_off >= src_size)
+			return (0);
+		len = src_size - src_off;
+	}
+
+	/*
+	 * Pages dirtied through mmap(2) are not known to the DMU until they
+	 * are written back, so flush both ranges first.
+	 */
+	error = filemap_write_and_wait_range(src_ip->i_mapping, src_off,
+	    src_off + len - 1);
+	if (error == 0) {
+		error = filemap_write_and_wait_range(dst_ip->i_mapping,
+		    dst_off, dst_off + len - 1);
+	}
+	if (error != 0)
+		return (error);
+
+	crhold(cr);
+	cookie = spl_fstrans_mark();
+	cloned = len;
+	error = -zfs_clone_range(ITOZ(src_ip), src_off, ITOZ(dst_ip), dst_off,
+	    &cloned, cr);
+	spl_fstrans_unmark(cookie);
+	crfree(cr);
+
+	if (cloned > 0) {
+		(void) invalidate_inode_pages2_range(dst_ip->i_mapping,
+		    dst_off >> PAGE_SHIFT, (dst_off + cloned - 1) >> PAGE_SHIFT);
+	}
+
+	return (error != 0 ? error : cloned);
+}
+#endif
+
+#ifdef HAVE_VFS_REMAP_FILE_RANGE
+static loff_t
+zpl_remap_file_range(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, loff_t len, unsigned int flags)
+{
+	/* FIDEDUPERANGE is not supported. */
+	if (flags & ~REMAP_FILE_CAN_SHORTEN)
+		return (-EOPNOTSUPP);
+
+	return (zpl_clone_file_range_common(src_file, src_off, dst_file,
+	    dst_off, len));
+}
+#elif defined(HAVE_VFS_CLONE_FILE_RANGE)
+static int
+zpl_clone_file_range(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, u64 len)
+{
+	loff_t cloned;
+
+	cloned = zpl_clone_file_range_common(src_file, src_off, dst_file,
+	    dst_off, len);
+
+	return (cloned < 0 ? cloned : 0);
+}
+#endif
+
 #define	ZFS_FL_USER_VISIBLE	(FS_FL_USER_VISIBLE | ZFS_PROJINHERIT_FL)
 #define	ZFS_FL_USER_MODIFIABLE	(FS_FL_USER_MODIFIABLE | ZFS_PROJINHERIT_FL)
 
@@ -1049,6 +1133,11 @@ const struct file_operations zpl_file_operations = {
 	.aio_fsync	= zpl_aio_fsync,
 #endif
 	.fallocate	= zpl_fallocate,
+#if defined(HAVE_VFS_REMAP_FILE_RANGE)
+	.remap_file_range	= zpl_remap_file_range,
+#elif defined(HAVE_VFS_CLONE_FILE_RANGE)
+	.clone_file_range	= zpl_clone_file_range,
+#endif
 	.unlocked_ioctl	= zpl_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl	= zpl_compat_ioctl,
@@ -589,6 +589,51 @@ zpool_feature_init(void)
 	    "zstd compression algorithm support.",
 	    ZFEATURE_FLAG_PER_DATASET, ZFEATURE_TYPE_BOOLEAN, zstd_deps);
 	}
+
+	zfeature_register(SPA_FEATURE_BLOCK_CLONING,
+	    "org.openzfs:block_cloning", "block_cloning",
+	    "Support for block cloning via the block reference table.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, ZFEATURE_TYPE_BOOLEAN, NULL);
+
+	zfeature_register(SPA_FEATURE_DRAID,
+	    "org.openzfs:draid", "draid",
+	    "Support for distributed parity RAID.",
+	    ZFEATURE_FLAG_MOS, ZFEATURE_TYPE_BOOLEAN, NULL);
+
+	zfeature_register(SPA_FEATURE_RAIDZ_EXPANSION,
+	    "org.openzfs:raidz_expansion", "raidz_expansion",
+	    "Support for raidz expansion.",
+	    ZFEATURE_FLAG_MOS, ZFEATURE_TYPE_BOOLEAN, NULL);
+
+	{
+	static const spa_feature_t blake3_deps[] = {
+		SPA_FEATURE_EXTENSIBLE_DATASET,
+		SPA_FEATURE_NONE
+	};
+	zfeature_register(SPA_FEATURE_BLAKE3,
+	    "org.openzfs:blake3", "blake3",
+	    "BLAKE3 hash algorithm.",
+	    ZFEATURE_FLAG_PER_DATASET, ZFEATURE_TYPE_BOOLEAN,
+	    blake3_deps);
+	}
+
+	{
+	static const spa_feature_t lz4_levels_deps[] = {
+		SPA_FEATURE_EXTENSIBLE_DATASET,
+		SPA_FEATURE_LZ4_COMPRESS,
+		SPA_FEATURE_NONE
+	};
+	zfeature_register(SPA_FEATURE_LZ4_LEVELS,
+	    "org.openzfs:lz4_levels", "lz4_levels",
+	    "lz4 compression levels.",
+	    ZFEATURE_FLAG_PER_DATASET, ZFEATURE_TYPE_BOOLEAN,
+	    lz4_levels_deps);
+	}
+
+	zfeature_register(SPA_FEATURE_DDT_LOG,
+	    "org.openzfs:ddt_log", "ddt_log",
+	    "Log-structured updates to the dedup table.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, ZFEATURE_TYPE_BOOLEAN, NULL);
 }
 
 #if defined(_KERNEL)
@@ -87,6 +87,7 @@ zfs_prop_init(void)
 
 		{ "edonr",	ZIO_CHECKSUM_EDONR },
 #endif
+		{ "blake3",	ZIO_CHECKSUM_BLAKE3 },
 		{ NULL }
 	};
 
@@ -108,6 +109,9 @@ zfs_prop_init(void)
 		{ "edonr,verify",
 				ZIO_CHECKSUM_EDONR | ZIO_CHECKSUM_VERIFY },
 #endif
+		{ "blake3",	ZIO_CHECKSUM_BLAKE3 },
+		{ "blake3,verify",
+				ZIO_CHECKSUM_BLAKE3 | ZIO_CHECKSUM_VERIFY },
 		{ NULL }
 	};
 
@@ -208,6 +212,57 @@ zfs_prop_init(void)
 		    ZIO_COMPLEVEL_ZSTD(ZIO_ZSTD_LEVEL_FAST_500) },
 		{ "zstd-fast-1000",
 		    ZIO_COMPLEVEL_ZSTD(ZIO_ZSTD_LEVEL_FAST_1000) },
+
+		/*
+		 * The LZ4 levels are synthetic as well.  They only change how
+		 * blocks are compressed, so unlike zstd the level isn't kept
+		 * in the compressed block.
+		 */
+		{ "lz4-1",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_1) },
+		{ "lz4-2",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_2) },
+		{ "lz4-3",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_3) },
+		{ "lz4-4",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_4) },
+		{ "lz4-5",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_5) },
+		{ "lz4-6",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_6) },
+		{ "lz4-7",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_7) },
+		{ "lz4-8",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_8) },
+		{ "lz4-9",	ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_9) },
+		{ "lz4-fast-2",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_2) },
+		{ "lz4-fast-3",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_3) },
+		{ "lz4-fast-4",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_4) },
+		{ "lz4-fast-5",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_5) },
+		{ "lz4-fast-6",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_6) },
+		{ "lz4-fast-7",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_7) },
+		{ "lz4-fast-8",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_8) },
+		{ "lz4-fast-9",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_9) },
+		{ "lz4-fast-10",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_10) },
+		{ "lz4-fast-20",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_20) },
+		{ "lz4-fast-30",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_30) },
+		{ "lz4-fast-40",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_40) },
+		{ "lz4-fast-50",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_50) },
+		{ "lz4-fast-60",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_60) },
+		{ "lz4-fast-70",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_70) },
+		{ "lz4-fast-80",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_80) },
+		{ "lz4-fast-90",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_90) },
+		{ "lz4-fast-100",
+		    ZIO_COMPLEVEL_LZ4(ZIO_LZ4_LEVEL_FAST_100) },
 		{ NULL }
 	};
 
@@ -348,6 +403,13 @@ zfs_prop_init(void)
 		{ NULL }
 	};
 
+	static zprop_index_t direct_table[] = {
+		{ "disabled",	ZFS_DIRECT_DISABLED },
+		{ "standard",	ZFS_DIRECT_STANDARD },
+		{ "always",	ZFS_DIRECT_ALWAYS },
+		{ NULL }
+	};
+
 	static zprop_index_t xattr_table[] = {
 		{ "off",	ZFS_XATTR_OFF },
 		{ "on",		ZFS_XATTR_DIR },
@@ -392,29 +454,35 @@ zfs_prop_init(void)
 	    PROP_INHERIT, ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
 	    "standard | always | disabled", "SYNC",
 	    sync_table);
+	zprop_register_index(ZFS_PROP_DIRECT, "direct", ZFS_DIRECT_STANDARD,
+	    PROP_INHERIT, ZFS_TYPE_FILESYSTEM,
+	    "disabled | standard | always", "DIRECT",
+	    direct_table);
 	zprop_register_index(ZFS_PROP_CHECKSUM, "checksum",
 	    ZIO_CHECKSUM_DEFAULT, PROP_INHERIT, ZFS_TYPE_FILESYSTEM |
 	    ZFS_TYPE_VOLUME,
 #if !defined(__FreeBSD__)
 	    "on | off | fletcher2 | fletcher4 | sha256 | sha512 | skein"
-	    " | edonr",
+	    " | edonr | blake3",
 #else
-	    "on | off | fletcher2 | fletcher4 | sha256 | sha512 | skein",
+	    "on | off | fletcher2 | fletcher4 | sha256 | sha512 | skein"
+	    " | blake3",
 #endif
 	    "CHECKSUM", checksum_table);
 	zprop_register_index(ZFS_PROP_DEDUP, "dedup", ZIO_CHECKSUM_OFF,
 	    PROP_INHERIT, ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
 	    "on | off | verify | sha256[,verify] | sha512[,verify] | "
 #if !defined(__FreeBSD__)
-	    "skein[,verify] | edonr,verify",
+	    "skein[,verify] | edonr,verify | blake3[,verify]",
 #else
-	    "skein[,verify]",
+	    "skein[,verify] | blake3[,verify]",
 #endif
 	    "DEDUP", dedup_table);
 	zprop_register_index(ZFS_PROP_COMPRESSION, "compression",
 	    ZIO_COMPRESS_DEFAULT, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
-	    "on | off | lzjb | gzip | gzip-[1-9] | zle | lz4 | "
+	    "on | off | lzjb | gzip | gzip-[1-9] | zle | lz4 | lz4-[1-9] | "
+	    "lz4-fast-[2-10,20,30,40,50,60,70,80,90,100] | "
 	    "zstd | zstd-[1-19] | "
 	    "zstd-fast-[1-10,20,30,40,50,60,70,80,90,100,500,1000]",
 	    "COMPRESS", compress_table);
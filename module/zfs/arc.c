@@ -426,6 +426,7 @@ int zfs_arc_grow_retry = 0;
 int zfs_arc_shrink_shift = 0;
 int zfs_arc_p_min_shift = 0;
 int zfs_arc_average_blocksize = 8 * 1024; /* 8KB */
+int zfs_arc_policy = ARC_POLICY_ARC;
 
 /*
  * ARC dirty data constraints for arc_tempreserve_space() throttle.
@@ -597,6 +598,7 @@ arc_stats_t arc_stats = {
 	{ "arc_raw_size",		KSTAT_DATA_UINT64 },
 	{ "cached_only_in_progress",	KSTAT_DATA_UINT64 },
 	{ "abd_chunk_waste_size",	KSTAT_DATA_UINT64 },
+	{ "admit_rejected",		KSTAT_DATA_UINT64 },
 };
 
 #define	ARCSTAT_MAX(stat, val) {					\
@@ -5417,6 +5419,165 @@ arc_free_data_impl(arc_buf_hdr_t *hdr, uint64_t size, void *tag)
 	}
 }
 
+/*
+ * TinyLFU admission (zfs_arc_policy = ARC_POLICY_TINYLFU).
+ *
+ * The MRU acts as an admission window: new blocks always go there, but a
+ * block only moves on into the MFU if it has been used more often than
+ * the block it would push out of the MFU.  How often blocks are used is
+ * tracked in a count-min sketch, which remembers blocks long after their
+ * headers are gone, and whose counters are halved every
+ * ARC_SKETCH_AGE_MULT * as_width accesses so that old popularity fades.
+ * Blocks read once or twice by a large scan then age out of the MRU
+ * instead of displacing the working set in the MFU.
+ */
+#define	ARC_SKETCH_DEPTH	4
+#define	ARC_SKETCH_MAX		15
+#define	ARC_SKETCH_AGE_MULT	10
+
+typedef struct arc_sketch {
+	uint8_t		*as_counts;	/* ARC_SKETCH_DEPTH rows */
+	uint64_t	as_width;	/* counters per row, a power of 2 */
+	uint64_t	as_accesses;	/* since the counters were halved */
+	kmutex_t	as_lock;	/* serializes halving */
+} arc_sketch_t;
+
+static arc_sketch_t *arc_sketch;
+
+static void
+arc_sketch_init(void)
+{
+	arc_sketch_t *as;
+	uint64_t width = 1024;
+
+	if (zfs_arc_policy != ARC_POLICY_TINYLFU)
+		return;
+
+	/* About one counter per row for each block the ARC can hold */
+	while (width * zfs_arc_average_blocksize < arc_c_max)
+		width <<= 1;
+
+	as = kmem_zalloc(sizeof (arc_sketch_t), KM_SLEEP);
+	as->as_counts = vmem_zalloc(ARC_SKETCH_DEPTH * width, KM_SLEEP);
+	as->as_width = width;
+	mutex_init(&as->as_lock, NULL, MUTEX_DEFAULT, NULL);
+	arc_sketch = as;
+}
+
+static void
+arc_sketch_fini(void)
+{
+	arc_sketch_t *as = arc_sketch;
+
+	if (as == NULL)
+		return;
+
+	arc_sketch = NULL;
+	mutex_destroy(&as->as_lock);
+	vmem_free(as->as_counts, ARC_SKETCH_DEPTH * as->as_width);
+	kmem_free(as, sizeof (arc_sketch_t));
+}
+
+static uint8_t *
+arc_sketch_counter(arc_sketch_t *as, uint64_t hash, int row)
+{
+	uint64_t h2 = (hash >> 32) | 1;
+
+	return (&as->as_counts[row * as->as_width +
+	    ((hash + row * h2) & (as->as_width - 1))]);
+}
+
+static uint_t
+arc_sketch_estimate(arc_sketch_t *as, const arc_buf_hdr_t *hdr)
+{
+	uint64_t hash = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	uint_t est = ARC_SKETCH_MAX;
+
+	for (int row = 0; row < ARC_SKETCH_DEPTH; row++)
+		est = MIN(est, *arc_sketch_counter(as, hash, row));
+
+	return (est);
+}
+
+/*
+ * Count an access.  Only the smallest counters are incremented, so blocks
+ * which share some of them with a popular one aren't overestimated as
+ * much.  The counters are updated without locking: a lost update merely
+ * makes an estimate a little low.
+ */
+static void
+arc_sketch_add(arc_sketch_t *as, const arc_buf_hdr_t *hdr)
+{
+	uint64_t hash = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	uint_t est = arc_sketch_estimate(as, hdr);
+
+	if (est < ARC_SKETCH_MAX) {
+		for (int row = 0; row < ARC_SKETCH_DEPTH; row++) {
+			uint8_t *count = arc_sketch_counter(as, hash, row);
+			if (*count == est)
+				*count = est + 1;
+		}
+	}
+
+	if (atomic_inc_64_nv(&as->as_accesses) <
+	    ARC_SKETCH_AGE_MULT * as->as_width || !mutex_tryenter(&as->as_lock))
+		return;
+
+	if (as->as_accesses >= ARC_SKETCH_AGE_MULT * as->as_width) {
+		uint64_t *words = (uint64_t *)as->as_counts;
+
+		for (uint64_t i = 0; i < ARC_SKETCH_DEPTH * as->as_width /
+		    sizeof (uint64_t); i++)
+			words[i] = (words[i] >> 1) & 0x7f7f7f7f7f7f7f7fULL;
+		as->as_accesses = 0;
+	}
+	mutex_exit(&as->as_lock);
+}
+
+/*
+ * Decide whether a block may move into the MFU.  That's always the case
+ * with the default policy, or while the MFU is below its target size.
+ * Otherwise the block has to be used more often than a sample victim:
+ * the tail of a random MFU sublist, which is what arc_evict_state() would
+ * evict next.
+ */
+static boolean_t
+arc_mfu_admit(arc_buf_hdr_t *hdr)
+{
+	arc_sketch_t *as = arc_sketch;
+	multilist_t *ml;
+	multilist_sublist_t *mls;
+	arc_buf_hdr_t *victim;
+	uint_t freq, victim_freq = 0;
+
+	if (as == NULL)
+		return (B_TRUE);
+
+	if (zfs_refcount_count(&arc_mfu->arcs_size) + HDR_GET_LSIZE(hdr) <=
+	    arc_c - MIN(arc_p, arc_c))
+		return (B_TRUE);
+
+	freq = arc_sketch_estimate(as, hdr);
+
+	ml = arc_mfu->arcs_list[arc_buf_type(hdr)];
+	mls = multilist_sublist_lock(ml, multilist_get_random_index(ml));
+	for (victim = multilist_sublist_tail(mls); victim != NULL;
+	    victim = multilist_sublist_prev(mls, victim)) {
+		/* Skip the markers of arc_evict_state() */
+		if (victim->b_spa != 0) {
+			victim_freq = arc_sketch_estimate(as, victim);
+			break;
+		}
+	}
+	multilist_sublist_unlock(mls);
+
+	if (freq > victim_freq)
+		return (B_TRUE);
+
+	ARCSTAT_BUMP(arcstat_admit_rejected);
+	return (B_FALSE);
+}
+
 /*
  * This routine is called whenever a buffer is accessed.
  * NOTE: the hash lock is dropped in this function.
@@ -5429,6 +5590,15 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 	ASSERT(MUTEX_HELD(hash_lock));
 	ASSERT(HDR_HAS_L1HDR(hdr));
 
+	/*
+	 * Repeated accesses within ARC_MINTIME, e.g. to several records of
+	 * the same block, are counted once, as for the MRU to MFU move.
+	 */
+	if (arc_sketch != NULL && (hdr->b_l1hdr.b_arc_access == 0 ||
+	    ddi_time_after(ddi_get_lbolt(),
+	    hdr->b_l1hdr.b_arc_access + ARC_MINTIME)))
+		arc_sketch_add(arc_sketch, hdr);
+
 	if (hdr->b_l1hdr.b_state == arc_anon) {
 		/*
 		 * This buffer is not in the cache, and does not
@@ -5485,8 +5655,11 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 			 * most frequently used state.
 			 */
 			hdr->b_l1hdr.b_arc_access = now;
-			DTRACE_PROBE1(new_state__mfu, arc_buf_hdr_t *, hdr);
-			arc_change_state(arc_mfu, hdr, hash_lock);
+			if (arc_mfu_admit(hdr)) {
+				DTRACE_PROBE1(new_state__mfu,
+				    arc_buf_hdr_t *, hdr);
+				arc_change_state(arc_mfu, hdr, hash_lock);
+			}
 		}
 		atomic_inc_32(&hdr->b_l1hdr.b_mru_hits);
 		ARCSTAT_BUMP(arcstat_mru_hits);
@@ -5509,9 +5682,12 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 					l2arc_hdr_arcstats_increment_state(hdr);
 			}
 			DTRACE_PROBE1(new_state__mru, arc_buf_hdr_t *, hdr);
-		} else {
+		} else if (arc_mfu_admit(hdr)) {
 			new_state = arc_mfu;
 			DTRACE_PROBE1(new_state__mfu, arc_buf_hdr_t *, hdr);
+		} else {
+			new_state = arc_mru;
+			DTRACE_PROBE1(new_state__mru, arc_buf_hdr_t *, hdr);
 		}
 
 		hdr->b_l1hdr.b_arc_access = ddi_get_lbolt();
@@ -5547,6 +5723,8 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 			 * move this block back to the MRU state.
 			 */
 			new_state = arc_mru;
+		} else if (!arc_mfu_admit(hdr)) {
+			new_state = arc_mru;
 		}
 
 		hdr->b_l1hdr.b_arc_access = ddi_get_lbolt();
@@ -5562,7 +5740,8 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 
 		hdr->b_l1hdr.b_arc_access = ddi_get_lbolt();
 		DTRACE_PROBE1(new_state__mfu, arc_buf_hdr_t *, hdr);
-		arc_change_state(arc_mfu, hdr, hash_lock);
+		arc_change_state(arc_mfu_admit(hdr) ? arc_mfu : arc_mru,
+		    hdr, hash_lock);
 	} else {
 		cmn_err(CE_PANIC, "invalid arc state 0x%p",
 		    hdr->b_l1hdr.b_state);
@@ -7638,6 +7817,8 @@ arc_init(void)
 
 	buf_init();
 
+	arc_sketch_init();
+
 	list_create(&arc_prune_list, sizeof (arc_prune_t),
 	    offsetof(arc_prune_t, p_node));
 	mutex_init(&arc_prune_mtx, NULL, MUTEX_DEFAULT, NULL);
@@ -7739,6 +7920,7 @@ arc_fini(void)
 	 */
 	buf_fini();
 	arc_state_fini();
+	arc_sketch_fini();
 
 	/*
 	 * We destroy the zthrs after all the ARC state has been
@@ -8929,30 +9111,34 @@ l2arc_apply_transforms(spa_t *spa, arc_buf_hdr_t *hdr, uint64_t asize,
 	}
 
 	if (compress != ZIO_COMPRESS_OFF && !HDR_COMPRESSION_ENABLED(hdr)) {
-		cabd = abd_alloc_for_io(asize, ismd);
-		tmp = abd_borrow_buf(cabd, asize);
-
+		/*
+		 * The block has to be recompressed to exactly what is on
+		 * disk.  That can't be guaranteed for lz4, whose blocks don't
+		 * record the level they were written with, so compress into
+		 * a scratch buffer large enough for any outcome and don't
+		 * cache the block if the size doesn't match.  A block of the
+		 * right size with different contents fails the checksum when
+		 * read back from the cache device and is then read from the
+		 * pool instead.
+		 */
+		tmp = zio_buf_alloc(size);
 		psize = zio_compress_data(compress, to_write, tmp, size,
 		    hdr->b_complevel);
 
-		if (psize >= size) {
-			abd_return_buf(cabd, tmp, asize);
-			HDR_SET_COMPRESS(hdr, ZIO_COMPRESS_OFF);
-			to_write = cabd;
-			abd_copy(to_write, hdr->b_l1hdr.b_pabd, size);
-			if (size != asize)
-				abd_zero_off(to_write, size, asize - size);
-			goto encrypt;
+		if (psize != HDR_GET_PSIZE(hdr)) {
+			zio_buf_free(tmp, size);
+			ret = SET_ERROR(EIO);
+			goto error;
 		}
-		ASSERT3U(psize, <=, HDR_GET_PSIZE(hdr));
+
+		cabd = abd_alloc_for_io(asize, ismd);
+		abd_copy_from_buf(cabd, tmp, psize);
 		if (psize < asize)
-			bzero((char *)tmp + psize, asize - psize);
-		psize = HDR_GET_PSIZE(hdr);
-		abd_return_buf_copy(cabd, tmp, asize);
+			abd_zero_off(cabd, psize, asize - psize);
+		zio_buf_free(tmp, size);
 		to_write = cabd;
 	}
 
-encrypt:
 	if (HDR_ENCRYPTED(hdr)) {
 		eabd = abd_alloc_for_io(asize, ismd);
 
@@ -10660,6 +10846,9 @@ ZFS_MODULE_PARAM_CALL(zfs_arc, zfs_arc_, p_min_shift, param_set_arc_int,
 ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, average_blocksize, INT, ZMOD_RD,
 	"Target average block size");
 
+ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, policy, INT, ZMOD_RD,
+	"Replacement policy: 0=arc, 1=tinylfu");
+
 ZFS_MODULE_PARAM(zfs, zfs_, compressed_arc_enabled, INT, ZMOD_RW,
 	"Disable compressed arc buffers");
 
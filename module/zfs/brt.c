@@ -0,0 +1,535 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Block Reference Table.
+ *
+ * Block cloning lets a file reference blocks that already belong to
+ * another file (or to another part of the same file) without reading or
+ * writing any data: the cloned block pointers are simply copied into the
+ * destination object.  Since the same block may then be referenced from
+ * several places, something has to keep it from being freed while any of
+ * those references remain.  Dedup solves the same problem with the DDT,
+ * but the DDT is keyed by checksum and so requires a strong checksum to be
+ * computed up front for every block that might ever be shared.  The BRT
+ * is instead keyed by the block's first DVA, which is known for every
+ * block, and only contains entries for blocks that have actually been
+ * cloned.
+ *
+ * Each entry counts the references held on a block in addition to the
+ * original one.  Cloning a block increments its count; when a block
+ * pointer is freed and its DVA has a non-zero count, the count is
+ * decremented and the free is skipped (see zio_free_sync()).  Once the
+ * count has dropped to zero the next free releases the space as usual.
+ *
+ * Clones are made in open context but the table is only modified in
+ * syncing context.  brt_pending_add() queues each cloned block pointer
+ * for its txg; brt_pending_apply() folds the queue into the table at the
+ * start of spa_sync(), before any frees for that txg are processed, and
+ * brt_sync() writes out the modified entries.  A clone which is undone in
+ * the same txg (e.g. the destination block is overwritten again) simply
+ * removes its queued reference with brt_pending_remove().
+ *
+ * The whole table is kept in memory while the pool is imported.  On disk
+ * it is a single ZAP in the MOS with 64-bit integer keys, which is created
+ * (activating the block_cloning feature) when the first entry is added and
+ * destroyed again once the last entry is gone.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/brt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_pool.h>
+#include <sys/zfeature.h>
+
+#define	BRT_ZAP_LEAF_BLOCKSHIFT		12
+#define	BRT_ZAP_INDIRECT_BLOCKSHIFT	12
+
+static kmem_cache_t *brt_entry_cache;
+static kmem_cache_t *brt_pending_entry_cache;
+
+static int
+brt_entry_compare(const void *x1, const void *x2)
+{
+	const brt_entry_t *bre1 = x1;
+	const brt_entry_t *bre2 = x2;
+
+	int cmp = TREE_CMP(bre1->bre_vdev, bre2->bre_vdev);
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_CMP(bre1->bre_offset, bre2->bre_offset));
+}
+
+static int
+brt_pending_entry_compare(const void *x1, const void *x2)
+{
+	const blkptr_t *bp1 = &((const brt_pending_entry_t *)x1)->bpe_bp;
+	const blkptr_t *bp2 = &((const brt_pending_entry_t *)x2)->bpe_bp;
+
+	int cmp = TREE_CMP(DVA_GET_VDEV(&bp1->blk_dva[0]),
+	    DVA_GET_VDEV(&bp2->blk_dva[0]));
+	if (likely(cmp))
+		return (cmp);
+
+	cmp = TREE_CMP(DVA_GET_OFFSET(&bp1->blk_dva[0]),
+	    DVA_GET_OFFSET(&bp2->blk_dva[0]));
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_CMP(BP_PHYSICAL_BIRTH(bp1), BP_PHYSICAL_BIRTH(bp2)));
+}
+
+static void
+brt_entry_key(const blkptr_t *bp, brt_entry_t *bre)
+{
+	bre->bre_vdev = DVA_GET_VDEV(&bp->blk_dva[0]);
+	bre->bre_offset = DVA_GET_OFFSET(&bp->blk_dva[0]);
+}
+
+static boolean_t
+brt_bp_is_tracked(const blkptr_t *bp)
+{
+	/*
+	 * Holes and embedded block pointers carry no allocated space, so
+	 * they can be cloned freely.  Dedup blocks are already reference
+	 * counted by the DDT and are never cloned.
+	 */
+	return (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp) && !BP_GET_DEDUP(bp));
+}
+
+static void
+brt_entry_dirty(brt_t *brt, brt_entry_t *bre)
+{
+	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+
+	if (!bre->bre_dirty) {
+		bre->bre_dirty = B_TRUE;
+		list_insert_tail(&brt->brt_dirty, bre);
+		brt->brt_ndirty++;
+	}
+}
+
+void
+brt_create(spa_t *spa)
+{
+	brt_t *brt;
+
+	ASSERT3P(spa->spa_brt, ==, NULL);
+
+	brt = kmem_zalloc(sizeof (brt_t), KM_SLEEP);
+	brt->brt_spa = spa;
+	rw_init(&brt->brt_lock, NULL, RW_DEFAULT, NULL);
+	avl_create(&brt->brt_tree, brt_entry_compare,
+	    sizeof (brt_entry_t), offsetof(brt_entry_t, bre_node));
+	list_create(&brt->brt_dirty, sizeof (brt_entry_t),
+	    offsetof(brt_entry_t, bre_dirty_node));
+	for (int t = 0; t < TXG_SIZE; t++) {
+		mutex_init(&brt->brt_pending_lock[t], NULL, MUTEX_DEFAULT,
+		    NULL);
+		avl_create(&brt->brt_pending_tree[t],
+		    brt_pending_entry_compare, sizeof (brt_pending_entry_t),
+		    offsetof(brt_pending_entry_t, bpe_node));
+	}
+
+	spa->spa_brt = brt;
+}
+
+int
+brt_load(spa_t *spa)
+{
+	objset_t *mos = spa->spa_meta_objset;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	brt_t *brt;
+	int error;
+
+	brt_create(spa);
+	brt = spa->spa_brt;
+
+	error = zap_lookup(mos, DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_BRT,
+	    sizeof (uint64_t), 1, &brt->brt_object);
+	if (error != 0)
+		return (error == ENOENT ? 0 : error);
+
+	for (zap_cursor_init(&zc, mos, brt->brt_object);
+	    (error = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		uint64_t *key = (uint64_t *)za.za_name;
+		uint64_t value[BRT_VALUE_WORDS];
+		brt_entry_t *bre;
+
+		error = zap_lookup_uint64(mos, brt->brt_object, key,
+		    BRT_KEY_WORDS, sizeof (uint64_t), BRT_VALUE_WORDS, value);
+		if (error != 0)
+			break;
+
+		bre = kmem_cache_alloc(brt_entry_cache, KM_SLEEP);
+		bre->bre_vdev = key[0];
+		bre->bre_offset = key[1];
+		bre->bre_refcount = value[0];
+		bre->bre_dsize = value[1];
+		bre->bre_dirty = B_FALSE;
+		list_link_init(&bre->bre_dirty_node);
+		avl_add(&brt->brt_tree, bre);
+
+		brt->brt_saved += bre->bre_refcount * bre->bre_dsize;
+	}
+	zap_cursor_fini(&zc);
+
+	return (error == ENOENT ? 0 : error);
+}
+
+void
+brt_unload(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_entry_t *bre;
+	brt_pending_entry_t *bpe;
+	void *cookie;
+
+	if (brt == NULL)
+		return;
+
+	while ((bre = list_remove_head(&brt->brt_dirty)) != NULL)
+		bre->bre_dirty = B_FALSE;
+	brt->brt_ndirty = 0;
+	list_destroy(&brt->brt_dirty);
+
+	cookie = NULL;
+	while ((bre = avl_destroy_nodes(&brt->brt_tree, &cookie)) != NULL)
+		kmem_cache_free(brt_entry_cache, bre);
+	avl_destroy(&brt->brt_tree);
+
+	for (int t = 0; t < TXG_SIZE; t++) {
+		cookie = NULL;
+		while ((bpe = avl_destroy_nodes(&brt->brt_pending_tree[t],
+		    &cookie)) != NULL)
+			kmem_cache_free(brt_pending_entry_cache, bpe);
+		avl_destroy(&brt->brt_pending_tree[t]);
+		mutex_destroy(&brt->brt_pending_lock[t]);
+	}
+
+	rw_destroy(&brt->brt_lock);
+	kmem_free(brt, sizeof (brt_t));
+	spa->spa_brt = NULL;
+}
+
+/*
+ * Queue an additional reference on bp, to be applied when tx's txg syncs.
+ */
+void
+brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
+{
+	brt_t *brt = spa->spa_brt;
+	uint64_t txg = dmu_tx_get_txg(tx);
+	brt_pending_entry_t *bpe, *newbpe;
+	avl_index_t where;
+
+	if (!brt_bp_is_tracked(bp))
+		return;
+
+	newbpe = kmem_cache_alloc(brt_pending_entry_cache, KM_SLEEP);
+	newbpe->bpe_bp = *bp;
+	newbpe->bpe_count = 1;
+
+	mutex_enter(&brt->brt_pending_lock[txg & TXG_MASK]);
+	bpe = avl_find(&brt->brt_pending_tree[txg & TXG_MASK], newbpe,
+	    &where);
+	if (bpe == NULL) {
+		avl_insert(&brt->brt_pending_tree[txg & TXG_MASK], newbpe,
+		    where);
+		newbpe = NULL;
+	} else {
+		bpe->bpe_count++;
+	}
+	mutex_exit(&brt->brt_pending_lock[txg & TXG_MASK]);
+
+	if (newbpe != NULL)
+		kmem_cache_free(brt_pending_entry_cache, newbpe);
+}
+
+/*
+ * Drop a reference queued by brt_pending_add() for the same txg.
+ */
+void
+brt_pending_remove(spa_t *spa, const blkptr_t *bp, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_pending_entry_t *bpe, bpe_search;
+
+	if (!brt_bp_is_tracked(bp))
+		return;
+
+	bpe_search.bpe_bp = *bp;
+
+	mutex_enter(&brt->brt_pending_lock[txg & TXG_MASK]);
+	bpe = avl_find(&brt->brt_pending_tree[txg & TXG_MASK], &bpe_search,
+	    NULL);
+	VERIFY3P(bpe, !=, NULL);
+	ASSERT3U(bpe->bpe_count, >, 0);
+	if (--bpe->bpe_count == 0)
+		avl_remove(&brt->brt_pending_tree[txg & TXG_MASK], bpe);
+	else
+		bpe = NULL;
+	mutex_exit(&brt->brt_pending_lock[txg & TXG_MASK]);
+
+	if (bpe != NULL)
+		kmem_cache_free(brt_pending_entry_cache, bpe);
+}
+
+/*
+ * Fold the clones made in txg into the table.  Called at the start of
+ * spa_sync(), before any blocks are freed in txg, so that a block which
+ * is cloned and then freed by its original owner in the same txg is kept.
+ */
+void
+brt_pending_apply(spa_t *spa, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	avl_tree_t *pending = &brt->brt_pending_tree[txg & TXG_MASK];
+	brt_pending_entry_t *bpe;
+	void *cookie = NULL;
+
+	ASSERT3U(txg, ==, spa_syncing_txg(spa));
+
+	/*
+	 * Open context can no longer add to this txg's tree, so it is safe
+	 * to walk it without the pending lock.
+	 */
+	if (avl_is_empty(pending))
+		return;
+
+	rw_enter(&brt->brt_lock, RW_WRITER);
+	while ((bpe = avl_destroy_nodes(pending, &cookie)) != NULL) {
+		brt_entry_t *bre, bre_search;
+		avl_index_t where;
+
+		brt_entry_key(&bpe->bpe_bp, &bre_search);
+		bre = avl_find(&brt->brt_tree, &bre_search, &where);
+		if (bre == NULL) {
+			bre = kmem_cache_alloc(brt_entry_cache, KM_SLEEP);
+			bre->bre_vdev = bre_search.bre_vdev;
+			bre->bre_offset = bre_search.bre_offset;
+			bre->bre_refcount = 0;
+			bre->bre_dsize = 0;
+			bre->bre_dirty = B_FALSE;
+			list_link_init(&bre->bre_dirty_node);
+			avl_insert(&brt->brt_tree, bre, where);
+		}
+		if (bre->bre_refcount == 0)
+			bre->bre_dsize = bp_get_dsize_sync(spa, &bpe->bpe_bp);
+		bre->bre_refcount += bpe->bpe_count;
+		brt->brt_saved += bpe->bpe_count * bre->bre_dsize;
+		brt_entry_dirty(brt, bre);
+
+		kmem_cache_free(brt_pending_entry_cache, bpe);
+	}
+	rw_exit(&brt->brt_lock);
+}
+
+/*
+ * Called when bp is being freed.  If the block has extra references,
+ * drop one and return B_TRUE: the caller must not free the block.
+ */
+boolean_t
+brt_entry_decref(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_entry_t *bre, bre_search;
+
+	if (brt == NULL || !brt_bp_is_tracked(bp))
+		return (B_FALSE);
+
+	brt_entry_key(bp, &bre_search);
+
+	/*
+	 * Nearly all frees are of blocks which were never cloned; look them
+	 * up as a reader so that they do not serialize on the table.
+	 */
+	rw_enter(&brt->brt_lock, RW_READER);
+	bre = avl_find(&brt->brt_tree, &bre_search, NULL);
+	if (bre == NULL || bre->bre_refcount == 0) {
+		rw_exit(&brt->brt_lock);
+		return (B_FALSE);
+	}
+	rw_exit(&brt->brt_lock);
+
+	rw_enter(&brt->brt_lock, RW_WRITER);
+	bre = avl_find(&brt->brt_tree, &bre_search, NULL);
+	if (bre == NULL || bre->bre_refcount == 0) {
+		rw_exit(&brt->brt_lock);
+		return (B_FALSE);
+	}
+	bre->bre_refcount--;
+	brt->brt_saved -= bre->bre_dsize;
+	brt_entry_dirty(brt, bre);
+	rw_exit(&brt->brt_lock);
+
+	return (B_TRUE);
+}
+
+uint64_t
+brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_entry_t *bre, bre_search;
+	uint64_t refcount = 0;
+
+	if (brt == NULL || !brt_bp_is_tracked(bp))
+		return (0);
+
+	brt_entry_key(bp, &bre_search);
+
+	rw_enter(&brt->brt_lock, RW_READER);
+	bre = avl_find(&brt->brt_tree, &bre_search, NULL);
+	if (bre != NULL)
+		refcount = bre->bre_refcount;
+	rw_exit(&brt->brt_lock);
+
+	return (refcount);
+}
+
+/*
+ * Space saved by cloning, which like the dedup savings is added to the
+ * pool's deflated space.
+ */
+uint64_t
+brt_get_dspace(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL)
+		return (0);
+
+	return (brt->brt_saved);
+}
+
+typedef struct brt_sync_entry {
+	uint64_t	bse_key[BRT_KEY_WORDS];
+	uint64_t	bse_value[BRT_VALUE_WORDS];
+} brt_sync_entry_t;
+
+void
+brt_sync(spa_t *spa, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	objset_t *mos = spa->spa_meta_objset;
+	brt_sync_entry_t *bses;
+	brt_entry_t *bre;
+	dmu_tx_t *tx;
+	uint64_t n, i;
+	boolean_t empty;
+
+	ASSERT3U(txg, ==, spa_syncing_txg(spa));
+
+	/*
+	 * Take a copy of the dirty entries so that the ZAP updates below
+	 * are not done with brt_lock held; frees of unrelated blocks from
+	 * the write pipeline look up the table concurrently.
+	 */
+	rw_enter(&brt->brt_lock, RW_WRITER);
+	n = brt->brt_ndirty;
+	if (n == 0) {
+		rw_exit(&brt->brt_lock);
+		return;
+	}
+	bses = vmem_alloc(n * sizeof (brt_sync_entry_t), KM_SLEEP);
+	for (i = 0; (bre = list_remove_head(&brt->brt_dirty)) != NULL; i++) {
+		bre->bre_dirty = B_FALSE;
+		brt->brt_ndirty--;
+		bses[i].bse_key[0] = bre->bre_vdev;
+		bses[i].bse_key[1] = bre->bre_offset;
+		bses[i].bse_value[0] = bre->bre_refcount;
+		bses[i].bse_value[1] = bre->bre_dsize;
+		if (bre->bre_refcount == 0) {
+			avl_remove(&brt->brt_tree, bre);
+			kmem_cache_free(brt_entry_cache, bre);
+		}
+	}
+	ASSERT3U(i, ==, n);
+	empty = avl_is_empty(&brt->brt_tree);
+	rw_exit(&brt->brt_lock);
+
+	/*
+	 * Every clone made in this txg was released again before we got
+	 * here; there is nothing to write.
+	 */
+	if (empty && brt->brt_object == 0) {
+		vmem_free(bses, n * sizeof (brt_sync_entry_t));
+		return;
+	}
+
+	tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+
+	if (brt->brt_object == 0) {
+		brt->brt_object = zap_create_flags(mos, 0,
+		    ZAP_FLAG_HASH64 | ZAP_FLAG_UINT64_KEY,
+		    DMU_OTN_ZAP_METADATA, BRT_ZAP_LEAF_BLOCKSHIFT,
+		    BRT_ZAP_INDIRECT_BLOCKSHIFT, DMU_OT_NONE, 0, tx);
+		VERIFY0(zap_add(mos, DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_BRT,
+		    sizeof (uint64_t), 1, &brt->brt_object, tx));
+		spa_feature_incr(spa, SPA_FEATURE_BLOCK_CLONING, tx);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (bses[i].bse_value[0] == 0) {
+			int error = zap_remove_uint64(mos, brt->brt_object,
+			    bses[i].bse_key, BRT_KEY_WORDS, tx);
+			VERIFY(error == 0 || error == ENOENT);
+		} else {
+			VERIFY0(zap_update_uint64(mos, brt->brt_object,
+			    bses[i].bse_key, BRT_KEY_WORDS, sizeof (uint64_t),
+			    BRT_VALUE_WORDS, bses[i].bse_value, tx));
+		}
+	}
+	vmem_free(bses, n * sizeof (brt_sync_entry_t));
+
+	if (empty) {
+		VERIFY0(zap_destroy(mos, brt->brt_object, tx));
+		VERIFY0(zap_remove(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_BRT, tx));
+		spa_feature_decr(spa, SPA_FEATURE_BLOCK_CLONING, tx);
+		brt->brt_object = 0;
+	}
+
+	dmu_tx_commit(tx);
+}
+
+void
+brt_init(void)
+{
+	brt_entry_cache = kmem_cache_create("brt_entry_cache",
+	    sizeof (brt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	brt_pending_entry_cache = kmem_cache_create("brt_pending_entry_cache",
+	    sizeof (brt_pending_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+brt_fini(void)
+{
+	kmem_cache_destroy(brt_pending_entry_cache);
+	kmem_cache_destroy(brt_entry_cache);
+}
@@ -37,6 +37,10 @@ static dataset_kstat_values_t empty_dataset_kstats = {
 	{ "nread",	KSTAT_DATA_UINT64 },
 	{ "nunlinks",	KSTAT_DATA_UINT64 },
 	{ "nunlinked",	KSTAT_DATA_UINT64 },
+	{ "ncompressed",	KSTAT_DATA_UINT64 },
+	{ "nincompressible",	KSTAT_DATA_UINT64 },
+	{ "ncompress_aborted",	KSTAT_DATA_UINT64 },
+	{ "nelided",	KSTAT_DATA_UINT64 },
 };
 
 static int
@@ -61,6 +65,14 @@ dataset_kstats_update(kstat_t *ksp, int rw)
 	    aggsum_value(&dk->dk_aggsums.das_nunlinks);
 	dkv->dkv_nunlinked.value.ui64 =
 	    aggsum_value(&dk->dk_aggsums.das_nunlinked);
+	dkv->dkv_ncompressed.value.ui64 =
+	    aggsum_value(&dk->dk_aggsums.das_ncompressed);
+	dkv->dkv_nincompressible.value.ui64 =
+	    aggsum_value(&dk->dk_aggsums.das_nincompressible);
+	dkv->dkv_ncompress_aborted.value.ui64 =
+	    aggsum_value(&dk->dk_aggsums.das_ncompress_aborted);
+	dkv->dkv_nelided.value.ui64 =
+	    aggsum_value(&dk->dk_aggsums.das_nelided);
 
 	return (0);
 }
@@ -146,6 +158,10 @@ dataset_kstats_create(dataset_kstats_t *dk, objset_t *objset)
 	aggsum_init(&dk->dk_aggsums.das_nread, 0);
 	aggsum_init(&dk->dk_aggsums.das_nunlinks, 0);
 	aggsum_init(&dk->dk_aggsums.das_nunlinked, 0);
+	aggsum_init(&dk->dk_aggsums.das_ncompressed, 0);
+	aggsum_init(&dk->dk_aggsums.das_nincompressible, 0);
+	aggsum_init(&dk->dk_aggsums.das_ncompress_aborted, 0);
+	aggsum_init(&dk->dk_aggsums.das_nelided, 0);
 }
 
 void
@@ -168,6 +184,26 @@ dataset_kstats_destroy(dataset_kstats_t *dk)
 	aggsum_fini(&dk->dk_aggsums.das_nread);
 	aggsum_fini(&dk->dk_aggsums.das_nunlinks);
 	aggsum_fini(&dk->dk_aggsums.das_nunlinked);
+	aggsum_fini(&dk->dk_aggsums.das_ncompressed);
+	aggsum_fini(&dk->dk_aggsums.das_nincompressible);
+	aggsum_fini(&dk->dk_aggsums.das_ncompress_aborted);
+	aggsum_fini(&dk->dk_aggsums.das_nelided);
+}
+
+/*
+ * Route the write-side statistics gathered below the DMU (see
+ * dataset_kstats_update_compress_kstats()) for the owned objset os to dk.
+ * The link is broken by dmu_objset_disown(), so the owner must call this
+ * again whenever it (re)opens the objset, and must have synced out its
+ * dirty data before disowning it.
+ */
+void
+dataset_kstats_attach(dataset_kstats_t *dk, objset_t *os)
+{
+	if (dk->dk_kstats == NULL)
+		return;
+
+	os->os_dataset_kstats = dk;
 }
 
 void
@@ -213,3 +249,27 @@ dataset_kstats_update_nunlinked_kstat(dataset_kstats_t *dk, int64_t delta)
 
 	aggsum_add(&dk->dk_aggsums.das_nunlinked, delta);
 }
+
+void
+dataset_kstats_update_compress_kstats(dataset_kstats_t *dk,
+    boolean_t compressed, boolean_t aborted)
+{
+	if (dk->dk_kstats == NULL)
+		return;
+
+	if (compressed)
+		aggsum_add(&dk->dk_aggsums.das_ncompressed, 1);
+	else if (aborted)
+		aggsum_add(&dk->dk_aggsums.das_ncompress_aborted, 1);
+	else
+		aggsum_add(&dk->dk_aggsums.das_nincompressible, 1);
+}
+
+void
+dataset_kstats_update_nelided_kstat(dataset_kstats_t *dk)
+{
+	if (dk->dk_kstats == NULL)
+		return;
+
+	aggsum_add(&dk->dk_aggsums.das_nelided, 1);
+}
@@ -35,6 +35,7 @@
 #include <sys/dmu_impl.h>
 #include <sys/dbuf.h>
 #include <sys/dmu_objset.h>
+#include <sys/brt.h>
 #include <sys/dsl_dataset.h>
 #include <sys/dsl_dir.h>
 #include <sys/dmu_tx.h>
@@ -49,6 +50,7 @@
 #include <sys/trace_zfs.h>
 #include <sys/callb.h>
 #include <sys/abd.h>
+#include <sys/dataset_kstats.h>
 #include <sys/vdev.h>
 #include <cityhash.h>
 #include <sys/spa_impl.h>
@@ -1245,6 +1247,39 @@ dmu_buf_unlock_parent(dmu_buf_impl_t *db, db_lock_type_t type, void *tag)
 		rrw_exit(&dmu_objset_ds(db->db_objset)->ds_bp_rwlock, tag);
 }
 
+/*
+ * Returns true if the newest dirty record of this dbuf is a block clone
+ * whose data has not been read yet; see dmu_brt_clone().
+ */
+static boolean_t
+dbuf_is_pending_clone(dmu_buf_impl_t *db)
+{
+	dbuf_dirty_record_t *dr = list_head(&db->db_dirty_records);
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+
+	return (db->db_level == 0 && dr != NULL && dr->dt.dl.dr_brtwrite &&
+	    dr->dt.dl.dr_data == NULL);
+}
+
+/*
+ * Once a pending block clone has been read, hand its data to the dirty
+ * record, so that it looks like any other overridden dirty buffer (e.g.
+ * one written by dmu_sync()) to the rest of this file.  A dirty record
+ * which is already being synced is left alone; its write does not use
+ * the data anyway.
+ */
+static void
+dbuf_set_clone_data(dmu_buf_impl_t *db)
+{
+	dbuf_dirty_record_t *dr = list_head(&db->db_dirty_records);
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+
+	if (dbuf_is_pending_clone(db) && dr != db->db_data_pending)
+		dr->dt.dl.dr_data = db->db_buf;
+}
+
 static void
 dbuf_read_done(zio_t *zio, const zbookmark_phys_t *zb, const blkptr_t *bp,
     arc_buf_t *buf, void *vdb)
@@ -1264,8 +1299,13 @@ dbuf_read_done(zio_t *zio, const zbookmark_phys_t *zb, const blkptr_t *bp,
 		ASSERT(zio == NULL || zio->io_error != 0);
 		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
 		ASSERT3P(db->db_buf, ==, NULL);
-		db->db_state = DB_UNCACHED;
-		DTRACE_SET_STATE(db, "i/o error");
+		if (dbuf_is_pending_clone(db)) {
+			db->db_state = DB_NOFILL;
+			DTRACE_SET_STATE(db, "i/o error reading clone");
+		} else {
+			db->db_state = DB_UNCACHED;
+			DTRACE_SET_STATE(db, "i/o error");
+		}
 	} else if (db->db_level == 0 && db->db_freed_in_flight) {
 		/* freed in flight */
 		ASSERT(zio == NULL || zio->io_error == 0);
@@ -1280,6 +1320,7 @@ dbuf_read_done(zio_t *zio, const zbookmark_phys_t *zb, const blkptr_t *bp,
 		/* success */
 		ASSERT(zio == NULL || zio->io_error == 0);
 		dbuf_set_data(db, buf);
+		dbuf_set_clone_data(db);
 		db->db_state = DB_CACHED;
 		DTRACE_SET_STATE(db, "successful read");
 	}
@@ -1443,6 +1484,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	uint32_t aflags = ARC_FLAG_NOWAIT;
 	int err, zio_flags;
 	boolean_t bonus_read;
+	blkptr_t bp;
 
 	err = zio_flags = 0;
 	bonus_read = B_FALSE;
@@ -1450,7 +1492,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	dn = DB_DNODE(db);
 	ASSERT(!zfs_refcount_is_zero(&db->db_holds));
 	ASSERT(MUTEX_HELD(&db->db_mtx));
-	ASSERT(db->db_state == DB_UNCACHED);
+	ASSERT(db->db_state == DB_UNCACHED || db->db_state == DB_NOFILL);
 	ASSERT(db->db_buf == NULL);
 	ASSERT(db->db_parent == NULL ||
 	    RW_LOCK_HELD(&db->db_parent->db_rwlock));
@@ -1460,16 +1502,39 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 		goto early_unlock;
 	}
 
-	err = dbuf_read_hole(db, dn, flags);
-	if (err == 0)
-		goto early_unlock;
+	/*
+	 * A block clone which has not been synced yet is read through the
+	 * block pointer in its dirty record rather than through db_blkptr.
+	 * Any free of this block since the clone was made has already
+	 * discarded or replaced that record; see dbuf_free_range().
+	 */
+	if (db->db_state == DB_NOFILL) {
+		dbuf_dirty_record_t *dr = list_head(&db->db_dirty_records);
+
+		ASSERT(dbuf_is_pending_clone(db));
+		bp = dr->dt.dl.dr_overridden_by;
+		if (BP_IS_HOLE(&bp)) {
+			dbuf_set_data(db, dbuf_alloc_arcbuf(db));
+			bzero(db->db.db_data, db->db.db_size);
+			dbuf_set_clone_data(db);
+			db->db_state = DB_CACHED;
+			DTRACE_SET_STATE(db, "cloned hole read satisfied");
+			goto early_unlock;
+		}
+	} else {
+		err = dbuf_read_hole(db, dn, flags);
+		if (err == 0)
+			goto early_unlock;
+		err = 0;
+		bp = *db->db_blkptr;
+	}
 
 	/*
 	 * Any attempt to read a redacted block should result in an error. This
 	 * will never happen under normal conditions, but can be useful for
 	 * debugging purposes.
 	 */
-	if (BP_IS_REDACTED(db->db_blkptr)) {
+	if (BP_IS_REDACTED(&bp)) {
 		ASSERT(dsl_dataset_feature_is_active(
 		    db->db_objset->os_dsl_dataset,
 		    SPA_FEATURE_REDACTED_DATASETS));
@@ -1484,7 +1549,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	 * All bps of an encrypted os should have the encryption bit set.
 	 * If this is not true it indicates tampering and we report an error.
 	 */
-	if (db->db_objset->os_encrypted && !BP_USES_CRYPT(db->db_blkptr)) {
+	if (db->db_objset->os_encrypted && !BP_USES_CRYPT(&bp)) {
 		spa_log_error(db->db_objset->os_spa, &zb);
 		zfs_panic_recover("unencrypted block in encrypted "
 		    "object set %llu", dmu_objset_id(db->db_objset));
@@ -1510,16 +1575,16 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	zio_flags = (flags & DB_RF_CANFAIL) ?
 	    ZIO_FLAG_CANFAIL : ZIO_FLAG_MUSTSUCCEED;
 
-	if ((flags & DB_RF_NO_DECRYPT) && BP_IS_PROTECTED(db->db_blkptr))
+	if ((flags & DB_RF_NO_DECRYPT) && BP_IS_PROTECTED(&bp))
 		zio_flags |= ZIO_FLAG_RAW;
 	/*
-	 * The zio layer will copy the provided blkptr later, but we need to
-	 * do this now so that we can release the parent's rwlock. We have to
-	 * do that now so that if dbuf_read_done is called synchronously (on
-	 * an l1 cache hit) we don't acquire the db_mtx while holding the
-	 * parent's rwlock, which would be a lock ordering violation.
+	 * The zio layer will copy the provided blkptr later, but we needed
+	 * to take our own copy above so that we can release the parent's
+	 * rwlock now. We have to do that now so that if dbuf_read_done is
+	 * called synchronously (on an l1 cache hit) we don't acquire the
+	 * db_mtx while holding the parent's rwlock, which would be a lock
+	 * ordering violation.
 	 */
-	blkptr_t bp = *db->db_blkptr;
 	dmu_buf_unlock_parent(db, dblt, tag);
 	(void) arc_read(zio, db->db_objset->os_spa, &bp,
 	    dbuf_read_done, db, ZIO_PRIORITY_SYNC_READ, zio_flags,
@@ -1597,9 +1662,6 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	 */
 	ASSERT(!zfs_refcount_is_zero(&db->db_holds));
 
-	if (db->db_state == DB_NOFILL)
-		return (SET_ERROR(EIO));
-
 	DB_DNODE_ENTER(db);
 	dn = DB_DNODE(db);
 
@@ -1644,14 +1706,18 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		}
 		DB_DNODE_EXIT(db);
 		DBUF_STAT_BUMP(hash_hits);
-	} else if (db->db_state == DB_UNCACHED) {
+	} else if (db->db_state == DB_NOFILL && !dbuf_is_pending_clone(db)) {
+		mutex_exit(&db->db_mtx);
+		DB_DNODE_EXIT(db);
+		err = SET_ERROR(EIO);
+	} else if (db->db_state == DB_UNCACHED || db->db_state == DB_NOFILL) {
 		spa_t *spa = dn->dn_objset->os_spa;
 		boolean_t need_wait = B_FALSE;
 
 		db_lock_type_t dblt = dmu_buf_lock_parent(db, RW_READER, FTAG);
 
-		if (zio == NULL &&
-		    db->db_blkptr != NULL && !BP_IS_HOLE(db->db_blkptr)) {
+		if (zio == NULL && (db->db_state == DB_NOFILL ||
+		    (db->db_blkptr != NULL && !BP_IS_HOLE(db->db_blkptr)))) {
 			zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
 			need_wait = B_TRUE;
 		}
@@ -1760,13 +1826,20 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 
 	ASSERT(db->db_data_pending != dr);
 
-	/* free this block */
-	if (!BP_IS_HOLE(bp) && !dr->dt.dl.dr_nopwrite)
+	/*
+	 * Free this block, or for a clone, drop the reference we were
+	 * going to add to the block it was cloned from.
+	 */
+	if (dr->dt.dl.dr_brtwrite)
+		brt_pending_remove(db->db_objset->os_spa, bp, txg);
+	else if (!BP_IS_HOLE(bp) && !dr->dt.dl.dr_nopwrite)
 		zio_free(db->db_objset->os_spa, txg, bp);
 
 	dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
 	dr->dt.dl.dr_nopwrite = B_FALSE;
 	dr->dt.dl.dr_has_raw_params = B_FALSE;
+	dr->dt.dl.dr_diowrite = B_FALSE;
+	dr->dt.dl.dr_brtwrite = B_FALSE;
 
 	/*
 	 * Release the already-written buffer, so we leave it in
@@ -1774,9 +1847,11 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	 * modifying the buffer, so they will immediately do
 	 * another (redundant) arc_release().  Therefore, leave
 	 * the buf thawed to save the effort of freezing &
-	 * immediately re-thawing it.
+	 * immediately re-thawing it.  A clone which was never
+	 * read has no buffer.
 	 */
-	arc_release(dr->dt.dl.dr_data, db);
+	if (dr->dt.dl.dr_data != NULL)
+		arc_release(dr->dt.dl.dr_data, db);
 }
 
 /*
@@ -1826,6 +1901,20 @@ dbuf_free_range(dnode_t *dn, uint64_t start_blkid, uint64_t end_blkid,
 			continue;
 		}
 
+		/*
+		 * A clone made in an earlier txg which has not been synced
+		 * yet would otherwise still be read through its dirty record;
+		 * give the dbuf empty contents instead.
+		 */
+		if (db->db_state == DB_NOFILL && dbuf_is_pending_clone(db)) {
+			dbuf_set_data(db, dbuf_alloc_arcbuf(db));
+			bzero(db->db.db_data, db->db.db_size);
+			db->db_state = DB_CACHED;
+			DTRACE_SET_STATE(db, "pending clone freed");
+			mutex_exit(&db->db_mtx);
+			continue;
+		}
+
 		if (db->db_state == DB_UNCACHED ||
 		    db->db_state == DB_NOFILL ||
 		    db->db_state == DB_EVICTING) {
@@ -2338,12 +2427,13 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	}
 	DB_DNODE_EXIT(db);
 
-	if (db->db_state != DB_NOFILL) {
+	if (db->db_state != DB_NOFILL || dr->dt.dl.dr_brtwrite) {
+		ASSERT(db->db_state == DB_NOFILL || db->db_buf != NULL);
+		ASSERT(dr->dt.dl.dr_brtwrite || dr->dt.dl.dr_data != NULL);
 		dbuf_unoverride(dr);
 
-		ASSERT(db->db_buf != NULL);
-		ASSERT(dr->dt.dl.dr_data != NULL);
-		if (dr->dt.dl.dr_data != db->db_buf)
+		if (dr->dt.dl.dr_data != NULL &&
+		    dr->dt.dl.dr_data != db->db_buf)
 			arc_buf_destroy(dr->dt.dl.dr_data, db);
 	}
 
@@ -2425,9 +2515,34 @@ dmu_buf_will_not_fill(dmu_buf_t *db_fake, dmu_tx_t *tx)
 {
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
 
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+	ASSERT(tx->tx_txg != 0);
+	ASSERT(db->db_level == 0);
+	ASSERT(!zfs_refcount_is_zero(&db->db_holds));
+
+	ASSERT(db->db.db_object != DMU_META_DNODE_OBJECT ||
+	    dmu_tx_private_ok(tx));
+
 	db->db_state = DB_NOFILL;
 	DTRACE_SET_STATE(db, "allocating NOFILL buffer");
-	dmu_buf_will_fill(db_fake, tx);
+	dbuf_noread(db);
+	(void) dbuf_dirty(db, tx);
+}
+
+/*
+ * A NOFILL dbuf (e.g. a pending block clone) is about to be given real
+ * contents covering the whole block.  Whatever was dirtied for this txg
+ * is no longer needed, and the dbuf starts again from UNCACHED.
+ */
+static void
+dbuf_nofill_discard(dmu_buf_impl_t *db, dmu_tx_t *tx)
+{
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT3U(db->db_state, ==, DB_NOFILL);
+
+	VERIFY(!dbuf_undirty(db, tx));
+	db->db_state = DB_UNCACHED;
+	DTRACE_SET_STATE(db, "discarding NOFILL buffer");
 }
 
 void
@@ -2443,6 +2558,54 @@ dmu_buf_will_fill(dmu_buf_t *db_fake, dmu_tx_t *tx)
 	ASSERT(db->db.db_object != DMU_META_DNODE_OBJECT ||
 	    dmu_tx_private_ok(tx));
 
+	mutex_enter(&db->db_mtx);
+	if (db->db_state == DB_NOFILL)
+		dbuf_nofill_discard(db, tx);
+	mutex_exit(&db->db_mtx);
+
+	dbuf_noread(db);
+	(void) dbuf_dirty(db, tx);
+}
+
+/*
+ * Prepare a level-0 dbuf to have its contents replaced by a block clone;
+ * the caller then fills in the override in the dirty record.  Anything
+ * dirtied for this txg so far, including an earlier clone, is discarded.
+ */
+void
+dmu_buf_will_clone(dmu_buf_t *db_fake, dmu_tx_t *tx)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
+	dbuf_dirty_record_t *dr;
+
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+	ASSERT(tx->tx_txg != 0);
+	ASSERT(db->db_level == 0);
+	ASSERT(!zfs_refcount_is_zero(&db->db_holds));
+
+	mutex_enter(&db->db_mtx);
+	while (db->db_state == DB_READ || db->db_state == DB_FILL)
+		cv_wait(&db->db_changed, &db->db_mtx);
+	DBUF_VERIFY(db);
+	VERIFY(!dbuf_undirty(db, tx));
+	ASSERT3P(dbuf_find_dirty_eq(db, tx->tx_txg), ==, NULL);
+
+	if (db->db_buf != NULL) {
+		/*
+		 * An earlier txg's dirty record may still be using the
+		 * buffer; it is freed along with that record in that case.
+		 */
+		dr = list_head(&db->db_dirty_records);
+		if (dr == NULL || dr->dt.dl.dr_data != db->db_buf)
+			arc_buf_destroy(db->db_buf, db);
+		db->db_buf = NULL;
+		dbuf_clear_data(db);
+	}
+	db->db_state = DB_NOFILL;
+	DTRACE_SET_STATE(db, "allocating NOFILL buffer for clone");
+	DBUF_VERIFY(db);
+	mutex_exit(&db->db_mtx);
+
 	dbuf_noread(db);
 	(void) dbuf_dirty(db, tx);
 }
@@ -2612,6 +2775,9 @@ dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx)
 	while (db->db_state == DB_READ || db->db_state == DB_FILL)
 		cv_wait(&db->db_changed, &db->db_mtx);
 
+	if (db->db_state == DB_NOFILL)
+		dbuf_nofill_discard(db, tx);
+
 	ASSERT(db->db_state == DB_CACHED || db->db_state == DB_UNCACHED);
 
 	if (db->db_state == DB_CACHED &&
@@ -2904,6 +3070,7 @@ dbuf_create(dnode_t *dn, uint8_t level, uint64_t blkid,
 	db->db_user_immediate_evict = FALSE;
 	db->db_freed_in_flight = FALSE;
 	db->db_pending_evict = FALSE;
+	db->db_uncached = FALSE;
 
 	if (blkid == DMU_BONUS_BLKID) {
 		ASSERT3P(parent, ==, dn->dn_dbuf);
@@ -3624,7 +3791,7 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag, boolean_t evicting)
 			blkptr_t bp;
 			spa_t *spa = dmu_objset_spa(db->db_objset);
 
-			if (!DBUF_IS_CACHEABLE(db) &&
+			if ((!DBUF_IS_CACHEABLE(db) || db->db_uncached) &&
 			    db->db_blkptr != NULL &&
 			    !BP_IS_HOLE(db->db_blkptr) &&
 			    !BP_IS_EMBEDDED(db->db_blkptr)) {
@@ -3633,7 +3800,7 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag, boolean_t evicting)
 			}
 
 			if (!DBUF_IS_CACHEABLE(db) ||
-			    db->db_pending_evict) {
+			    db->db_pending_evict || db->db_uncached) {
 				dbuf_destroy(db);
 			} else if (!multilist_link_active(&db->db_cache_link)) {
 				ASSERT3U(db->db_caching_status, ==,
@@ -4005,6 +4172,12 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 	dprintf_dbuf_bp(db, db->db_blkptr, "blkptr=%p", db->db_blkptr);
 
 	mutex_enter(&db->db_mtx);
+	/*
+	 * A block clone which has not been synced yet may be being read
+	 * through its override bp (see dbuf_read_impl()).
+	 */
+	while (db->db_state == DB_READ)
+		cv_wait(&db->db_changed, &db->db_mtx);
 	/*
 	 * To be synced, we must be dirtied.  But we
 	 * might have been freed after the dirty.
@@ -4347,6 +4520,21 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 		dsl_dataset_t *ds = os->os_dsl_dataset;
 		(void) dsl_dataset_block_kill(ds, bp_orig, tx, B_TRUE);
 		dsl_dataset_block_born(ds, bp, tx);
+
+		if (os->os_dataset_kstats != NULL && db->db_level == 0 &&
+		    !DMU_OT_IS_METADATA(zio->io_prop.zp_type) &&
+		    zio->io_prop.zp_compress != ZIO_COMPRESS_OFF &&
+		    !(zio->io_flags & ZIO_FLAG_RAW_COMPRESS)) {
+			if (BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp)) {
+				dataset_kstats_update_nelided_kstat(
+				    os->os_dataset_kstats);
+			} else {
+				dataset_kstats_update_compress_kstats(
+				    os->os_dataset_kstats,
+				    BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF,
+				    zio->io_compress_aborted);
+			}
+		}
 	}
 
 	mutex_enter(&db->db_mtx);
@@ -4375,9 +4563,17 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 	if (db->db_level == 0) {
 		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
 		ASSERT(dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN);
-		if (db->db_state != DB_NOFILL) {
-			if (dr->dt.dl.dr_data != db->db_buf)
-				arc_buf_destroy(dr->dt.dl.dr_data, db);
+		if (dr->dt.dl.dr_data != NULL &&
+		    dr->dt.dl.dr_data != db->db_buf)
+			arc_buf_destroy(dr->dt.dl.dr_data, db);
+		/*
+		 * Once a clone that was never read is on disk, later reads
+		 * can go through db_blkptr like any other uncached block.
+		 */
+		if (db->db_state == DB_NOFILL && dr->dt.dl.dr_brtwrite &&
+		    list_is_empty(&db->db_dirty_records)) {
+			db->db_state = DB_UNCACHED;
+			DTRACE_SET_STATE(db, "clone written");
 		}
 	} else {
 		dnode_t *dn;
@@ -4462,7 +4658,8 @@ dbuf_write_override_done(zio_t *zio)
 	if (!BP_EQUAL(zio->io_bp, obp)) {
 		if (!BP_IS_HOLE(obp))
 			dsl_free(spa_get_dsl(zio->io_spa), zio->io_txg, obp);
-		arc_release(dr->dt.dl.dr_data, db);
+		if (dr->dt.dl.dr_data != NULL)
+			arc_release(dr->dt.dl.dr_data, db);
 	}
 	mutex_exit(&db->db_mtx);
 
@@ -4682,7 +4879,8 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 		mutex_enter(&db->db_mtx);
 		dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
 		zio_write_override(dr->dr_zio, &dr->dt.dl.dr_overridden_by,
-		    dr->dt.dl.dr_copies, dr->dt.dl.dr_nopwrite);
+		    dr->dt.dl.dr_copies, dr->dt.dl.dr_nopwrite,
+		    dr->dt.dl.dr_brtwrite);
 		mutex_exit(&db->db_mtx);
 	} else if (db->db_state == DB_NOFILL) {
 		ASSERT(zp.zp_checksum == ZIO_CHECKSUM_OFF ||
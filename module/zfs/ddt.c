@@ -31,12 +31,14 @@
 #include <sys/ddt.h>
 #include <sys/zap.h>
 #include <sys/dmu_tx.h>
+#include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/dsl_pool.h>
 #include <sys/zio_checksum.h>
 #include <sys/zio_compress.h>
 #include <sys/dsl_scan.h>
 #include <sys/abd.h>
+#include <sys/zfeature.h>
 
 static kmem_cache_t *ddt_cache;
 static kmem_cache_t *ddt_entry_cache;
@@ -619,11 +621,13 @@ ddt_init(void)
 	    sizeof (ddt_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 	ddt_entry_cache = kmem_cache_create("ddt_entry_cache",
 	    sizeof (ddt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	ddt_log_init();
 }
 
 void
 ddt_fini(void)
 {
+	ddt_log_fini();
 	kmem_cache_destroy(ddt_entry_cache);
 	kmem_cache_destroy(ddt_cache);
 }
@@ -670,6 +674,7 @@ ddt_entry_t *
 ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 {
 	ddt_entry_t *dde, dde_search;
+	ddt_log_entry_t *ddle;
 	enum ddt_type type;
 	enum ddt_class class;
 	avl_index_t where;
@@ -693,28 +698,53 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	if (dde->dde_loaded)
 		return (dde);
 
-	dde->dde_loading = B_TRUE;
+	/*
+	 * The log has the latest state of the entries in it.  Otherwise the
+	 * filter can tell us that a new block isn't in the ZAPs either.
+	 */
+	if (ddt_log_enabled(ddt) &&
+	    (ddle = ddt_log_find(ddt, &dde->dde_key)) != NULL) {
+		error = ENOENT;
+		type = DDT_TYPES;
+		class = DDT_CLASSES;
+		if (ddt_log_entry_is_live(ddle)) {
+			bcopy(ddle->ddle_phys, dde->dde_phys,
+			    sizeof (dde->dde_phys));
+			error = 0;
+			type = DDT_TYPE_CURRENT;
+			class = ddt_phys_total_refcnt(dde) > 1 ?
+			    DDT_CLASS_DUPLICATE : DDT_CLASS_UNIQUE;
+		}
+	} else if (!ddt_filter_may_contain(ddt, &dde->dde_key)) {
+		error = ENOENT;
+		type = DDT_TYPES;
+		class = DDT_CLASSES;
+	} else {
+		dde->dde_loading = B_TRUE;
 
-	ddt_exit(ddt);
+		ddt_exit(ddt);
 
-	error = ENOENT;
+		error = ENOENT;
 
-	for (type = 0; type < DDT_TYPES; type++) {
-		for (class = 0; class < DDT_CLASSES; class++) {
-			error = ddt_object_lookup(ddt, type, class, dde);
-			if (error != ENOENT) {
-				ASSERT0(error);
-				break;
+		for (type = 0; type < DDT_TYPES; type++) {
+			for (class = 0; class < DDT_CLASSES; class++) {
+				error = ddt_object_lookup(ddt, type, class,
+				    dde);
+				if (error != ENOENT) {
+					ASSERT0(error);
+					break;
+				}
 			}
+			if (error != ENOENT)
+				break;
 		}
-		if (error != ENOENT)
-			break;
-	}
 
-	ddt_enter(ddt);
+		ddt_enter(ddt);
+
+		ASSERT(dde->dde_loading == B_TRUE);
+	}
 
 	ASSERT(dde->dde_loaded == B_FALSE);
-	ASSERT(dde->dde_loading == B_TRUE);
 
 	dde->dde_type = type;	/* will be DDT_TYPES if no entry found */
 	dde->dde_class = class;	/* will be DDT_CLASSES if no entry found */
@@ -763,12 +793,10 @@ typedef struct ddt_key_cmp {
 } ddt_key_cmp_t;
 
 int
-ddt_entry_compare(const void *x1, const void *x2)
+ddt_key_compare(const ddt_key_t *key1, const ddt_key_t *key2)
 {
-	const ddt_entry_t *dde1 = x1;
-	const ddt_entry_t *dde2 = x2;
-	const ddt_key_cmp_t *k1 = (const ddt_key_cmp_t *)&dde1->dde_key;
-	const ddt_key_cmp_t *k2 = (const ddt_key_cmp_t *)&dde2->dde_key;
+	const ddt_key_cmp_t *k1 = (const ddt_key_cmp_t *)key1;
+	const ddt_key_cmp_t *k2 = (const ddt_key_cmp_t *)key2;
 	int32_t cmp = 0;
 
 	for (int i = 0; i < DDT_KEY_CMP_LEN; i++) {
@@ -780,6 +808,15 @@ ddt_entry_compare(const void *x1, const void *x2)
 	return (TREE_ISIGN(cmp));
 }
 
+int
+ddt_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_entry_t *dde1 = x1;
+	const ddt_entry_t *dde2 = x2;
+
+	return (ddt_key_compare(&dde1->dde_key, &dde2->dde_key));
+}
+
 static ddt_t *
 ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 {
@@ -796,6 +833,7 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
+	ddt_log_alloc(ddt);
 
 	return (ddt);
 }
@@ -807,6 +845,7 @@ ddt_table_free(ddt_t *ddt)
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
 	avl_destroy(&ddt->ddt_tree);
 	avl_destroy(&ddt->ddt_repair_tree);
+	ddt_log_free(ddt);
 	mutex_destroy(&ddt->ddt_lock);
 	kmem_cache_free(ddt_cache, ddt);
 }
@@ -845,6 +884,10 @@ ddt_load(spa_t *spa)
 			}
 		}
 
+		error = ddt_log_load(ddt);
+		if (error != 0 && error != ENOENT)
+			return (error);
+
 		/*
 		 * Seed the cached histograms.
 		 */
@@ -872,6 +915,7 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 {
 	ddt_t *ddt;
 	ddt_entry_t *dde;
+	boolean_t contains;
 
 	if (!BP_GET_DEDUP(bp))
 		return (B_FALSE);
@@ -884,6 +928,14 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 
 	ddt_key_fill(&(dde->dde_key), bp);
 
+	ddt_enter(ddt);
+	contains = ddt_filter_may_contain(ddt, &dde->dde_key);
+	ddt_exit(ddt);
+	if (!contains) {
+		kmem_cache_free(ddt_entry_cache, dde);
+		return (B_FALSE);
+	}
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class <= max_class; class++) {
 			if (ddt_object_lookup(ddt, type, class, dde) == 0) {
@@ -902,11 +954,23 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 {
 	ddt_key_t ddk;
 	ddt_entry_t *dde;
+	ddt_log_entry_t *ddle;
 
 	ddt_key_fill(&ddk, bp);
 
 	dde = ddt_alloc(&ddk);
 
+	ddt_enter(ddt);
+	if (ddt_log_enabled(ddt) &&
+	    (ddle = ddt_log_find(ddt, &ddk)) != NULL) {
+		bcopy(ddle->ddle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+		ddt_exit(ddt);
+		if (ddt_phys_total_refcnt(dde) <= 1)
+			bzero(dde->dde_phys, sizeof (dde->dde_phys));
+		return (dde);
+	}
+	ddt_exit(ddt);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -1042,6 +1106,19 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	else
 		nclass = DDT_CLASS_UNIQUE;
 
+	if (ddt_log_enabled(ddt)) {
+		/* The ZAPs are updated when the log is flushed */
+		ddt_log_append(ddt, dde, tx);
+		if (total_refcnt != 0) {
+			dde->dde_type = ntype;
+			dde->dde_class = nclass;
+			ddt_stat_update(ddt, dde, 0);
+			if (!ddt_object_exists(ddt, ntype, nclass))
+				ddt_object_create(ddt, ntype, nclass, tx);
+		}
+		return;
+	}
+
 	if (otype != DDT_TYPES &&
 	    (otype != ntype || oclass != nclass || total_refcnt == 0)) {
 		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
@@ -1070,14 +1147,84 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	}
 }
 
+/*
+ * Apply a flushed log entry to the ZAPs.  otype and oclass say which ZAP
+ * object the entry is in, if any; if that's DDT_TYPE_UNKNOWN, look for it.
+ */
+void
+ddt_flush_entry(ddt_t *ddt, ddt_entry_t *dde, enum ddt_type otype,
+    enum ddt_class oclass, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
+	enum ddt_type ntype = DDT_TYPE_CURRENT;
+	enum ddt_class nclass;
+	uint64_t total_refcnt = ddt_phys_total_refcnt(dde);
+	ddt_phys_t phys[DDT_PHYS_TYPES];
+
+	if (otype == DDT_TYPE_UNKNOWN) {
+		/* The lookup overwrites the phys */
+		bcopy(dde->dde_phys, phys, sizeof (phys));
+		otype = DDT_TYPE_NONE;
+		oclass = DDT_CLASSES;
+		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+			for (enum ddt_class class = 0; class < DDT_CLASSES;
+			    class++) {
+				if (otype == DDT_TYPE_NONE &&
+				    ddt_object_lookup(ddt, type, class,
+				    dde) == 0) {
+					otype = type;
+					oclass = class;
+				}
+			}
+		}
+		bcopy(phys, dde->dde_phys, sizeof (phys));
+	}
+
+	if (total_refcnt > 1)
+		nclass = DDT_CLASS_DUPLICATE;
+	else
+		nclass = DDT_CLASS_UNIQUE;
+
+	if (otype != DDT_TYPE_NONE &&
+	    (otype != ntype || oclass != nclass || total_refcnt == 0))
+		VERIFY0(ddt_object_remove(ddt, otype, oclass, dde, tx));
+
+	if (total_refcnt != 0) {
+		if (!ddt_object_exists(ddt, ntype, nclass))
+			ddt_object_create(ddt, ntype, nclass, tx);
+		VERIFY0(ddt_object_update(ddt, ntype, nclass, dde, tx));
+
+		ddt_enter(ddt);
+		ddt_filter_add(ddt, &dde->dde_key);
+		ddt_exit(ddt);
+
+		/* As in ddt_sync_entry(), but the ZAP class changes now */
+		if (nclass < oclass) {
+			dsl_scan_ddt_entry(dp->dp_scan,
+			    ddt->ddt_checksum, dde, tx);
+		}
+	}
+}
+
 static void
 ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
 	spa_t *spa = ddt->ddt_spa;
 	ddt_entry_t *dde;
 	void *cookie = NULL;
+	boolean_t empty = B_TRUE;
+
+	if (ddt_log_enabled(ddt) && spa_sync_pass(spa) == 1)
+		ddt_filter_sync(ddt, tx);
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	/*
+	 * Even without new changes, the log is flushed in the first pass
+	 * of each txg until it's empty, but only in txgs which are written
+	 * anyway; in particular not in the final ones of an export.
+	 */
+	if (avl_numnodes(&ddt->ddt_tree) == 0 &&
+	    (spa_sync_pass(spa) > 1 || ddt_log_idle(ddt) ||
+	    !dmu_objset_is_dirty(ddt->ddt_os, txg)))
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1088,11 +1235,18 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
+	if (!ddt_log_enabled(ddt) && avl_numnodes(&ddt->ddt_tree) != 0 &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DDT_LOG))
+		ddt_log_create(ddt, tx);
+
 	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
 		ddt_sync_entry(ddt, dde, tx, txg);
 		ddt_free(dde);
 	}
 
+	if (ddt_log_enabled(ddt))
+		ddt_log_sync(ddt, tx);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		uint64_t add, count = 0;
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
@@ -1103,12 +1257,20 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 				count += add;
 			}
 		}
+		/* Logged entries still need their objects' histograms */
+		if (count != 0 || !ddt_log_empty(ddt)) {
+			empty = B_FALSE;
+			continue;
+		}
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
-			if (count == 0 && ddt_object_exists(ddt, type, class))
+			if (ddt_object_exists(ddt, type, class))
 				ddt_object_destroy(ddt, type, class, tx);
 		}
 	}
 
+	if (empty && ddt_log_enabled(ddt))
+		ddt_log_destroy(ddt, tx);
+
 	bcopy(ddt->ddt_histogram, &ddt->ddt_histogram_cache,
 	    sizeof (ddt->ddt_histogram));
 	spa->spa_dedup_dspace = ~0ULL;
@@ -1151,6 +1313,30 @@ ddt_sync(spa_t *spa, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * Returns B_FALSE if the log has removed an entry we found in a ZAP, and
+ * otherwise updates it with its logged state.
+ */
+static boolean_t
+ddt_walk_log(ddt_t *ddt, ddt_entry_t *dde)
+{
+	ddt_log_entry_t *ddle;
+	boolean_t live = B_TRUE;
+
+	if (!ddt_log_enabled(ddt))
+		return (B_TRUE);
+
+	ddt_enter(ddt);
+	ddle = ddt_log_find(ddt, &dde->dde_key);
+	if (ddle != NULL) {
+		live = ddt_log_entry_is_live(ddle);
+		bcopy(ddle->ddle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+	}
+	ddt_exit(ddt);
+
+	return (live);
+}
+
 int
 ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 {
@@ -1159,11 +1345,14 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 			do {
 				ddt_t *ddt = spa->spa_ddt[ddb->ddb_checksum];
 				int error = ENOENT;
-				if (ddt_object_exists(ddt, ddb->ddb_type,
+				while (ddt_object_exists(ddt, ddb->ddb_type,
 				    ddb->ddb_class)) {
 					error = ddt_object_walk(ddt,
 					    ddb->ddb_type, ddb->ddb_class,
 					    &ddb->ddb_cursor, dde);
+					if (error != 0 ||
+					    ddt_walk_log(ddt, dde))
+						break;
 				}
 				dde->dde_type = ddb->ddb_type;
 				dde->dde_class = ddb->ddb_class;
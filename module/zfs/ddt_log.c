@@ -0,0 +1,765 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/ddt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/zio_checksum.h>
+#include <sys/zfeature.h>
+
+/*
+ * Without a log, every dedup write whose entry changes costs a ZAP update
+ * in the txg it's written in, and since the keys are checksums those
+ * updates land on random ZAP leaf blocks all over the table.  Once the
+ * table is larger than the ARC, each txg has to read and rewrite about one
+ * leaf block per changed entry.
+ *
+ * With the log, sync just appends the new state of each changed entry to
+ * the active log object, and keeps it in an in-core tree which is checked
+ * before the ZAPs on lookup.  The other log is flushed into the ZAPs a
+ * slice at a time in key order, which visits the leaf blocks sequentially
+ * and applies all the changes to an entry at once.  A log must be flushed
+ * completely before it becomes the active one again, so each slice is
+ * sized to finish it in about zfs_dedup_log_flush_txgs txgs.
+ */
+unsigned int zfs_dedup_log_flush_entries_min = 1000;
+unsigned int zfs_dedup_log_flush_txgs = 100;
+
+/*
+ * The filter uses zfs_dedup_filter_bits bits per entry it's sized for,
+ * which gives about 1% false positives at 10 bits.  It's sized for twice
+ * the entries the ZAPs held when it was built, and rebuilt larger once the
+ * ZAPs outgrow it, as long as it fits in zfs_dedup_filter_max_size bytes.
+ * A zfs_dedup_filter_bits of 0 disables it.
+ */
+unsigned int zfs_dedup_filter_bits = 10;
+unsigned long zfs_dedup_filter_max_size = 128 << 20;
+unsigned int zfs_dedup_filter_build_entries = 20000;
+
+#define	DDT_LOG_WBUF_RECORDS	256
+#define	DDT_LOG_READ_RECORDS	1024
+
+#define	DDT_FILTER_MIN_ENTRIES	(1 << 16)
+#define	DDT_FILTER_HASHES	7
+
+static kmem_cache_t *ddt_log_entry_cache;
+
+static int
+ddt_log_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_log_entry_t *ddle1 = x1;
+	const ddt_log_entry_t *ddle2 = x2;
+
+	return (ddt_key_compare(&ddle1->ddle_key, &ddle2->ddle_key));
+}
+
+void
+ddt_log_init(void)
+{
+	ddt_log_entry_cache = kmem_cache_create("ddt_log_entry_cache",
+	    sizeof (ddt_log_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+ddt_log_fini(void)
+{
+	kmem_cache_destroy(ddt_log_entry_cache);
+}
+
+void
+ddt_log_alloc(ddt_t *ddt)
+{
+	for (int n = 0; n < DDT_LOGS; n++) {
+		avl_create(&ddt->ddt_log[n].ddl_tree, ddt_log_entry_compare,
+		    sizeof (ddt_log_entry_t),
+		    offsetof(ddt_log_entry_t, ddle_node));
+	}
+	ddt->ddt_log_active = &ddt->ddt_log[0];
+	ddt->ddt_log_flushing = &ddt->ddt_log[1];
+}
+
+static void
+ddt_log_clear(ddt_log_t *ddl)
+{
+	ddt_log_entry_t *ddle;
+	void *cookie = NULL;
+
+	while ((ddle = avl_destroy_nodes(&ddl->ddl_tree, &cookie)) != NULL)
+		kmem_cache_free(ddt_log_entry_cache, ddle);
+}
+
+void
+ddt_log_free(ddt_t *ddt)
+{
+	for (int n = 0; n < DDT_LOGS; n++) {
+		ddt_log_clear(&ddt->ddt_log[n]);
+		avl_destroy(&ddt->ddt_log[n].ddl_tree);
+	}
+
+	if (ddt->ddt_log_wbuf != NULL) {
+		ASSERT0(ddt->ddt_log_wbuf_count);
+		vmem_free(ddt->ddt_log_wbuf,
+		    DDT_LOG_WBUF_RECORDS * sizeof (ddt_log_record_t));
+		ddt->ddt_log_wbuf = NULL;
+	}
+
+	ddt_filter_free(ddt);
+}
+
+static void
+ddt_log_name(ddt_t *ddt, int n, char *name)
+{
+	(void) snprintf(name, DDT_NAMELEN, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name, n);
+}
+
+/*
+ * Returns B_TRUE if changes to this DDT go through the log.
+ */
+boolean_t
+ddt_log_enabled(ddt_t *ddt)
+{
+	return (ddt->ddt_log[0].ddl_object != 0);
+}
+
+/*
+ * Returns B_TRUE if no logged change is waiting to be flushed.
+ */
+boolean_t
+ddt_log_empty(ddt_t *ddt)
+{
+	return (avl_numnodes(&ddt->ddt_log[0].ddl_tree) == 0 &&
+	    avl_numnodes(&ddt->ddt_log[1].ddl_tree) == 0);
+}
+
+/*
+ * Returns B_TRUE if syncing the log wouldn't change anything on disk.
+ */
+boolean_t
+ddt_log_idle(ddt_t *ddt)
+{
+	return (!ddt_log_enabled(ddt) || (ddt_log_empty(ddt) &&
+	    ddt->ddt_log[0].ddl_length == 0 &&
+	    ddt->ddt_log[1].ddl_length == 0));
+}
+
+/*
+ * Returns the logged state of an entry, which supersedes anything in the
+ * ZAPs, or NULL if it isn't in either log.
+ */
+ddt_log_entry_t *
+ddt_log_find(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_log_entry_t *ddle;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	/* The key is the first member of a log entry */
+	ddle = avl_find(&ddt->ddt_log_active->ddl_tree, ddk, NULL);
+	if (ddle == NULL)
+		ddle = avl_find(&ddt->ddt_log_flushing->ddl_tree, ddk, NULL);
+
+	return (ddle);
+}
+
+/*
+ * A log entry without any phys records the removal of the entry.
+ */
+boolean_t
+ddt_log_entry_is_live(const ddt_log_entry_t *ddle)
+{
+	for (int p = 0; p < DDT_PHYS_TYPES; p++) {
+		if (ddle->ddle_phys[p].ddp_phys_birth != 0)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+static int
+ddt_log_load_header(ddt_t *ddt, ddt_log_t *ddl, uint64_t object)
+{
+	ddt_log_phys_t *ddlp;
+	dmu_buf_t *db;
+	int error;
+
+	error = dmu_bonus_hold(ddt->ddt_os, object, FTAG, &db);
+	if (error != 0)
+		return (error);
+
+	ddlp = db->db_data;
+	if (ddlp->ddlp_version != DDT_LOG_VERSION) {
+		dmu_buf_rele(db, FTAG);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	ddl->ddl_object = object;
+	ddl->ddl_length = ddlp->ddlp_length;
+	ddl->ddl_first_txg = ddlp->ddlp_first_txg;
+	dmu_buf_rele(db, FTAG);
+
+	if (ddl->ddl_length % sizeof (ddt_log_record_t) != 0)
+		return (SET_ERROR(EINVAL));
+
+	return (0);
+}
+
+static void
+ddt_log_replay_record(ddt_t *ddt, ddt_log_t *ddl,
+    const ddt_log_record_t *ddlr)
+{
+	ddt_log_entry_t *ddle, *fddle;
+	avl_index_t where;
+
+	ddle = avl_find(&ddl->ddl_tree, &ddlr->ddlr_key, &where);
+	if (ddle == NULL) {
+		ddle = kmem_cache_alloc(ddt_log_entry_cache, KM_SLEEP);
+		ddle->ddle_key = ddlr->ddlr_key;
+		ddle->ddle_ztype = DDT_TYPE_UNKNOWN;
+		ddle->ddle_zclass = DDT_CLASSES;
+		avl_insert(&ddl->ddl_tree, ddle, where);
+
+		/* Anything in the active log supersedes the flushing one */
+		if (ddl == ddt->ddt_log_active) {
+			fddle = avl_find(&ddt->ddt_log_flushing->ddl_tree,
+			    &ddlr->ddlr_key, NULL);
+			if (fddle != NULL) {
+				avl_remove(&ddt->ddt_log_flushing->ddl_tree,
+				    fddle);
+				kmem_cache_free(ddt_log_entry_cache, fddle);
+			}
+		}
+	}
+
+	bcopy(ddlr->ddlr_phys, ddle->ddle_phys, sizeof (ddle->ddle_phys));
+}
+
+static int
+ddt_log_replay(ddt_t *ddt, ddt_log_t *ddl)
+{
+	uint64_t bufsize = DDT_LOG_READ_RECORDS * sizeof (ddt_log_record_t);
+	ddt_log_record_t *buf;
+	int error = 0;
+
+	buf = vmem_alloc(bufsize, KM_SLEEP);
+
+	for (uint64_t off = 0; off < ddl->ddl_length; off += bufsize) {
+		uint64_t size = MIN(bufsize, ddl->ddl_length - off);
+
+		error = dmu_read(ddt->ddt_os, ddl->ddl_object, off, size,
+		    buf, DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		for (int i = 0; i < size / sizeof (ddt_log_record_t); i++)
+			ddt_log_replay_record(ddt, ddl, &buf[i]);
+	}
+
+	vmem_free(buf, bufsize);
+	return (error);
+}
+
+/*
+ * Rebuild the in-core trees from the log objects.  The flushing log is
+ * older, so it's replayed first.  We don't know which ZAP objects the
+ * replayed entries are in until they're flushed.
+ */
+int
+ddt_log_load(ddt_t *ddt)
+{
+	uint64_t object[DDT_LOGS];
+	char name[DDT_NAMELEN];
+	int error;
+
+	for (int n = 0; n < DDT_LOGS; n++) {
+		ddt_log_name(ddt, n, name);
+		error = zap_lookup(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT,
+		    name, sizeof (uint64_t), 1, &object[n]);
+		if (error != 0)
+			return (error);
+	}
+
+	for (int n = 0; n < DDT_LOGS; n++) {
+		error = ddt_log_load_header(ddt, &ddt->ddt_log[n], object[n]);
+		if (error != 0)
+			return (error);
+	}
+
+	if (ddt->ddt_log[0].ddl_first_txg < ddt->ddt_log[1].ddl_first_txg) {
+		ddt->ddt_log_active = &ddt->ddt_log[1];
+		ddt->ddt_log_flushing = &ddt->ddt_log[0];
+	}
+
+	error = ddt_log_replay(ddt, ddt->ddt_log_flushing);
+	if (error == 0)
+		error = ddt_log_replay(ddt, ddt->ddt_log_active);
+
+	return (error);
+}
+
+static void
+ddt_log_sync_header(ddt_t *ddt, ddt_log_t *ddl, dmu_tx_t *tx)
+{
+	ddt_log_phys_t *ddlp;
+	dmu_buf_t *db;
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db));
+	ddlp = db->db_data;
+	if (ddlp->ddlp_version != DDT_LOG_VERSION ||
+	    ddlp->ddlp_length != ddl->ddl_length ||
+	    ddlp->ddlp_first_txg != ddl->ddl_first_txg) {
+		dmu_buf_will_dirty(db, tx);
+		ddlp->ddlp_version = DDT_LOG_VERSION;
+		ddlp->ddlp_length = ddl->ddl_length;
+		ddlp->ddlp_first_txg = ddl->ddl_first_txg;
+	}
+	dmu_buf_rele(db, FTAG);
+}
+
+void
+ddt_log_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT(!ddt_log_enabled(ddt));
+	ASSERT(ddt_log_empty(ddt));
+
+	for (int n = 0; n < DDT_LOGS; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ddl->ddl_object = dmu_object_alloc(ddt->ddt_os,
+		    DMU_OTN_UINT64_METADATA, SPA_OLD_MAXBLOCKSIZE,
+		    DMU_OTN_UINT64_METADATA, sizeof (ddt_log_phys_t), tx);
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = (n == 0) ? dmu_tx_get_txg(tx) : 0;
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_add(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+		    sizeof (uint64_t), 1, &ddl->ddl_object, tx));
+		ddt_log_sync_header(ddt, ddl, tx);
+	}
+	ddt->ddt_log_active = &ddt->ddt_log[0];
+	ddt->ddt_log_flushing = &ddt->ddt_log[1];
+
+	spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DDT_LOG, tx);
+}
+
+/*
+ * Called once the DDT is empty.  Without the logs, the filter is no
+ * longer kept up to date.
+ */
+void
+ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT(ddt_log_enabled(ddt));
+	ASSERT(ddt_log_empty(ddt));
+	ASSERT0(ddt->ddt_log_wbuf_count);
+
+	for (int n = 0; n < DDT_LOGS; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_remove(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT,
+		    name, tx));
+		VERIFY0(dmu_object_free(ddt->ddt_os, ddl->ddl_object, tx));
+		ddl->ddl_object = 0;
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = 0;
+	}
+
+	spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DDT_LOG, tx);
+
+	ddt_filter_free(ddt);
+}
+
+static void
+ddt_log_write_buf(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+	uint64_t size = ddt->ddt_log_wbuf_count * sizeof (ddt_log_record_t);
+
+	if (size == 0)
+		return;
+
+	dmu_write(ddt->ddt_os, ddl->ddl_object, ddl->ddl_length, size,
+	    ddt->ddt_log_wbuf, tx);
+	ddl->ddl_length += size;
+	ddt->ddt_log_wbuf_count = 0;
+}
+
+/*
+ * Log the new state of an entry synced in this txg.  If it isn't in the
+ * active log yet, remember which ZAP object it's in: that's where its
+ * flushing log entry was going to put it, or else where ddt_lookup() found
+ * it.
+ */
+void
+ddt_log_append(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+	avl_tree_t *ft = &ddt->ddt_log_flushing->ddl_tree;
+	ddt_log_entry_t *ddle, *fddle;
+	ddt_log_record_t *ddlr;
+	avl_index_t where;
+
+	ASSERT(ddt_log_enabled(ddt));
+
+	ddt_enter(ddt);
+	ddle = avl_find(&ddl->ddl_tree, &dde->dde_key, &where);
+	if (ddle == NULL) {
+		ddle = kmem_cache_alloc(ddt_log_entry_cache, KM_SLEEP);
+		ddle->ddle_key = dde->dde_key;
+
+		fddle = avl_find(ft, &dde->dde_key, NULL);
+		if (fddle != NULL) {
+			ddle->ddle_ztype = fddle->ddle_ztype;
+			ddle->ddle_zclass = fddle->ddle_zclass;
+			avl_remove(ft, fddle);
+			kmem_cache_free(ddt_log_entry_cache, fddle);
+		} else {
+			ddle->ddle_ztype = dde->dde_type;
+			ddle->ddle_zclass = dde->dde_class;
+		}
+		avl_insert(&ddl->ddl_tree, ddle, where);
+	}
+	bcopy(dde->dde_phys, ddle->ddle_phys, sizeof (ddle->ddle_phys));
+	ddt_exit(ddt);
+
+	if (ddt->ddt_log_wbuf == NULL) {
+		ddt->ddt_log_wbuf = vmem_alloc(
+		    DDT_LOG_WBUF_RECORDS * sizeof (ddt_log_record_t), KM_SLEEP);
+	}
+
+	ddlr = &ddt->ddt_log_wbuf[ddt->ddt_log_wbuf_count++];
+	ddlr->ddlr_key = dde->dde_key;
+	bcopy(dde->dde_phys, ddlr->ddlr_phys, sizeof (ddlr->ddlr_phys));
+
+	if (ddt->ddt_log_wbuf_count == DDT_LOG_WBUF_RECORDS)
+		ddt_log_write_buf(ddt, tx);
+}
+
+/*
+ * Move a slice of the flushing log into the ZAPs, lowest keys first.  Once
+ * it's empty, its object is truncated and it becomes the active log.
+ */
+static void
+ddt_log_flush(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+	ddt_log_entry_t *ddle;
+	ddt_entry_t *dde;
+	uint64_t count;
+
+	if (avl_numnodes(&ddl->ddl_tree) == 0) {
+		if (ddl->ddl_length != 0) {
+			VERIFY0(dmu_free_range(ddt->ddt_os, ddl->ddl_object,
+			    0, DMU_OBJECT_END, tx));
+			ddl->ddl_length = 0;
+		}
+		/*
+		 * The logs are told apart on import by their first txg, so
+		 * the active log must be at least a txg old to be swapped.
+		 */
+		if (ddt->ddt_log_active->ddl_length == 0 ||
+		    ddt->ddt_log_active->ddl_first_txg >= dmu_tx_get_txg(tx))
+			return;
+
+		ASSERT0(ddt->ddt_log_wbuf_count);
+		ddt_enter(ddt);
+		ddt->ddt_log_flushing = ddt->ddt_log_active;
+		ddt->ddt_log_active = ddl;
+		ddt_exit(ddt);
+		ddl->ddl_first_txg = dmu_tx_get_txg(tx);
+		ddl = ddt->ddt_log_flushing;
+	}
+
+	count = MAX(zfs_dedup_log_flush_entries_min,
+	    avl_numnodes(&ddl->ddl_tree) / MAX(zfs_dedup_log_flush_txgs, 1));
+
+	dde = kmem_zalloc(sizeof (ddt_entry_t), KM_SLEEP);
+	while (count-- > 0 && (ddle = avl_first(&ddl->ddl_tree)) != NULL) {
+		dde->dde_key = ddle->ddle_key;
+		bcopy(ddle->ddle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+		ddt_flush_entry(ddt, dde, ddle->ddle_ztype, ddle->ddle_zclass,
+		    tx);
+
+		/* The ZAP is up to date before the entry leaves the log */
+		ddt_enter(ddt);
+		avl_remove(&ddl->ddl_tree, ddle);
+		ddt_exit(ddt);
+		kmem_cache_free(ddt_log_entry_cache, ddle);
+	}
+	kmem_free(dde, sizeof (ddt_entry_t));
+}
+
+/*
+ * Write out this txg's log records, and in the first pass flush part of
+ * the flushing log.
+ */
+void
+ddt_log_sync(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ASSERT(ddt_log_enabled(ddt));
+
+	ddt_log_write_buf(ddt, tx);
+
+	if (spa_sync_pass(ddt->ddt_spa) == 1)
+		ddt_log_flush(ddt, tx);
+
+	for (int n = 0; n < DDT_LOGS; n++)
+		ddt_log_sync_header(ddt, &ddt->ddt_log[n], tx);
+}
+
+void
+ddt_log_stats(spa_t *spa, uint64_t *entries, uint64_t *bytes)
+{
+	*entries = 0;
+	*bytes = 0;
+
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+
+		if (ddt == NULL || !ddt_log_enabled(ddt))
+			continue;
+
+		ddt_enter(ddt);
+		for (int n = 0; n < DDT_LOGS; n++) {
+			*entries += avl_numnodes(&ddt->ddt_log[n].ddl_tree);
+			*bytes += ddt->ddt_log[n].ddl_length;
+		}
+		ddt_exit(ddt);
+	}
+}
+
+static inline uint64_t
+ddt_filter_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (h);
+}
+
+/*
+ * Double hashing: probe i is at h1 + i * h2.  h2 is odd, so the probes
+ * are distinct in a power of 2 sized filter.
+ */
+static void
+ddt_filter_hash(const ddt_key_t *ddk, uint64_t *h1, uint64_t *h2)
+{
+	*h1 = ddt_filter_mix(ddk->ddk_cksum.zc_word[0] ^ ddk->ddk_prop);
+	*h2 = ddt_filter_mix(ddk->ddk_cksum.zc_word[1] ^
+	    ddk->ddk_cksum.zc_word[2]) | 1;
+}
+
+void
+ddt_filter_add(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	uint64_t h1, h2, bit;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	if (ddt->ddt_filter == NULL)
+		return;
+
+	ddt_filter_hash(ddk, &h1, &h2);
+	for (int i = 0; i < DDT_FILTER_HASHES; i++) {
+		bit = (h1 + i * h2) & (ddt->ddt_filter_bits - 1);
+		ddt->ddt_filter[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+/*
+ * Returns B_FALSE only if the key definitely isn't in any ZAP object.
+ */
+boolean_t
+ddt_filter_may_contain(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	uint64_t h1, h2, bit;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	if (ddt->ddt_filter_state != DDT_FILTER_READY)
+		return (B_TRUE);
+
+	ddt_filter_hash(ddk, &h1, &h2);
+	for (int i = 0; i < DDT_FILTER_HASHES; i++) {
+		bit = (h1 + i * h2) & (ddt->ddt_filter_bits - 1);
+		if (!(ddt->ddt_filter[bit >> 6] & (1ULL << (bit & 63))))
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+void
+ddt_filter_free(ddt_t *ddt)
+{
+	uint64_t *filter = ddt->ddt_filter;
+
+	if (filter == NULL)
+		return;
+
+	ddt_enter(ddt);
+	ddt->ddt_filter = NULL;
+	ddt->ddt_filter_state = DDT_FILTER_NONE;
+	ddt_exit(ddt);
+
+	vmem_free(filter, ddt->ddt_filter_bits / NBBY);
+	ddt->ddt_filter_bits = 0;
+	ddt->ddt_filter_capacity = 0;
+}
+
+static uint64_t
+ddt_filter_zap_count(ddt_t *ddt)
+{
+	uint64_t count = 0;
+
+	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+		for (enum ddt_class class = 0; class < DDT_CLASSES; class++)
+			count += ddt->ddt_object_stats[type][class].ddo_count;
+	}
+
+	return (count);
+}
+
+static void
+ddt_filter_alloc(ddt_t *ddt)
+{
+	uint64_t count = ddt_filter_zap_count(ddt);
+	uint64_t bits, max_bits, capacity;
+
+	bits = MAX(count * 2, DDT_FILTER_MIN_ENTRIES) * zfs_dedup_filter_bits;
+	bits = 1ULL << highbit64(bits - 1);
+	max_bits = 1ULL << (highbit64(MAX(zfs_dedup_filter_max_size, 8)) + 2);
+	bits = MIN(bits, max_bits);
+	capacity = bits / zfs_dedup_filter_bits;
+
+	/* Too small to be of any use */
+	if (count >= capacity)
+		return;
+
+	ddt->ddt_filter_bits = bits;
+	ddt->ddt_filter_capacity = capacity;
+	bzero(&ddt->ddt_filter_cursor, sizeof (ddt_bookmark_t));
+
+	ddt_enter(ddt);
+	ddt->ddt_filter = vmem_zalloc(bits / NBBY, KM_SLEEP);
+	ddt->ddt_filter_state = DDT_FILTER_BUILDING;
+	ddt_exit(ddt);
+}
+
+/*
+ * Add the next zfs_dedup_filter_build_entries keys in the ZAPs to the
+ * filter.  Keys flushed meanwhile are added as they're flushed, so the
+ * filter is complete once the walk is.
+ */
+static void
+ddt_filter_build(ddt_t *ddt)
+{
+	ddt_bookmark_t *ddb = &ddt->ddt_filter_cursor;
+	unsigned int n = zfs_dedup_filter_build_entries;
+	ddt_entry_t *dde;
+	int error;
+
+	dde = kmem_alloc(sizeof (ddt_entry_t), KM_SLEEP);
+	while (n > 0 && ddb->ddb_class < DDT_CLASSES) {
+		error = ENOENT;
+		if (ddt_object_exists(ddt, ddb->ddb_type, ddb->ddb_class)) {
+			error = ddt_object_walk(ddt, ddb->ddb_type,
+			    ddb->ddb_class, &ddb->ddb_cursor, dde);
+		}
+		if (error == 0) {
+			ddt_enter(ddt);
+			ddt_filter_add(ddt, &dde->dde_key);
+			ddt_exit(ddt);
+			n--;
+			continue;
+		}
+		if (error != ENOENT) {
+			/* An incomplete filter would be wrong, not slow */
+			kmem_free(dde, sizeof (ddt_entry_t));
+			ddt_filter_free(ddt);
+			return;
+		}
+		ddb->ddb_cursor = 0;
+		if (++ddb->ddb_type == DDT_TYPES) {
+			ddb->ddb_type = 0;
+			ddb->ddb_class++;
+		}
+	}
+	kmem_free(dde, sizeof (ddt_entry_t));
+
+	if (ddb->ddb_class == DDT_CLASSES) {
+		ddt_enter(ddt);
+		ddt->ddt_filter_state = DDT_FILTER_READY;
+		ddt_exit(ddt);
+	}
+}
+
+/*
+ * Called in the first pass of each txg while the log is in use, to
+ * create, build or resize the filter.
+ */
+void
+ddt_filter_sync(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ASSERT(ddt_log_enabled(ddt));
+
+	if (zfs_dedup_filter_bits == 0) {
+		ddt_filter_free(ddt);
+		return;
+	}
+
+	if (ddt->ddt_filter != NULL &&
+	    ddt_filter_zap_count(ddt) > ddt->ddt_filter_capacity)
+		ddt_filter_free(ddt);
+
+	if (ddt->ddt_filter == NULL)
+		ddt_filter_alloc(ddt);
+
+	if (ddt->ddt_filter_state == DDT_FILTER_BUILDING)
+		ddt_filter_build(ddt);
+}
+
+/* BEGIN CSTYLED */
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_entries_min, UINT, ZMOD_RW,
+	"Minimum number of DDT log entries to flush per txg");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_txgs, UINT, ZMOD_RW,
+	"Number of txgs to spread flushing a DDT log over");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, filter_bits, UINT, ZMOD_RW,
+	"Bits per entry in the DDT filter, 0 to disable it");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, filter_max_size, ULONG, ZMOD_RW,
+	"Maximum size of the DDT filter in bytes");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, filter_build_entries, UINT, ZMOD_RW,
+	"Number of DDT entries to add to the filter per txg while building it");
+/* END CSTYLED */
@@ -50,6 +50,7 @@
 #include <sys/zio_compress.h>
 #include <sys/sa.h>
 #include <sys/zfeature.h>
+#include <sys/brt.h>
 #include <sys/abd.h>
 #include <sys/trace_zfs.h>
 #include <sys/zfs_rlock.h>
@@ -1151,6 +1152,120 @@ dmu_write_embedded(objset_t *os, uint64_t object, uint64_t offset,
 	dmu_buf_rele(db, FTAG);
 }
 
+/*
+ * Collect the level-0 block pointers covering [offset, offset + length) of
+ * the given object, for use by dmu_brt_clone().  The range must be block
+ * aligned.  Blocks which are dirty (other than by an earlier clone) do not
+ * have a final block pointer yet; EAGAIN is returned for those and the
+ * caller may wait for the txg to sync and try again.  Dedup blocks are
+ * reference counted by the DDT and cannot be cloned.
+ */
+int
+dmu_read_l0_bps(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t length, blkptr_t *bps, size_t *nbpsp)
+{
+	dmu_buf_t **dbp;
+	int numbufs, error;
+
+	error = dmu_buf_hold_array(os, object, offset, length, FALSE, FTAG,
+	    &numbufs, &dbp);
+	if (error != 0)
+		return (error);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dbuf_dirty_record_t *dr;
+		blkptr_t *bp = &bps[i];
+
+		mutex_enter(&db->db_mtx);
+		dr = list_head(&db->db_dirty_records);
+		if (dr != NULL) {
+			if (!dr->dt.dl.dr_brtwrite) {
+				mutex_exit(&db->db_mtx);
+				error = SET_ERROR(EAGAIN);
+				break;
+			}
+			*bp = dr->dt.dl.dr_overridden_by;
+		} else if (db->db_blkptr == NULL) {
+			BP_ZERO(bp);
+		} else {
+			db_lock_type_t dblt;
+
+			dblt = dmu_buf_lock_parent(db, RW_READER, FTAG);
+			*bp = *db->db_blkptr;
+			dmu_buf_unlock_parent(db, dblt, FTAG);
+		}
+		mutex_exit(&db->db_mtx);
+
+		if (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp) &&
+		    BP_GET_DEDUP(bp)) {
+			error = SET_ERROR(EOPNOTSUPP);
+			break;
+		}
+	}
+	if (error == 0)
+		*nbpsp = numbufs;
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (error);
+}
+
+/*
+ * Make [offset, offset + length) of the given object reference the blocks
+ * in bps, as returned by dmu_read_l0_bps() for a range of the same size
+ * and block size in this pool.  No data is copied: the blocks are written
+ * out as overrides of the dirty records, and the extra references are
+ * recorded in the BRT when this txg syncs.
+ */
+void
+dmu_brt_clone(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t length, dmu_tx_t *tx, const blkptr_t *bps, size_t nbps)
+{
+	spa_t *spa = dmu_objset_spa(os);
+	dmu_buf_t **dbp;
+	int numbufs;
+
+	ASSERT(spa_feature_is_enabled(spa, SPA_FEATURE_BLOCK_CLONING));
+
+	VERIFY0(dmu_buf_hold_array(os, object, offset, length, FALSE, FTAG,
+	    &numbufs, &dbp));
+	VERIFY3U(nbps, ==, numbufs);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		const blkptr_t *bp = &bps[i];
+		dbuf_dirty_record_t *dr;
+
+		ASSERT3U(db->db.db_object, !=, DMU_META_DNODE_OBJECT);
+		ASSERT0(db->db_level);
+		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+		ASSERT(db->db_blkid != DMU_SPILL_BLKID);
+		ASSERT(BP_IS_HOLE(bp) || db->db.db_size == BP_GET_LSIZE(bp));
+
+		dmu_buf_will_clone(&db->db, tx);
+
+		mutex_enter(&db->db_mtx);
+		dr = list_head(&db->db_dirty_records);
+		VERIFY(dr != NULL);
+		ASSERT3U(dr->dr_txg, ==, tx->tx_txg);
+		dr->dt.dl.dr_overridden_by = *bp;
+		if (BP_IS_EMBEDDED(bp)) {
+			dr->dt.dl.dr_overridden_by.blk_birth = dr->dr_txg;
+		} else if (!BP_IS_HOLE(bp)) {
+			BP_SET_BIRTH(&dr->dt.dl.dr_overridden_by, dr->dr_txg,
+			    BP_PHYSICAL_BIRTH(bp));
+		}
+		dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
+		dr->dt.dl.dr_brtwrite = B_TRUE;
+		mutex_exit(&db->db_mtx);
+
+		brt_pending_add(spa, bp, tx);
+	}
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+}
+
 void
 dmu_redact(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
     dmu_tx_t *tx)
@@ -1866,6 +1981,16 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 	 */
 	mutex_enter(&db->db_mtx);
 
+	/*
+	 * A Direct I/O write of this block may still be in flight.  Wait
+	 * for it so that we can either log the block pointer it produced
+	 * or, if it failed, write the block ourselves.
+	 */
+	while ((dr = dbuf_find_dirty_eq(db, txg)) != NULL &&
+	    dr->dt.dl.dr_diowrite &&
+	    dr->dt.dl.dr_override_state == DR_IN_DMU_SYNC)
+		cv_wait(&db->db_changed, &db->db_mtx);
+
 	if (txg <= spa_last_synced_txg(os->os_spa)) {
 		/*
 		 * This txg has already synced.  There's nothing to do.
@@ -1941,6 +2066,22 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 	DB_DNODE_EXIT(db);
 
 	ASSERT(dr->dr_txg == txg);
+	if (dr->dt.dl.dr_diowrite) {
+		/*
+		 * This block has already been written by Direct I/O.  There
+		 * is no earlier log record to rely on, so log the block
+		 * pointer of that write rather than returning EALREADY.
+		 */
+		ASSERT(dr->dt.dl.dr_override_state == DR_OVERRIDDEN);
+		*zgd->zgd_bp = dr->dt.dl.dr_overridden_by;
+		mutex_exit(&db->db_mtx);
+
+		if (!BP_IS_HOLE(zgd->zgd_bp))
+			zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
+		done(zgd, 0);
+		return (0);
+	}
+
 	if (dr->dt.dl.dr_override_state == DR_IN_DMU_SYNC ||
 	    dr->dt.dl.dr_override_state == DR_OVERRIDDEN) {
 		/*
@@ -2091,6 +2232,7 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 		 */
 		compress = zio_compress_select(os->os_spa,
 		    ZIO_COMPRESS_ON, ZIO_COMPRESS_ON);
+		complevel = ZIO_COMPLEVEL_DEFAULT;
 
 		/*
 		 * Metadata always gets checksummed.  If the data
@@ -2194,6 +2336,7 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	zp->zp_dedup = dedup;
 	zp->zp_dedup_verify = dedup && dedup_verify;
 	zp->zp_nopwrite = nopwrite;
+	zp->zp_brtwrite = B_FALSE;
 	zp->zp_encrypt = encrypt;
 	zp->zp_byteorder = ZFS_HOST_BYTEORDER;
 	bzero(zp->zp_salt, ZIO_DATA_SALT_LEN);
@@ -2448,6 +2591,8 @@ EXPORT_SYMBOL(dmu_read_by_dnode);
 EXPORT_SYMBOL(dmu_write);
 EXPORT_SYMBOL(dmu_write_by_dnode);
 EXPORT_SYMBOL(dmu_prealloc);
+EXPORT_SYMBOL(dmu_read_l0_bps);
+EXPORT_SYMBOL(dmu_brt_clone);
 EXPORT_SYMBOL(dmu_object_info);
 EXPORT_SYMBOL(dmu_object_info_from_dnode);
 EXPORT_SYMBOL(dmu_object_info_from_db);
@@ -0,0 +1,387 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Direct I/O support for the DMU.
+ *
+ * Direct I/O requests bypass the ARC for whole, block-aligned ranges of an
+ * object.  Reads are issued straight from the block pointer into a caller
+ * supplied buffer and never populate the ARC.  Writes still dirty the dbuf
+ * for the open txg (so that readers, the ZIL and the sync thread all see a
+ * consistent view of the block) but the block is written out immediately,
+ * in the caller's context, and the resulting block pointer overrides the
+ * dirty record in exactly the same way dmu_sync() does for the ZIL.  Once
+ * the txg syncs and the last hold is dropped the dbuf and its ARC buffer
+ * are evicted instead of being cached.
+ *
+ * Requests which are not block-aligned are expected to be served by the
+ * regular buffered paths; see the platform zfs_read()/zfs_write().
+ */
+
+#include <sys/dmu.h>
+#include <sys/dmu_impl.h>
+#include <sys/dmu_tx.h>
+#include <sys/dbuf.h>
+#include <sys/dnode.h>
+#include <sys/zfs_context.h>
+#include <sys/dmu_objset.h>
+#include <sys/spa.h>
+#include <sys/zio.h>
+#include <sys/abd.h>
+
+typedef struct dmu_direct_arg {
+	dbuf_dirty_record_t	*dda_dr;
+	blkptr_t		dda_bp;
+} dmu_direct_arg_t;
+
+/* ARGSUSED */
+static void
+dmu_write_direct_ready(zio_t *zio, arc_buf_t *buf, void *varg)
+{
+	dmu_direct_arg_t *dda = varg;
+	dmu_buf_impl_t *db = dda->dda_dr->dr_dbuf;
+	blkptr_t *bp = zio->io_bp;
+
+	if (zio->io_error == 0) {
+		if (BP_IS_HOLE(bp)) {
+			BP_SET_LSIZE(bp, db->db.db_size);
+		} else if (!BP_IS_EMBEDDED(bp)) {
+			ASSERT(BP_GET_LEVEL(bp) == 0);
+			BP_SET_FILL(bp, 1);
+		}
+	}
+}
+
+/* ARGSUSED */
+static void
+dmu_write_direct_done(zio_t *zio, arc_buf_t *buf, void *varg)
+{
+	dmu_direct_arg_t *dda = varg;
+	dbuf_dirty_record_t *dr = dda->dda_dr;
+	dmu_buf_impl_t *db = dr->dr_dbuf;
+
+	mutex_enter(&db->db_mtx);
+	ASSERT(dr->dt.dl.dr_override_state == DR_IN_DMU_SYNC);
+	ASSERT(dr->dt.dl.dr_diowrite);
+	if (zio->io_error == 0) {
+		dr->dt.dl.dr_overridden_by = *zio->io_bp;
+		dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
+		dr->dt.dl.dr_copies = zio->io_prop.zp_copies;
+
+		/* See the comment in dmu_sync_done() regarding holes. */
+		if (BP_IS_HOLE(&dr->dt.dl.dr_overridden_by) &&
+		    dr->dt.dl.dr_overridden_by.blk_birth == 0)
+			BP_ZERO(&dr->dt.dl.dr_overridden_by);
+	} else {
+		/*
+		 * The data is still attached to the dirty record, so on
+		 * failure simply let the syncing txg write it as usual.
+		 */
+		dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
+		dr->dt.dl.dr_diowrite = B_FALSE;
+	}
+	cv_broadcast(&db->db_changed);
+	mutex_exit(&db->db_mtx);
+
+	dbuf_rele(db, dda);
+	kmem_free(dda, sizeof (*dda));
+}
+
+/*
+ * Assign 'buf' to the block at 'offset' of 'dn' and issue the write for it
+ * immediately as a child of 'pio', without waiting for the txg to sync.
+ * The caller must hold a range lock covering the block and must wait for
+ * 'pio' before dropping it, and before committing 'tx' if it intends to
+ * dirty the block again in the same txg.  An I/O error is not fatal: the
+ * block is then written by the syncing txg like any other dirty buffer.
+ *
+ * As with dmu_assign_arcbuf_by_dnode(), 'buf' is consumed on success and
+ * remains owned by the caller on error.  When 'buf' does not exactly cover
+ * one block the data is written through the regular dbuf path instead.
+ */
+int
+dmu_write_direct_by_dnode(zio_t *pio, dnode_t *dn, uint64_t offset,
+    arc_buf_t *buf, dmu_tx_t *tx)
+{
+	objset_t *os = dn->dn_objset;
+	spa_t *spa = os->os_spa;
+	uint64_t txg = dmu_tx_get_txg(tx);
+	dmu_direct_arg_t *dda;
+	dbuf_dirty_record_t *dr;
+	dmu_buf_impl_t *db;
+	zbookmark_phys_t zb;
+	zio_prop_t zp;
+	uint64_t blkid;
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	blkid = dbuf_whichblock(dn, 0, offset);
+	db = dbuf_hold(dn, blkid, FTAG);
+	rw_exit(&dn->dn_struct_rwlock);
+	if (db == NULL)
+		return (SET_ERROR(EIO));
+
+	if (offset != db->db.db_offset ||
+	    arc_buf_lsize(buf) != db->db.db_size ||
+	    txg > spa_freeze_txg(spa)) {
+		dbuf_rele(db, FTAG);
+		return (dmu_assign_arcbuf_by_dnode(dn, offset, buf, tx));
+	}
+
+	dbuf_assign_arcbuf(db, buf, tx);
+
+	mutex_enter(&db->db_mtx);
+	dr = dbuf_find_dirty_eq(db, txg);
+	ASSERT3P(dr, !=, NULL);
+	ASSERT(dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN);
+	dr->dt.dl.dr_override_state = DR_IN_DMU_SYNC;
+	dr->dt.dl.dr_diowrite = B_TRUE;
+	db->db_uncached = B_TRUE;
+	mutex_exit(&db->db_mtx);
+
+	/*
+	 * Dedup is handled by the caller falling back to buffered writes,
+	 * and we never nopwrite: the on-disk block may still change before
+	 * this txg syncs if it is dirty in an earlier one.
+	 */
+	dmu_write_policy(os, dn, 0, WP_DMU_SYNC, &zp);
+	zp.zp_nopwrite = B_FALSE;
+
+	SET_BOOKMARK(&zb, dmu_objset_id(os), dn->dn_object, 0, blkid);
+
+	/*
+	 * The dbuf is held until the write is done.  Otherwise releasing the
+	 * last hold would freeze the buffer while the write may still be
+	 * reallocating its header (see arc_write_ready()).
+	 */
+	dda = kmem_zalloc(sizeof (dmu_direct_arg_t), KM_SLEEP);
+	dda->dda_dr = dr;
+	dbuf_add_ref(db, dda);
+
+	zio_nowait(arc_write(pio, spa, txg, &dda->dda_bp, dr->dt.dl.dr_data,
+	    DBUF_IS_L2CACHEABLE(db), &zp, dmu_write_direct_ready, NULL, NULL,
+	    dmu_write_direct_done, dda, ZIO_PRIORITY_SYNC_WRITE,
+	    ZIO_FLAG_CANFAIL, &zb));
+
+	dbuf_rele(db, FTAG);
+
+	return (0);
+}
+
+int
+dmu_write_direct_by_dbuf(zio_t *pio, dmu_buf_t *handle, uint64_t offset,
+    arc_buf_t *buf, dmu_tx_t *tx)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)handle;
+	int err;
+
+	DB_DNODE_ENTER(db);
+	err = dmu_write_direct_by_dnode(pio, DB_DNODE(db), offset, buf, tx);
+	DB_DNODE_EXIT(db);
+
+	return (err);
+}
+
+/*
+ * Read 'nblks' whole blocks of 'dn', starting at the block-aligned 'offset',
+ * into 'abds' without going through the dbuf layer or the ARC.
+ *
+ * A block which currently has a dbuf may be dirty, or have a write in
+ * flight, so its on-disk copy cannot be trusted.  Such blocks are not read
+ * here but flagged in 'cached', and the caller must copy them out through
+ * the dbuf layer instead.  The caller must hold a range lock covering the
+ * blocks so that no new dbufs can be dirtied while the reads are issued.
+ */
+static int
+dmu_read_direct_impl(dnode_t *dn, uint64_t offset, uint64_t nblks,
+    abd_t **abds, boolean_t *cached)
+{
+	objset_t *os = dn->dn_objset;
+	spa_t *spa = os->os_spa;
+	uint64_t blksz = dn->dn_datablksz;
+	zio_t *rio;
+	int err = 0;
+
+	ASSERT(!os->os_encrypted);
+	ASSERT0(P2PHASE(offset, blksz));
+
+	rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	for (uint64_t i = 0; i < nblks; i++) {
+		uint64_t blkid = dbuf_whichblock(dn, 0, offset + i * blksz);
+		dmu_buf_impl_t *db;
+		zbookmark_phys_t zb;
+		blkptr_t bp;
+
+		db = dbuf_find(os, dn->dn_object, 0, blkid);
+		if (db != NULL) {
+			mutex_exit(&db->db_mtx);
+			cached[i] = B_TRUE;
+			continue;
+		}
+
+		err = dbuf_dnode_findbp(dn, 0, blkid, &bp, NULL, NULL);
+		if (err == ENOENT) {
+			BP_ZERO(&bp);
+			err = 0;
+		} else if (err != 0) {
+			break;
+		}
+
+		if (BP_IS_HOLE(&bp)) {
+			abd_zero(abds[i], blksz);
+			cached[i] = B_FALSE;
+			continue;
+		}
+
+		/*
+		 * Redacted blocks and blocks which do not match the current
+		 * block size are left to the dbuf layer to sort out.
+		 */
+		if (BP_IS_REDACTED(&bp) || BP_GET_LSIZE(&bp) != blksz) {
+			cached[i] = B_TRUE;
+			continue;
+		}
+
+		cached[i] = B_FALSE;
+		SET_BOOKMARK(&zb, dmu_objset_id(os), dn->dn_object, 0, blkid);
+		zio_nowait(zio_read(rio, spa, &bp, abds[i], blksz, NULL, NULL,
+		    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL, &zb));
+	}
+	rw_exit(&dn->dn_struct_rwlock);
+
+	if (err == 0)
+		err = zio_wait(rio);
+	else
+		(void) zio_wait(rio);
+
+	return (err);
+}
+
+/*
+ * Read 'size' bytes at 'offset' of 'dn' into 'buf', bypassing the ARC.
+ * Both 'offset' and 'size' must be multiples of the object's block size.
+ */
+int
+dmu_read_direct_by_dnode(dnode_t *dn, uint64_t offset, uint64_t size,
+    void *buf)
+{
+	uint64_t blksz = dn->dn_datablksz;
+	uint64_t nblks = size / blksz;
+	abd_t **abds;
+	boolean_t *cached;
+	int err;
+
+	ASSERT0(P2PHASE(size, blksz));
+	if (nblks == 0)
+		return (0);
+
+	abds = kmem_alloc(nblks * sizeof (abd_t *), KM_SLEEP);
+	cached = kmem_alloc(nblks * sizeof (boolean_t), KM_SLEEP);
+	for (uint64_t i = 0; i < nblks; i++)
+		abds[i] = abd_get_from_buf((char *)buf + i * blksz, blksz);
+
+	err = dmu_read_direct_impl(dn, offset, nblks, abds, cached);
+
+	for (uint64_t i = 0; i < nblks; i++) {
+		if (err == 0 && cached[i]) {
+			err = dmu_read_by_dnode(dn, offset + i * blksz, blksz,
+			    (char *)buf + i * blksz, DMU_READ_NO_PREFETCH);
+		}
+		abd_put(abds[i]);
+	}
+
+	kmem_free(cached, nblks * sizeof (boolean_t));
+	kmem_free(abds, nblks * sizeof (abd_t *));
+
+	return (err);
+}
+
+#ifdef _KERNEL
+static int
+dmu_read_direct_uiomove(void *buf, size_t len, void *arg)
+{
+	uio_t *uio = arg;
+
+#ifdef __FreeBSD__
+	return (vn_io_fault_uiomove(buf, len, uio));
+#else
+	return (uiomove(buf, len, UIO_READ, uio));
+#endif
+}
+
+/*
+ * Read 'size' bytes into the uio buffer, bypassing the ARC.  Both the uio
+ * offset and 'size' must be multiples of the object's block size.
+ */
+int
+dmu_read_uio_direct(dmu_buf_t *zdb, uio_t *uio, uint64_t size)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
+	uint64_t offset = uio_offset(uio);
+	uint64_t blksz, nblks;
+	abd_t **abds;
+	boolean_t *cached;
+	dnode_t *dn;
+	int err;
+
+	if (size == 0)
+		return (0);
+
+	DB_DNODE_ENTER(db);
+	dn = DB_DNODE(db);
+	blksz = dn->dn_datablksz;
+	nblks = size / blksz;
+	ASSERT0(P2PHASE(size, blksz));
+
+	abds = kmem_alloc(nblks * sizeof (abd_t *), KM_SLEEP);
+	cached = kmem_alloc(nblks * sizeof (boolean_t), KM_SLEEP);
+	for (uint64_t i = 0; i < nblks; i++)
+		abds[i] = abd_alloc(blksz, B_FALSE);
+
+	err = dmu_read_direct_impl(dn, offset, nblks, abds, cached);
+
+	for (uint64_t i = 0; i < nblks; i++) {
+		if (err == 0) {
+			if (cached[i]) {
+				err = dmu_read_uio_dnode(dn, uio, blksz);
+			} else {
+				err = abd_iterate_func(abds[i], 0, blksz,
+				    dmu_read_direct_uiomove, uio);
+			}
+		}
+		abd_free(abds[i]);
+	}
+
+	kmem_free(cached, nblks * sizeof (boolean_t));
+	kmem_free(abds, nblks * sizeof (abd_t *));
+	DB_DNODE_EXIT(db);
+
+	return (err);
+}
+#endif /* _KERNEL */
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(dmu_write_direct_by_dnode);
+EXPORT_SYMBOL(dmu_write_direct_by_dbuf);
+EXPORT_SYMBOL(dmu_read_direct_by_dnode);
+EXPORT_SYMBOL(dmu_read_uio_direct);
+#endif
@@ -276,6 +276,20 @@ sync_changed_cb(void *arg, uint64_t newval)
 		zil_set_sync(os->os_zil, newval);
 }
 
+static void
+direct_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	/*
+	 * Inheritance and range checking should have been done by now.
+	 */
+	ASSERT(newval == ZFS_DIRECT_DISABLED || newval == ZFS_DIRECT_STANDARD ||
+	    newval == ZFS_DIRECT_ALWAYS);
+
+	os->os_direct = newval;
+}
+
 static void
 redundant_metadata_changed_cb(void *arg, uint64_t newval)
 {
@@ -521,6 +535,11 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 			    zfs_prop_to_name(ZFS_PROP_SECONDARYCACHE),
 			    secondary_cache_changed_cb, os);
 		}
+		if (err == 0) {
+			err = dsl_prop_register(ds,
+			    zfs_prop_to_name(ZFS_PROP_DIRECT),
+			    direct_changed_cb, os);
+		}
 		if (!ds->ds_is_snapshot) {
 			if (err == 0) {
 				err = dsl_prop_register(ds,
@@ -591,6 +610,7 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		os->os_dedup_verify = B_FALSE;
 		os->os_logbias = ZFS_LOGBIAS_LATENCY;
 		os->os_sync = ZFS_SYNC_STANDARD;
+		os->os_direct = ZFS_DIRECT_DISABLED;
 		os->os_primary_cache = ZFS_CACHE_ALL;
 		os->os_secondary_cache = ZFS_CACHE_ALL;
 		os->os_dnodesize = DNODE_MIN_SIZE;
@@ -863,6 +883,7 @@ dmu_objset_disown(objset_t *os, boolean_t decrypt, void *tag)
 	 * Stop upgrading thread
 	 */
 	dmu_objset_upgrade_stop(os);
+	os->os_dataset_kstats = NULL;
 	dsl_dataset_disown(os->os_dsl_dataset,
 	    (decrypt) ? DS_HOLD_FLAG_DECRYPT : 0, tag);
 }
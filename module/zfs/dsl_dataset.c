@@ -4528,6 +4528,23 @@ typedef struct dsl_dataset_set_compression_arg {
 	uint64_t ddsca_value;
 } dsl_dataset_set_compression_arg_t;
 
+/*
+ * Returns the feature which has to be active for a dataset to use the given
+ * compression property value.  lz4 itself only needs the pool-wide
+ * lz4_compress feature, but older software doesn't understand its levels.
+ */
+static spa_feature_t
+dsl_dataset_compression_feature(uint64_t compression)
+{
+	uint64_t compval = ZIO_COMPRESS_ALGO(compression);
+
+	if (compval == ZIO_COMPRESS_LZ4 &&
+	    ZIO_COMPRESS_LEVEL(compression) != ZIO_COMPLEVEL_INHERIT)
+		return (SPA_FEATURE_LZ4_LEVELS);
+
+	return (zio_compress_to_feature(compval));
+}
+
 /* ARGSUSED */
 static int
 dsl_dataset_set_compression_check(void *arg, dmu_tx_t *tx)
@@ -4535,8 +4552,7 @@ dsl_dataset_set_compression_check(void *arg, dmu_tx_t *tx)
 	dsl_dataset_set_compression_arg_t *ddsca = arg;
 	dsl_pool_t *dp = dmu_tx_pool(tx);
 
-	uint64_t compval = ZIO_COMPRESS_ALGO(ddsca->ddsca_value);
-	spa_feature_t f = zio_compress_to_feature(compval);
+	spa_feature_t f = dsl_dataset_compression_feature(ddsca->ddsca_value);
 
 	if (f == SPA_FEATURE_NONE)
 		return (SET_ERROR(EINVAL));
@@ -4554,8 +4570,7 @@ dsl_dataset_set_compression_sync(void *arg, dmu_tx_t *tx)
 	dsl_pool_t *dp = dmu_tx_pool(tx);
 	dsl_dataset_t *ds = NULL;
 
-	uint64_t compval = ZIO_COMPRESS_ALGO(ddsca->ddsca_value);
-	spa_feature_t f = zio_compress_to_feature(compval);
+	spa_feature_t f = dsl_dataset_compression_feature(ddsca->ddsca_value);
 	ASSERT3S(spa_feature_table[f].fi_type, ==, ZFEATURE_TYPE_BOOLEAN);
 
 	VERIFY0(dsl_dataset_hold(dp, ddsca->ddsca_name, FTAG, &ds));
@@ -4575,10 +4590,10 @@ dsl_dataset_set_compression(const char *dsname, zprop_source_t source,
 	dsl_dataset_set_compression_arg_t ddsca;
 
 	/*
-	 * The sync task is only required for zstd in order to activate
-	 * the feature flag when the property is first set.
+	 * The sync task is only required for zstd and the lz4 levels in
+	 * order to activate the feature flag when the property is first set.
 	 */
-	if (ZIO_COMPRESS_ALGO(compression) != ZIO_COMPRESS_ZSTD)
+	if (dsl_dataset_compression_feature(compression) == SPA_FEATURE_NONE)
 		return (0);
 
 	ddsca.ddsca_name = dsname;
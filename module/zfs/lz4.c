@@ -36,20 +36,24 @@
 #include <sys/zio_compress.h>
 
 static int real_LZ4_compress(const char *source, char *dest, int isize,
-    int osize);
+    int osize, int level);
 static int LZ4_uncompress_unknownOutputSize(const char *source, char *dest,
     int isize, int maxOutputSize);
+static int LZ4_decompress_safe(const char *source, char *dest, int isize,
+    int maxOutputSize);
 static int LZ4_compressCtx(void *ctx, const char *source, char *dest,
-    int isize, int osize);
+    int isize, int osize, int acceleration);
 static int LZ4_compress64kCtx(void *ctx, const char *source, char *dest,
-    int isize, int osize);
+    int isize, int osize, int acceleration);
+static int LZ4_compressHCCtx(void *ctx, const char *source, char *dest,
+    int isize, int osize, int maxAttempts);
 
 static kmem_cache_t *lz4_cache;
+static kmem_cache_t *lz4hc_cache;
 
-/*ARGSUSED*/
 size_t
 lz4_compress_zfs(void *s_start, void *d_start, size_t s_len,
-    size_t d_len, int n)
+    size_t d_len, int level)
 {
 	uint32_t bufsiz;
 	char *dest = d_start;
@@ -57,7 +61,7 @@ lz4_compress_zfs(void *s_start, void *d_start, size_t s_len,
 	ASSERT(d_len >= sizeof (bufsiz));
 
 	bufsiz = real_LZ4_compress(s_start, &dest[sizeof (bufsiz)], s_len,
-	    d_len - sizeof (bufsiz));
+	    d_len - sizeof (bufsiz), level);
 
 	/* Signal an error if the compression routine returned zero. */
 	if (bufsiz == 0)
@@ -90,7 +94,7 @@ lz4_decompress_zfs(void *s_start, void *d_start, size_t s_len,
 	 * Returns 0 on success (decompression function returned non-negative)
 	 * and non-zero on failure (decompression function returned negative).
 	 */
-	return (LZ4_uncompress_unknownOutputSize(&src[sizeof (bufsiz)],
+	return (LZ4_decompress_safe(&src[sizeof (bufsiz)],
 	    d_start, bufsiz, d_len) < 0);
 }
 
@@ -144,8 +148,18 @@ lz4_decompress_zfs(void *s_start, void *d_start, size_t s_len,
  * 	note   : Destination buffer must be already allocated.
  *		This version is slightly slower than real_LZ4_uncompress()
  *
+ * LZ4_decompress_safe() :
+ * 	Same interface and guarantees as LZ4_uncompress_unknownOutputSize(),
+ * 	which it replaces for all reads. It decodes the common short
+ * 	sequences with fixed size copies and handles overlapping matches
+ * 	without falling back to byte copies. The old decoder is only kept
+ * 	for the lz4_bench kstat.
+ *
  * LZ4_compressCtx() :
  * 	This function explicitly handles the CTX memory structure.
+ * 	acceleration : 1 is the default. Larger values skip through
+ * 	incompressible looking data faster, trading compression ratio for
+ * 	speed.
  *
  * 	ILLUMOS CHANGES: the CTX memory structure must be explicitly allocated
  * 	by the caller (either on the stack or using kmem_cache_alloc). Passing
@@ -158,6 +172,12 @@ lz4_decompress_zfs(void *s_start, void *d_start, size_t s_len,
  * 	ILLUMOS CHANGES: the CTX memory structure must be explicitly allocated
  * 	by the caller (either on the stack or using kmem_cache_alloc). Passing
  * 	NULL isn't valid.
+ *
+ * LZ4_compressHCCtx() :
+ * 	High compression variant producing the same format. Every position
+ * 	is indexed in hash chains and up to maxAttempts candidates are
+ * 	compared to find the longest match, with one step of lazy matching.
+ * 	The CTX comes from lz4hc_cache and keeps its tables between calls.
  */
 
 /*
@@ -356,9 +376,11 @@ typedef struct _U64_S {
 	{ U16 v = A16(p); v = lz4_bswap16(v); d = (s) - v; }
 #define	LZ4_WRITE_LITTLEENDIAN_16(p, i) \
 	{ U16 v = (U16)(i); v = lz4_bswap16(v); A16(p) = v; p += 2; }
+#define	LZ4_READ_LE16(p)	lz4_bswap16(A16(p))
 #else
 #define	LZ4_READ_LITTLEENDIAN_16(d, s, p) { d = (s) - A16(p); }
 #define	LZ4_WRITE_LITTLEENDIAN_16(p, v)  { A16(p) = v; p += 2; }
+#define	LZ4_READ_LE16(p)	A16(p)
 #endif
 
 
@@ -367,6 +389,25 @@ struct refTables {
 	HTYPE hashTable[HASHTABLESIZE];
 };
 
+/*
+ * High compression context.  Positions are stored as 32-bit indexes which
+ * keep increasing from one call to the next, so entries left over from
+ * earlier blocks are simply below the current block's first index and the
+ * tables don't need to be cleared for every block.  The chain table holds
+ * the distance from each position to the previous one with the same hash.
+ */
+#define	LZ4HC_HASH_LOG		15
+#define	LZ4HC_HASHTABLESIZE	(1 << LZ4HC_HASH_LOG)
+#define	LZ4HC_MAXD		(1 << MAXD_LOG)
+#define	LZ4HC_MAXD_MASK		(LZ4HC_MAXD - 1)
+#define	LZ4HC_IDX_LIMIT		(1U << 30)
+
+struct lz4hc_ctx {
+	U32 hashTable[LZ4HC_HASHTABLESIZE];
+	U16 chainTable[LZ4HC_MAXD];
+	U32 nextIdx;	/* index of the first byte of the next block */
+};
+
 
 /* Macros */
 #define	LZ4_HASH_FUNCTION(i) (((i) * 2654435761U) >> ((MINMATCH * 8) - \
@@ -375,6 +416,8 @@ struct refTables {
 #define	LZ4_WILDCOPY(s, d, e) do { LZ4_COPYPACKET(s, d) } while (d < e);
 #define	LZ4_BLINDCOPY(s, d, l) { BYTE* e = (d) + l; LZ4_WILDCOPY(s, d, e); \
 	d = e; }
+#define	LZ4HC_HASH_VALUE(p) ((A32(p) * 2654435761U) >> ((MINMATCH * 8) - \
+	LZ4HC_HASH_LOG))
 
 
 /* Private functions */
@@ -466,7 +509,7 @@ LZ4_NbCommonBytes(register U32 val)
 /*ARGSUSED*/
 static int
 LZ4_compressCtx(void *ctx, const char *source, char *dest, int isize,
-    int osize)
+    int osize, int acceleration)
 {
 	struct refTables *srt = (struct refTables *)ctx;
 	HTYPE *HashTable = (HTYPE *) (srt->hashTable);
@@ -497,7 +540,7 @@ LZ4_compressCtx(void *ctx, const char *source, char *dest, int isize,
 
 	/* Main Loop */
 	for (;;) {
-		int findMatchAttempts = (1U << skipStrength) + 3;
+		int findMatchAttempts = (acceleration << skipStrength) + 3;
 		const BYTE *forwardIp = ip;
 		const BYTE *ref;
 		BYTE *token;
@@ -657,7 +700,7 @@ LZ4_compressCtx(void *ctx, const char *source, char *dest, int isize,
 /*ARGSUSED*/
 static int
 LZ4_compress64kCtx(void *ctx, const char *source, char *dest, int isize,
-    int osize)
+    int osize, int acceleration)
 {
 	struct refTables *srt = (struct refTables *)ctx;
 	U16 *HashTable = (U16 *) (srt->hashTable);
@@ -686,7 +729,7 @@ LZ4_compress64kCtx(void *ctx, const char *source, char *dest, int isize,
 
 	/* Main Loop */
 	for (;;) {
-		int findMatchAttempts = (1U << skipStrength) + 3;
+		int findMatchAttempts = (acceleration << skipStrength) + 3;
 		const BYTE *forwardIp = ip;
 		const BYTE *ref;
 		BYTE *token;
@@ -832,11 +875,250 @@ LZ4_compress64kCtx(void *ctx, const char *source, char *dest, int isize,
 	return (int)(((char *)op) - dest);
 }
 
+/* High compression */
+
+static inline int
+LZ4_count(const BYTE *ip, const BYTE *ref, const BYTE *const limit)
+{
+	const BYTE *const start = ip;
+
+	while (likely(ip < limit - (STEPSIZE - 1))) {
+		UARCH diff = AARCH(ref) ^ AARCH(ip);
+		if (!diff) {
+			ip += STEPSIZE;
+			ref += STEPSIZE;
+			continue;
+		}
+		ip += LZ4_NbCommonBytes(diff);
+		return (ip - start);
+	}
+#if LZ4_ARCH64
+	if ((ip < (limit - 3)) && (A32(ref) == A32(ip))) {
+		ip += 4;
+		ref += 4;
+	}
+#endif
+	if ((ip < (limit - 1)) && (A16(ref) == A16(ip))) {
+		ip += 2;
+		ref += 2;
+	}
+	if ((ip < limit) && (*ref == *ip))
+		ip++;
+
+	return (ip - start);
+}
+
+/*
+ * Index every position up to ip, then walk the chain of earlier positions
+ * with the same hash and return the length of the longest match found
+ * within maxAttempts candidates, or 0 if there is none.
+ */
+static inline int
+LZ4HC_findLongestMatch(struct lz4hc_ctx *hc, const BYTE *base, U32 lowest,
+    U32 *nextToUpdate, const BYTE *ip, const BYTE *const mlimit,
+    int maxAttempts, const BYTE **matchpos)
+{
+	U32 *const hashTable = hc->hashTable;
+	U16 *const chainTable = hc->chainTable;
+	const U32 target = ip - base;
+	U32 idx, lowLimit, matchIndex;
+	int ml = 0;
+
+	for (idx = *nextToUpdate; idx < target; idx++) {
+		U32 h = LZ4HC_HASH_VALUE(base + idx);
+		U32 delta = idx - hashTable[h];
+
+		if (delta > MAX_DISTANCE)
+			delta = MAX_DISTANCE;
+		chainTable[idx & LZ4HC_MAXD_MASK] = (U16)delta;
+		hashTable[h] = idx;
+	}
+	*nextToUpdate = target;
+
+	lowLimit = (target > lowest + MAX_DISTANCE) ?
+	    target - MAX_DISTANCE : lowest;
+	matchIndex = hashTable[LZ4HC_HASH_VALUE(ip)];
+
+	while (matchIndex >= lowLimit && maxAttempts-- > 0) {
+		const BYTE *ref = base + matchIndex;
+
+		if (ref[ml] == ip[ml] && A32(ref) == A32(ip)) {
+			int mlt = MINMATCH + LZ4_count(ip + MINMATCH,
+			    ref + MINMATCH, mlimit);
+			if (mlt > ml) {
+				ml = mlt;
+				*matchpos = ref;
+			}
+		}
+		matchIndex -= chainTable[matchIndex & LZ4HC_MAXD_MASK];
+	}
+
+	return (ml);
+}
+
+/*
+ * Emit the literals between anchor and ip followed by a match of length ml
+ * at ref.  Returns the new output position, or NULL if it doesn't fit.
+ */
+static inline BYTE *
+LZ4HC_encodeSequence(BYTE *op, const BYTE *const oend, const BYTE *anchor,
+    const BYTE *ip, const BYTE *ref, int ml)
+{
+	int length = ip - anchor;
+	int len;
+	BYTE *token = op++;
+
+	/* Check output limit */
+	if (unlikely(op + length + (length / 255) + (2 + 1 + LASTLITERALS) +
+	    (ml / 255) > oend))
+		return (NULL);
+
+	/* Encode Literal length */
+	if (length >= (int)RUN_MASK) {
+		*token = (RUN_MASK << ML_BITS);
+		len = length - RUN_MASK;
+		for (; len > 254; len -= 255)
+			*op++ = 255;
+		*op++ = (BYTE)len;
+	} else
+		*token = (length << ML_BITS);
+
+	/* Copy Literals */
+	(void) memcpy(op, anchor, length);
+	op += length;
+
+	/* Encode Offset */
+	LZ4_WRITE_LITTLEENDIAN_16(op, ip - ref);
+
+	/* Encode MatchLength */
+	len = ml - MINMATCH;
+	if (len >= (int)ML_MASK) {
+		*token += ML_MASK;
+		len -= ML_MASK;
+		for (; len > 254; len -= 255)
+			*op++ = 255;
+		*op++ = (BYTE)len;
+	} else
+		*token += len;
+
+	return (op);
+}
+
 static int
-real_LZ4_compress(const char *source, char *dest, int isize, int osize)
+LZ4_compressHCCtx(void *ctx, const char *source, char *dest, int isize,
+    int osize, int maxAttempts)
+{
+	struct lz4hc_ctx *hc = ctx;
+
+	const BYTE *ip = (const BYTE *) source;
+	const BYTE *anchor = ip;
+	const BYTE *const iend = ip + isize;
+	const BYTE *const mflimit = iend - MFLIMIT;
+	const BYTE *const mlimit = iend - LASTLITERALS;
+
+	BYTE *op = (BYTE *) dest;
+	BYTE *const oend = op + osize;
+
+	const BYTE *base, *ref = NULL, *ref2 = NULL;
+	U32 lowest, nextToUpdate;
+	int ml, ml2;
+
+	/* Start over once the indexes get too large */
+	if (hc->nextIdx > LZ4HC_IDX_LIMIT) {
+		memset(hc->hashTable, 0, sizeof (hc->hashTable));
+		hc->nextIdx = LZ4HC_MAXD;
+	}
+	lowest = hc->nextIdx;
+	base = ip - lowest;
+	nextToUpdate = lowest;
+	hc->nextIdx += isize;
+
+	/* Init */
+	if (isize < MINLENGTH)
+		goto _last_literals;
+
+	/* Main Loop */
+	while (ip <= mflimit) {
+		ml = LZ4HC_findLongestMatch(hc, base, lowest, &nextToUpdate,
+		    ip, mlimit, maxAttempts, &ref);
+		if (ml == 0) {
+			ip++;
+			continue;
+		}
+
+		/* Defer the match while the next position has a longer one */
+		while (ip < mflimit) {
+			ml2 = LZ4HC_findLongestMatch(hc, base, lowest,
+			    &nextToUpdate, ip + 1, mlimit, maxAttempts,
+			    &ref2);
+			if (ml2 <= ml)
+				break;
+			ip++;
+			ml = ml2;
+			ref = ref2;
+		}
+
+		op = LZ4HC_encodeSequence(op, oend, anchor, ip, ref, ml);
+		if (op == NULL)
+			return (0);
+
+		ip += ml;
+		anchor = ip;
+	}
+
+	_last_literals:
+	/* Encode Last Literals */
+	{
+		int lastRun = iend - anchor;
+		if (op + lastRun + 1 + ((lastRun + 255 - RUN_MASK) / 255) >
+		    oend)
+			return (0);
+		if (lastRun >= (int)RUN_MASK) {
+			*op++ = (RUN_MASK << ML_BITS);
+			lastRun -= RUN_MASK;
+			for (; lastRun > 254; lastRun -= 255)
+				*op++ = 255;
+			*op++ = (BYTE)lastRun;
+		} else
+			*op++ = (lastRun << ML_BITS);
+		(void) memcpy(op, anchor, iend - anchor);
+		op += iend - anchor;
+	}
+
+	/* End */
+	return (int)(((char *)op) - dest);
+}
+
+/*
+ * Acceleration of the lz4-fast-N levels, starting with ZIO_LZ4_LEVEL_FAST_2.
+ */
+static const int lz4_fast_accel[] = {
+	2, 3, 4, 5, 6, 7, 8, 9, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100
+};
+
+static int
+real_LZ4_compress(const char *source, char *dest, int isize, int osize,
+    int level)
 {
 	void *ctx;
-	int result;
+	int result, acceleration = 1;
+
+	/* lz4-2 to lz4-9 search 2 to 256 candidates for each match */
+	if (level >= ZIO_LZ4_LEVEL_HC_MIN && level <= ZIO_LZ4_LEVEL_MAX) {
+		ASSERT(lz4hc_cache != NULL);
+		ctx = kmem_cache_alloc(lz4hc_cache, KM_SLEEP);
+		if (ctx == NULL)
+			return (0);
+
+		result = LZ4_compressHCCtx(ctx, source, dest, isize, osize,
+		    1 << (level - 1));
+
+		kmem_cache_free(lz4hc_cache, ctx);
+		return (result);
+	}
+
+	if (level >= ZIO_LZ4_LEVEL_FAST_2 && level <= ZIO_LZ4_LEVEL_FAST_MAX)
+		acceleration = lz4_fast_accel[level - ZIO_LZ4_LEVEL_FAST_2];
 
 	ASSERT(lz4_cache != NULL);
 	ctx = kmem_cache_alloc(lz4_cache, KM_SLEEP);
@@ -851,9 +1133,11 @@ real_LZ4_compress(const char *source, char *dest, int isize, int osize)
 	memset(ctx, 0, sizeof (struct refTables));
 
 	if (isize < LZ4_64KLIMIT)
-		result = LZ4_compress64kCtx(ctx, source, dest, isize, osize);
+		result = LZ4_compress64kCtx(ctx, source, dest, isize, osize,
+		    acceleration);
 	else
-		result = LZ4_compressCtx(ctx, source, dest, isize, osize);
+		result = LZ4_compressCtx(ctx, source, dest, isize, osize,
+		    acceleration);
 
 	kmem_cache_free(lz4_cache, ctx);
 	return (result);
@@ -1014,16 +1298,409 @@ LZ4_uncompress_unknownOutputSize(const char *source, char *dest, int isize,
 	return (-1);
 }
 
+/*
+ * Offset adjustments used to copy a match which overlaps its own output,
+ * i.e. whose offset is less than 8 bytes.  After the first 8 bytes have
+ * been copied, the source is at least 8 bytes behind the destination and
+ * still in phase with the repeated pattern.
+ */
+static const unsigned int inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
+static const int dec64table_ovl[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+
+/*
+ * A match has to end at least this far from the end of the output for the
+ * 8 byte copies to not overrun it.
+ */
+#define	MATCH_SAFEGUARD_DISTANCE	((2 * COPYLENGTH) - MINMATCH)
+
+static int
+LZ4_decompress_safe(const char *source, char *dest, int isize,
+    int maxOutputSize)
+{
+	/* Local Variables */
+	const BYTE *restrict ip = (const BYTE *) source;
+	const BYTE *const iend = ip + isize;
+	const BYTE *match;
+
+	BYTE *op = (BYTE *) dest;
+	BYTE *const oend = op + maxOutputSize;
+	BYTE *cpy;
+
+	if (unlikely(isize <= 0))
+		goto _output_error;
+
+	/* Main Loop */
+	for (;;) {
+		unsigned int token;
+		size_t length, offset;
+
+		if (unlikely(ip >= iend))
+			goto _output_error;
+
+		/* get runlength */
+		token = *ip++;
+		length = token >> ML_BITS;
+
+		/*
+		 * Fast path: up to 14 literals followed by a match of up to
+		 * 18 bytes, far enough from the end of both buffers to copy
+		 * 16 and 18 bytes blindly.
+		 */
+		if (length != RUN_MASK && likely(iend - ip >= 16 &&
+		    oend - op >= 32)) {
+			A64(op) = A64(ip);
+			A64(op + 8) = A64(ip + 8);
+			op += length;
+			ip += length;
+
+			offset = LZ4_READ_LE16(ip);
+			ip += 2;
+			match = op - offset;
+			length = token & ML_MASK;
+
+			if (length != ML_MASK && offset >= 8 &&
+			    offset <= (size_t)(op - (BYTE *) dest)) {
+				A64(op) = A64(match);
+				A64(op + 8) = A64(match + 8);
+				A16(op + 16) = A16(match + 16);
+				op += length + MINMATCH;
+				continue;
+			}
+
+			/* Let the general case handle this match */
+			goto _copy_match;
+		}
+
+		if (length == RUN_MASK) {
+			unsigned int s;
+			do {
+				if (unlikely(ip >= iend))
+					goto _output_error;
+				s = *ip++;
+				length += s;
+				if (unlikely(length > (size_t)(iend - ip)))
+					goto _output_error;
+			} while (s == 255);
+		}
+
+		/* copy literals */
+		if ((length + MFLIMIT > (size_t)(oend - op)) ||
+		    (length + (2 + 1 + LASTLITERALS) > (size_t)(iend - ip))) {
+			/*
+			 * Only the last literals get this close to the end
+			 * of either buffer, and they must consume all input.
+			 */
+			if (length != (size_t)(iend - ip) ||
+			    length > (size_t)(oend - op))
+				goto _output_error;
+			(void) memmove(op, ip, length);
+			op += length;
+			break;
+		}
+		cpy = op + length;
+		LZ4_WILDCOPY(ip, op, cpy);
+		ip -= (op - cpy);
+		op = cpy;
+
+		/* get offset */
+		offset = LZ4_READ_LE16(ip);
+		ip += 2;
+		match = op - offset;
+		length = token & ML_MASK;
+
+		_copy_match:
+		/* get matchlength */
+		if (length == ML_MASK) {
+			unsigned int s;
+			do {
+				if (unlikely(iend - ip <= LASTLITERALS))
+					goto _output_error;
+				s = *ip++;
+				length += s;
+				if (unlikely(length > (size_t)(oend - op)))
+					goto _output_error;
+			} while (s == 255);
+		}
+		length += MINMATCH;
+
+		/* the reference must be within the output produced so far */
+		if (unlikely(offset == 0 ||
+		    offset > (size_t)(op - (BYTE *) dest)))
+			goto _output_error;
+
+		/* copy repeated sequence */
+		if (unlikely(length + MATCH_SAFEGUARD_DISTANCE >
+		    (size_t)(oend - op))) {
+			/* the last 5 bytes are always literals */
+			if (length + LASTLITERALS > (size_t)(oend - op))
+				goto _output_error;
+			while (length-- > 0)
+				*op++ = *match++;
+			continue;
+		}
+
+		cpy = op + length;
+		if (unlikely(offset < 8)) {
+			op[0] = match[0];
+			op[1] = match[1];
+			op[2] = match[2];
+			op[3] = match[3];
+			match += inc32table[offset];
+			A32(op + 4) = A32(match);
+			match -= dec64table_ovl[offset];
+		} else {
+			A64(op) = A64(match);
+			match += 8;
+		}
+		op += 8;
+		if (op < cpy)
+			LZ4_WILDCOPY(match, op, cpy);
+		op = cpy;
+	}
+
+	/* end of decoding */
+	return (int)(((char *)op) - dest);
+
+	/* malformed input detected */
+	_output_error:
+	return (-1);
+}
+
+/*
+ * lz4_bench kstat: decompression speed of the current and the original
+ * decoder on generated text-like data, at common record sizes and for
+ * blocks written with the default level and with lz4-9.  It's only of
+ * interest when comparing the two, so it runs the first time the kstat is
+ * read rather than slowing down every module load.
+ */
+#define	LZ4_BENCH_NS		(MSEC2NSEC(10))		/* 10ms */
+#define	LZ4_BENCH_MAXSIZE	(1 << 20)
+
+typedef int lz4_decompress_func_t(const char *, char *, int, int);
+
+static const uint32_t lz4_bench_sizes[] = {
+	4096, 8192, 16384, 32768, 65536, 131072, LZ4_BENCH_MAXSIZE
+};
+
+static struct lz4_bench_stat {
+	uint64_t psize;		/* compressed size, default level */
+	uint64_t legacy;	/* B/s, default level, original decoder */
+	uint64_t fast;		/* B/s, default level */
+	uint64_t hc_psize;	/* compressed size, lz4-9 */
+	uint64_t hc_legacy;	/* B/s, lz4-9, original decoder */
+	uint64_t hc_fast;	/* B/s, lz4-9 */
+} lz4_bench_stat[ARRAY_SIZE(lz4_bench_sizes)];
+
+static boolean_t lz4_bench_done = B_FALSE;
+static kstat_t *lz4_bench_kstat;
+
+/* Words of 2 to 9 letters and numbers, separated by spaces and newlines */
+static void
+lz4_bench_fill(char *buf, size_t size)
+{
+	char words[64][10];
+	uint64_t x = 0x9e3779b97f4a7c15ULL;
+	size_t i, j, off;
+
+#define	LZ4_BENCH_RAND()	(x ^= x << 13, x ^= x >> 7, x ^= x << 17, x)
+	for (i = 0; i < ARRAY_SIZE(words); i++) {
+		size_t len = 2 + LZ4_BENCH_RAND() % 8;
+		for (j = 0; j < len; j++)
+			words[i][j] = 'a' + LZ4_BENCH_RAND() % 26;
+		words[i][len] = '\0';
+	}
+
+	for (off = 0; off < size; ) {
+		uint64_t r = LZ4_BENCH_RAND();
+		char tmp[24];
+		const char *w;
+		size_t len;
+
+		if ((r & 15) == 0) {
+			(void) snprintf(tmp, sizeof (tmp), "%llu",
+			    (u_longlong_t)(r >> 40));
+			w = tmp;
+		} else {
+			/* favor the first words, like natural text */
+			w = words[(r >> 8) %
+			    ((r >> 16) % ARRAY_SIZE(words) + 1)];
+		}
+		len = MIN(strlen(w), size - off);
+		(void) memcpy(buf + off, w, len);
+		off += len;
+		if (off < size)
+			buf[off++] = ((r >> 4) & 15) == 0 ? '\n' : ' ';
+	}
+#undef	LZ4_BENCH_RAND
+}
+
+static uint64_t
+lz4_bench_decompress(lz4_decompress_func_t *func, const char *src,
+    int psize, char *dst, int lsize)
+{
+	uint64_t run_count = 0;
+	hrtime_t start, run_time_ns;
+	int l;
+
+	kpreempt_disable();
+	start = gethrtime();
+	do {
+		for (l = 0; l < 8; l++, run_count++) {
+			if (func(src, dst, psize, lsize) != lsize) {
+				kpreempt_enable();
+				return (0);
+			}
+		}
+		run_time_ns = gethrtime() - start;
+	} while (run_time_ns < LZ4_BENCH_NS);
+	kpreempt_enable();
+
+	return (lsize * run_count * NANOSEC / run_time_ns);
+}
+
+static void
+lz4_bench(void)
+{
+	char *data = vmem_alloc(LZ4_BENCH_MAXSIZE, KM_SLEEP);
+	char *cbuf = vmem_alloc(LZ4_BENCH_MAXSIZE, KM_SLEEP);
+	char *dbuf = vmem_alloc(LZ4_BENCH_MAXSIZE, KM_SLEEP);
+	int i, psize;
+
+	lz4_bench_fill(data, LZ4_BENCH_MAXSIZE);
+
+	for (i = 0; i < ARRAY_SIZE(lz4_bench_sizes); i++) {
+		struct lz4_bench_stat *stat = &lz4_bench_stat[i];
+		int lsize = lz4_bench_sizes[i];
+
+		psize = real_LZ4_compress(data, cbuf, lsize, lsize,
+		    ZIO_LZ4_LEVEL_DEFAULT);
+		if (psize != 0) {
+			stat->psize = psize;
+			stat->legacy = lz4_bench_decompress(
+			    LZ4_uncompress_unknownOutputSize, cbuf, psize,
+			    dbuf, lsize);
+			stat->fast = lz4_bench_decompress(LZ4_decompress_safe,
+			    cbuf, psize, dbuf, lsize);
+		}
+
+		psize = real_LZ4_compress(data, cbuf, lsize, lsize,
+		    ZIO_LZ4_LEVEL_9);
+		if (psize != 0) {
+			stat->hc_psize = psize;
+			stat->hc_legacy = lz4_bench_decompress(
+			    LZ4_uncompress_unknownOutputSize, cbuf, psize,
+			    dbuf, lsize);
+			stat->hc_fast = lz4_bench_decompress(
+			    LZ4_decompress_safe, cbuf, psize, dbuf, lsize);
+		}
+	}
+
+	vmem_free(dbuf, LZ4_BENCH_MAXSIZE);
+	vmem_free(cbuf, LZ4_BENCH_MAXSIZE);
+	vmem_free(data, LZ4_BENCH_MAXSIZE);
+}
+
+static int
+lz4_bench_kstat_headers(char *buf, size_t size)
+{
+	ssize_t off = 0;
+
+	if (!lz4_bench_done) {
+		lz4_bench();
+		lz4_bench_done = B_TRUE;
+	}
+
+	off += snprintf(buf + off, size, "%-10s", "recordsize");
+	off += snprintf(buf + off, size - off, "%-10s", "psize");
+	off += snprintf(buf + off, size - off, "%-13s", "legacy");
+	off += snprintf(buf + off, size - off, "%-13s", "lz4");
+	off += snprintf(buf + off, size - off, "%-10s", "psize-9");
+	off += snprintf(buf + off, size - off, "%-13s", "legacy-9");
+	(void) snprintf(buf + off, size - off, "%-13s\n", "lz4-9");
+
+	return (0);
+}
+
+static int
+lz4_bench_kstat_data(char *buf, size_t size, void *data)
+{
+	struct lz4_bench_stat *stat = data;
+	ptrdiff_t id = stat - lz4_bench_stat;
+	ssize_t off = 0;
+
+	off += snprintf(buf + off, size - off, "%-10u", lz4_bench_sizes[id]);
+	off += snprintf(buf + off, size - off, "%-10llu",
+	    (u_longlong_t)stat->psize);
+	off += snprintf(buf + off, size - off, "%-13llu",
+	    (u_longlong_t)stat->legacy);
+	off += snprintf(buf + off, size - off, "%-13llu",
+	    (u_longlong_t)stat->fast);
+	off += snprintf(buf + off, size - off, "%-10llu",
+	    (u_longlong_t)stat->hc_psize);
+	off += snprintf(buf + off, size - off, "%-13llu",
+	    (u_longlong_t)stat->hc_legacy);
+	(void) snprintf(buf + off, size - off, "%-13llu\n",
+	    (u_longlong_t)stat->hc_fast);
+
+	return (0);
+}
+
+static void *
+lz4_bench_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	if (n < ARRAY_SIZE(lz4_bench_stat))
+		ksp->ks_private = (void *) (lz4_bench_stat + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+/*ARGSUSED*/
+static int
+lz4hc_ctx_constructor(void *buf, void *arg, int kmflags)
+{
+	struct lz4hc_ctx *hc = buf;
+
+	memset(hc->hashTable, 0, sizeof (hc->hashTable));
+	hc->nextIdx = LZ4HC_MAXD;
+
+	return (0);
+}
+
 void
 lz4_init(void)
 {
 	lz4_cache = kmem_cache_create("lz4_cache",
 	    sizeof (struct refTables), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	lz4hc_cache = kmem_cache_create("lz4hc_cache",
+	    sizeof (struct lz4hc_ctx), 0, lz4hc_ctx_constructor, NULL, NULL,
+	    NULL, NULL, 0);
+
+	lz4_bench_kstat = kstat_create("zfs", 0, "lz4_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (lz4_bench_kstat != NULL) {
+		lz4_bench_kstat->ks_data = NULL;
+		lz4_bench_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(lz4_bench_kstat,
+		    lz4_bench_kstat_headers,
+		    lz4_bench_kstat_data,
+		    lz4_bench_kstat_addr);
+		kstat_install(lz4_bench_kstat);
+	}
 }
 
 void
 lz4_fini(void)
 {
+	if (lz4_bench_kstat != NULL) {
+		kstat_delete(lz4_bench_kstat);
+		lz4_bench_kstat = NULL;
+	}
+	if (lz4hc_cache) {
+		kmem_cache_destroy(lz4hc_cache);
+		lz4hc_cache = NULL;
+	}
 	if (lz4_cache) {
 		kmem_cache_destroy(lz4_cache);
 		lz4_cache = NULL;
@@ -52,12 +52,15 @@
 #include <sys/zap.h>
 #include <sys/zil.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_removal.h>
 #include <sys/vdev_indirect_mapping.h>
 #include <sys/vdev_indirect_births.h>
 #include <sys/vdev_initialize.h>
 #include <sys/vdev_rebuild.h>
+#include <sys/vdev_draid.h>
+#include <sys/vdev_raidz.h>
 #include <sys/vdev_trim.h>
 #include <sys/vdev_disk.h>
 #include <sys/metaslab.h>
@@ -1517,6 +1520,10 @@ spa_destroy_aux_threads(spa_t *spa)
 		zthr_destroy(spa->spa_livelist_condense_zthr);
 		spa->spa_livelist_condense_zthr = NULL;
 	}
+	if (spa->spa_raidz_expand_zthr != NULL) {
+		zthr_destroy(spa->spa_raidz_expand_zthr);
+		spa->spa_raidz_expand_zthr = NULL;
+	}
 }
 
 /*
@@ -1618,6 +1625,7 @@ spa_unload(spa_t *spa)
 	}
 
 	ddt_unload(spa);
+	brt_unload(spa);
 	spa_unload_log_sm_metadata(spa);
 
 	/*
@@ -2766,6 +2774,7 @@ spa_spawn_aux_threads(spa_t *spa)
 	spa_start_indirect_condensing_thread(spa);
 	spa_start_livelist_destroy_thread(spa);
 	spa_start_livelist_condensing_thread(spa);
+	spa_start_raidz_expansion_thread(spa);
 
 	ASSERT3P(spa->spa_checkpoint_discard_zthr, ==, NULL);
 	spa->spa_checkpoint_discard_zthr =
@@ -4259,6 +4268,21 @@ spa_ld_load_dedup_tables(spa_t *spa)
 	return (0);
 }
 
+static int
+spa_ld_load_brt(spa_t *spa)
+{
+	int error = 0;
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	error = brt_load(spa);
+	if (error != 0) {
+		spa_load_failed(spa, "brt_load failed [error=%d]", error);
+		return (spa_vdev_err(rvd, VDEV_AUX_CORRUPT_DATA, EIO));
+	}
+
+	return (0);
+}
+
 static int
 spa_ld_verify_logs(spa_t *spa, spa_import_type_t type, char **ereport)
 {
@@ -4740,6 +4764,10 @@ spa_load_impl(spa_t *spa, spa_import_type_t type, char **ereport)
 	if (error != 0)
 		return (error);
 
+	error = spa_ld_load_brt(spa);
+	if (error != 0)
+		return (error);
+
 	/*
 	 * Verify the logs now to make sure we don't have any unexpected errors
 	 * when we claim log blocks later.
@@ -5615,6 +5643,29 @@ spa_create_check_encryption_params(dsl_crypto_params_t *dcp,
 	return (dmu_objset_create_crypt_check(NULL, dcp, NULL));
 }
 
+/*
+ * Return whether the vdev configuration has a dRAID top-level vdev.
+ */
+static boolean_t
+spa_nvroot_has_draid(nvlist_t *nvroot)
+{
+	nvlist_t **child;
+	uint_t children;
+	char *type;
+
+	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) != 0)
+		return (B_FALSE);
+
+	for (uint_t c = 0; c < children; c++) {
+		if (nvlist_lookup_string(child[c], ZPOOL_CONFIG_TYPE,
+		    &type) == 0 && strcmp(type, VDEV_TYPE_DRAID) == 0)
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
 /*
  * Pool Creation
  */
@@ -5635,6 +5686,7 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	boolean_t has_features;
 	boolean_t has_encryption;
 	boolean_t has_allocclass;
+	boolean_t has_draid;
 	spa_feature_t feat;
 	char *feat_name;
 	char *poolname;
@@ -5680,6 +5732,7 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	has_features = B_FALSE;
 	has_encryption = B_FALSE;
 	has_allocclass = B_FALSE;
+	has_draid = B_FALSE;
 	for (nvpair_t *elem = nvlist_next_nvpair(props, NULL);
 	    elem != NULL; elem = nvlist_next_nvpair(props, elem)) {
 		if (zpool_prop_feature(nvpair_name(elem))) {
@@ -5691,6 +5744,8 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 				has_encryption = B_TRUE;
 			if (feat == SPA_FEATURE_ALLOCATION_CLASSES)
 				has_allocclass = B_TRUE;
+			if (feat == SPA_FEATURE_DRAID)
+				has_draid = B_TRUE;
 		}
 	}
 
@@ -5710,6 +5765,12 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 		mutex_exit(&spa_namespace_lock);
 		return (ENOTSUP);
 	}
+	if (!has_draid && spa_nvroot_has_draid(nvroot)) {
+		spa_deactivate(spa);
+		spa_remove(spa);
+		mutex_exit(&spa_namespace_lock);
+		return (ENOTSUP);
+	}
 
 	if (has_features || nvlist_lookup_uint64(props,
 	    zpool_prop_to_name(ZPOOL_PROP_VERSION), &version) != 0) {
@@ -5748,6 +5809,10 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	ASSERT(error != 0 || rvd != NULL);
 	ASSERT(error != 0 || spa->spa_root_vdev == rvd);
 
+	/* Distributed spares are part of the spares list */
+	if (error == 0)
+		error = vdev_draid_spare_create(nvroot, rvd, 0);
+
 	if (error == 0 && !zfs_allocatable_devs(nvroot))
 		error = SET_ERROR(EINVAL);
 
@@ -5815,6 +5880,10 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	 * Create DDTs (dedup tables).
 	 */
 	ddt_create(spa);
+	/*
+	 * Create the BRT (block reference table).
+	 */
+	brt_create(spa);
 
 	spa_update_dspace(spa);
 
@@ -6426,6 +6495,11 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
 
 	spa->spa_pending_vdev = vd;	/* spa_vdev_exit() will clear this */
 
+	/* Distributed spares are part of the spares list */
+	if ((error = vdev_draid_spare_create(nvroot, vd,
+	    rvd->vdev_children)) != 0)
+		return (spa_vdev_exit(spa, vd, txg, error));
+
 	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_SPARES, &spares,
 	    &nspares) != 0)
 		nspares = 0;
@@ -6462,8 +6536,9 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
 			    tvd->vdev_ashift != spa->spa_max_ashift) {
 				return (spa_vdev_exit(spa, vd, txg, EINVAL));
 			}
-			/* Fail if top level vdev is raidz */
-			if (tvd->vdev_ops == &vdev_raidz_ops) {
+			/* Fail if top level vdev is raidz or draid */
+			if (tvd->vdev_ops == &vdev_raidz_ops ||
+			    tvd->vdev_ops == &vdev_draid_ops) {
 				return (spa_vdev_exit(spa, vd, txg, EINVAL));
 			}
 			/*
@@ -6556,6 +6631,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	char *oldvdpath, *newvdpath;
 	int newvd_isspare;
 	int error;
+	boolean_t raidz = B_FALSE;
 
 	ASSERT(spa_writeable(spa));
 
@@ -6589,10 +6665,37 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	if (oldvd == NULL)
 		return (spa_vdev_exit(spa, NULL, txg, ENODEV));
 
-	if (!oldvd->vdev_ops->vdev_op_leaf)
+	if (oldvd->vdev_ops == &vdev_raidz_ops) {
+		/*
+		 * Attaching to a RAID-Z vdev adds a child to it, and the
+		 * existing data is reflowed onto it in the background.
+		 */
+		raidz = B_TRUE;
+
+		if (!spa_feature_is_enabled(spa, SPA_FEATURE_RAIDZ_EXPANSION))
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+
+		if (replacing || rebuild || oldvd != oldvd->vdev_top ||
+		    oldvd->vdev_top_zap == 0)
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+
+		if (spa->spa_raidz_expand != NULL) {
+			return (spa_vdev_exit(spa, NULL, txg,
+			    ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS));
+		}
+
+		for (uint64_t c = 0; c < oldvd->vdev_children; c++) {
+			vdev_t *cvd = oldvd->vdev_child[c];
+
+			if (cvd->vdev_initialize_thread != NULL ||
+			    cvd->vdev_trim_thread != NULL)
+				return (spa_vdev_exit(spa, NULL, txg, EBUSY));
+		}
+	} else if (!oldvd->vdev_ops->vdev_op_leaf) {
 		return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+	}
 
-	pvd = oldvd->vdev_parent;
+	pvd = raidz ? oldvd : oldvd->vdev_parent;
 
 	if ((error = spa_config_parse(spa, &newrootvd, nvroot, NULL, 0,
 	    VDEV_ALLOC_ATTACH)) != 0)
@@ -6615,19 +6718,30 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	if (oldvd->vdev_top->vdev_islog && newvd->vdev_isspare)
 		return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
 
+	/*
+	 * A distributed spare can only replace a child of the dRAID vdev
+	 * which provides its space.
+	 */
+	if (newvd->vdev_ops == &vdev_draid_spare_ops &&
+	    vdev_draid_spare_get_parent(newvd) != oldvd->vdev_top)
+		return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
+
 	if (rebuild) {
 		/*
 		 * For rebuilds, the parent vdev must support reconstruction
 		 * using only space maps.  This means the only allowable
-		 * parents are the root vdev or a mirror vdev.
+		 * parents are the root vdev, a mirror vdev or a dRAID vdev.
 		 */
 		if (pvd->vdev_ops != &vdev_mirror_ops &&
-		    pvd->vdev_ops != &vdev_root_ops) {
+		    pvd->vdev_ops != &vdev_root_ops &&
+		    pvd->vdev_ops != &vdev_draid_ops) {
 			return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
 		}
 	}
 
-	if (!replacing) {
+	if (raidz) {
+		pvops = &vdev_raidz_ops;
+	} else if (!replacing) {
 		/*
 		 * For attach, the only allowable parent is a mirror or the root
 		 * vdev.
@@ -6672,7 +6786,8 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	/*
 	 * Make sure the new device is big enough.
 	 */
-	if (newvd->vdev_asize < vdev_get_min_asize(oldvd))
+	if (newvd->vdev_asize <
+	    vdev_get_min_asize(raidz ? oldvd->vdev_child[0] : oldvd))
 		return (spa_vdev_exit(spa, newrootvd, txg, EOVERFLOW));
 
 	/*
@@ -6686,7 +6801,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	 * If this is an in-place replacement, update oldvd's path and devid
 	 * to make it distinguishable from newvd, and unopenable from now on.
 	 */
-	if (strcmp(oldvd->vdev_path, newvd->vdev_path) == 0) {
+	if (!raidz && strcmp(oldvd->vdev_path, newvd->vdev_path) == 0) {
 		spa_strfree(oldvd->vdev_path);
 		oldvd->vdev_path = kmem_alloc(strlen(newvd->vdev_path) + 5,
 		    KM_SLEEP);
@@ -6707,7 +6822,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 
 	ASSERT(pvd->vdev_top->vdev_parent == rvd);
 	ASSERT(pvd->vdev_ops == pvops);
-	ASSERT(oldvd->vdev_parent == pvd);
+	ASSERT(raidz || oldvd->vdev_parent == pvd);
 
 	/*
 	 * Extract the new device from its root and add it to pvd.
@@ -6717,6 +6832,29 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	newvd->vdev_crtxg = oldvd->vdev_crtxg;
 	vdev_add_child(pvd, newvd);
 
+	if (raidz) {
+		vdev_raidz_t *vdrz = pvd->vdev_tsd;
+		vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+
+		rw_enter(&vdrz->vd_expand_lock, RW_WRITER);
+		pvd->vdev_rz_expanding = B_TRUE;
+		rw_exit(&vdrz->vd_expand_lock);
+
+		mutex_enter(&vre->vre_lock);
+		vre->vre_vdev_id = pvd->vdev_id;
+		vre->vre_offset = 0;
+		vre->vre_offset_durable = 0;
+		vre->vre_offset_synced = 0;
+		bzero(vre->vre_offset_pertxg, sizeof (vre->vre_offset_pertxg));
+		mutex_exit(&vre->vre_lock);
+		spa->spa_raidz_expand = vre;
+
+		dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+		dsl_sync_task_nowait(spa->spa_dsl_pool, vdev_raidz_attach_sync,
+		    pvd, tx);
+		dmu_tx_commit(tx);
+	}
+
 	/*
 	 * Reevaluate the parent vdev state.
 	 */
@@ -6735,29 +6873,44 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	 */
 	dtl_max_txg = txg + TXG_CONCURRENT_STATES;
 
-	vdev_dtl_dirty(newvd, DTL_MISSING,
-	    TXG_INITIAL, dtl_max_txg - TXG_INITIAL);
+	if (!raidz) {
+		vdev_dtl_dirty(newvd, DTL_MISSING,
+		    TXG_INITIAL, dtl_max_txg - TXG_INITIAL);
+	}
 
 	if (newvd->vdev_isspare) {
 		spa_spare_activate(newvd);
 		spa_event_notify(spa, newvd, NULL, ESC_ZFS_VDEV_SPARE);
 	}
 
-	oldvdpath = spa_strdup(oldvd->vdev_path);
+	if (raidz) {
+		char name[32];
+
+		(void) snprintf(name, sizeof (name), "%s%llu-%llu",
+		    VDEV_TYPE_RAIDZ, (u_longlong_t)oldvd->vdev_nparity,
+		    (u_longlong_t)oldvd->vdev_id);
+		oldvdpath = spa_strdup(name);
+	} else {
+		oldvdpath = spa_strdup(oldvd->vdev_path);
+	}
 	newvdpath = spa_strdup(newvd->vdev_path);
 	newvd_isspare = newvd->vdev_isspare;
 
 	/*
 	 * Mark newvd's DTL dirty in this txg.
 	 */
-	vdev_dirty(tvd, VDD_DTL, newvd, txg);
+	if (!raidz)
+		vdev_dirty(tvd, VDD_DTL, newvd, txg);
 
 	/*
 	 * Schedule the resilver or rebuild to restart in the future. We do
 	 * this to ensure that dmu_sync-ed blocks have been stitched into the
-	 * respective datasets.
+	 * respective datasets.  An expanding RAID-Z vdev needs neither, its
+	 * new child is written by the reflow.
 	 */
-	if (rebuild) {
+	if (raidz) {
+		/* nothing to resilver */
+	} else if (rebuild) {
 		newvd->vdev_rebuild_txg = txg;
 
 		vdev_rebuild(tvd);
@@ -6783,6 +6936,9 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
 	 */
 	(void) spa_vdev_exit(spa, newrootvd, dtl_max_txg, 0);
 
+	if (raidz)
+		zthr_wakeup(spa->spa_raidz_expand_zthr);
+
 	spa_history_log_internal(spa, "vdev attach", NULL,
 	    "%s vdev=%s %s vdev=%s",
 	    replacing && newvd_isspare ? "spare in" :
@@ -7069,12 +7225,16 @@ spa_vdev_initialize_impl(spa_t *spa, uint64_t guid, uint64_t cmd_type,
 	if (vd == NULL || vd->vdev_detached) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(ENODEV));
-	} else if (!vd->vdev_ops->vdev_op_leaf || !vdev_is_concrete(vd)) {
+	} else if (!vd->vdev_ops->vdev_op_leaf || !vdev_is_concrete(vd) ||
+	    vd->vdev_ops == &vdev_draid_spare_ops) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(EINVAL));
 	} else if (!vdev_writeable(vd)) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(EROFS));
+	} else if (vd->vdev_top->vdev_rz_expanding) {
+		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
+		return (SET_ERROR(ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS));
 	}
 	mutex_enter(&vd->vdev_initialize_lock);
 	spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
@@ -7180,12 +7340,16 @@ spa_vdev_trim_impl(spa_t *spa, uint64_t guid, uint64_t cmd_type,
 	if (vd == NULL || vd->vdev_detached) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(ENODEV));
-	} else if (!vd->vdev_ops->vdev_op_leaf || !vdev_is_concrete(vd)) {
+	} else if (!vd->vdev_ops->vdev_op_leaf || !vdev_is_concrete(vd) ||
+	    vd->vdev_ops == &vdev_draid_spare_ops) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(EINVAL));
 	} else if (!vdev_writeable(vd)) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(EROFS));
+	} else if (vd->vdev_top->vdev_rz_expanding) {
+		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
+		return (SET_ERROR(ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS));
 	} else if (!vd->vdev_has_trim) {
 		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
 		return (SET_ERROR(EOPNOTSUPP));
@@ -8118,6 +8282,10 @@ spa_async_suspend(spa_t *spa)
 	zthr_t *ll_condense_thread = spa->spa_livelist_condense_zthr;
 	if (ll_condense_thread != NULL)
 		zthr_cancel(ll_condense_thread);
+
+	zthr_t *raidz_expand_thread = spa->spa_raidz_expand_zthr;
+	if (raidz_expand_thread != NULL)
+		zthr_cancel(raidz_expand_thread);
 }
 
 void
@@ -8144,6 +8312,10 @@ spa_async_resume(spa_t *spa)
 	zthr_t *ll_condense_thread = spa->spa_livelist_condense_zthr;
 	if (ll_condense_thread != NULL)
 		zthr_resume(ll_condense_thread);
+
+	zthr_t *raidz_expand_thread = spa->spa_raidz_expand_zthr;
+	if (raidz_expand_thread != NULL)
+		zthr_resume(raidz_expand_thread);
 }
 
 static boolean_t
@@ -8886,6 +9058,7 @@ spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
 		}
 
 		ddt_sync(spa, txg);
+		brt_sync(spa, txg);
 		dsl_scan_sync(dp, tx);
 		svr_sync(spa, tx);
 		spa_sync_upgrades(spa, tx);
@@ -9081,6 +9254,14 @@ spa_sync(spa_t *spa, uint64_t txg)
 	spa_sync_adjust_vdev_max_queue_depth(spa);
 
 	spa_sync_condense_indirect(spa, tx);
+	vdev_raidz_expand_sync(spa, tx);
+
+	/*
+	 * Blocks cloned in this txg must be accounted for before anything
+	 * is freed, so that a clone of a block which is overwritten in the
+	 * same txg keeps the block alive.
+	 */
+	brt_pending_apply(spa, txg);
 
 	spa_sync_iterate_to_convergence(spa, tx);
 
@@ -9527,6 +9708,9 @@ spa_activity_in_progress(spa_t *spa, zpool_wait_activity_t activity,
 		*in_progress = (spa->spa_removing_phys.sr_state ==
 		    DSS_SCANNING);
 		break;
+	case ZPOOL_WAIT_RAIDZ_EXPAND:
+		*in_progress = (spa->spa_raidz_expand != NULL);
+		break;
 	case ZPOOL_WAIT_RESILVER:
 		if ((*in_progress = vdev_rebuild_active(spa->spa_root_vdev)))
 			break;
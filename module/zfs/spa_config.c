@@ -529,6 +529,16 @@ spa_config_generate(spa_t *spa, vdev_t *vd, uint64_t txg, int getstats)
 		    ZPOOL_CONFIG_DDT_STATS,
 		    (uint64_t *)dds, sizeof (*dds) / sizeof (uint64_t));
 		kmem_free(dds, sizeof (ddt_stat_t));
+
+		if (spa_feature_is_active(spa, SPA_FEATURE_DDT_LOG)) {
+			uint64_t entries, bytes;
+
+			ddt_log_stats(spa, &entries, &bytes);
+			fnvlist_add_uint64(config,
+			    ZPOOL_CONFIG_DDT_LOG_ENTRIES, entries);
+			fnvlist_add_uint64(config,
+			    ZPOOL_CONFIG_DDT_LOG_SIZE, bytes);
+		}
 	}
 
 	if (locked)
@@ -57,12 +57,14 @@
 #include <sys/metaslab_impl.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/kstat.h>
 #include "zfs_prop.h"
 #include <sys/btree.h>
 #include <sys/zfeature.h>
 #include <sys/qat.h>
 #include <sys/zstd/zstd.h>
+#include <sys/blake3.h>
 
 /*
  * SPA locking
@@ -1804,7 +1806,7 @@ void
 spa_update_dspace(spa_t *spa)
 {
 	spa->spa_dspace = metaslab_class_get_dspace(spa_normal_class(spa)) +
-	    ddt_get_dedup_dspace(spa);
+	    ddt_get_dedup_dspace(spa) + brt_get_dspace(spa);
 	if (spa->spa_vdev_removal != NULL) {
 		/*
 		 * We can't allocate from the removing device, so
@@ -2376,12 +2378,14 @@ spa_init(spa_mode_t mode)
 	zfs_btree_init();
 	metaslab_stat_init();
 	ddt_init();
+	brt_init();
 	zio_init();
 	dmu_init();
 	zil_init();
 	vdev_cache_stat_init();
 	vdev_mirror_stat_init();
 	vdev_raidz_math_init();
+	blake3_impl_init();
 	vdev_file_init();
 	zfs_prop_init();
 	zpool_prop_init();
@@ -2404,9 +2408,11 @@ spa_fini(void)
 	vdev_cache_stat_fini();
 	vdev_mirror_stat_fini();
 	vdev_raidz_math_fini();
+	blake3_impl_fini();
 	zil_fini();
 	dmu_fini();
 	zio_fini();
+	brt_fini();
 	ddt_fini();
 	metaslab_stat_fini();
 	zfs_btree_fini();
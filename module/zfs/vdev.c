@@ -39,6 +39,8 @@
 #include <sys/dmu_tx.h>
 #include <sys/dsl_dir.h>
 #include <sys/vdev_impl.h>
+#include <sys/vdev_draid.h>
+#include <sys/vdev_raidz.h>
 #include <sys/vdev_rebuild.h>
 #include <sys/uberblock_impl.h>
 #include <sys/metaslab.h>
@@ -193,6 +195,8 @@ vdev_dbgmsg_print_tree(vdev_t *vd, int indent)
 static vdev_ops_t *vdev_ops_table[] = {
 	&vdev_root_ops,
 	&vdev_raidz_ops,
+	&vdev_draid_ops,
+	&vdev_draid_spare_ops,
 	&vdev_mirror_ops,
 	&vdev_replacing_ops,
 	&vdev_spare_ops,
@@ -221,10 +225,12 @@ vdev_getops(const char *type)
 
 /* ARGSUSED */
 void
-vdev_default_xlate(vdev_t *vd, const range_seg64_t *in, range_seg64_t *res)
+vdev_default_xlate(vdev_t *vd, const range_seg64_t *in, range_seg64_t *res,
+    range_seg64_t *remain)
 {
 	res->rs_start = in->rs_start;
 	res->rs_end = in->rs_end;
+	remain->rs_start = remain->rs_end = 0;
 }
 
 /*
@@ -251,13 +257,13 @@ vdev_derive_alloc_bias(const char *bias)
  * all children.  This is what's used by anything other than RAID-Z.
  */
 uint64_t
-vdev_default_asize(vdev_t *vd, uint64_t psize)
+vdev_default_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
 	uint64_t asize = P2ROUNDUP(psize, 1ULL << vd->vdev_top->vdev_ashift);
 	uint64_t csize;
 
 	for (int c = 0; c < vd->vdev_children; c++) {
-		csize = vdev_psize_to_asize(vd->vdev_child[c], psize);
+		csize = vdev_psize_to_asize_txg(vd->vdev_child[c], psize, txg);
 		asize = MAX(asize, csize);
 	}
 
@@ -293,9 +299,17 @@ vdev_get_min_asize(vdev_t *vd)
 	 * The allocatable space for a raidz vdev is N * sizeof(smallest child),
 	 * so each child must provide at least 1/Nth of its asize.
 	 */
-	if (pvd->vdev_ops == &vdev_raidz_ops)
-		return ((pvd->vdev_min_asize + pvd->vdev_children - 1) /
-		    pvd->vdev_children);
+	if (pvd->vdev_ops == &vdev_raidz_ops) {
+		uint64_t width = pvd->vdev_children - pvd->vdev_rz_expanding;
+
+		return ((pvd->vdev_min_asize + width - 1) / width);
+	}
+
+	/*
+	 * A dRAID child must provide whole slices, see vdev_draid_open().
+	 */
+	if (pvd->vdev_ops == &vdev_draid_ops)
+		return (vdev_draid_min_asize(pvd));
 
 	return (pvd->vdev_min_asize);
 }
@@ -603,6 +617,8 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	uint64_t guid = 0, islog, nparity;
 	vdev_t *vd;
 	vdev_indirect_config_t *vic;
+	vdev_draid_config_t *vdc = NULL;
+	vdev_raidz_t *vdrz = NULL;
 	char *tmp = NULL;
 	int rc;
 	vdev_alloc_bias_t alloc_bias = VDEV_BIAS_NONE;
@@ -688,6 +704,22 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 			 */
 			nparity = 1;
 		}
+	} else if (ops == &vdev_draid_ops) {
+		/*
+		 * A dRAID vdev is always a top-level vdev and is only
+		 * supported by pools with the draid feature.
+		 */
+		if (!top_level)
+			return (SET_ERROR(EINVAL));
+		if (alloctype == VDEV_ALLOC_ADD &&
+		    spa->spa_load_state != SPA_LOAD_CREATE &&
+		    !spa_feature_is_enabled(spa, SPA_FEATURE_DRAID))
+			return (SET_ERROR(ENOTSUP));
+		if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY,
+		    &nparity) != 0)
+			return (SET_ERROR(EINVAL));
+		if ((rc = vdev_draid_config_alloc(nv, &vdc)) != 0)
+			return (rc);
 	} else {
 		nparity = 0;
 	}
@@ -712,11 +744,22 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 		}
 	}
 
+	if (ops == &vdev_raidz_ops &&
+	    (rc = vdev_raidz_config_alloc(nv, &vdrz)) != 0)
+		return (rc);
+
 	vd = vdev_alloc_common(spa, id, guid, ops);
 	vic = &vd->vdev_indirect_config;
 
 	vd->vdev_islog = islog;
 	vd->vdev_nparity = nparity;
+	if (vdc != NULL)
+		vd->vdev_tsd = vdc;
+	if (vdrz != NULL) {
+		vd->vdev_tsd = vdrz;
+		vd->vdev_rz_expanding = nvlist_exists(nv,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_OFFSET);
+	}
 	if (top_level && alloc_bias != VDEV_BIAS_NONE)
 		vd->vdev_alloc_bias = alloc_bias;
 
@@ -964,6 +1007,20 @@ vdev_free(vdev_t *vd)
 	vdev_queue_fini(vd);
 	vdev_cache_fini(vd);
 
+	if (vd->vdev_ops == &vdev_draid_ops) {
+		vdev_draid_config_free(vd->vdev_tsd);
+		vd->vdev_tsd = NULL;
+	}
+
+	if (vd->vdev_ops == &vdev_raidz_ops) {
+		vdev_raidz_t *vdrz = vd->vdev_tsd;
+
+		if (spa->spa_raidz_expand == &vdrz->vn_vre)
+			spa->spa_raidz_expand = NULL;
+		vdev_raidz_config_free(vdrz);
+		vd->vdev_tsd = NULL;
+	}
+
 	if (vd->vdev_path)
 		spa_strfree(vd->vdev_path);
 	if (vd->vdev_devid)
@@ -1622,8 +1679,12 @@ vdev_uses_zvols(vdev_t *vd)
 	return (B_FALSE);
 }
 
+/*
+ * Open the children of vd for which open_func returns B_TRUE, or all of
+ * them if open_func is NULL.
+ */
 void
-vdev_open_children(vdev_t *vd)
+vdev_open_children_subset(vdev_t *vd, vdev_open_children_func_t *open_func)
 {
 	taskq_t *tq;
 	int children = vd->vdev_children;
@@ -1635,18 +1696,27 @@ vdev_open_children(vdev_t *vd)
 	 */
 	if (vdev_uses_zvols(vd)) {
 retry_sync:
-		for (int c = 0; c < children; c++)
-			vd->vdev_child[c]->vdev_open_error =
-			    vdev_open(vd->vdev_child[c]);
+		for (int c = 0; c < children; c++) {
+			vdev_t *cvd = vd->vdev_child[c];
+
+			if (open_func == NULL || open_func(cvd))
+				cvd->vdev_open_error = vdev_open(cvd);
+		}
 	} else {
 		tq = taskq_create("vdev_open", children, minclsyspri,
 		    children, children, TASKQ_PREPOPULATE);
 		if (tq == NULL)
 			goto retry_sync;
 
-		for (int c = 0; c < children; c++)
+		for (int c = 0; c < children; c++) {
+			vdev_t *cvd = vd->vdev_child[c];
+
+			if (open_func != NULL && !open_func(cvd))
+				continue;
+
 			VERIFY(taskq_dispatch(tq, vdev_open_child,
-			    vd->vdev_child[c], TQ_SLEEP) != TASKQID_INVALID);
+			    cvd, TQ_SLEEP) != TASKQID_INVALID);
+		}
 
 		taskq_destroy(tq);
 	}
@@ -1657,6 +1727,12 @@ retry_sync:
 		vd->vdev_nonrot &= vd->vdev_child[c]->vdev_nonrot;
 }
 
+void
+vdev_open_children(vdev_t *vd)
+{
+	vdev_open_children_subset(vd, NULL);
+}
+
 /*
  * Compute the raidz-deflation ratio.  Note, we hard-code
  * in 128k (1 << 17) because it is the "typical" blocksize.
@@ -1934,7 +2010,7 @@ vdev_open(vdev_t *vd)
 	 * vdev_min_asize.
 	 */
 	if (vd->vdev_state == VDEV_STATE_HEALTHY &&
-	    ((asize > vd->vdev_asize &&
+	    ((asize > vd->vdev_asize && !vd->vdev_rz_expanding &&
 	    (vd->vdev_expanding || spa->spa_autoexpand)) ||
 	    (asize < vd->vdev_asize)))
 		vd->vdev_asize = asize;
@@ -2986,6 +3062,10 @@ vdev_construct_zaps(vdev_t *vd, dmu_tx_t *tx)
 			vd->vdev_top_zap = vdev_create_link_zap(vd, tx);
 			if (vd->vdev_alloc_bias != VDEV_BIAS_NONE)
 				vdev_zap_allocation_data(vd, tx);
+			if (vd->vdev_ops == &vdev_draid_ops) {
+				spa_feature_incr(vd->vdev_spa,
+				    SPA_FEATURE_DRAID, tx);
+			}
 		}
 	}
 
@@ -3223,6 +3303,20 @@ vdev_load(vdev_t *vd)
 		}
 	}
 
+	/*
+	 * Load any RAID-Z expansion state from the top-level vdev zap.
+	 */
+	if (vd == vd->vdev_top && vd->vdev_ops == &vdev_raidz_ops) {
+		error = vdev_raidz_load(vd);
+		if (error != 0) {
+			vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
+			    VDEV_AUX_CORRUPT_DATA);
+			vdev_dbgmsg(vd, "vdev_load: vdev_raidz_load "
+			    "failed [error=%d]", error);
+			return (error);
+		}
+	}
+
 	/*
 	 * If this is a top-level vdev, initialize its metaslabs.
 	 */
@@ -3507,10 +3601,26 @@ vdev_sync(vdev_t *vd, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * The allocated size of a block of psize bytes which was (or is about to
+ * be) written in the given txg.  This only depends on the txg for a RAID-Z
+ * vdev which has been expanded, see vdev_raidz_get_logical_width().
+ */
+uint64_t
+vdev_psize_to_asize_txg(vdev_t *vd, uint64_t psize, uint64_t txg)
+{
+	return (vd->vdev_ops->vdev_op_asize(vd, psize, txg));
+}
+
+/*
+ * The allocated size of a block of psize bytes.  For an expanded RAID-Z
+ * vdev this is the size of the block in its original layout, which keeps
+ * e.g. the deflate ratio stable.
+ */
 uint64_t
 vdev_psize_to_asize(vdev_t *vd, uint64_t psize)
 {
-	return (vd->vdev_ops->vdev_op_asize(vd, psize));
+	return (vdev_psize_to_asize_txg(vd, psize, 0));
 }
 
 /*
@@ -5000,16 +5110,21 @@ vdev_clear_resilver_deferred(vdev_t *vd, dmu_tx_t *tx)
  * reached the physical range is initialized and the recursive function
  * begins to unwind. As it unwinds it calls the parent's vdev specific
  * translation function to do the real conversion.
+ *
+ * A top-level vdev may only be able to translate the beginning of the
+ * logical range (see vdev_draid_xlate()), in which case the rest of it is
+ * returned in remain_rs.  Otherwise remain_rs is empty.
  */
 void
 vdev_xlate(vdev_t *vd, const range_seg64_t *logical_rs,
-    range_seg64_t *physical_rs)
+    range_seg64_t *physical_rs, range_seg64_t *remain_rs)
 {
 	/*
 	 * Walk up the vdev tree
 	 */
 	if (vd != vd->vdev_top) {
-		vdev_xlate(vd->vdev_parent, logical_rs, physical_rs);
+		vdev_xlate(vd->vdev_parent, logical_rs, physical_rs,
+		    remain_rs);
 	} else {
 		/*
 		 * We've reached the top-level vdev, initialize the
@@ -5018,6 +5133,7 @@ vdev_xlate(vdev_t *vd, const range_seg64_t *logical_rs,
 		 */
 		physical_rs->rs_start = logical_rs->rs_start;
 		physical_rs->rs_end = logical_rs->rs_end;
+		remain_rs->rs_start = remain_rs->rs_end = 0;
 		return;
 	}
 
@@ -5031,10 +5147,52 @@ vdev_xlate(vdev_t *vd, const range_seg64_t *logical_rs,
 	 * vdev specific translate function.
 	 */
 	range_seg64_t intermediate = { 0 };
-	pvd->vdev_ops->vdev_op_xlate(vd, physical_rs, &intermediate);
+	range_seg64_t remain = { 0 };
+	pvd->vdev_ops->vdev_op_xlate(vd, physical_rs, &intermediate, &remain);
 
 	physical_rs->rs_start = intermediate.rs_start;
 	physical_rs->rs_end = intermediate.rs_end;
+
+	/*
+	 * Only the top-level vdev translates the logical range itself; the
+	 * vdevs below it are given a range which they translate whole.
+	 */
+	if (pvd == vd->vdev_top)
+		*remain_rs = remain;
+	else
+		ASSERT(vdev_xlate_is_empty(&remain));
+}
+
+boolean_t
+vdev_xlate_is_empty(range_seg64_t *rs)
+{
+	return (rs->rs_start == rs->rs_end);
+}
+
+/*
+ * Translate the whole logical range to physical ranges on the leaf vdev,
+ * calling func for each non-empty one.
+ */
+void
+vdev_xlate_walk(vdev_t *vd, const range_seg64_t *logical_rs,
+    vdev_xlate_func_t *func, void *arg)
+{
+	range_seg64_t iter_rs = *logical_rs;
+	range_seg64_t physical_rs;
+	range_seg64_t remain_rs;
+
+	while (!vdev_xlate_is_empty(&iter_rs)) {
+		vdev_xlate(vd, &iter_rs, &physical_rs, &remain_rs);
+
+		/*
+		 * The range may not live on this leaf vdev at all, e.g.
+		 * with raidz or draid, so skip empty ranges.
+		 */
+		if (!vdev_xlate_is_empty(&physical_rs))
+			func(arg, &physical_rs);
+
+		iter_rs = remain_rs;
+	}
 }
 
 /*
@@ -0,0 +1,1038 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
+#include <sys/vdev_draid.h>
+#include <sys/vdev_raidz.h>
+#include <sys/vdev_raidz_impl.h>
+#include <sys/zio.h>
+#include <sys/abd.h>
+#include <sys/fs/zfs.h>
+
+/*
+ * Virtual device vector for declustered parity RAID (dRAID).
+ *
+ * A RAID-Z vdev stores every block on the same set of children, so when a
+ * child fails all of the reconstructed data has to be written to the one
+ * device replacing it.  dRAID instead spreads fixed width redundancy groups,
+ * and the capacity of its distributed spares, over all of its children:
+ *
+ *   - Each redundancy group has vdc_ndata data and vdc_nparity parity
+ *     columns.  The logical address space of the vdev is the groups laid
+ *     end to end, each vdc_groupsz (groupwidth * VDEV_DRAID_ROWHEIGHT)
+ *     bytes long.
+ *
+ *   - Every child is divided into rows of VDEV_DRAID_ROWHEIGHT bytes.  A
+ *     slice is the smallest number of rows which holds a whole number of
+ *     groups (vdc_ngroups) placed one after another over the vdc_ndisks
+ *     non-spare positions of each row.  Each slice also has vdc_nspares
+ *     spare positions.
+ *
+ *   - Which child is at which position is decided by one of vdc_nperms
+ *     fixed pseudo-random permutations of the children, selected by the
+ *     slice number.  The permutations are generated from a fixed seed and
+ *     so they are part of the on-disk format.
+ *
+ * Within a group, each (groupwidth << ashift) byte stripe is one sector on
+ * each of the columns, i.e. a RAID-Z row with a constant width.  A block is
+ * therefore stored as a RAID-Z map (see vdev_draid_map_alloc()) and the
+ * RAID-Z parity generation, reconstruction and error handling are used as
+ * they are.  Unlike RAID-Z, a block always uses whole rows, the padding of
+ * its short columns is written as zeros, and it never crosses a group (see
+ * vdev_draid_alloc_adjust()).  That keeps every allocated row consistent
+ * with its parity, so allocated space can be sequentially rebuilt a range
+ * at a time by vdev_rebuild.c without reading any block pointers, and
+ * since the groups of consecutive slices are on different children the
+ * rebuild reads from all of them.
+ *
+ * A distributed spare is a leaf vdev of type "dspare", named after its
+ * dRAID vdev (see vdev_draid_spare_parse()).  It maps its offsets onto the
+ * spare positions of each slice, so a device replaced by a distributed
+ * spare is rebuilt onto all of the remaining children in parallel.
+ */
+
+#define	VDEV_DRAID_SPARE_NAME	"draid%llu-%llu-%llu"
+
+static uint64_t
+vdev_draid_gcd(uint64_t a, uint64_t b)
+{
+	while (b != 0) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return (a);
+}
+
+/*
+ * xorshift64*, used to generate the permutations.  Any change to it is an
+ * on-disk format change.
+ */
+static uint64_t
+vdev_draid_rand(uint64_t *s)
+{
+	uint64_t x = *s;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*s = x;
+
+	return (x * 0x2545f4914f6cdd1dULL);
+}
+
+static void
+vdev_draid_generate_perms(vdev_draid_config_t *vdc)
+{
+	uint64_t children = vdc->vdc_children;
+	uint64_t seed = VDEV_DRAID_SEED + children;
+
+	vdc->vdc_nperms = VDEV_DRAID_NPERMS;
+	vdc->vdc_perms = kmem_alloc(vdc->vdc_nperms * children, KM_SLEEP);
+
+	for (uint64_t n = 0; n < vdc->vdc_nperms; n++) {
+		uint8_t *perm = &vdc->vdc_perms[n * children];
+
+		for (uint64_t i = 0; i < children; i++)
+			perm[i] = i;
+
+		for (uint64_t i = children - 1; i > 0; i--) {
+			uint64_t j = vdev_draid_rand(&seed) % (i + 1);
+			uint8_t tmp = perm[i];
+
+			perm[i] = perm[j];
+			perm[j] = tmp;
+		}
+	}
+}
+
+static uint8_t *
+vdev_draid_perm(vdev_draid_config_t *vdc, uint64_t slice)
+{
+	return (&vdc->vdc_perms[(slice % vdc->vdc_nperms) *
+	    vdc->vdc_children]);
+}
+
+/*
+ * Set up the layout of a dRAID vdev from its configuration.
+ */
+int
+vdev_draid_config_alloc(nvlist_t *nv, vdev_draid_config_t **vdcp)
+{
+	vdev_draid_config_t *vdc;
+	uint64_t nparity, ndata, nspares;
+	nvlist_t **child;
+	uint_t children;
+
+	if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY, &nparity) != 0 ||
+	    nvlist_lookup_uint64(nv, ZPOOL_CONFIG_DRAID_NDATA, &ndata) != 0 ||
+	    nvlist_lookup_uint64(nv, ZPOOL_CONFIG_DRAID_NSPARES,
+	    &nspares) != 0 ||
+	    nvlist_lookup_nvlist_array(nv, ZPOOL_CONFIG_CHILDREN, &child,
+	    &children) != 0)
+		return (SET_ERROR(EINVAL));
+
+	if (nparity == 0 || nparity > VDEV_DRAID_MAXPARITY || ndata == 0 ||
+	    nspares > VDEV_DRAID_MAX_SPARES ||
+	    children < VDEV_DRAID_MIN_CHILDREN ||
+	    children > VDEV_DRAID_MAX_CHILDREN ||
+	    ndata + nparity + nspares > children)
+		return (SET_ERROR(EINVAL));
+
+	vdc = kmem_zalloc(sizeof (vdev_draid_config_t), KM_SLEEP);
+	vdc->vdc_ndata = ndata;
+	vdc->vdc_nparity = nparity;
+	vdc->vdc_nspares = nspares;
+	vdc->vdc_children = children;
+	vdc->vdc_groupwidth = ndata + nparity;
+	vdc->vdc_ndisks = children - nspares;
+	vdc->vdc_ngroups = vdc->vdc_ndisks /
+	    vdev_draid_gcd(vdc->vdc_groupwidth, vdc->vdc_ndisks);
+	vdc->vdc_groupsz = vdc->vdc_groupwidth * VDEV_DRAID_ROWHEIGHT;
+	vdc->vdc_devslicesz = (vdc->vdc_ngroups * vdc->vdc_groupwidth /
+	    vdc->vdc_ndisks) * VDEV_DRAID_ROWHEIGHT;
+	vdev_draid_generate_perms(vdc);
+
+	*vdcp = vdc;
+
+	return (0);
+}
+
+void
+vdev_draid_config_free(vdev_draid_config_t *vdc)
+{
+	kmem_free(vdc->vdc_perms, vdc->vdc_nperms * vdc->vdc_children);
+	kmem_free(vdc, sizeof (vdev_draid_config_t));
+}
+
+/*
+ * Add the dRAID specific parts of the vdev configuration.
+ */
+void
+vdev_draid_config_generate(vdev_t *vd, nvlist_t *nv)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_NDATA, vdc->vdc_ndata);
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_NSPARES, vdc->vdc_nspares);
+}
+
+/*
+ * Find the child and its offset which hold column c of the stripe at the
+ * given logical offset.
+ */
+static void
+vdev_draid_map_column(vdev_draid_config_t *vdc, uint64_t offset, uint64_t c,
+    uint64_t *devidxp, uint64_t *physicalp)
+{
+	uint64_t group = offset / vdc->vdc_groupsz;
+	uint64_t slice = group / vdc->vdc_ngroups;
+	uint64_t pos = (group % vdc->vdc_ngroups) * vdc->vdc_groupwidth + c;
+	uint64_t row = pos / vdc->vdc_ndisks;
+	uint8_t *perm = vdev_draid_perm(vdc, slice);
+
+	ASSERT3U(c, <, vdc->vdc_groupwidth);
+
+	*devidxp = perm[pos % vdc->vdc_ndisks];
+	*physicalp = slice * vdc->vdc_devslicesz +
+	    row * VDEV_DRAID_ROWHEIGHT +
+	    (offset - group * vdc->vdc_groupsz) / vdc->vdc_groupwidth;
+}
+
+/*
+ * Return the logical offset at which the group containing offset ends.
+ */
+uint64_t
+vdev_draid_group_end(vdev_t *vd, uint64_t offset)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+
+	return ((offset / vdc->vdc_groupsz + 1) * vdc->vdc_groupsz);
+}
+
+/*
+ * The number of data bytes stored in the given allocated size, which is
+ * always a whole number of rows.
+ */
+uint64_t
+vdev_draid_asize_to_psize(vdev_t *vd, uint64_t asize)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+	ASSERT0(asize % (vdc->vdc_groupwidth << vd->vdev_top->vdev_ashift));
+
+	return (asize / vdc->vdc_groupwidth * vdc->vdc_ndata);
+}
+
+/*
+ * The minimum size of a child.  Only whole slices are used, so each child
+ * must provide a slice for every vdc_ngroups groups of the vdev.
+ */
+uint64_t
+vdev_draid_min_asize(vdev_t *vd)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t slicesz = vdc->vdc_ngroups * vdc->vdc_groupsz;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+
+	return ((vd->vdev_min_asize + slicesz - 1) / slicesz *
+	    vdc->vdc_devslicesz);
+}
+
+/*
+ * Return the first offset at or after start where a block can begin: on a
+ * stripe boundary, and not straddling two groups since then its rows would
+ * be stored on different children.
+ */
+static uint64_t
+vdev_draid_alloc_fit(vdev_t *vd, uint64_t start, uint64_t size)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t stripe = vdc->vdc_groupwidth << vd->vdev_ashift;
+	uint64_t offset = roundup(start, stripe);
+
+	if (offset + size > vdev_draid_group_end(vd, offset))
+		offset = vdev_draid_group_end(vd, offset);
+
+	return (offset);
+}
+
+/*
+ * Called by metaslab_block_alloc() to fix up an allocation made by the
+ * allocator, which knows nothing of the dRAID layout.  The block is moved
+ * forward to where vdev_draid_alloc_fit() allows it to start if that space
+ * is free too.  Otherwise the first free segment of the metaslab which can
+ * hold it is used, or -1ULL is returned and the allocation fails.
+ */
+uint64_t
+vdev_draid_alloc_adjust(vdev_t *vd, range_tree_t *rt, uint64_t start,
+    uint64_t size)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t offset;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+	ASSERT0(size % (vdc->vdc_groupwidth << vd->vdev_ashift));
+
+	if (size > vdc->vdc_groupsz)
+		return (-1ULL);
+
+	offset = vdev_draid_alloc_fit(vd, start, size);
+	if (range_tree_contains(rt, offset, size))
+		return (offset);
+
+	zfs_btree_index_t where;
+	for (range_seg_t *rs = zfs_btree_first(&rt->rt_root, &where);
+	    rs != NULL; rs = zfs_btree_next(&rt->rt_root, &where, &where)) {
+		offset = vdev_draid_alloc_fit(vd, rs_get_start(rs, rt), size);
+		if (offset + size <= rs_get_end(rs, rt))
+			return (offset);
+	}
+
+	return (-1ULL);
+}
+
+/*
+ * Return whether a distributed spare is part of the given child's subtree.
+ */
+static boolean_t
+vdev_draid_open_spares(vdev_t *cvd)
+{
+	if (cvd->vdev_ops == &vdev_draid_spare_ops)
+		return (B_TRUE);
+
+	for (int c = 0; c < cvd->vdev_children; c++) {
+		if (vdev_draid_open_spares(cvd->vdev_child[c]))
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
+static boolean_t
+vdev_draid_open_children(vdev_t *cvd)
+{
+	return (!vdev_draid_open_spares(cvd));
+}
+
+/*
+ * Calculate the space of each child which is used from the open children
+ * which do not depend on distributed spares.  Returns the number of
+ * children which were counted.
+ */
+static int
+vdev_draid_calculate_asize(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
+    uint64_t *logical_ashift, uint64_t *physical_ashift)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	int counted = 0;
+
+	*asize = *max_asize = 0;
+	for (int c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+
+		if (cvd->vdev_open_error != 0 || vdev_draid_open_spares(cvd))
+			continue;
+
+		*asize = MIN(*asize - 1, cvd->vdev_asize - 1) + 1;
+		*max_asize = MIN(*max_asize - 1, cvd->vdev_max_asize - 1) + 1;
+		*logical_ashift = MAX(*logical_ashift, cvd->vdev_ashift);
+		*physical_ashift = MAX(*physical_ashift,
+		    cvd->vdev_physical_ashift);
+		counted++;
+	}
+
+	/* Only whole slices of the children are used. */
+	*asize = *asize / vdc->vdc_devslicesz * vdc->vdc_devslicesz;
+	*max_asize = *max_asize / vdc->vdc_devslicesz * vdc->vdc_devslicesz;
+
+	return (counted);
+}
+
+static int
+vdev_draid_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
+    uint64_t *logical_ashift, uint64_t *physical_ashift)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t nparity = vd->vdev_nparity;
+	uint64_t slices;
+	int lasterror = 0;
+	int numerrors = 0;
+
+	ASSERT(nparity > 0);
+
+	if (vdc == NULL || nparity != vdc->vdc_nparity ||
+	    vd->vdev_children != vdc->vdc_children) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_BAD_LABEL;
+		return (SET_ERROR(EINVAL));
+	}
+
+	/*
+	 * The size of a distributed spare is derived from the other
+	 * children, so those must be opened first.
+	 */
+	vdev_open_children_subset(vd, vdev_draid_open_children);
+	vdev_open_children_subset(vd, vdev_draid_open_spares);
+
+	for (int c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+
+		if (cvd->vdev_open_error != 0) {
+			lasterror = cvd->vdev_open_error;
+			numerrors++;
+		}
+	}
+
+	if (numerrors > nparity) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_NO_REPLICAS;
+		return (lasterror);
+	}
+
+	(void) vdev_draid_calculate_asize(vd, asize, max_asize,
+	    logical_ashift, physical_ashift);
+
+	slices = *asize / vdc->vdc_devslicesz;
+	*asize = slices * vdc->vdc_ngroups * vdc->vdc_groupsz;
+	slices = *max_asize / vdc->vdc_devslicesz;
+	*max_asize = slices * vdc->vdc_ngroups * vdc->vdc_groupsz;
+
+	return (0);
+}
+
+static void
+vdev_draid_close(vdev_t *vd)
+{
+	for (int c = 0; c < vd->vdev_children; c++)
+		vdev_close(vd->vdev_child[c]);
+}
+
+/*
+ * A block is always a whole number of rows of a group.
+ */
+static uint64_t
+vdev_draid_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t rows = ((psize - 1) / (vdc->vdc_ndata << ashift)) + 1;
+
+	return ((rows * vdc->vdc_groupwidth) << ashift);
+}
+
+/*
+ * Lay out a block as a RAID-Z map with one column per member of the group.
+ * The columns are sized just like a RAID-Z row of the same width; the
+ * sector missing from the end of each short column is padding, which is
+ * skipped when reading but written as zeros (see vdev_raidz_skip_write()).
+ */
+static raidz_map_t *
+vdev_draid_map_alloc(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t groupwidth = vdc->vdc_groupwidth;
+	uint64_t nparity = vdc->vdc_nparity;
+	/* The zio's size in units of the vdev's minimum sector size. */
+	uint64_t s = zio->io_size >> ashift;
+	/* Full rows, and the data sectors in the last partial row. */
+	uint64_t q = s / vdc->vdc_ndata;
+	uint64_t r = s - q * vdc->vdc_ndata;
+	/* The number of "big columns", which hold the partial row. */
+	uint64_t bc = (r == 0 ? 0 : r + nparity);
+	uint64_t acols = (q == 0 ? bc : groupwidth);
+	uint64_t off = 0;
+	raidz_map_t *rm;
+	uint64_t c;
+
+	ASSERT0(zio->io_offset % (groupwidth << ashift));
+	ASSERT3U(zio->io_offset + vdev_draid_asize(vd, zio->io_size, 0), <=,
+	    vdev_draid_group_end(vd, zio->io_offset));
+
+	rm = kmem_alloc(offsetof(raidz_map_t, rm_col[groupwidth]), KM_SLEEP);
+
+	rm->rm_cols = acols;
+	rm->rm_scols = groupwidth;
+	rm->rm_bigcols = bc;
+	rm->rm_skipstart = bc;
+	rm->rm_nskip = (r == 0 ? 0 : groupwidth - bc);
+	rm->rm_missingdata = 0;
+	rm->rm_missingparity = 0;
+	rm->rm_firstdatacol = nparity;
+	rm->rm_abd_copy = NULL;
+	rm->rm_reports = 0;
+	rm->rm_freed = 0;
+	rm->rm_ecksuminjected = 0;
+	rm->rm_skipzero = 1;
+	rm->rm_lr = NULL;
+	rm->rm_expanded = NULL;
+	rm->rm_asize = ((q + (r == 0 ? 0 : 1)) * groupwidth) << ashift;
+
+	for (c = 0; c < groupwidth; c++) {
+		raidz_col_t *rc = &rm->rm_col[c];
+
+		vdev_draid_map_column(vdc, zio->io_offset, c,
+		    &rc->rc_devidx, &rc->rc_offset);
+		rc->rc_abd = NULL;
+		rc->rc_gdata = NULL;
+		rc->rc_error = 0;
+		rc->rc_tried = 0;
+		rc->rc_skipped = 0;
+
+		if (c >= acols)
+			rc->rc_size = 0;
+		else if (c < bc)
+			rc->rc_size = (q + 1) << ashift;
+		else
+			rc->rc_size = q << ashift;
+	}
+
+	for (c = 0; c < nparity; c++) {
+		rm->rm_col[c].rc_abd =
+		    abd_alloc_linear(rm->rm_col[c].rc_size, B_FALSE);
+	}
+
+	for (; c < acols; c++) {
+		rm->rm_col[c].rc_abd = abd_get_offset_size(zio->io_abd, off,
+		    rm->rm_col[c].rc_size);
+		off += rm->rm_col[c].rc_size;
+	}
+	ASSERT3U(off, ==, zio->io_size);
+
+	zio->io_vsd = rm;
+	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
+
+	/* init RAIDZ parity ops */
+	rm->rm_ops = vdev_raidz_math_get_ops();
+
+	return (rm);
+}
+
+static void
+vdev_draid_io_start(zio_t *zio)
+{
+	raidz_map_t *rm = vdev_draid_map_alloc(zio);
+
+	ASSERT3U(rm->rm_asize, ==,
+	    vdev_psize_to_asize(zio->io_vd, zio->io_size));
+
+	vdev_raidz_io_issue(zio, rm);
+}
+
+/*
+ * Every column of a block, including the zeroed padding, is written so
+ * any child with a dirty DTL may need to be resilvered.
+ */
+static boolean_t
+vdev_draid_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+	for (uint64_t c = 0; c < vdc->vdc_groupwidth; c++) {
+		uint64_t devidx, physical;
+
+		vdev_draid_map_column(vdc, offset, c, &devidx, &physical);
+
+		/*
+		 * dsl_scan_need_resilver() already checked vd with
+		 * vdev_dtl_contains(). So here just check cvd with
+		 * vdev_dtl_empty(), cheaper and a good approximation.
+		 */
+		if (!vdev_dtl_empty(vd->vdev_child[devidx], DTL_PARTIAL))
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
+/*
+ * Translate the part of the logical range which is in the same group as
+ * its start to the physical range on child cvd.  The rest of the range is
+ * returned in remain_rs for the caller to translate next.
+ */
+static void
+vdev_draid_xlate(vdev_t *cvd, const range_seg64_t *logical_rs,
+    range_seg64_t *physical_rs, range_seg64_t *remain_rs)
+{
+	vdev_t *vd = cvd->vdev_parent;
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t groupwidth = vdc->vdc_groupwidth;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t start = logical_rs->rs_start;
+	uint64_t gstart = start - start % vdc->vdc_groupsz;
+	uint64_t end = MIN(logical_rs->rs_end, gstart + vdc->vdc_groupsz);
+	uint64_t devidx, physical, c;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+	ASSERT0(start % (1 << ashift));
+	ASSERT0(logical_rs->rs_end % (1 << ashift));
+
+	remain_rs->rs_start = end;
+	remain_rs->rs_end = logical_rs->rs_end;
+
+	for (c = 0; c < groupwidth; c++) {
+		vdev_draid_map_column(vdc, gstart, c, &devidx, &physical);
+		if (devidx == cvd->vdev_id)
+			break;
+	}
+
+	if (c == groupwidth) {
+		/* This group is not stored on cvd. */
+		physical_rs->rs_start = physical_rs->rs_end = 0;
+		return;
+	}
+
+	/* As in vdev_raidz_xlate(), count the rows using column c. */
+	uint64_t b_start = (start - gstart) >> ashift;
+	uint64_t b_end = (end - gstart) >> ashift;
+	uint64_t start_row = 0;
+	uint64_t end_row = 0;
+
+	if (b_start > c)
+		start_row = ((b_start - c - 1) / groupwidth) + 1;
+	if (b_end > c)
+		end_row = ((b_end - c - 1) / groupwidth) + 1;
+
+	physical_rs->rs_start = physical + (start_row << ashift);
+	physical_rs->rs_end = physical + (end_row << ashift);
+}
+
+vdev_ops_t vdev_draid_ops = {
+	.vdev_op_open = vdev_draid_open,
+	.vdev_op_close = vdev_draid_close,
+	.vdev_op_asize = vdev_draid_asize,
+	.vdev_op_io_start = vdev_draid_io_start,
+	.vdev_op_io_done = vdev_raidz_io_done,
+	.vdev_op_state_change = vdev_raidz_state_change,
+	.vdev_op_need_resilver = vdev_draid_need_resilver,
+	.vdev_op_hold = NULL,
+	.vdev_op_rele = NULL,
+	.vdev_op_remap = NULL,
+	.vdev_op_xlate = vdev_draid_xlate,
+	.vdev_op_type = VDEV_TYPE_DRAID,	/* name of this vdev type */
+	.vdev_op_leaf = B_FALSE			/* not a leaf vdev */
+};
+
+/*
+ * Parse the name of a distributed spare, "draid<parity>-<top>-<spare>",
+ * where <top> is the id of its top-level dRAID vdev and <spare> selects
+ * the spare position in each slice.
+ */
+int
+vdev_draid_spare_parse(const char *name, uint64_t *nparityp,
+    uint64_t *top_idp, uint64_t *spare_idp)
+{
+	uint64_t *vals[3] = { nparityp, top_idp, spare_idp };
+	size_t len = strlen(VDEV_TYPE_DRAID);
+	char *end;
+
+	if (strncmp(name, VDEV_TYPE_DRAID, len) != 0)
+		return (SET_ERROR(EINVAL));
+
+	name += len;
+	for (int i = 0; i < 3; i++) {
+		*vals[i] = zfs_strtonum(name, &end);
+		if (end == name || *end != (i < 2 ? '-' : '\0'))
+			return (SET_ERROR(EINVAL));
+		name = end + 1;
+	}
+
+	return (0);
+}
+
+/*
+ * Add the distributed spares of the dRAID vdevs among the new top-level
+ * vdevs, the children of vd, to the spares of nvroot.  The first of the new
+ * top-level vdevs will have id next_id.  Distributed spares cannot be
+ * given as spares by the caller.
+ */
+int
+vdev_draid_spare_create(nvlist_t *nvroot, vdev_t *vd, uint64_t next_id)
+{
+	nvlist_t **spares, **new_spares;
+	uint_t nspares, n = 0, total = 0;
+	char path[64];
+
+	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_SPARES,
+	    &spares, &nspares) != 0)
+		nspares = 0;
+
+	for (uint_t s = 0; s < nspares; s++) {
+		char *type;
+
+		if (nvlist_lookup_string(spares[s], ZPOOL_CONFIG_TYPE,
+		    &type) == 0 && strcmp(type, VDEV_TYPE_DRAID_SPARE) == 0)
+			return (SET_ERROR(EINVAL));
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+
+		if (cvd->vdev_ops == &vdev_draid_ops) {
+			vdev_draid_config_t *vdc = cvd->vdev_tsd;
+			total += vdc->vdc_nspares;
+		}
+	}
+
+	if (total == 0)
+		return (0);
+
+	new_spares = kmem_alloc((nspares + total) * sizeof (nvlist_t *),
+	    KM_SLEEP);
+	for (; n < nspares; n++)
+		new_spares[n] = fnvlist_dup(spares[n]);
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+		vdev_draid_config_t *vdc = cvd->vdev_tsd;
+
+		if (cvd->vdev_ops != &vdev_draid_ops)
+			continue;
+
+		for (uint64_t s = 0; s < vdc->vdc_nspares; s++) {
+			(void) snprintf(path, sizeof (path),
+			    VDEV_DRAID_SPARE_NAME, (u_longlong_t)
+			    vdc->vdc_nparity, (u_longlong_t)(next_id + c),
+			    (u_longlong_t)s);
+
+			nvlist_t *nv = fnvlist_alloc();
+			fnvlist_add_string(nv, ZPOOL_CONFIG_TYPE,
+			    VDEV_TYPE_DRAID_SPARE);
+			fnvlist_add_string(nv, ZPOOL_CONFIG_PATH, path);
+			fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_SPARE, 1);
+			new_spares[n++] = nv;
+		}
+	}
+
+	ASSERT3U(n, ==, nspares + total);
+	fnvlist_add_nvlist_array(nvroot, ZPOOL_CONFIG_SPARES, new_spares, n);
+
+	for (uint_t i = 0; i < n; i++)
+		nvlist_free(new_spares[i]);
+	kmem_free(new_spares, n * sizeof (nvlist_t *));
+
+	return (0);
+}
+
+/*
+ * Return the dRAID vdev which a distributed spare is part of, or NULL if
+ * the spare is not open.
+ */
+vdev_t *
+vdev_draid_spare_get_parent(vdev_t *vd)
+{
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_spare_ops);
+
+	return (vds != NULL ? vds->vds_draid_vdev : NULL);
+}
+
+/*
+ * A distributed spare is active when it is in use in the vdev tree of its
+ * dRAID vdev rather than only being in the pool's list of spares.
+ */
+static boolean_t
+vdev_draid_spare_is_active(vdev_t *vd)
+{
+	return (vd->vdev_top != NULL &&
+	    vd->vdev_top->vdev_ops == &vdev_draid_ops);
+}
+
+/*
+ * A distributed spare has no label of its own.  Generate the configuration
+ * which its label would hold, for vdev_label_read_config().  Like a new
+ * hot spare device, a distributed spare which is not yet one of the
+ * pool's spares has no label at all.
+ */
+nvlist_t *
+vdev_draid_read_config_spare(vdev_t *vd)
+{
+	spa_t *spa = vd->vdev_spa;
+	spa_aux_vdev_t *sav = &spa->spa_spares;
+	uint64_t guid = vd->vdev_guid;
+	boolean_t found = B_FALSE;
+	nvlist_t *nv;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_spare_ops);
+
+	/*
+	 * Use the guid of the spare with the same name, as a hot spare
+	 * label would, so that attaching it activates that spare.  The
+	 * list may be partially filled in by spa_load_spares().
+	 */
+	for (int i = 0; i < sav->sav_count && sav->sav_vdevs != NULL; i++) {
+		vdev_t *svd = sav->sav_vdevs[i];
+
+		if (svd != NULL && svd->vdev_ops == &vdev_draid_spare_ops &&
+		    svd->vdev_path != NULL &&
+		    strcmp(svd->vdev_path, vd->vdev_path) == 0) {
+			guid = svd->vdev_guid;
+			found = B_TRUE;
+			break;
+		}
+	}
+
+	if (!found && !vdev_draid_spare_is_active(vd))
+		return (NULL);
+
+	nv = fnvlist_alloc();
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_SPARE, 1);
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_CREATE_TXG, vd->vdev_crtxg);
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_VERSION, spa_version(spa));
+	fnvlist_add_string(nv, ZPOOL_CONFIG_POOL_NAME, spa_name(spa));
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_POOL_GUID, spa_guid(spa));
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_POOL_TXG, spa->spa_config_txg);
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_GUID, guid);
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_TOP_GUID,
+	    vd->vdev_top != NULL ? vd->vdev_top->vdev_guid : guid);
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_POOL_STATE,
+	    vdev_draid_spare_is_active(vd) ?
+	    POOL_STATE_ACTIVE : POOL_STATE_SPARE);
+
+	return (nv);
+}
+
+static int
+vdev_draid_spare_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
+    uint64_t *logical_ashift, uint64_t *physical_ashift)
+{
+	spa_t *spa = vd->vdev_spa;
+	vdev_t *rvd = spa->spa_root_vdev;
+	vdev_t *pvd = spa->spa_pending_vdev;
+	vdev_draid_spare_t *vds;
+	vdev_draid_config_t *vdc;
+	vdev_t *tvd = NULL;
+	uint64_t nparity, top_id, spare_id;
+
+	if (vd->vdev_path == NULL || vdev_draid_spare_parse(vd->vdev_path,
+	    &nparity, &top_id, &spare_id) != 0) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_BAD_LABEL;
+		return (SET_ERROR(EINVAL));
+	}
+
+	/*
+	 * The dRAID vdev is either in the pool, or is one of the top-level
+	 * vdevs being added by spa_vdev_add(), which follow those in the
+	 * pool.
+	 */
+	if (rvd != NULL && top_id < rvd->vdev_children) {
+		tvd = rvd->vdev_child[top_id];
+	} else if (rvd != NULL && pvd != NULL && pvd != rvd &&
+	    top_id - rvd->vdev_children < pvd->vdev_children) {
+		tvd = pvd->vdev_child[top_id - rvd->vdev_children];
+	}
+
+	if (tvd == NULL || tvd->vdev_ops != &vdev_draid_ops) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+		return (SET_ERROR(ENODEV));
+	}
+
+	vdc = tvd->vdev_tsd;
+	if (nparity != vdc->vdc_nparity || spare_id >= vdc->vdc_nspares) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+		return (SET_ERROR(ENODEV));
+	}
+
+	/*
+	 * The spare is as large as the part of each child which is used.
+	 * vdev_draid_open() opens the children which the spare depends on
+	 * before the spare itself.
+	 */
+	if (vdev_draid_calculate_asize(tvd, psize, max_psize,
+	    logical_ashift, physical_ashift) == 0 || *psize == 0) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+		return (SET_ERROR(ENXIO));
+	}
+
+	*psize += VDEV_LABEL_START_SIZE + VDEV_LABEL_END_SIZE;
+	*max_psize += VDEV_LABEL_START_SIZE + VDEV_LABEL_END_SIZE;
+
+	if (vd->vdev_tsd == NULL)
+		vd->vdev_tsd = kmem_zalloc(sizeof (vdev_draid_spare_t),
+		    KM_SLEEP);
+
+	vds = vd->vdev_tsd;
+	vds->vds_draid_vdev = tvd;
+	vds->vds_top_id = top_id;
+	vds->vds_spare_id = spare_id;
+
+	vd->vdev_nonrot = tvd->vdev_nonrot;
+	vd->vdev_has_trim = B_FALSE;
+	vd->vdev_has_securetrim = B_FALSE;
+
+	return (0);
+}
+
+static void
+vdev_draid_spare_close(vdev_t *vd)
+{
+	if (vd->vdev_tsd != NULL) {
+		kmem_free(vd->vdev_tsd, sizeof (vdev_draid_spare_t));
+		vd->vdev_tsd = NULL;
+	}
+}
+
+static void
+vdev_draid_spare_child_done(zio_t *zio)
+{
+	zio_t *pio = zio->io_private;
+
+	/* Only errors are recorded, so the children never race to clear. */
+	if (zio->io_error != 0)
+		pio->io_error = zio->io_error;
+
+	abd_put(zio->io_abd);
+}
+
+/*
+ * Return whether the distributed spare vd is part of cvd's subtree.
+ */
+static boolean_t
+vdev_draid_spare_in_subtree(vdev_t *cvd, vdev_t *vd)
+{
+	if (cvd == vd)
+		return (B_TRUE);
+
+	for (int c = 0; c < cvd->vdev_children; c++) {
+		if (vdev_draid_spare_in_subtree(cvd->vdev_child[c], vd))
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
+/*
+ * Issue the I/O to the children holding the spare position of each slice
+ * in the range.  The spare position of a slice may be held by the child
+ * the spare replaces, which never stores data in that slice; such I/O
+ * would be issued back to the spare itself and fails instead.
+ */
+static void
+vdev_draid_spare_issue(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+	vdev_t *tvd = vds->vds_draid_vdev;
+	vdev_draid_config_t *vdc = tvd->vdev_tsd;
+	uint64_t offset = zio->io_offset - VDEV_LABEL_START_SIZE;
+	uint64_t done = 0;
+
+	while (done < zio->io_size) {
+		uint64_t slice = offset / vdc->vdc_devslicesz;
+		uint64_t size = MIN(zio->io_size - done,
+		    (slice + 1) * vdc->vdc_devslicesz - offset);
+		uint8_t *perm = vdev_draid_perm(vdc, slice);
+		vdev_t *cvd =
+		    tvd->vdev_child[perm[vdc->vdc_ndisks + vds->vds_spare_id]];
+
+		if (vdev_draid_spare_in_subtree(cvd, vd)) {
+			zio->io_error = SET_ERROR(ENXIO);
+			break;
+		}
+
+		zio_nowait(zio_vdev_child_io(zio, NULL, cvd, offset,
+		    abd_get_offset_size(zio->io_abd, done, size), size,
+		    zio->io_type, zio->io_priority, 0,
+		    vdev_draid_spare_child_done, zio));
+
+		offset += size;
+		done += size;
+	}
+}
+
+static void
+vdev_draid_spare_io_start(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+
+	if (vd->vdev_tsd == NULL) {
+		zio->io_error = SET_ERROR(ENXIO);
+		zio_interrupt(zio);
+		return;
+	}
+
+	switch (zio->io_type) {
+	case ZIO_TYPE_IOCTL:
+		zio->io_error = 0;
+		break;
+
+	case ZIO_TYPE_READ:
+	case ZIO_TYPE_WRITE:
+		if (zio->io_offset < VDEV_LABEL_START_SIZE ||
+		    zio->io_offset >= vd->vdev_psize - VDEV_LABEL_END_SIZE) {
+			/*
+			 * There are no labels.  Label and uberblock writes
+			 * are discarded and only probes may read them; the
+			 * configuration is generated instead by
+			 * vdev_draid_read_config_spare().
+			 */
+			if ((zio->io_flags & ZIO_FLAG_PROBE) ||
+			    (zio->io_type == ZIO_TYPE_WRITE &&
+			    (zio->io_flags & ZIO_FLAG_CONFIG_WRITER)))
+				zio->io_error = 0;
+			else
+				zio->io_error = SET_ERROR(EIO);
+			break;
+		}
+
+		vdev_draid_spare_issue(zio);
+		break;
+
+	default:
+		zio->io_error = SET_ERROR(ENOTSUP);
+		break;
+	}
+
+	zio_execute(zio);
+}
+
+/* ARGSUSED */
+static void
+vdev_draid_spare_io_done(zio_t *zio)
+{
+}
+
+vdev_ops_t vdev_draid_spare_ops = {
+	.vdev_op_open = vdev_draid_spare_open,
+	.vdev_op_close = vdev_draid_spare_close,
+	.vdev_op_asize = vdev_default_asize,
+	.vdev_op_io_start = vdev_draid_spare_io_start,
+	.vdev_op_io_done = vdev_draid_spare_io_done,
+	.vdev_op_state_change = NULL,
+	.vdev_op_need_resilver = NULL,
+	.vdev_op_hold = NULL,
+	.vdev_op_rele = NULL,
+	.vdev_op_remap = NULL,
+	.vdev_op_xlate = vdev_default_xlate,
+	.vdev_op_type = VDEV_TYPE_DRAID_SPARE,	/* name of this vdev type */
+	.vdev_op_leaf = B_TRUE			/* leaf vdev */
+};
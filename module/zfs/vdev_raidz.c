@@ -27,7 +27,14 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
+#include <sys/spa_impl.h>
 #include <sys/vdev_impl.h>
+#include <sys/metaslab_impl.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
+#include <sys/zap.h>
+#include <sys/zthr.h>
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
 #include <sys/abd.h>
@@ -134,11 +141,105 @@
 	VDEV_RAIDZ_64MUL_2((x), mask); \
 }
 
+/*
+ * RAID-Z expansion
+ *
+ * A RAID-Z vdev may be expanded by attaching a new child to it.  Think of
+ * the vdev as a sequence of sectors: sector s lives on child (s % W) at
+ * row (s / W), where W is the number of children.  Once a child has been
+ * attached, a background "reflow" (vdev_raidz_reflow_thread()) copies the
+ * sectors in ascending order from their place in the old layout, with W
+ * children, to their place in the new one, with W + 1 children, while I/O
+ * to the vdev continues.  Sectors below the reflow offset are in the new
+ * layout and those above it are still in the old one.  Because each
+ * sector moves to a lower row, the copy never overwrites a sector which
+ * has yet to be copied.
+ *
+ * The reflow does not rewrite blocks, so the layout of a block within the
+ * sequence of sectors stays the same: its data and parity are spread over
+ * as many columns as the vdev had children when the block was born (its
+ * "logical width", see vdev_raidz_get_logical_width()).  A block whose
+ * logical width matches the physical width of where it lives is read and
+ * written with the usual map from vdev_raidz_map_alloc().  Otherwise the
+ * map is built with the logical width and each child's share of the
+ * block, which is no longer a contiguous part of a column, is issued as a
+ * "span" (see vdev_raidz_map_expand()).  Reconstruction is then done one
+ * logical row at a time.
+ */
+typedef struct raidz_span {
+	uint64_t	rs_devidx;	/* child device index for I/O */
+	uint64_t	rs_offset;	/* device offset */
+	uint64_t	rs_size;	/* I/O size */
+	abd_t		*rs_abd;	/* the columns' sectors, ganged */
+	int		rs_error;	/* I/O error for this device */
+	uint8_t		rs_tried;	/* Did we attempt this I/O span? */
+	uint8_t		rs_skipped;	/* Did we skip this I/O span? */
+} raidz_span_t;
+
+typedef struct raidz_region {
+	uint64_t	rr_start;	/* first sector of the region */
+	uint64_t	rr_end;		/* sector past the region */
+	uint64_t	rr_width;	/* physical width of the region */
+	raidz_span_t	*rr_span;	/* one span per child */
+} raidz_region_t;
+
+/*
+ * The primary regions hold the block where it is read from.  While a
+ * block is between the durable and the current reflow offset it is also
+ * written to the new layout, which is the secondary region.
+ */
+#define	RAIDZ_MAX_REGIONS	3
+
+typedef struct raidz_expanded {
+	uint64_t	re_width;	/* logical width of the block */
+	uint64_t	*re_colstart;	/* first sector of each column */
+	int		*re_col;	/* column at each position of a row */
+	int		re_nprimary;
+	int		re_nregions;
+	raidz_region_t	re_region[RAIDZ_MAX_REGIONS];
+} raidz_expanded_t;
+
+static void
+vdev_raidz_expanded_free_spans(raidz_expanded_t *re)
+{
+	for (int r = 0; r < re->re_nregions; r++) {
+		raidz_region_t *rr = &re->re_region[r];
+
+		if (rr->rr_span == NULL)
+			continue;
+
+		for (int d = 0; d < rr->rr_width; d++) {
+			if (rr->rr_span[d].rs_abd != NULL)
+				abd_free(rr->rr_span[d].rs_abd);
+		}
+		kmem_free(rr->rr_span, rr->rr_width * sizeof (raidz_span_t));
+		rr->rr_span = NULL;
+	}
+}
+
+static void
+vdev_raidz_expanded_free(raidz_map_t *rm)
+{
+	raidz_expanded_t *re = rm->rm_expanded;
+
+	vdev_raidz_expanded_free_spans(re);
+	kmem_free(re->re_colstart, rm->rm_cols * sizeof (uint64_t));
+	kmem_free(re->re_col, re->re_width * sizeof (int));
+	kmem_free(re, sizeof (raidz_expanded_t));
+	rm->rm_expanded = NULL;
+}
+
 void
 vdev_raidz_map_free(raidz_map_t *rm)
 {
 	int c;
 
+	ASSERT3P(rm->rm_lr, ==, NULL);
+
+	/* The spans hold views of the columns. */
+	if (rm->rm_expanded != NULL)
+		vdev_raidz_expanded_free(rm);
+
 	for (c = 0; c < rm->rm_firstdatacol; c++) {
 		abd_free(rm->rm_col[c].rc_abd);
 
@@ -163,6 +264,11 @@ vdev_raidz_map_free_vsd(zio_t *zio)
 	ASSERT0(rm->rm_freed);
 	rm->rm_freed = 1;
 
+	if (rm->rm_lr != NULL) {
+		zfs_rangelock_exit(rm->rm_lr);
+		rm->rm_lr = NULL;
+	}
+
 	if (rm->rm_reports == 0)
 		vdev_raidz_map_free(rm);
 }
@@ -321,7 +427,7 @@ vdev_raidz_cksum_report(zio_t *zio, zio_cksum_report_t *zcr, void *arg)
 	ASSERT3U(offset, ==, size);
 }
 
-static const zio_vsd_ops_t vdev_raidz_vsd_ops = {
+const zio_vsd_ops_t vdev_raidz_vsd_ops = {
 	.vsd_free = vdev_raidz_map_free_vsd,
 	.vsd_cksum_report = vdev_raidz_cksum_report
 };
@@ -396,6 +502,9 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
 	rm->rm_reports = 0;
 	rm->rm_freed = 0;
 	rm->rm_ecksuminjected = 0;
+	rm->rm_skipzero = 0;
+	rm->rm_lr = NULL;
+	rm->rm_expanded = NULL;
 
 	asize = 0;
 
@@ -1588,8 +1697,12 @@ vdev_raidz_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
 		    cvd->vdev_physical_ashift);
 	}
 
-	*asize *= vd->vdev_children;
-	*max_asize *= vd->vdev_children;
+	/*
+	 * Until the reflow finishes, the vdev can only hold as many sectors
+	 * as its old layout.
+	 */
+	*asize *= vd->vdev_children - vd->vdev_rz_expanding;
+	*max_asize *= vd->vdev_children - vd->vdev_rz_expanding;
 
 	if (numerrors > nparity) {
 		vd->vdev_stat.vs_aux = VDEV_AUX_NO_REPLICAS;
@@ -1608,12 +1721,136 @@ vdev_raidz_close(vdev_t *vd)
 		vdev_close(vd->vdev_child[c]);
 }
 
+/*
+ * Set up the expansion state of a RAID-Z vdev from its configuration.
+ */
+int
+vdev_raidz_config_alloc(nvlist_t *nv, vdev_raidz_t **vdrzp)
+{
+	vdev_raidz_t *vdrz;
+	vdev_raidz_expand_t *vre;
+	uint64_t *txgs, offset;
+	uint_t ntxgs = 0;
+
+	if (nvlist_lookup_uint64_array(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+	    &txgs, &ntxgs) == 0) {
+		for (uint_t i = 1; i < ntxgs; i++) {
+			if (txgs[i] <= txgs[i - 1])
+				return (SET_ERROR(EINVAL));
+		}
+	}
+
+	vdrz = kmem_zalloc(sizeof (vdev_raidz_t), KM_SLEEP);
+	rw_init(&vdrz->vd_expand_lock, NULL, RW_DEFAULT, NULL);
+	vdrz->vd_nexpansions = ntxgs;
+	if (ntxgs != 0) {
+		vdrz->vd_expand_txgs = kmem_alloc(ntxgs * sizeof (uint64_t),
+		    KM_SLEEP);
+		bcopy(txgs, vdrz->vd_expand_txgs, ntxgs * sizeof (uint64_t));
+	}
+
+	vre = &vdrz->vn_vre;
+	mutex_init(&vre->vre_lock, NULL, MUTEX_DEFAULT, NULL);
+	zfs_rangelock_init(&vre->vre_rangelock, NULL, NULL);
+	if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_OFFSET,
+	    &offset) == 0) {
+		vre->vre_offset = offset;
+		vre->vre_offset_durable = offset;
+		vre->vre_offset_synced = offset;
+	}
+
+	*vdrzp = vdrz;
+
+	return (0);
+}
+
+void
+vdev_raidz_config_free(vdev_raidz_t *vdrz)
+{
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+
+	zfs_rangelock_fini(&vre->vre_rangelock);
+	mutex_destroy(&vre->vre_lock);
+	if (vdrz->vd_nexpansions != 0) {
+		kmem_free(vdrz->vd_expand_txgs,
+		    vdrz->vd_nexpansions * sizeof (uint64_t));
+	}
+	rw_destroy(&vdrz->vd_expand_lock);
+	kmem_free(vdrz, sizeof (vdev_raidz_t));
+}
+
+/*
+ * Add the expansion specific parts of the RAID-Z vdev configuration.  The
+ * reflow offset is only recorded once the txg which reached it is synced,
+ * see vdev_raidz_expand_sync().
+ */
+void
+vdev_raidz_config_generate(vdev_t *vd, nvlist_t *nv)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_raidz_ops);
+
+	if (vd->vdev_rz_expanding) {
+		fnvlist_add_uint64(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_OFFSET,
+		    vdrz->vn_vre.vre_offset_synced);
+	}
+
+	rw_enter(&vdrz->vd_expand_lock, RW_READER);
+	if (vdrz->vd_nexpansions != 0) {
+		fnvlist_add_uint64_array(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+		    vdrz->vd_expand_txgs, vdrz->vd_nexpansions);
+	}
+	rw_exit(&vdrz->vd_expand_lock);
+}
+
+static uint64_t
+vdev_raidz_logical_width_impl(vdev_t *vd, uint64_t txg)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	uint64_t width;
+
+	ASSERT(RW_LOCK_HELD(&vdrz->vd_expand_lock));
+
+	/*
+	 * Every expansion added a child, but blocks born before it finished
+	 * keep the width they were written with.  A child which is still
+	 * being reflowed onto holds no blocks of its own.
+	 */
+	width = vd->vdev_children - vd->vdev_rz_expanding -
+	    vdrz->vd_nexpansions;
+	for (uint64_t i = 0; i < vdrz->vd_nexpansions; i++) {
+		if (txg < vdrz->vd_expand_txgs[i])
+			break;
+		width++;
+	}
+
+	return (width);
+}
+
+/*
+ * The number of columns a block born in txg is spread over.  A txg of zero
+ * gives the width the vdev was created with.
+ */
+uint64_t
+vdev_raidz_get_logical_width(vdev_t *vd, uint64_t txg)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	uint64_t width;
+
+	rw_enter(&vdrz->vd_expand_lock, RW_READER);
+	width = vdev_raidz_logical_width_impl(vd, txg);
+	rw_exit(&vdrz->vd_expand_lock);
+
+	return (width);
+}
+
 static uint64_t
-vdev_raidz_asize(vdev_t *vd, uint64_t psize)
+vdev_raidz_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
 	uint64_t asize;
 	uint64_t ashift = vd->vdev_top->vdev_ashift;
-	uint64_t cols = vd->vdev_children;
+	uint64_t cols = vdev_raidz_get_logical_width(vd, txg);
 	uint64_t nparity = vd->vdev_nparity;
 
 	asize = ((psize - 1) >> ashift) + 1;
@@ -1633,6 +1870,12 @@ vdev_raidz_child_done(zio_t *zio)
 	rc->rc_skipped = 0;
 }
 
+static void
+vdev_raidz_skip_done(zio_t *zio)
+{
+	abd_put(zio->io_abd);
+}
+
 static void
 vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 {
@@ -1640,15 +1883,15 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 	vdev_t *vd = zio->io_vd;
 	vdev_t *tvd = vd->vdev_top;
 
-	range_seg64_t logical_rs, physical_rs;
+	range_seg64_t logical_rs, physical_rs, remain_rs;
 	logical_rs.rs_start = zio->io_offset;
-	logical_rs.rs_end = logical_rs.rs_start +
-	    vdev_raidz_asize(zio->io_vd, zio->io_size);
+	logical_rs.rs_end = logical_rs.rs_start + rm->rm_asize;
 
 	raidz_col_t *rc = &rm->rm_col[col];
 	vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
 
-	vdev_xlate(cvd, &logical_rs, &physical_rs);
+	vdev_xlate(cvd, &logical_rs, &physical_rs, &remain_rs);
+	ASSERT(vdev_xlate_is_empty(&remain_rs));
 	ASSERT3U(rc->rc_offset, ==, physical_rs.rs_start);
 	ASSERT3U(rc->rc_offset, <, physical_rs.rs_end);
 	/*
@@ -1667,15 +1910,43 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 }
 
 /*
- * Start an IO operation on a RAIDZ VDev
+ * Write out the padding sector which follows column c.  RAID-Z only issues
+ * this as an optional write to improve aggregation contiguity.  A dRAID map
+ * sets rm_skipzero instead, in which case the padding is zero filled and
+ * always written so that every row of a redundancy group stays consistent
+ * with its parity; sequential rebuild depends on this.
+ */
+static void
+vdev_raidz_skip_write(zio_t *zio, raidz_map_t *rm, int c, int flags)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_col_t *rc = &rm->rm_col[c];
+	vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
+	uint64_t size = 1ULL << vd->vdev_top->vdev_ashift;
+
+	if (rm->rm_skipzero) {
+		zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
+		    rc->rc_offset + rc->rc_size, abd_get_zeros(size), size,
+		    ZIO_TYPE_WRITE, zio->io_priority, flags,
+		    vdev_raidz_skip_done, NULL));
+	} else {
+		zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
+		    rc->rc_offset + rc->rc_size, NULL, size,
+		    ZIO_TYPE_WRITE, zio->io_priority,
+		    flags | ZIO_FLAG_NODATA | ZIO_FLAG_OPTIONAL, NULL, NULL));
+	}
+}
+
+/*
+ * Issue the child I/Os for a RAID-Z or dRAID map.
  *
  * Outline:
  * - For write operations:
  *   1. Generate the parity data
  *   2. Create child zio write operations to each column's vdev, for both
  *      data and parity.
- *   3. If the column skips any sectors for padding, create optional dummy
- *      write zio children for those areas to improve aggregation continuity.
+ *   3. If the column skips any sectors for padding, create dummy write
+ *      zio children for those areas (see vdev_raidz_skip_write()).
  * - For read operations:
  *   1. Create child zio read operations to each data column's vdev to read
  *      the range of data required for zio.
@@ -1683,21 +1954,14 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
  *      vdevs have had errors, then create zio read operations to the parity
  *      columns' VDevs as well.
  */
-static void
-vdev_raidz_io_start(zio_t *zio)
+void
+vdev_raidz_io_issue(zio_t *zio, raidz_map_t *rm)
 {
 	vdev_t *vd = zio->io_vd;
-	vdev_t *tvd = vd->vdev_top;
 	vdev_t *cvd;
-	raidz_map_t *rm;
 	raidz_col_t *rc;
 	int c, i;
 
-	rm = vdev_raidz_map_alloc(zio, tvd->vdev_ashift, vd->vdev_children,
-	    vd->vdev_nparity);
-
-	ASSERT3U(rm->rm_asize, ==, vdev_psize_to_asize(vd, zio->io_size));
-
 	if (zio->io_type == ZIO_TYPE_WRITE) {
 		vdev_raidz_generate_parity(rm);
 
@@ -1708,7 +1972,9 @@ vdev_raidz_io_start(zio_t *zio)
 			/*
 			 * Verify physical to logical translation.
 			 */
-			vdev_raidz_io_verify(zio, rm, c);
+			if (vd->vdev_ops == &vdev_raidz_ops &&
+			    !vd->vdev_rz_expanding)
+				vdev_raidz_io_verify(zio, rm, c);
 
 			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
 			    rc->rc_offset, rc->rc_abd, rc->rc_size,
@@ -1716,21 +1982,11 @@ vdev_raidz_io_start(zio_t *zio)
 			    vdev_raidz_child_done, rc));
 		}
 
-		/*
-		 * Generate optional I/Os for any skipped sectors to improve
-		 * aggregation contiguity.
-		 */
 		for (c = rm->rm_skipstart, i = 0; i < rm->rm_nskip; c++, i++) {
 			ASSERT(c <= rm->rm_scols);
 			if (c == rm->rm_scols)
 				c = 0;
-			rc = &rm->rm_col[c];
-			cvd = vd->vdev_child[rc->rc_devidx];
-			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
-			    rc->rc_offset + rc->rc_size, NULL,
-			    1 << tvd->vdev_ashift,
-			    zio->io_type, zio->io_priority,
-			    ZIO_FLAG_NODATA | ZIO_FLAG_OPTIONAL, NULL, NULL));
+			vdev_raidz_skip_write(zio, rm, c, 0);
 		}
 
 		zio_execute(zio);
@@ -1777,6 +2033,300 @@ vdev_raidz_io_start(zio_t *zio)
 	zio_execute(zio);
 }
 
+static void
+vdev_raidz_span_done(zio_t *zio)
+{
+	raidz_span_t *rs = zio->io_private;
+
+	rs->rs_error = zio->io_error;
+	rs->rs_tried = 1;
+	rs->rs_skipped = 0;
+}
+
+/*
+ * Split the sectors [start, end) of an expanded block, which are laid out
+ * over width children, into one span per child.
+ */
+static void
+vdev_raidz_region_init(raidz_map_t *rm, raidz_region_t *rr, uint64_t start,
+    uint64_t end, uint64_t width, uint64_t ashift)
+{
+	raidz_expanded_t *re = rm->rm_expanded;
+	uint64_t lwidth = re->re_width;
+
+	rr->rr_start = start;
+	rr->rr_end = end;
+	rr->rr_width = width;
+	rr->rr_span = kmem_zalloc(width * sizeof (raidz_span_t), KM_SLEEP);
+
+	for (uint64_t d = 0; d < width; d++) {
+		raidz_span_t *rs = &rr->rr_span[d];
+		uint64_t first = start + (d + width - start % width) % width;
+		int c = -1;
+		uint64_t k = 0, n = 0;
+
+		rs->rs_devidx = d;
+		if (first >= end)
+			continue;
+
+		rs->rs_offset = (first / width) << ashift;
+		rs->rs_abd = abd_alloc_gang_abd();
+
+		/*
+		 * Gather the sectors which this child holds, merging those
+		 * which follow each other in the same column.
+		 */
+		for (uint64_t p = first; p < end; p += width) {
+			int pc = re->re_col[p % lwidth];
+			uint64_t pk = (p - re->re_colstart[pc]) / lwidth;
+
+			ASSERT3S(pc, >=, 0);
+			ASSERT3U(pk << ashift, <, rm->rm_col[pc].rc_size);
+
+			if (pc == c && pk == k + n) {
+				n++;
+				continue;
+			}
+			if (n != 0) {
+				abd_gang_add(rs->rs_abd,
+				    abd_get_offset_size(rm->rm_col[c].rc_abd,
+				    k << ashift, n << ashift), B_TRUE);
+			}
+			c = pc;
+			k = pk;
+			n = 1;
+		}
+		abd_gang_add(rs->rs_abd, abd_get_offset_size(
+		    rm->rm_col[c].rc_abd, k << ashift, n << ashift), B_TRUE);
+		rs->rs_size = abd_get_size(rs->rs_abd);
+	}
+}
+
+static void
+vdev_raidz_add_region(raidz_map_t *rm, uint64_t start, uint64_t end,
+    uint64_t width, uint64_t ashift)
+{
+	raidz_expanded_t *re = rm->rm_expanded;
+
+	ASSERT3S(re->re_nregions, <, RAIDZ_MAX_REGIONS);
+	vdev_raidz_region_init(rm, &re->re_region[re->re_nregions++],
+	    start, end, width, ashift);
+}
+
+/*
+ * Find the span which holds sector k of column c.
+ */
+static raidz_span_t *
+vdev_raidz_span_lookup(raidz_map_t *rm, int c, uint64_t k)
+{
+	raidz_expanded_t *re = rm->rm_expanded;
+	uint64_t p = re->re_colstart[c] + k * re->re_width;
+
+	for (int r = 0; r < re->re_nprimary; r++) {
+		raidz_region_t *rr = &re->re_region[r];
+
+		if (p < rr->rr_end) {
+			ASSERT3U(p, >=, rr->rr_start);
+			return (&rr->rr_span[p % rr->rr_width]);
+		}
+	}
+
+	panic("sector %llu of column %d is not in its block",
+	    (u_longlong_t)k, c);
+	return (NULL);
+}
+
+/*
+ * Lay out a block whose logical width does not match the physical width
+ * of (all of) the sectors it occupies.  The map has been built with the
+ * logical width, so its data and parity take up the sectors [b, b + tot),
+ * in the order vdev_raidz_map_alloc() places them in; we skip the padding
+ * which follows them.  Sectors below durable are in the new layout and
+ * the others in the old one.  Those in [durable, reflow) have been copied
+ * already, but might be again should we crash, so writes to them update
+ * both layouts.
+ */
+static void
+vdev_raidz_map_expand(zio_t *zio, raidz_map_t *rm, uint64_t width,
+    uint64_t durable, uint64_t reflow)
+{
+	vdev_t *vd = zio->io_vd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t nwidth = vd->vdev_children;
+	uint64_t owidth = vd->vdev_children - vd->vdev_rz_expanding;
+	uint64_t b = zio->io_offset >> ashift;
+	uint64_t e = b + (rm->rm_asize >> ashift) - rm->rm_nskip;
+	raidz_expanded_t *re;
+
+	re = kmem_zalloc(sizeof (raidz_expanded_t), KM_SLEEP);
+	re->re_width = width;
+	re->re_colstart = kmem_alloc(rm->rm_cols * sizeof (uint64_t),
+	    KM_SLEEP);
+	re->re_col = kmem_alloc(width * sizeof (int), KM_SLEEP);
+	for (int i = 0; i < width; i++)
+		re->re_col[i] = -1;
+
+	for (int c = 0; c < rm->rm_cols; c++) {
+		raidz_col_t *rc = &rm->rm_col[c];
+
+		ASSERT3U(rc->rc_devidx, <, width);
+		re->re_colstart[c] = (rc->rc_offset >> ashift) * width +
+		    rc->rc_devidx;
+		re->re_col[rc->rc_devidx] = c;
+	}
+	rm->rm_expanded = re;
+
+	if (b < durable)
+		vdev_raidz_add_region(rm, b, MIN(e, durable), nwidth, ashift);
+	if (e > durable)
+		vdev_raidz_add_region(rm, MAX(b, durable), e, owidth, ashift);
+	re->re_nprimary = re->re_nregions;
+	if (MAX(b, durable) < MIN(e, reflow)) {
+		vdev_raidz_add_region(rm, MAX(b, durable), MIN(e, reflow),
+		    nwidth, ashift);
+	}
+
+	/*
+	 * The columns' errors are tracked by their spans.  Report the
+	 * location of the first sector of each column in ereports.
+	 */
+	for (int c = 0; c < rm->rm_cols; c++) {
+		raidz_col_t *rc = &rm->rm_col[c];
+		raidz_span_t *rs = vdev_raidz_span_lookup(rm, c, 0);
+
+		rc->rc_devidx = rs->rs_devidx;
+		rc->rc_offset = rs->rs_offset;
+		rc->rc_tried = 1;
+	}
+}
+
+/*
+ * Issue the child I/Os for an expanded map, see vdev_raidz_map_expand().
+ * All of the sectors of the block are read, parity included, since a
+ * child's span mixes data and parity sectors.
+ */
+static void
+vdev_raidz_io_issue_expanded(zio_t *zio, raidz_map_t *rm)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_expanded_t *re = rm->rm_expanded;
+	int nregions = re->re_nregions;
+
+	if (zio->io_type == ZIO_TYPE_WRITE)
+		vdev_raidz_generate_parity(rm);
+	else
+		nregions = re->re_nprimary;
+
+	for (int r = 0; r < nregions; r++) {
+		raidz_region_t *rr = &re->re_region[r];
+
+		for (int d = 0; d < rr->rr_width; d++) {
+			raidz_span_t *rs = &rr->rr_span[d];
+			vdev_t *cvd = vd->vdev_child[rs->rs_devidx];
+
+			if (rs->rs_size == 0)
+				continue;
+
+			if (zio->io_type == ZIO_TYPE_READ) {
+				if (!vdev_readable(cvd)) {
+					rs->rs_error = SET_ERROR(ENXIO);
+					rs->rs_tried = 1;
+					rs->rs_skipped = 1;
+					continue;
+				}
+				if (vdev_dtl_contains(cvd, DTL_MISSING,
+				    zio->io_txg, 1)) {
+					rs->rs_error = SET_ERROR(ESTALE);
+					rs->rs_skipped = 1;
+					continue;
+				}
+			}
+
+			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
+			    rs->rs_offset, rs->rs_abd, rs->rs_size,
+			    zio->io_type, zio->io_priority, 0,
+			    vdev_raidz_span_done, rs));
+		}
+	}
+
+	zio_execute(zio);
+}
+
+/*
+ * Start an IO operation on a RAIDZ VDev
+ */
+static void
+vdev_raidz_io_start(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_t *tvd = vd->vdev_top;
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	uint64_t ashift = tvd->vdev_ashift;
+	uint64_t durable = UINT64_MAX, reflow = UINT64_MAX;
+	uint64_t txg, width, owidth;
+	boolean_t expanding;
+	raidz_map_t *rm;
+
+	/*
+	 * The layout of a block depends on the txg it was born in.
+	 */
+	if (zio->io_bp != NULL && BP_PHYSICAL_BIRTH(zio->io_bp) != 0)
+		txg = BP_PHYSICAL_BIRTH(zio->io_bp);
+	else
+		txg = zio->io_txg;
+
+	rw_enter(&vdrz->vd_expand_lock, RW_READER);
+	width = vdev_raidz_logical_width_impl(vd, txg);
+	expanding = vd->vdev_rz_expanding;
+	rw_exit(&vdrz->vd_expand_lock);
+
+	rm = vdev_raidz_map_alloc(zio, ashift, width, vd->vdev_nparity);
+
+	ASSERT3U(rm->rm_asize, ==, vdev_psize_to_asize_txg(vd, zio->io_size,
+	    txg));
+
+	if (!expanding && width == vd->vdev_children) {
+		vdev_raidz_io_issue(zio, rm);
+		return;
+	}
+
+	if (expanding) {
+		vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+
+		/*
+		 * Keep the reflow away from this block until we are done
+		 * with it; the offsets can't move past it meanwhile.
+		 */
+		rm->rm_lr = zfs_rangelock_enter(&vre->vre_rangelock,
+		    zio->io_offset, rm->rm_asize, RL_READER);
+		mutex_enter(&vre->vre_lock);
+		durable = vre->vre_offset_durable >> ashift;
+		reflow = vre->vre_offset >> ashift;
+		mutex_exit(&vre->vre_lock);
+
+		/*
+		 * A block which lies entirely on one side of the durable
+		 * offset, in a layout as wide as itself, can use the usual
+		 * map.  Writes to a block which has been copied but whose
+		 * copy may be needed again update both layouts.
+		 */
+		uint64_t b = zio->io_offset >> ashift;
+		uint64_t e = b + (rm->rm_asize >> ashift);
+
+		owidth = vd->vdev_children - 1;
+		if (((e <= durable && width == vd->vdev_children) ||
+		    (b >= durable && width == owidth)) &&
+		    (zio->io_type == ZIO_TYPE_READ || e <= durable ||
+		    b >= reflow)) {
+			vdev_raidz_io_issue(zio, rm);
+			return;
+		}
+	}
+
+	vdev_raidz_map_expand(zio, rm, width, durable, reflow);
+	vdev_raidz_io_issue_expanded(zio, rm);
+}
+
 
 /*
  * Report a checksum error for a child of a RAID-Z device.
@@ -2036,46 +2586,457 @@ done:
 }
 
 /*
- * Complete an IO operation on a RAIDZ VDev
- *
- * Outline:
- * - For write operations:
- *   1. Check for errors on the child IOs.
- *   2. Return, setting an error code if too few child VDevs were written
- *      to reconstruct the data later.  Note that partial writes are
- *      considered successful if they can be reconstructed at all.
- * - For read operations:
- *   1. Check for errors on the child IOs.
- *   2. If data errors occurred:
- *      a. Try to reassemble the data from the parity available.
- *      b. If we haven't yet read the parity drives, read them now.
- *      c. If all parity drives have been read but the data still doesn't
- *         reassemble with a correct checksum, then try combinatorial
- *         reconstruction.
- *      d. If that doesn't work, return an error.
- *   3. If there were unexpected errors or this is a resilver operation,
- *      rewrite the vdevs that had errors.
+ * Report a checksum error for a span of an expanded block.
  */
 static void
-vdev_raidz_io_done(zio_t *zio)
+raidz_span_checksum_error(zio_t *zio, raidz_span_t *rs)
 {
-	vdev_t *vd = zio->io_vd;
-	vdev_t *cvd;
-	raidz_map_t *rm = zio->io_vsd;
-	raidz_col_t *rc = NULL;
-	int unexpected_errors = 0;
-	int parity_errors = 0;
-	int parity_untried = 0;
-	int data_errors = 0;
-	int total_errors = 0;
-	int n, c;
-	int tgts[VDEV_RAIDZ_MAXPARITY];
-	int code;
+	vdev_t *vd = zio->io_vd->vdev_child[rs->rs_devidx];
 
-	ASSERT(zio->io_bp != NULL);  /* XXX need to add code to enforce this */
+	if (!(zio->io_flags & ZIO_FLAG_SPECULATIVE)) {
+		zio_bad_cksum_t zbc;
+		raidz_map_t *rm = zio->io_vsd;
 
-	ASSERT(rm->rm_missingparity <= rm->rm_firstdatacol);
-	ASSERT(rm->rm_missingdata <= rm->rm_cols - rm->rm_firstdatacol);
+		zbc.zbc_has_cksum = 0;
+		zbc.zbc_injected = rm->rm_ecksuminjected;
+
+		int ret = zfs_ereport_post_checksum(zio->io_spa, vd,
+		    &zio->io_bookmark, zio, rs->rs_offset, rs->rs_size,
+		    rs->rs_abd, NULL, &zbc);
+		if (ret != EALREADY) {
+			mutex_enter(&vd->vdev_stat_lock);
+			vd->vdev_stat.vs_checksum_errors++;
+			mutex_exit(&vd->vdev_stat_lock);
+		}
+	}
+}
+
+/*
+ * Count the sectors in error in logical row k of an expanded block, that
+ * is sector k of each column which is long enough.  The spans in extra
+ * are taken to be in error too.  If a row map is passed its columns'
+ * errors are filled in.
+ */
+static int
+vdev_raidz_row_errors(raidz_map_t *rm, uint64_t k, uint64_t ashift,
+    raidz_span_t **extra, int nextra, raidz_map_t *row, int *data_errors)
+{
+	int errors = 0;
+	int c;
+
+	*data_errors = 0;
+	for (c = 0; c < rm->rm_cols &&
+	    (k << ashift) < rm->rm_col[c].rc_size; c++) {
+		raidz_span_t *rs = vdev_raidz_span_lookup(rm, c, k);
+		int error = rs->rs_error;
+
+		for (int i = 0; i < nextra; i++) {
+			if (extra[i] == rs)
+				error = ECKSUM;
+		}
+
+		if (error != 0) {
+			errors++;
+			if (c >= rm->rm_firstdatacol)
+				(*data_errors)++;
+		}
+		if (row != NULL)
+			row->rm_col[c].rc_error = error;
+	}
+
+	if (row != NULL) {
+		row->rm_cols = c;
+		row->rm_scols = c;
+		row->rm_bigcols = c;
+	}
+
+	return (errors);
+}
+
+/*
+ * Reconstruct the sectors of an expanded block which are in error, one
+ * logical row at a time.  Returns ECKSUM if a row has more sectors in
+ * error than it has parity.
+ */
+static int
+vdev_raidz_expanded_reconstruct(zio_t *zio, raidz_map_t *rm,
+    raidz_span_t **extra, int nextra)
+{
+	uint64_t ashift = zio->io_vd->vdev_top->vdev_ashift;
+	uint64_t nrows = rm->rm_col[0].rc_size >> ashift;
+	raidz_map_t *row;
+	int error = 0;
+
+	row = kmem_zalloc(offsetof(raidz_map_t, rm_col[rm->rm_cols]),
+	    KM_SLEEP);
+	row->rm_firstdatacol = rm->rm_firstdatacol;
+	row->rm_ops = rm->rm_ops;
+
+	for (uint64_t k = 0; k < nrows; k++) {
+		int data_errors;
+
+		if (vdev_raidz_row_errors(rm, k, ashift, extra, nextra, row,
+		    &data_errors) > rm->rm_firstdatacol) {
+			error = SET_ERROR(ECKSUM);
+			break;
+		}
+		if (data_errors == 0)
+			continue;
+
+		for (int c = 0; c < row->rm_cols; c++) {
+			raidz_col_t *rc = &row->rm_col[c];
+
+			rc->rc_size = 1ULL << ashift;
+			rc->rc_abd = abd_get_offset_size(rm->rm_col[c].rc_abd,
+			    k << ashift, rc->rc_size);
+			rc->rc_tried = 1;
+		}
+
+		(void) vdev_raidz_reconstruct(row, NULL, 0);
+
+		for (int c = 0; c < row->rm_cols; c++)
+			abd_put(row->rm_col[c].rc_abd);
+	}
+
+	kmem_free(row, offsetof(raidz_map_t, rm_col[rm->rm_cols]));
+
+	return (error);
+}
+
+static void
+vdev_raidz_expanded_copy(raidz_map_t *rm, abd_t *copy, boolean_t restore)
+{
+	size_t off = 0;
+
+	for (int c = 0; c < rm->rm_cols; c++) {
+		raidz_col_t *rc = &rm->rm_col[c];
+
+		if (restore)
+			abd_copy_off(rc->rc_abd, copy, 0, off, rc->rc_size);
+		else
+			abd_copy_off(copy, rc->rc_abd, off, 0, rc->rc_size);
+		off += rc->rc_size;
+	}
+}
+
+/*
+ * Produce the data of an expanded block which failed to read or to verify.
+ * First reconstruct the sectors whose spans failed, then, as with
+ * vdev_raidz_combrec(), try every combination of up to nparity other spans
+ * which might have returned bad data.
+ */
+static int
+vdev_raidz_expanded_combrec(zio_t *zio, raidz_map_t *rm)
+{
+	raidz_expanded_t *re = rm->rm_expanded;
+	raidz_span_t *extra[VDEV_RAIDZ_MAXPARITY];
+	raidz_span_t **cand;
+	int idx[VDEV_RAIDZ_MAXPARITY];
+	int ncand = 0, maxcand = 0;
+	int error = SET_ERROR(ECKSUM);
+	size_t size = 0;
+	abd_t *copy;
+
+	for (int c = 0; c < rm->rm_cols; c++)
+		size += rm->rm_col[c].rc_size;
+	copy = abd_alloc_for_io(size, B_FALSE);
+	vdev_raidz_expanded_copy(rm, copy, B_FALSE);
+
+	for (int r = 0; r < re->re_nprimary; r++)
+		maxcand += re->re_region[r].rr_width;
+	cand = kmem_alloc(maxcand * sizeof (raidz_span_t *), KM_SLEEP);
+	for (int r = 0; r < re->re_nprimary; r++) {
+		raidz_region_t *rr = &re->re_region[r];
+
+		for (int d = 0; d < rr->rr_width; d++) {
+			if (rr->rr_span[d].rs_size != 0 &&
+			    rr->rr_span[d].rs_error == 0)
+				cand[ncand++] = &rr->rr_span[d];
+		}
+	}
+
+	if (vdev_raidz_expanded_reconstruct(zio, rm, NULL, 0) != 0)
+		goto out;
+	if (raidz_checksum_verify(zio) == 0) {
+		error = 0;
+		goto out;
+	}
+
+	for (int n = 1; n <= rm->rm_firstdatacol && n <= ncand; n++) {
+		int i;
+
+		for (i = 0; i < n; i++)
+			idx[i] = i;
+
+		for (;;) {
+			for (i = 0; i < n; i++)
+				extra[i] = cand[idx[i]];
+
+			vdev_raidz_expanded_copy(rm, copy, B_TRUE);
+			if (vdev_raidz_expanded_reconstruct(zio, rm,
+			    extra, n) == 0 && raidz_checksum_verify(zio) == 0) {
+				for (i = 0; i < n; i++) {
+					raidz_span_checksum_error(zio,
+					    extra[i]);
+					extra[i]->rs_error = SET_ERROR(ECKSUM);
+				}
+				error = 0;
+				goto out;
+			}
+
+			/* Move on to the next combination. */
+			for (i = n - 1; i >= 0 && idx[i] == ncand - n + i; i--)
+				continue;
+			if (i < 0)
+				break;
+			idx[i]++;
+			for (i++; i < n; i++)
+				idx[i] = idx[i - 1] + 1;
+		}
+	}
+
+out:
+	if (error != 0)
+		vdev_raidz_expanded_copy(rm, copy, B_TRUE);
+	kmem_free(cand, maxcand * sizeof (raidz_span_t *));
+	abd_free(copy);
+
+	return (error);
+}
+
+/*
+ * Complete an I/O of an expanded block, see vdev_raidz_map_expand().  This
+ * follows vdev_raidz_io_done(), but all spans were read up front and the
+ * errors are counted per logical row.
+ */
+static void
+vdev_raidz_io_done_expanded(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_map_t *rm = zio->io_vsd;
+	raidz_expanded_t *re = rm->rm_expanded;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t nrows = rm->rm_col[0].rc_size >> ashift;
+	int unexpected_errors = 0;
+	int total_errors = 0;
+	int error = 0;
+
+	for (int r = 0; r < re->re_nprimary; r++) {
+		raidz_region_t *rr = &re->re_region[r];
+
+		for (int d = 0; d < rr->rr_width; d++) {
+			raidz_span_t *rs = &rr->rr_span[d];
+
+			if (rs->rs_error != 0) {
+				error = zio_worst_error(error, rs->rs_error);
+				if (!rs->rs_skipped)
+					unexpected_errors++;
+				total_errors++;
+			}
+		}
+	}
+
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		/*
+		 * As in vdev_raidz_io_done(), a partial write is a success
+		 * if every row can be reconstructed later.
+		 */
+		for (uint64_t k = 0; total_errors != 0 && k < nrows; k++) {
+			int data_errors;
+
+			if (vdev_raidz_row_errors(rm, k, ashift, NULL, 0,
+			    NULL, &data_errors) > rm->rm_firstdatacol) {
+				zio->io_error = error;
+				break;
+			}
+		}
+		return;
+	}
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ);
+
+	if (total_errors != 0 || raidz_checksum_verify(zio) != 0) {
+		if (vdev_raidz_expanded_combrec(zio, rm) == 0) {
+			/* Count the spans found to hold bad data. */
+			unexpected_errors = 0;
+			for (int r = 0; r < re->re_nprimary; r++) {
+				raidz_region_t *rr = &re->re_region[r];
+
+				for (int d = 0; d < rr->rr_width; d++) {
+					if (rr->rr_span[d].rs_error != 0 &&
+					    !rr->rr_span[d].rs_skipped)
+						unexpected_errors++;
+				}
+			}
+		} else {
+			for (uint64_t k = 0; k < nrows; k++) {
+				int data_errors;
+
+				if (vdev_raidz_row_errors(rm, k, ashift, NULL,
+				    0, NULL, &data_errors) >
+				    rm->rm_firstdatacol) {
+					zio->io_error = error;
+					break;
+				}
+			}
+			if (zio->io_error == 0)
+				zio->io_error = SET_ERROR(ECKSUM);
+		}
+	}
+
+	if (zio->io_error == ECKSUM) {
+		/*
+		 * Start checksum ereports for the columns, as in
+		 * vdev_raidz_io_done().  Saving the data of the columns
+		 * replaces their buffers, so the spans must go first.
+		 */
+		vdev_raidz_expanded_free_spans(re);
+
+		if (!(zio->io_flags & ZIO_FLAG_SPECULATIVE)) {
+			for (int c = 0; c < rm->rm_cols; c++) {
+				raidz_col_t *rc = &rm->rm_col[c];
+				vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
+				zio_bad_cksum_t zbc;
+
+				zbc.zbc_has_cksum = 0;
+				zbc.zbc_injected = rm->rm_ecksuminjected;
+
+				int ret = zfs_ereport_start_checksum(
+				    zio->io_spa, cvd, &zio->io_bookmark, zio,
+				    rc->rc_offset, rc->rc_size,
+				    (void *)(uintptr_t)c, &zbc);
+				if (ret != EALREADY) {
+					mutex_enter(&cvd->vdev_stat_lock);
+					cvd->vdev_stat.vs_checksum_errors++;
+					mutex_exit(&cvd->vdev_stat_lock);
+				}
+			}
+		}
+	}
+
+	zio_checksum_verified(zio);
+
+	if (zio->io_error != 0)
+		return;
+
+	/*
+	 * Verify the parity we read when scrubbing, or regenerate it to
+	 * repair damaged children.  A column whose sectors failed to read
+	 * holds garbage, so only compare those which were read.
+	 */
+	if ((zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER)) ||
+	    unexpected_errors) {
+		for (int c = 0; c < rm->rm_cols; c++) {
+			raidz_col_t *rc = &rm->rm_col[c];
+
+			rc->rc_error = 0;
+			for (uint64_t k = 0; (k << ashift) < rc->rc_size; k++) {
+				rc->rc_error = zio_worst_error(rc->rc_error,
+				    vdev_raidz_span_lookup(rm, c, k)->rs_error);
+			}
+		}
+
+		if (raidz_parity_verify(zio, rm) != 0) {
+			unexpected_errors++;
+			for (int c = 0; c < rm->rm_firstdatacol; c++) {
+				raidz_col_t *rc = &rm->rm_col[c];
+
+				if (rc->rc_error != ECKSUM)
+					continue;
+				for (uint64_t k = 0;
+				    (k << ashift) < rc->rc_size; k++) {
+					raidz_span_t *rs =
+					    vdev_raidz_span_lookup(rm, c, k);
+					if (rs->rs_error == 0) {
+						rs->rs_error =
+						    SET_ERROR(ECKSUM);
+					}
+				}
+			}
+		}
+		vdev_raidz_generate_parity(rm);
+	}
+
+	if (spa_writeable(zio->io_spa) &&
+	    (unexpected_errors || (zio->io_flags & ZIO_FLAG_RESILVER))) {
+		boolean_t repaired = B_FALSE;
+
+		/*
+		 * Use the good data we have in hand to repair damaged
+		 * children.  The copy in the new layout was taken from the
+		 * old one, so refresh it as well.
+		 */
+		for (int r = 0; r < re->re_nregions; r++) {
+			raidz_region_t *rr = &re->re_region[r];
+
+			if (r >= re->re_nprimary && !repaired)
+				break;
+
+			for (int d = 0; d < rr->rr_width; d++) {
+				raidz_span_t *rs = &rr->rr_span[d];
+
+				if (rs->rs_size == 0 ||
+				    (r < re->re_nprimary && rs->rs_error == 0))
+					continue;
+
+				zio_nowait(zio_vdev_child_io(zio, NULL,
+				    vd->vdev_child[rs->rs_devidx],
+				    rs->rs_offset, rs->rs_abd, rs->rs_size,
+				    ZIO_TYPE_WRITE, ZIO_PRIORITY_ASYNC_WRITE,
+				    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
+				    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
+				repaired = B_TRUE;
+			}
+		}
+	}
+}
+
+/*
+ * Complete an IO operation on a RAIDZ VDev
+ *
+ * Outline:
+ * - For write operations:
+ *   1. Check for errors on the child IOs.
+ *   2. Return, setting an error code if too few child VDevs were written
+ *      to reconstruct the data later.  Note that partial writes are
+ *      considered successful if they can be reconstructed at all.
+ * - For read operations:
+ *   1. Check for errors on the child IOs.
+ *   2. If data errors occurred:
+ *      a. Try to reassemble the data from the parity available.
+ *      b. If we haven't yet read the parity drives, read them now.
+ *      c. If all parity drives have been read but the data still doesn't
+ *         reassemble with a correct checksum, then try combinatorial
+ *         reconstruction.
+ *      d. If that doesn't work, return an error.
+ *   3. If there were unexpected errors or this is a resilver operation,
+ *      rewrite the vdevs that had errors.
+ */
+void
+vdev_raidz_io_done(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_t *cvd;
+	raidz_map_t *rm = zio->io_vsd;
+	raidz_col_t *rc = NULL;
+	int unexpected_errors = 0;
+	int parity_errors = 0;
+	int parity_untried = 0;
+	int data_errors = 0;
+	int total_errors = 0;
+	int n, c;
+	int tgts[VDEV_RAIDZ_MAXPARITY];
+	int code;
+
+	ASSERT(zio->io_bp != NULL);  /* XXX need to add code to enforce this */
+
+	if (rm->rm_expanded != NULL) {
+		vdev_raidz_io_done_expanded(zio);
+		return;
+	}
+
+	ASSERT(rm->rm_missingparity <= rm->rm_firstdatacol);
+	ASSERT(rm->rm_missingdata <= rm->rm_cols - rm->rm_firstdatacol);
 
 	for (c = 0; c < rm->rm_cols; c++) {
 		rc = &rm->rm_col[c];
@@ -2321,10 +3282,29 @@ done:
 			    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
 			    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
 		}
+
+		/*
+		 * Zeroed padding is part of the row, so it is repaired along
+		 * with the rest of its column.  A column which only holds
+		 * padding was not read, so use the child's DTL instead.
+		 */
+		for (c = rm->rm_skipstart; rm->rm_skipzero &&
+		    c < rm->rm_skipstart + rm->rm_nskip; c++) {
+			rc = &rm->rm_col[c];
+			cvd = vd->vdev_child[rc->rc_devidx];
+
+			if (c < rm->rm_cols ? rc->rc_error == 0 :
+			    !vdev_dtl_contains(cvd, DTL_PARTIAL,
+			    zio->io_txg, 1))
+				continue;
+
+			vdev_raidz_skip_write(zio, rm, c, ZIO_FLAG_IO_REPAIR |
+			    (unexpected_errors ? ZIO_FLAG_SELF_HEAL : 0));
+		}
 	}
 }
 
-static void
+void
 vdev_raidz_state_change(vdev_t *vd, int faulted, int degraded)
 {
 	if (faulted > vd->vdev_nparity)
@@ -2345,6 +3325,7 @@ vdev_raidz_state_change(vdev_t *vd, int faulted, int degraded)
 static boolean_t
 vdev_raidz_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
 {
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
 	uint64_t dcols = vd->vdev_children;
 	uint64_t nparity = vd->vdev_nparity;
 	uint64_t ashift = vd->vdev_top->vdev_ashift;
@@ -2355,6 +3336,13 @@ vdev_raidz_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
 	/* The first column for this stripe. */
 	uint64_t f = b % dcols;
 
+	/*
+	 * The block may be narrower than the vdev, or straddle the reflow
+	 * offset, so its columns can't be found without its birth txg.
+	 */
+	if (vd->vdev_rz_expanding || vdrz->vd_nexpansions != 0)
+		return (B_TRUE);
+
 	if (s + nparity >= dcols)
 		return (B_TRUE);
 
@@ -2375,12 +3363,13 @@ vdev_raidz_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
 }
 
 static void
-vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *in, range_seg64_t *res)
+vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *in, range_seg64_t *res,
+    range_seg64_t *remain)
 {
 	vdev_t *raidvd = cvd->vdev_parent;
 	ASSERT(raidvd->vdev_ops == &vdev_raidz_ops);
 
-	uint64_t width = raidvd->vdev_children;
+	uint64_t width = raidvd->vdev_children - raidvd->vdev_rz_expanding;
 	uint64_t tgt_col = cvd->vdev_id;
 	uint64_t ashift = raidvd->vdev_top->vdev_ashift;
 
@@ -2400,11 +3389,565 @@ vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *in, range_seg64_t *res)
 
 	res->rs_start = start_row << ashift;
 	res->rs_end = end_row << ashift;
+	remain->rs_start = remain->rs_end = 0;
 
 	ASSERT3U(res->rs_start, <=, in->rs_start);
 	ASSERT3U(res->rs_end - res->rs_start, <=, in->rs_end - in->rs_start);
 }
 
+/*
+ * Largest amount of allocated space the reflow copies at once, and an
+ * offset at which it pauses (for testing; zero means never pause).
+ */
+unsigned long zfs_raidz_expand_max_copy_bytes = 16 * 1024 * 1024;
+unsigned long zfs_raidz_expand_max_reflow_bytes = 0;
+
+int
+vdev_raidz_load(vdev_t *vd)
+{
+	spa_t *spa = vd->vdev_spa;
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+	int err;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_raidz_ops);
+
+	vre->vre_vdev_id = vd->vdev_id;
+	if (vd->vdev_top_zap == 0)
+		return (0);
+
+	err = zap_lookup(spa->spa_meta_objset, vd->vdev_top_zap,
+	    VDEV_TOP_ZAP_RAIDZ_EXPAND_PHYS, sizeof (uint64_t),
+	    sizeof (vre->vre_phys) / sizeof (uint64_t), &vre->vre_phys);
+	if (err == ENOENT)
+		err = 0;
+	if (err != 0)
+		return (err);
+
+	if (vd->vdev_rz_expanding) {
+		if (vre->vre_phys.vrep_state != DSS_SCANNING ||
+		    spa->spa_raidz_expand != NULL)
+			return (SET_ERROR(EINVAL));
+		spa->spa_raidz_expand = vre;
+	}
+
+	return (0);
+}
+
+/*
+ * Sync task of "zpool attach" to a RAID-Z vdev.  The new child is already
+ * in the config, with the reflow offset at zero.
+ */
+void
+vdev_raidz_attach_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_t *raidvd = arg;
+	spa_t *spa = raidvd->vdev_spa;
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+
+	VERIFY(raidvd->vdev_rz_expanding);
+	ASSERT3P(spa->spa_raidz_expand, ==, vre);
+
+	spa_feature_incr(spa, SPA_FEATURE_RAIDZ_EXPANSION, tx);
+
+	vre->vre_phys.vrep_state = DSS_SCANNING;
+	vre->vre_phys.vrep_start_time = gethrestime_sec();
+	vre->vre_phys.vrep_end_time = 0;
+	vre->vre_phys.vrep_reflowed = 0;
+	VERIFY0(zap_update(spa->spa_meta_objset, raidvd->vdev_top_zap,
+	    VDEV_TOP_ZAP_RAIDZ_EXPAND_PHYS, sizeof (uint64_t),
+	    sizeof (vre->vre_phys) / sizeof (uint64_t), &vre->vre_phys, tx));
+
+	spa_history_log_internal(spa, "raidz expand", tx,
+	    "started vdev=%llu width=%llu", (u_longlong_t)raidvd->vdev_id,
+	    (u_longlong_t)raidvd->vdev_children);
+}
+
+/*
+ * Called from spa_sync() to put the reflow offset recorded for this txg
+ * into the config being synced.
+ */
+void
+vdev_raidz_expand_sync(spa_t *spa, dmu_tx_t *tx)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	uint64_t txg = dmu_tx_get_txg(tx);
+
+	if (vre == NULL || vre->vre_offset_pertxg[txg & TXG_MASK] == 0)
+		return;
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_offset_synced = MAX(vre->vre_offset_synced,
+	    vre->vre_offset_pertxg[txg & TXG_MASK]);
+	vre->vre_offset_pertxg[txg & TXG_MASK] = 0;
+	mutex_exit(&vre->vre_lock);
+
+	vdev_config_dirty(vdev_lookup_top(spa, vre->vre_vdev_id));
+}
+
+static void
+raidz_reflow_complete_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+	uint64_t n = vdrz->vd_nexpansions;
+	uint64_t *txgs;
+
+	ASSERT3U(vre->vre_offset_durable, ==, vre->vre_offset);
+
+	/*
+	 * Blocks of the txgs which may already be open have been allocated
+	 * with the old width, so the new width starts with the first txg
+	 * that can't be.
+	 */
+	txgs = kmem_alloc((n + 1) * sizeof (uint64_t), KM_SLEEP);
+	if (n != 0)
+		bcopy(vdrz->vd_expand_txgs, txgs, n * sizeof (uint64_t));
+	txgs[n] = dmu_tx_get_txg(tx) + TXG_CONCURRENT_STATES;
+
+	rw_enter(&vdrz->vd_expand_lock, RW_WRITER);
+	if (n != 0)
+		kmem_free(vdrz->vd_expand_txgs, n * sizeof (uint64_t));
+	vdrz->vd_expand_txgs = txgs;
+	vdrz->vd_nexpansions = n + 1;
+	raidvd->vdev_rz_expanding = B_FALSE;
+	rw_exit(&vdrz->vd_expand_lock);
+
+	vre->vre_phys.vrep_state = DSS_FINISHED;
+	vre->vre_phys.vrep_end_time = gethrestime_sec();
+	vre->vre_phys.vrep_reflowed = vre->vre_offset;
+	VERIFY0(zap_update(spa->spa_meta_objset, raidvd->vdev_top_zap,
+	    VDEV_TOP_ZAP_RAIDZ_EXPAND_PHYS, sizeof (uint64_t),
+	    sizeof (vre->vre_phys) / sizeof (uint64_t), &vre->vre_phys, tx));
+
+	spa->spa_raidz_expand = NULL;
+	vdev_config_dirty(raidvd);
+
+	spa_history_log_internal(spa, "raidz expand", tx,
+	    "completed vdev=%llu reflowed=%llu", (u_longlong_t)raidvd->vdev_id,
+	    (u_longlong_t)vre->vre_phys.vrep_reflowed);
+
+	spa_notify_waiters(spa);
+}
+
+typedef struct raidz_reflow_arg {
+	vdev_t		*rra_vd;
+	zio_t		*rra_zio;
+	zio_type_t	rra_type;
+	uint64_t	rra_width;	/* number of children data is on */
+	abd_t		*rra_abd;
+	uint64_t	rra_abd_offset;
+	uint32_t	rra_error;
+} raidz_reflow_arg_t;
+
+static void
+raidz_reflow_io_done(zio_t *zio)
+{
+	raidz_reflow_arg_t *rra = zio->io_private;
+
+	if (zio->io_error != 0)
+		(void) atomic_cas_32(&rra->rra_error, 0, zio->io_error);
+	abd_free(zio->io_abd);
+}
+
+/*
+ * range_tree_walk() callback which issues the child I/Os of one allocated
+ * segment in the layout rra_width wide.  The sectors of all segments are
+ * packed into rra_abd in order.
+ */
+static void
+raidz_reflow_issue_segment(void *arg, uint64_t start, uint64_t size)
+{
+	raidz_reflow_arg_t *rra = arg;
+	vdev_t *raidvd = rra->rra_vd;
+	uint64_t ashift = raidvd->vdev_ashift;
+	uint64_t width = rra->rra_width;
+	uint64_t b = start >> ashift;
+	uint64_t e = (start + size) >> ashift;
+
+	for (uint64_t d = 0; d < width; d++) {
+		uint64_t first = b + (d + width - b % width) % width;
+		uint64_t n = 0;
+
+		if (first >= e)
+			continue;
+
+		abd_t *abd = abd_alloc_gang_abd();
+		for (uint64_t s = first; s < e; s += width, n++) {
+			abd_gang_add(abd, abd_get_offset_size(rra->rra_abd,
+			    rra->rra_abd_offset + ((s - b) << ashift),
+			    1ULL << ashift), B_TRUE);
+		}
+
+		zio_nowait(zio_vdev_child_io(rra->rra_zio, NULL,
+		    raidvd->vdev_child[d], (first / width) << ashift, abd,
+		    n << ashift, rra->rra_type, ZIO_PRIORITY_REMOVAL,
+		    ZIO_FLAG_CANFAIL, raidz_reflow_io_done, rra));
+	}
+
+	rra->rra_abd_offset += size;
+}
+
+/*
+ * Copy the segments in rt from the old layout to the new one, and make
+ * sure they are on stable storage before the reflow offset passes them.
+ */
+static int
+raidz_reflow_copy(vdev_t *raidvd, range_tree_t *rt)
+{
+	spa_t *spa = raidvd->vdev_spa;
+	raidz_reflow_arg_t rra;
+	uint64_t size = range_tree_space(rt);
+
+	if (size == 0)
+		return (0);
+
+	bzero(&rra, sizeof (rra));
+	rra.rra_vd = raidvd;
+	rra.rra_abd = abd_alloc_for_io(size, B_FALSE);
+
+	rra.rra_zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	rra.rra_type = ZIO_TYPE_READ;
+	rra.rra_width = raidvd->vdev_children - 1;
+	range_tree_walk(rt, raidz_reflow_issue_segment, &rra);
+	(void) zio_wait(rra.rra_zio);
+
+	if (rra.rra_error == 0) {
+		rra.rra_zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+		rra.rra_type = ZIO_TYPE_WRITE;
+		rra.rra_width = raidvd->vdev_children;
+		rra.rra_abd_offset = 0;
+		range_tree_walk(rt, raidz_reflow_issue_segment, &rra);
+		(void) zio_wait(rra.rra_zio);
+	}
+
+	if (rra.rra_error == 0) {
+		zio_t *zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+		zio_flush(zio, raidvd);
+		(void) zio_wait(zio);
+	}
+
+	abd_free(rra.rra_abd);
+
+	return (rra.rra_error);
+}
+
+/*
+ * The reflow only proceeds while every child is healthy, since the old
+ * layout is copied without reconstructing missing sectors.
+ */
+static boolean_t
+raidz_reflow_paused(vdev_t *raidvd, vdev_raidz_expand_t *vre)
+{
+	if (zfs_raidz_expand_max_reflow_bytes != 0 &&
+	    vre->vre_offset >= zfs_raidz_expand_max_reflow_bytes)
+		return (B_TRUE);
+
+	for (uint64_t c = 0; c < raidvd->vdev_children; c++) {
+		vdev_t *cvd = raidvd->vdev_child[c];
+
+		if (!vdev_readable(cvd) || !vdev_writeable(cvd) ||
+		    !vdev_dtl_empty(cvd, DTL_MISSING))
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
+/*
+ * Let I/O use the new layout below offset.  The txg that recorded it
+ * must have synced.
+ */
+static void
+raidz_reflow_advance_durable(vdev_raidz_expand_t *vre, uint64_t offset)
+{
+	uint64_t durable = vre->vre_offset_durable;
+	zfs_locked_range_t *lr;
+
+	if (offset <= durable)
+		return;
+
+	lr = zfs_rangelock_enter(&vre->vre_rangelock, durable,
+	    offset - durable, RL_WRITER);
+	mutex_enter(&vre->vre_lock);
+	vre->vre_offset_durable = offset;
+	mutex_exit(&vre->vre_lock);
+	zfs_rangelock_exit(lr);
+}
+
+static uint64_t
+raidz_reflow_record(spa_t *spa, vdev_raidz_expand_t *vre, uint64_t offset)
+{
+	dmu_tx_t *tx = dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+	uint64_t txg;
+
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+	txg = dmu_tx_get_txg(tx);
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_offset_pertxg[txg & TXG_MASK] = offset;
+	mutex_exit(&vre->vre_lock);
+
+	dmu_tx_commit(tx);
+
+	return (txg);
+}
+
+typedef struct raidz_reflow_state {
+	uint64_t	rrs_txg;	/* txg recording vre_offset */
+	uint64_t	rrs_pending_txg;
+	uint64_t	rrs_pending_offset;
+} raidz_reflow_state_t;
+
+/*
+ * The highest offset we may copy to without overwriting a sector of the
+ * old layout which we might still need after a crash.  Sector s of the
+ * new layout is on the same child as sector s + s / n of the old one, at
+ * the same row, so everything below the durable offset may be written.
+ */
+static uint64_t
+raidz_reflow_limit(vdev_t *raidvd, vdev_raidz_expand_t *vre)
+{
+	uint64_t ashift = raidvd->vdev_ashift;
+	uint64_t n = raidvd->vdev_children - 1;
+	uint64_t s = MAX(vre->vre_offset_durable >> ashift, n);
+
+	return (((s / n) * (n + 1) + s % n) << ashift);
+}
+
+static void
+raidz_reflow_metaslab(spa_t *spa, vdev_t *raidvd, vdev_raidz_expand_t *vre,
+    metaslab_t *msp, raidz_reflow_state_t *rrs, zthr_t *zthr)
+{
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	uint64_t ashift = raidvd->vdev_ashift;
+	uint64_t ms_end = msp->ms_start + msp->ms_size;
+	uint64_t max_copy = MAX(zfs_raidz_expand_max_copy_bytes,
+	    SPA_MAXBLOCKSIZE);
+	range_tree_t *rt, *copy;
+	int error;
+
+	metaslab_disable(msp);
+	mutex_enter(&msp->ms_lock);
+	error = metaslab_load(msp);
+	if (error != 0) {
+		mutex_exit(&msp->ms_lock);
+		metaslab_enable(msp, B_FALSE, B_FALSE);
+		zfs_dbgmsg("raidz expand: failed to load metaslab %llu of "
+		    "vdev %llu, error %d", (u_longlong_t)msp->ms_id,
+		    (u_longlong_t)raidvd->vdev_id, error);
+		delay(hz);
+		return;
+	}
+
+	/* With allocations disabled, this is all that must be copied. */
+	rt = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
+	range_tree_add(rt, msp->ms_start, msp->ms_size);
+	range_tree_walk(msp->ms_allocatable, range_tree_remove, rt);
+	mutex_exit(&msp->ms_lock);
+	if (vre->vre_offset > msp->ms_start)
+		range_tree_clear(rt, msp->ms_start,
+		    vre->vre_offset - msp->ms_start);
+
+	copy = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
+	while (vre->vre_offset < ms_end && !zthr_iscancelled(zthr)) {
+		uint64_t offset = vre->vre_offset;
+		uint64_t end, limit, pos, copied;
+		uint64_t seg_start, seg_size;
+		zfs_locked_range_t *lr;
+
+		if (rrs->rrs_pending_txg != 0 &&
+		    spa_last_synced_txg(spa) >= rrs->rrs_pending_txg) {
+			raidz_reflow_advance_durable(vre,
+			    rrs->rrs_pending_offset);
+			rrs->rrs_pending_txg = 0;
+		}
+
+		limit = raidz_reflow_limit(raidvd, vre);
+		if (offset >= limit) {
+			txg_wait_synced(dp, rrs->rrs_txg);
+			raidz_reflow_advance_durable(vre, offset);
+			rrs->rrs_pending_txg = 0;
+			continue;
+		}
+
+		end = MIN(limit, ms_end);
+		if (zfs_raidz_expand_max_reflow_bytes > offset)
+			end = MIN(end, zfs_raidz_expand_max_reflow_bytes);
+
+		pos = offset;
+		copied = 0;
+		while (pos < end && range_tree_find_in(rt, pos, end - pos,
+		    &seg_start, &seg_size) && seg_size != 0) {
+			if (copied + seg_size >= max_copy) {
+				seg_size = MIN(seg_size, P2ROUNDUP(max_copy -
+				    copied, 1ULL << ashift));
+				end = seg_start + seg_size;
+			}
+			range_tree_add(copy, seg_start, seg_size);
+			copied += seg_size;
+			pos = seg_start + seg_size;
+		}
+
+		spa_config_enter(spa, SCL_CONFIG | SCL_STATE, FTAG, RW_READER);
+		if (raidz_reflow_paused(raidvd, vre)) {
+			spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
+			range_tree_vacate(copy, NULL, NULL);
+			delay(hz);
+			continue;
+		}
+
+		lr = zfs_rangelock_enter(&vre->vre_rangelock, offset,
+		    end - offset, RL_WRITER);
+		error = raidz_reflow_copy(raidvd, copy);
+		if (error == 0) {
+			mutex_enter(&vre->vre_lock);
+			vre->vre_offset = end;
+			mutex_exit(&vre->vre_lock);
+		}
+		zfs_rangelock_exit(lr);
+		spa_config_exit(spa, SCL_CONFIG | SCL_STATE, FTAG);
+		range_tree_vacate(copy, NULL, NULL);
+
+		if (error != 0) {
+			zfs_dbgmsg("raidz expand: failed to reflow vdev %llu "
+			    "at offset %llu, error %d",
+			    (u_longlong_t)raidvd->vdev_id,
+			    (u_longlong_t)offset, error);
+			delay(hz);
+			continue;
+		}
+
+		range_tree_clear(rt, offset, end - offset);
+		rrs->rrs_txg = raidz_reflow_record(spa, vre, end);
+		if (rrs->rrs_pending_txg == 0) {
+			rrs->rrs_pending_txg = rrs->rrs_txg;
+			rrs->rrs_pending_offset = end;
+		}
+	}
+	range_tree_destroy(copy);
+
+	range_tree_vacate(rt, NULL, NULL);
+	range_tree_destroy(rt);
+	metaslab_enable(msp, B_FALSE, B_FALSE);
+}
+
+static boolean_t
+spa_raidz_expand_thread_check(void *arg, zthr_t *zthr)
+{
+	spa_t *spa = arg;
+
+	return (spa->spa_raidz_expand != NULL);
+}
+
+/*
+ * Reflow the allocated space of an expanding RAID-Z vdev one metaslab at a
+ * time from the old layout into the one including its new child, then
+ * make the new child's space available.
+ */
+static void
+spa_raidz_expand_thread(void *arg, zthr_t *zthr)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	raidz_reflow_state_t rrs = { 0 };
+	vdev_t *raidvd;
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	/* The new child must be in the synced config before data moves. */
+	txg_wait_synced(spa_get_dsl(spa), 0);
+
+	for (uint64_t i = vre->vre_offset >> raidvd->vdev_ms_shift;
+	    i < raidvd->vdev_ms_count && !zthr_iscancelled(zthr); i++) {
+		metaslab_t *msp = raidvd->vdev_ms[i];
+
+		raidz_reflow_metaslab(spa, raidvd, vre, msp, &rrs, zthr);
+		if (vre->vre_offset < msp->ms_start + msp->ms_size)
+			i--;
+	}
+
+	if (zthr_iscancelled(zthr))
+		return;
+
+	txg_wait_synced(spa_get_dsl(spa), rrs.rrs_txg);
+	raidz_reflow_advance_durable(vre, vre->vre_offset);
+
+	dmu_tx_t *tx = dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+	uint64_t txg = dmu_tx_get_txg(tx);
+	dsl_sync_task_nowait(spa_get_dsl(spa), raidz_reflow_complete_sync,
+	    spa, tx);
+	dmu_tx_commit(tx);
+	txg_wait_synced(spa_get_dsl(spa), txg);
+
+	/* Grow into the space of the new child. */
+	spa_config_enter(spa, SCL_STATE_ALL, FTAG, RW_WRITER);
+	raidvd->vdev_expanding = B_TRUE;
+	vdev_reopen(raidvd);
+	raidvd->vdev_expanding = B_FALSE;
+	spa_config_exit(spa, SCL_STATE_ALL, FTAG);
+	spa_async_request(spa, SPA_ASYNC_CONFIG_UPDATE);
+}
+
+void
+spa_start_raidz_expansion_thread(spa_t *spa)
+{
+	ASSERT3P(spa->spa_raidz_expand_zthr, ==, NULL);
+	spa->spa_raidz_expand_zthr = zthr_create("z_raidz_expand",
+	    spa_raidz_expand_thread_check, spa_raidz_expand_thread, spa);
+}
+
+/*
+ * Progress of the current expansion, or the most recently finished one.
+ */
+int
+spa_raidz_expand_get_stats(spa_t *spa, pool_raidz_expand_stat_t *pres)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	if (vre == NULL) {
+		for (uint64_t c = 0; c < rvd->vdev_children; c++) {
+			vdev_t *tvd = rvd->vdev_child[c];
+			vdev_raidz_t *vdrz = tvd->vdev_tsd;
+
+			if (tvd->vdev_ops != &vdev_raidz_ops ||
+			    vdrz->vn_vre.vre_phys.vrep_state != DSS_FINISHED)
+				continue;
+			if (vre == NULL || vdrz->vn_vre.vre_phys.vrep_end_time >
+			    vre->vre_phys.vrep_end_time)
+				vre = &vdrz->vn_vre;
+		}
+	}
+
+	if (vre == NULL)
+		return (SET_ERROR(ENOENT));
+
+	pres->pres_state = vre->vre_phys.vrep_state;
+	pres->pres_expanding_vdev = vre->vre_vdev_id;
+	pres->pres_start_time = vre->vre_phys.vrep_start_time;
+	pres->pres_end_time = vre->vre_phys.vrep_end_time;
+	if (pres->pres_state == DSS_SCANNING) {
+		vdev_t *vd = vdev_lookup_top(spa, vre->vre_vdev_id);
+
+		pres->pres_to_reflow = vd->vdev_ms_count << vd->vdev_ms_shift;
+		mutex_enter(&vre->vre_lock);
+		pres->pres_reflowed = vre->vre_offset;
+		mutex_exit(&vre->vre_lock);
+	} else {
+		pres->pres_to_reflow = vre->vre_phys.vrep_reflowed;
+		pres->pres_reflowed = vre->vre_phys.vrep_reflowed;
+	}
+
+	return (0);
+}
+
 vdev_ops_t vdev_raidz_ops = {
 	.vdev_op_open = vdev_raidz_open,
 	.vdev_op_close = vdev_raidz_close,
@@ -2420,3 +3963,11 @@ vdev_ops_t vdev_raidz_ops = {
 	.vdev_op_type = VDEV_TYPE_RAIDZ,	/* name of this vdev type */
 	.vdev_op_leaf = B_FALSE			/* not a leaf vdev */
 };
+
+/* BEGIN CSTYLED */
+ZFS_MODULE_PARAM(zfs, zfs_, raidz_expand_max_copy_bytes, ULONG, ZMOD_RW,
+	"Max amount of allocated space to copy at once when expanding RAID-Z");
+
+ZFS_MODULE_PARAM(zfs, zfs_, raidz_expand_max_reflow_bytes, ULONG, ZMOD_RW,
+	"Pause RAID-Z expansion when this many bytes are reflowed (testing)");
+/* END CSTYLED */
@@ -25,6 +25,7 @@
  */
 
 #include <sys/vdev_impl.h>
+#include <sys/vdev_draid.h>
 #include <sys/dsl_scan.h>
 #include <sys/spa_impl.h>
 #include <sys/metaslab_impl.h>
@@ -48,8 +49,8 @@
  * is taken to sequentialize the IO as much as possible.  This substantially
  * increases the time required to resilver the pool and restore redundancy.
  *
- * For mirrored devices it's possible to implement an alternate sequential
- * reconstruction strategy when resilvering.  Sequential reconstruction
+ * For mirrored and dRAID devices it's possible to implement an alternate
+ * sequential reconstruction strategy when resilvering.  Sequential reconstruction
  * behaves like a traditional RAID rebuild and reconstructs a device in LBA
  * order without verifying the checksum.  After this phase completes a second
  * scrub phase is started to verify all of the checksums.  This two phase
@@ -63,8 +64,10 @@
  *
  * Limitations:
  *
- *   - Only supported for mirror vdev types.  Due to the variable stripe
- *     width used by raidz sequential reconstruction is not possible.
+ *   - Only supported for mirror and dRAID vdev types.  Due to the variable
+ *     stripe width used by raidz sequential reconstruction is not possible.
+ *     dRAID always allocates whole rows of a redundancy group, so any
+ *     allocated range made up of whole rows can be reconstructed.
  *
  *   - Block checksums are not verified during sequential reconstuction.
  *     Similar to traditional RAID the parity/mirror data is reconstructed
@@ -86,7 +89,7 @@
  *     allowing all of these logical blocks to be repaired with a single IO.
  *
  *   - Unlike a healing resilver or scrub which are pool wide operations,
- *     sequential reconstruction is handled by the top-level mirror vdevs.
+ *     sequential reconstruction is handled by the top-level vdevs.
  *     This allows for it to be started or canceled on a top-level vdev
  *     without impacting any other top-level vdevs in the pool.
  *
@@ -468,7 +471,7 @@ vdev_rebuild_cb(zio_t *zio)
  * pointer for the given range.  It has no relation to any existing blocks
  * in the pool.  But by disabling checksum verification and issuing a scrub
  * I/O mirrored vdevs will replicate the block using any available mirror
- * leaf vdevs.
+ * leaf vdevs, and dRAID vdevs will reconstruct it from its parity.
  */
 static void
 vdev_rebuild_rebuild_block(vdev_rebuild_t *vr, uint64_t start, uint64_t asize,
@@ -480,7 +483,11 @@ vdev_rebuild_rebuild_block(vdev_rebuild_t *vr, uint64_t start, uint64_t asize,
 
 	ASSERT(vd->vdev_ops == &vdev_mirror_ops ||
 	    vd->vdev_ops == &vdev_replacing_ops ||
-	    vd->vdev_ops == &vdev_spare_ops);
+	    vd->vdev_ops == &vdev_spare_ops ||
+	    vd->vdev_ops == &vdev_draid_ops);
+
+	if (vd->vdev_ops == &vdev_draid_ops)
+		psize = vdev_draid_asize_to_psize(vd, asize);
 
 	blkptr_t blk, *bp = &blk;
 	BP_ZERO(bp);
@@ -578,7 +585,7 @@ vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
 
 /*
  * Split range into legally-sized logical chunks given the constraints of the
- * top-level mirror vdev type.
+ * top-level vdev type.
  */
 static uint64_t
 vdev_rebuild_chunk_size(vdev_t *vd, uint64_t start, uint64_t size)
@@ -587,11 +594,26 @@ vdev_rebuild_chunk_size(vdev_t *vd, uint64_t start, uint64_t size)
 
 	ASSERT(vd->vdev_ops == &vdev_mirror_ops ||
 	    vd->vdev_ops == &vdev_replacing_ops ||
-	    vd->vdev_ops == &vdev_spare_ops);
+	    vd->vdev_ops == &vdev_spare_ops ||
+	    vd->vdev_ops == &vdev_draid_ops);
 
 	max_segment = MIN(P2ROUNDUP(zfs_rebuild_max_segment,
 	    1 << vd->vdev_ashift), SPA_MAXBLOCKSIZE);
 	max_asize = vdev_psize_to_asize(vd, max_segment);
+
+	/*
+	 * A dRAID chunk is made up of whole rows of a single redundancy
+	 * group and its data must fit in a block.
+	 */
+	if (vd->vdev_ops == &vdev_draid_ops) {
+		uint64_t row = vdev_psize_to_asize(vd, 1);
+
+		if (vdev_draid_asize_to_psize(vd, max_asize) > SPA_MAXBLOCKSIZE)
+			max_asize -= row;
+		max_asize = MIN(max_asize,
+		    vdev_draid_group_end(vd, start) - start);
+	}
+
 	chunk_size = MIN(size, max_asize);
 
 	return (chunk_size);
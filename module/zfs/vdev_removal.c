@@ -251,6 +251,7 @@ vdev_remove_initiate_sync(void *arg, dmu_tx_t *tx)
 	uint64_t txg __maybe_unused = dmu_tx_get_txg(tx);
 
 	ASSERT3P(vd->vdev_ops, !=, &vdev_raidz_ops);
+	ASSERT3P(vd->vdev_ops, !=, &vdev_draid_ops);
 	svr = spa_vdev_removal_create(vd);
 
 	ASSERT(vd->vdev_removing);
@@ -1121,6 +1122,7 @@ vdev_remove_enlist_zaps(vdev_t *vd, nvlist_t *zlist)
 {
 	ASSERT3P(zlist, !=, NULL);
 	ASSERT3P(vd->vdev_ops, !=, &vdev_raidz_ops);
+	ASSERT3P(vd->vdev_ops, !=, &vdev_draid_ops);
 
 	if (vd->vdev_leaf_zap != 0) {
 		char zkey[32];
@@ -1976,6 +1978,15 @@ spa_vdev_remove_top_check(vdev_t *vd)
 	if (!spa_feature_is_enabled(spa, SPA_FEATURE_DEVICE_REMOVAL))
 		return (SET_ERROR(ENOTSUP));
 
+	/*
+	 * Block pointers are remapped to the new location of their data as
+	 * the blocks containing them are rewritten, which would separate
+	 * the references to a cloned block from its entry in the block
+	 * reference table.
+	 */
+	if (spa_feature_is_active(spa, SPA_FEATURE_BLOCK_CLONING))
+		return (SET_ERROR(ENOTSUP));
+
 	/* available space in the pool's normal class */
 	uint64_t available = dsl_dir_space_available(
 	    spa->spa_dsl_pool->dp_root_dir, NULL, 0, B_TRUE);
@@ -2032,7 +2043,7 @@ spa_vdev_remove_top_check(vdev_t *vd)
 
 	/*
 	 * All vdevs in normal class must have the same ashift
-	 * and not be raidz.
+	 * and not be raidz or draid.
 	 */
 	vdev_t *rvd = spa->spa_root_vdev;
 	int num_indirect = 0;
@@ -2044,7 +2055,8 @@ spa_vdev_remove_top_check(vdev_t *vd)
 			num_indirect++;
 		if (!vdev_is_concrete(cvd))
 			continue;
-		if (cvd->vdev_ops == &vdev_raidz_ops)
+		if (cvd->vdev_ops == &vdev_raidz_ops ||
+		    cvd->vdev_ops == &vdev_draid_ops)
 			return (SET_ERROR(EINVAL));
 		/*
 		 * Need the mirror to be mirror of leaf vdevs only
@@ -2194,9 +2206,14 @@ spa_vdev_remove(spa_t *spa, uint64_t guid, boolean_t unspare)
 	    (nv = spa_nvlist_lookup_by_guid(spares, nspares, guid)) != NULL) {
 		/*
 		 * Only remove the hot spare if it's not currently in use
-		 * in this pool.
+		 * in this pool.  Distributed spares are provided by their
+		 * dRAID vdev and are only removed from the list once they
+		 * permanently replace a child.
 		 */
-		if (vd == NULL || unspare) {
+		if (vd == NULL && strcmp(fnvlist_lookup_string(nv,
+		    ZPOOL_CONFIG_TYPE), VDEV_TYPE_DRAID_SPARE) == 0) {
+			error = SET_ERROR(ENOTSUP);
+		} else if (vd == NULL || unspare) {
 			if (vd == NULL)
 				vd = spa_lookup_by_guid(spa, guid, B_TRUE);
 			ev = spa_event_create(spa, vd, NULL,
@@ -601,6 +601,40 @@ vdev_trim_ranges(trim_args_t *ta)
 	return (0);
 }
 
+/*
+ * Callback to fetch the end of the last physical range translated from a
+ * logical range, see vdev_trim_calculate_progress().
+ */
+static void
+vdev_trim_xlate_last_rs_end(void *arg, range_seg64_t *physical_rs)
+{
+	uint64_t *last_rs_end = (uint64_t *)arg;
+
+	if (physical_rs->rs_end > *last_rs_end)
+		*last_rs_end = physical_rs->rs_end;
+}
+
+/*
+ * Callback to add the size of a free physical range to the trim progress
+ * estimate, see vdev_trim_calculate_progress().
+ */
+static void
+vdev_trim_xlate_progress(void *arg, range_seg64_t *physical_rs)
+{
+	vdev_t *vd = (vdev_t *)arg;
+
+	uint64_t size = physical_rs->rs_end - physical_rs->rs_start;
+	vd->vdev_trim_bytes_est += size;
+
+	if (vd->vdev_trim_last_offset >= physical_rs->rs_end) {
+		vd->vdev_trim_bytes_done += size;
+	} else if (vd->vdev_trim_last_offset > physical_rs->rs_start &&
+	    vd->vdev_trim_last_offset <= physical_rs->rs_end) {
+		vd->vdev_trim_bytes_done +=
+		    vd->vdev_trim_last_offset - physical_rs->rs_start;
+	}
+}
+
 /*
  * Calculates the completion percentage of a manual TRIM.
  */
@@ -621,7 +655,8 @@ vdev_trim_calculate_progress(vdev_t *vd)
 		uint64_t ms_free = msp->ms_size -
 		    metaslab_allocated_space(msp);
 
-		if (vd->vdev_top->vdev_ops == &vdev_raidz_ops)
+		if (vd->vdev_top->vdev_ops == &vdev_raidz_ops ||
+		    vd->vdev_top->vdev_ops == &vdev_draid_ops)
 			ms_free /= vd->vdev_top->vdev_children;
 
 		/*
@@ -629,16 +664,26 @@ vdev_trim_calculate_progress(vdev_t *vd)
 		 * on our vdev. We use this to determine if we are
 		 * in the middle of this metaslab range.
 		 */
-		range_seg64_t logical_rs, physical_rs;
+		range_seg64_t logical_rs, physical_rs, remain_rs;
 		logical_rs.rs_start = msp->ms_start;
 		logical_rs.rs_end = msp->ms_start + msp->ms_size;
-		vdev_xlate(vd, &logical_rs, &physical_rs);
 
+		/* Metaslab space after this offset has not been trimmed. */
+		vdev_xlate(vd, &logical_rs, &physical_rs, &remain_rs);
 		if (vd->vdev_trim_last_offset <= physical_rs.rs_start) {
 			vd->vdev_trim_bytes_est += ms_free;
 			mutex_exit(&msp->ms_lock);
 			continue;
-		} else if (vd->vdev_trim_last_offset > physical_rs.rs_end) {
+		}
+
+		/* Metaslab space before this offset has been trimmed */
+		uint64_t last_rs_end = physical_rs.rs_end;
+		if (!vdev_xlate_is_empty(&remain_rs)) {
+			vdev_xlate_walk(vd, &remain_rs,
+			    vdev_trim_xlate_last_rs_end, &last_rs_end);
+		}
+
+		if (vd->vdev_trim_last_offset > last_rs_end) {
 			vd->vdev_trim_bytes_done += ms_free;
 			vd->vdev_trim_bytes_est += ms_free;
 			mutex_exit(&msp->ms_lock);
@@ -659,21 +704,9 @@ vdev_trim_calculate_progress(vdev_t *vd)
 		    rs != NULL; rs = zfs_btree_next(bt, &idx, &idx)) {
 			logical_rs.rs_start = rs_get_start(rs, rt);
 			logical_rs.rs_end = rs_get_end(rs, rt);
-			vdev_xlate(vd, &logical_rs, &physical_rs);
-
-			uint64_t size = physical_rs.rs_end -
-			    physical_rs.rs_start;
-			vd->vdev_trim_bytes_est += size;
-			if (vd->vdev_trim_last_offset >= physical_rs.rs_end) {
-				vd->vdev_trim_bytes_done += size;
-			} else if (vd->vdev_trim_last_offset >
-			    physical_rs.rs_start &&
-			    vd->vdev_trim_last_offset <=
-			    physical_rs.rs_end) {
-				vd->vdev_trim_bytes_done +=
-				    vd->vdev_trim_last_offset -
-				    physical_rs.rs_start;
-			}
+
+			vdev_xlate_walk(vd, &logical_rs,
+			    vdev_trim_xlate_progress, vd);
 		}
 		mutex_exit(&msp->ms_lock);
 	}
@@ -742,37 +775,13 @@ vdev_trim_load(vdev_t *vd)
 }
 
 /*
- * Convert the logical range into a physical range and add it to the
- * range tree passed in the trim_args_t.
+ * Add the physical range to the range tree passed in the trim_args_t.
  */
 static void
-vdev_trim_range_add(void *arg, uint64_t start, uint64_t size)
+vdev_trim_xlate_range_add(void *arg, range_seg64_t *physical_rs)
 {
 	trim_args_t *ta = arg;
 	vdev_t *vd = ta->trim_vdev;
-	range_seg64_t logical_rs, physical_rs;
-	logical_rs.rs_start = start;
-	logical_rs.rs_end = start + size;
-
-	/*
-	 * Every range to be trimmed must be part of ms_allocatable.
-	 * When ZFS_DEBUG_TRIM is set load the metaslab to verify this
-	 * is always the case.
-	 */
-	if (zfs_flags & ZFS_DEBUG_TRIM) {
-		metaslab_t *msp = ta->trim_msp;
-		VERIFY0(metaslab_load(msp));
-		VERIFY3B(msp->ms_loaded, ==, B_TRUE);
-		VERIFY(range_tree_contains(msp->ms_allocatable, start, size));
-	}
-
-	ASSERT(vd->vdev_ops->vdev_op_leaf);
-	vdev_xlate(vd, &logical_rs, &physical_rs);
-
-	IMPLY(vd->vdev_top == vd,
-	    logical_rs.rs_start == physical_rs.rs_start);
-	IMPLY(vd->vdev_top == vd,
-	    logical_rs.rs_end == physical_rs.rs_end);
 
 	/*
 	 * Only a manual trim will be traversing the vdev sequentially.
@@ -781,30 +790,50 @@ vdev_trim_range_add(void *arg, uint64_t start, uint64_t size)
 	if (ta->trim_type == TRIM_TYPE_MANUAL) {
 
 		/* Only add segments that we have not visited yet */
-		if (physical_rs.rs_end <= vd->vdev_trim_last_offset)
+		if (physical_rs->rs_end <= vd->vdev_trim_last_offset)
 			return;
 
 		/* Pick up where we left off mid-range. */
-		if (vd->vdev_trim_last_offset > physical_rs.rs_start) {
-			ASSERT3U(physical_rs.rs_end, >,
+		if (vd->vdev_trim_last_offset > physical_rs->rs_start) {
+			ASSERT3U(physical_rs->rs_end, >,
 			    vd->vdev_trim_last_offset);
-			physical_rs.rs_start = vd->vdev_trim_last_offset;
+			physical_rs->rs_start = vd->vdev_trim_last_offset;
 		}
 	}
 
-	ASSERT3U(physical_rs.rs_end, >=, physical_rs.rs_start);
+	ASSERT3U(physical_rs->rs_end, >, physical_rs->rs_start);
+
+	range_tree_add(ta->trim_tree, physical_rs->rs_start,
+	    physical_rs->rs_end - physical_rs->rs_start);
+}
+
+/*
+ * Convert the logical range into physical ranges and add them to the
+ * range tree passed in the trim_args_t.
+ */
+static void
+vdev_trim_range_add(void *arg, uint64_t start, uint64_t size)
+{
+	trim_args_t *ta = arg;
+	vdev_t *vd = ta->trim_vdev;
+	range_seg64_t logical_rs;
+	logical_rs.rs_start = start;
+	logical_rs.rs_end = start + size;
 
 	/*
-	 * With raidz, it's possible that the logical range does not live on
-	 * this leaf vdev. We only add the physical range to this vdev's if it
-	 * has a length greater than 0.
+	 * Every range to be trimmed must be part of ms_allocatable.
+	 * When ZFS_DEBUG_TRIM is set load the metaslab to verify this
+	 * is always the case.
 	 */
-	if (physical_rs.rs_end > physical_rs.rs_start) {
-		range_tree_add(ta->trim_tree, physical_rs.rs_start,
-		    physical_rs.rs_end - physical_rs.rs_start);
-	} else {
-		ASSERT3U(physical_rs.rs_end, ==, physical_rs.rs_start);
+	if (zfs_flags & ZFS_DEBUG_TRIM) {
+		metaslab_t *msp = ta->trim_msp;
+		VERIFY0(metaslab_load(msp));
+		VERIFY3B(msp->ms_loaded, ==, B_TRUE);
+		VERIFY(range_tree_contains(msp->ms_allocatable, start, size));
 	}
+
+	ASSERT(vd->vdev_ops->vdev_op_leaf);
+	vdev_xlate_walk(vd, &logical_rs, vdev_trim_xlate_range_add, arg);
 }
 
 /*
@@ -1224,9 +1253,11 @@ vdev_autotrim_thread(void *arg)
 			 * vacated.  Only ranges added after the manual TRIM
 			 * disabled the metaslab will be included in the tree.
 			 * These will be processed when the automatic TRIM
-			 * next revisits this metaslab.
+			 * next revisits this metaslab.  The same goes for an
+			 * expanding RAID-Z vdev, whose free space can't be
+			 * translated to its children until the reflow is done.
 			 */
-			if (msp->ms_disabled > 1) {
+			if (msp->ms_disabled > 1 || vd->vdev_rz_expanding) {
 				mutex_exit(&msp->ms_lock);
 				metaslab_enable(msp, B_FALSE, B_FALSE);
 				continue;
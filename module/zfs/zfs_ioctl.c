@@ -4466,7 +4466,11 @@ zfs_check_settable(const char *dsname, nvpair_t *pair, cred_t *cr)
 					return (err);
 
 				if (!spa_feature_is_enabled(spa,
-				    SPA_FEATURE_LZ4_COMPRESS)) {
+				    SPA_FEATURE_LZ4_COMPRESS) ||
+				    (ZIO_COMPRESS_LEVEL(intval) !=
+				    ZIO_COMPLEVEL_INHERIT &&
+				    !spa_feature_is_enabled(spa,
+				    SPA_FEATURE_LZ4_LEVELS))) {
 					spa_close(spa, FTAG);
 					return (SET_ERROR(ENOTSUP));
 				}
@@ -647,6 +647,38 @@ zfs_log_truncate(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 	zil_itx_assign(zilog, itx, tx);
 }
 
+/*
+ * Handles TX_CLONE_RANGE transactions.  The block pointers of the cloned
+ * range are logged, so that replay does not depend on the source file,
+ * which may have been modified or removed since.  The caller limits the
+ * range so that the record fits in a single log block.
+ */
+void
+zfs_log_clone_range(zilog_t *zilog, dmu_tx_t *tx, int txtype, znode_t *zp,
+    uint64_t off, uint64_t len, uint64_t blksz, const blkptr_t *bps,
+    size_t nbps)
+{
+	itx_t *itx;
+	lr_clone_range_t *lr;
+
+	if (zil_replaying(zilog, tx) || zp->z_unlinked ||
+	    zfs_xattr_owner_unlinked(zp))
+		return;
+
+	itx = zil_itx_create(txtype,
+	    sizeof (*lr) + sizeof (blkptr_t) * nbps);
+	lr = (lr_clone_range_t *)&itx->itx_lr;
+	lr->lr_foid = zp->z_id;
+	lr->lr_offset = off;
+	lr->lr_length = len;
+	lr->lr_blksz = blksz;
+	lr->lr_nbps = nbps;
+	bcopy(bps, lr->lr_bps, sizeof (blkptr_t) * nbps);
+
+	itx->itx_sync = (zp->z_sync_cnt != 0);
+	zil_itx_assign(zilog, itx, tx);
+}
+
 /*
  * Handles TX_SETATTR transactions.
  */
@@ -0,0 +1,311 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#include <sys/zfs_pattern.h>
+
+/*
+ * Every block written with compression enabled is first checked for being
+ * all zeroes, and then for being a single repeated 64-bit word.  The scan
+ * stops at the first word that doesn't match so it's cheap for ordinary
+ * data, but it has to read the whole block when it does match.  The SIMD
+ * implementations below make that part run at memory bandwidth.
+ *
+ * The scan is memory bound, so rather than benchmarking we prefer the
+ * widest implementation the CPU supports.  zfs_pattern_impl can be used to
+ * select a specific one.
+ */
+
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX - 1)
+
+#define	PATTERN_IMPL_READ(i)	(*(volatile uint32_t *) &(i))
+
+static uint32_t zfs_pattern_impl = IMPL_FASTEST;
+static uint32_t user_sel_impl = IMPL_FASTEST;
+
+boolean_t
+zfs_pattern_match_scalar(const void *buf, size_t size, uint64_t pattern)
+{
+	const uint64_t *p = buf;
+	const uint64_t *end = p + size / sizeof (uint64_t);
+
+	ASSERT(IS_P2ALIGNED(size, sizeof (uint64_t)));
+
+	for (; p + 4 <= end; p += 4) {
+		if ((p[0] ^ pattern) | (p[1] ^ pattern) |
+		    (p[2] ^ pattern) | (p[3] ^ pattern))
+			return (B_FALSE);
+	}
+	for (; p < end; p++) {
+		if (*p != pattern)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+static boolean_t
+zfs_pattern_scalar_will_work(void)
+{
+	return (B_TRUE);
+}
+
+static const zfs_pattern_ops_t zfs_pattern_scalar_impl = {
+	.match = zfs_pattern_match_scalar,
+	.is_supported = zfs_pattern_scalar_will_work,
+	.name = "scalar"
+};
+
+/* All implementations, in order of preference */
+static const zfs_pattern_ops_t *const pattern_impls[] = {
+	&zfs_pattern_scalar_impl,
+#if defined(__x86_64)
+#if defined(HAVE_SSE2)
+	&zfs_pattern_sse2_impl,
+#endif
+#if defined(HAVE_AVX2)
+	&zfs_pattern_avx2_impl,
+#endif
+#if defined(HAVE_AVX512F)
+	&zfs_pattern_avx512f_impl,
+#endif
+#endif
+#if defined(__aarch64__)
+	&zfs_pattern_aarch64_neon_impl,
+#endif
+};
+
+/* Indicate that implementation selection is finished */
+static boolean_t pattern_initialized = B_FALSE;
+
+/* Implementations supported by the current CPU */
+static const zfs_pattern_ops_t *pattern_supp_impl[ARRAY_SIZE(pattern_impls)];
+static uint32_t pattern_supp_impl_cnt = 0;
+
+static const zfs_pattern_ops_t *
+zfs_pattern_get_ops(void)
+{
+	const zfs_pattern_ops_t *ops;
+	const uint32_t impl = PATTERN_IMPL_READ(zfs_pattern_impl);
+
+	/* The SIMD implementations may not be usable in this context */
+	if (!pattern_initialized || !kfpu_allowed())
+		return (&zfs_pattern_scalar_impl);
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		ops = pattern_supp_impl[pattern_supp_impl_cnt - 1];
+		break;
+	case IMPL_CYCLE: {
+		static uint32_t cycle_count = 0;
+		uint32_t idx = (++cycle_count) % pattern_supp_impl_cnt;
+		ops = pattern_supp_impl[idx];
+		break;
+	}
+	default:
+		ASSERT3U(impl, <, pattern_supp_impl_cnt);
+		ops = pattern_supp_impl[impl];
+		break;
+	}
+
+	ASSERT3P(ops, !=, NULL);
+	return (ops);
+}
+
+typedef struct zfs_pattern_iter {
+	const zfs_pattern_ops_t *zpi_ops;
+	uint64_t zpi_pattern;
+	boolean_t zpi_first;
+} zfs_pattern_iter_t;
+
+static int
+zfs_pattern_abd_cb(void *buf, size_t size, void *private)
+{
+	zfs_pattern_iter_t *zpi = private;
+
+	/* A partial word would break the pattern for the next chunk */
+	if (size == 0 || !IS_P2ALIGNED(size, sizeof (uint64_t)))
+		return (1);
+
+	if (zpi->zpi_first) {
+		zpi->zpi_pattern = *(uint64_t *)buf;
+		zpi->zpi_first = B_FALSE;
+	}
+
+	return (zpi->zpi_ops->match(buf, size, zpi->zpi_pattern) ? 0 : 1);
+}
+
+/*
+ * Returns B_TRUE and the repeated word in *pattern if the first size bytes
+ * of abd consist of a single 64-bit word repeated over and over.
+ */
+boolean_t
+zfs_pattern_abd(abd_t *abd, size_t size, uint64_t *pattern)
+{
+	zfs_pattern_iter_t zpi;
+	boolean_t simd;
+	int err;
+
+	zpi.zpi_ops = zfs_pattern_get_ops();
+	zpi.zpi_pattern = 0;
+	zpi.zpi_first = B_TRUE;
+	simd = (zpi.zpi_ops != &zfs_pattern_scalar_impl);
+
+	/* Save the FPU state once for the whole buffer, not per chunk */
+	if (simd)
+		kfpu_begin();
+	err = abd_iterate_func(abd, 0, size, zfs_pattern_abd_cb, &zpi);
+	if (simd)
+		kfpu_end();
+
+	if (err != 0 || zpi.zpi_first)
+		return (B_FALSE);
+
+	*pattern = zpi.zpi_pattern;
+	return (B_TRUE);
+}
+
+void
+zfs_pattern_init(void)
+{
+	const zfs_pattern_ops_t *curr_impl;
+	int i, c;
+
+	for (i = 0, c = 0; i < ARRAY_SIZE(pattern_impls); i++) {
+		curr_impl = pattern_impls[i];
+
+		if (curr_impl->is_supported())
+			pattern_supp_impl[c++] = curr_impl;
+	}
+	membar_producer();
+	pattern_supp_impl_cnt = c;
+
+	/* Finish initialization */
+	atomic_swap_32(&zfs_pattern_impl, user_sel_impl);
+	pattern_initialized = B_TRUE;
+}
+
+void
+zfs_pattern_fini(void)
+{
+	pattern_initialized = B_FALSE;
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} pattern_impl_opts[] = {
+	{ "cycle",	IMPL_CYCLE },
+	{ "fastest",	IMPL_FASTEST },
+};
+
+/*
+ * Function sets desired pattern scan implementation.
+ *
+ * If we are called before init(), user preference will be saved in
+ * user_sel_impl, and applied in later init() call.
+ *
+ * @val		Name of pattern scan implementation to use
+ */
+int
+zfs_pattern_impl_set(const char *val)
+{
+	int err = -EINVAL;
+	char req_name[32];
+	uint32_t impl = PATTERN_IMPL_READ(user_sel_impl);
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(val, sizeof (req_name));
+	if (i == 0 || i == sizeof (req_name))
+		return (err);
+
+	strlcpy(req_name, val, sizeof (req_name));
+	while (i > 0 && !!isspace(req_name[i-1]))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(pattern_impl_opts); i++) {
+		if (strcmp(req_name, pattern_impl_opts[i].name) == 0) {
+			impl = pattern_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	/* check all supported impl if init() was already called */
+	if (err != 0 && pattern_initialized) {
+		for (i = 0; i < pattern_supp_impl_cnt; i++) {
+			if (strcmp(req_name, pattern_supp_impl[i]->name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (pattern_initialized)
+			atomic_swap_32(&zfs_pattern_impl, impl);
+		else
+			atomic_swap_32(&user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+#if defined(_KERNEL) && defined(__linux__)
+
+static int
+zfs_pattern_impl_set_param(const char *val, zfs_kernel_param_t *kp)
+{
+	return (zfs_pattern_impl_set(val));
+}
+
+static int
+zfs_pattern_impl_get_param(char *buffer, zfs_kernel_param_t *kp)
+{
+	int i, cnt = 0;
+	char *fmt;
+	const uint32_t impl = PATTERN_IMPL_READ(zfs_pattern_impl);
+
+	ASSERT(pattern_initialized);
+
+	/* list fastest */
+	fmt = (impl == IMPL_FASTEST) ? "[%s] " : "%s ";
+	cnt += sprintf(buffer + cnt, fmt, "fastest");
+
+	/* list all supported implementations */
+	for (i = 0; i < pattern_supp_impl_cnt; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, pattern_supp_impl[i]->name);
+	}
+
+	return (cnt);
+}
+
+module_param_call(zfs_pattern_impl, zfs_pattern_impl_set_param,
+    zfs_pattern_impl_get_param, NULL, 0644);
+MODULE_PARM_DESC(zfs_pattern_impl, "Select zero/pattern scan implementation.");
+#endif
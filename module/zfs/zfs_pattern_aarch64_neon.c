@@ -0,0 +1,91 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#if defined(__aarch64__)
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#include <sys/zfs_pattern.h>
+
+/*
+ * Same approach as the x86 versions: XOR 64 bytes at a time with the
+ * broadcast pattern, OR the results and leave on the first set bit.  The
+ * caller is responsible for kfpu_begin()/kfpu_end().
+ */
+static boolean_t
+zfs_pattern_aarch64_neon_match(const void *buf, size_t size,
+    uint64_t pattern)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = p + P2ALIGN(size, 64);
+	uint32_t mask;
+
+	register unsigned char V0 asm("v0") __attribute__((vector_size(16)));
+	register unsigned char V1 asm("v1") __attribute__((vector_size(16)));
+	register unsigned char V2 asm("v2") __attribute__((vector_size(16)));
+	register unsigned char V3 asm("v3") __attribute__((vector_size(16)));
+	register unsigned char PAT asm("v4") __attribute__((vector_size(16)));
+
+	asm volatile(
+	    "dup %[PAT].2d, %[pat]\n"
+	    "1:\n"
+	    "cmp %[p], %[end]\n"
+	    "b.hs 2f\n"
+	    "ld1 { %[V0].2d, %[V1].2d, %[V2].2d, %[V3].2d }, [%[p]]\n"
+	    "eor %[V0].16b, %[V0].16b, %[PAT].16b\n"
+	    "eor %[V1].16b, %[V1].16b, %[PAT].16b\n"
+	    "eor %[V2].16b, %[V2].16b, %[PAT].16b\n"
+	    "eor %[V3].16b, %[V3].16b, %[PAT].16b\n"
+	    "orr %[V0].16b, %[V0].16b, %[V1].16b\n"
+	    "orr %[V2].16b, %[V2].16b, %[V3].16b\n"
+	    "orr %[V0].16b, %[V0].16b, %[V2].16b\n"
+	    "umaxv %s[V0], %[V0].4s\n"
+	    "fmov %w[mask], %s[V0]\n"
+	    "cbnz %w[mask], 2f\n"
+	    "add %[p], %[p], #64\n"
+	    "b 1b\n"
+	    "2:\n"
+	    : [p] "+r" (p), [mask] "=&r" (mask),
+	    [V0] "=&w" (V0), [V1] "=&w" (V1), [V2] "=&w" (V2),
+	    [V3] "=&w" (V3), [PAT] "=&w" (PAT)
+	    : [end] "r" (end), [pat] "r" (pattern)
+	    : "cc", "memory");
+
+	if (p < end)
+		return (B_FALSE);
+
+	return (zfs_pattern_match_scalar(p, size - (p - (const uint8_t *)buf),
+	    pattern));
+}
+
+static boolean_t
+zfs_pattern_aarch64_neon_will_work(void)
+{
+	return (kfpu_allowed());
+}
+
+const zfs_pattern_ops_t zfs_pattern_aarch64_neon_impl = {
+	.match = zfs_pattern_aarch64_neon_match,
+	.is_supported = zfs_pattern_aarch64_neon_will_work,
+	.name = "aarch64_neon"
+};
+
+#endif /* __aarch64__ */
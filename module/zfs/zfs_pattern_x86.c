@@ -0,0 +1,203 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#if defined(__x86_64)
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#include <sys/zfs_pattern.h>
+
+/*
+ * Each loop iteration XORs a few vectors of the buffer with the broadcast
+ * pattern, ORs the results together and leaves the loop as soon as any bit
+ * is set.  The tail which doesn't fill a whole iteration is left to the
+ * scalar code.  The caller is responsible for kfpu_begin()/kfpu_end().
+ *
+ * The kernel is built without SIMD support so the compiler never uses
+ * these registers, and it doesn't accept them as clobbers.  In user space
+ * they must be declared.
+ */
+#if defined(_KERNEL)
+#define	PATTERN_CLOBBERS	"cc"
+#else
+#define	PATTERN_CLOBBERS						\
+	"cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5"
+#endif
+
+#if defined(HAVE_SSE2)
+static boolean_t
+zfs_pattern_sse2_match(const void *buf, size_t size, uint64_t pattern)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = p + P2ALIGN(size, 64);
+	uint32_t mask;
+
+	asm volatile(
+	    "movq %[pat], %%xmm4\n"
+	    "punpcklqdq %%xmm4, %%xmm4\n"
+	    "pxor %%xmm5, %%xmm5\n"
+	    "1:\n"
+	    "cmp %[end], %[p]\n"
+	    "jae 2f\n"
+	    "movdqu 0(%[p]), %%xmm0\n"
+	    "movdqu 16(%[p]), %%xmm1\n"
+	    "movdqu 32(%[p]), %%xmm2\n"
+	    "movdqu 48(%[p]), %%xmm3\n"
+	    "pxor %%xmm4, %%xmm0\n"
+	    "pxor %%xmm4, %%xmm1\n"
+	    "pxor %%xmm4, %%xmm2\n"
+	    "pxor %%xmm4, %%xmm3\n"
+	    "por %%xmm1, %%xmm0\n"
+	    "por %%xmm3, %%xmm2\n"
+	    "por %%xmm2, %%xmm0\n"
+	    "pcmpeqb %%xmm5, %%xmm0\n"
+	    "pmovmskb %%xmm0, %[mask]\n"
+	    "cmp $0xffff, %[mask]\n"
+	    "jne 2f\n"
+	    "add $64, %[p]\n"
+	    "jmp 1b\n"
+	    "2:\n"
+	    : [p] "+r" (p), [mask] "=&r" (mask)
+	    : [end] "r" (end), [pat] "r" (pattern)
+	    : "memory", PATTERN_CLOBBERS);
+
+	if (p < end)
+		return (B_FALSE);
+
+	return (zfs_pattern_match_scalar(p, size - (p - (const uint8_t *)buf),
+	    pattern));
+}
+
+static boolean_t
+zfs_pattern_sse2_will_work(void)
+{
+	return (kfpu_allowed() && zfs_sse2_available());
+}
+
+const zfs_pattern_ops_t zfs_pattern_sse2_impl = {
+	.match = zfs_pattern_sse2_match,
+	.is_supported = zfs_pattern_sse2_will_work,
+	.name = "sse2"
+};
+#endif /* HAVE_SSE2 */
+
+#if defined(HAVE_AVX2)
+static boolean_t
+zfs_pattern_avx2_match(const void *buf, size_t size, uint64_t pattern)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = p + P2ALIGN(size, 128);
+
+	asm volatile(
+	    "vmovq %[pat], %%xmm4\n"
+	    "vpbroadcastq %%xmm4, %%ymm4\n"
+	    "1:\n"
+	    "cmp %[end], %[p]\n"
+	    "jae 2f\n"
+	    "vpxor 0(%[p]), %%ymm4, %%ymm0\n"
+	    "vpxor 32(%[p]), %%ymm4, %%ymm1\n"
+	    "vpxor 64(%[p]), %%ymm4, %%ymm2\n"
+	    "vpxor 96(%[p]), %%ymm4, %%ymm3\n"
+	    "vpor %%ymm1, %%ymm0, %%ymm0\n"
+	    "vpor %%ymm3, %%ymm2, %%ymm2\n"
+	    "vpor %%ymm2, %%ymm0, %%ymm0\n"
+	    "vptest %%ymm0, %%ymm0\n"
+	    "jnz 2f\n"
+	    "add $128, %[p]\n"
+	    "jmp 1b\n"
+	    "2:\n"
+	    "vzeroupper\n"
+	    : [p] "+r" (p)
+	    : [end] "r" (end), [pat] "r" (pattern)
+	    : "memory", PATTERN_CLOBBERS);
+
+	if (p < end)
+		return (B_FALSE);
+
+	return (zfs_pattern_match_scalar(p, size - (p - (const uint8_t *)buf),
+	    pattern));
+}
+
+static boolean_t
+zfs_pattern_avx2_will_work(void)
+{
+	return (kfpu_allowed() && zfs_avx2_available());
+}
+
+const zfs_pattern_ops_t zfs_pattern_avx2_impl = {
+	.match = zfs_pattern_avx2_match,
+	.is_supported = zfs_pattern_avx2_will_work,
+	.name = "avx2"
+};
+#endif /* HAVE_AVX2 */
+
+#if defined(HAVE_AVX512F)
+static boolean_t
+zfs_pattern_avx512f_match(const void *buf, size_t size, uint64_t pattern)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = p + P2ALIGN(size, 256);
+
+	asm volatile(
+	    "vpbroadcastq %[pat], %%zmm4\n"
+	    "1:\n"
+	    "cmp %[end], %[p]\n"
+	    "jae 2f\n"
+	    "vpxorq 0(%[p]), %%zmm4, %%zmm0\n"
+	    "vpxorq 64(%[p]), %%zmm4, %%zmm1\n"
+	    "vpxorq 128(%[p]), %%zmm4, %%zmm2\n"
+	    "vpxorq 192(%[p]), %%zmm4, %%zmm3\n"
+	    "vporq %%zmm1, %%zmm0, %%zmm0\n"
+	    "vporq %%zmm3, %%zmm2, %%zmm2\n"
+	    "vporq %%zmm2, %%zmm0, %%zmm0\n"
+	    "vextracti64x4 $1, %%zmm0, %%ymm1\n"
+	    "vpor %%ymm1, %%ymm0, %%ymm0\n"
+	    "vptest %%ymm0, %%ymm0\n"
+	    "jnz 2f\n"
+	    "add $256, %[p]\n"
+	    "jmp 1b\n"
+	    "2:\n"
+	    "vzeroupper\n"
+	    : [p] "+r" (p)
+	    : [end] "r" (end), [pat] "r" (pattern)
+	    : "memory", PATTERN_CLOBBERS);
+
+	if (p < end)
+		return (B_FALSE);
+
+	return (zfs_pattern_match_scalar(p, size - (p - (const uint8_t *)buf),
+	    pattern));
+}
+
+static boolean_t
+zfs_pattern_avx512f_will_work(void)
+{
+	return (kfpu_allowed() && zfs_avx512f_available());
+}
+
+const zfs_pattern_ops_t zfs_pattern_avx512f_impl = {
+	.match = zfs_pattern_avx512f_match,
+	.is_supported = zfs_pattern_avx512f_will_work,
+	.name = "avx512f"
+};
+#endif /* HAVE_AVX512F */
+
+#endif /* __x86_64 */
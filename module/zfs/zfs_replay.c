@@ -812,6 +812,62 @@ zfs_replay_truncate(void *arg1, void *arg2, boolean_t byteswap)
 	return (error);
 }
 
+static int
+zfs_replay_clone_range(void *arg1, void *arg2, boolean_t byteswap)
+{
+	zfsvfs_t *zfsvfs = arg1;
+	lr_clone_range_t *lr = arg2;
+	znode_t *zp;
+	dmu_tx_t *tx;
+	uint64_t end;
+	int error;
+
+	if (byteswap) {
+		byteswap_uint64_array(lr, sizeof (*lr));
+		byteswap_uint64_array(lr->lr_bps,
+		    sizeof (blkptr_t) * lr->lr_nbps);
+	}
+
+	if ((error = zfs_zget(zfsvfs, lr->lr_foid, &zp)) != 0)
+		return (error);
+
+	tx = dmu_tx_create(zfsvfs->z_os);
+	dmu_tx_hold_sa(tx, zp->z_sa_hdl, B_FALSE);
+	dmu_tx_hold_write(tx, lr->lr_foid, lr->lr_offset, lr->lr_length);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error != 0) {
+		dmu_tx_abort(tx);
+		zrele(zp);
+		return (error);
+	}
+
+	if (zp->z_blksz < lr->lr_blksz)
+		zfs_grow_blocksize(zp, lr->lr_blksz, tx);
+	if (zp->z_blksz != lr->lr_blksz) {
+		dmu_tx_commit(tx);
+		zrele(zp);
+		return (SET_ERROR(EINVAL));
+	}
+
+	dmu_brt_clone(zfsvfs->z_os, lr->lr_foid, lr->lr_offset, lr->lr_length,
+	    tx, lr->lr_bps, lr->lr_nbps);
+
+	end = lr->lr_offset + lr->lr_length;
+	if (end > zp->z_size) {
+		zp->z_size = end;
+		(void) sa_update(zp->z_sa_hdl, SA_ZPL_SIZE(zfsvfs),
+		    (void *)&zp->z_size, sizeof (uint64_t), tx);
+	}
+
+	/* Ensure the replayed seq is updated */
+	(void) zil_replaying(zfsvfs->z_log, tx);
+
+	dmu_tx_commit(tx);
+	zrele(zp);
+
+	return (0);
+}
+
 static int
 zfs_replay_setattr(void *arg1, void *arg2, boolean_t byteswap)
 {
@@ -989,4 +1045,5 @@ zil_replay_func_t *zfs_replay_vector[TX_MAX_TYPE] = {
 	zfs_replay_create,	/* TX_MKDIR_ATTR */
 	zfs_replay_create_acl,	/* TX_MKDIR_ACL_ATTR */
 	zfs_replay_write2,	/* TX_WRITE2 */
+	zfs_replay_clone_range,	/* TX_CLONE_RANGE */
 };
@@ -41,6 +41,7 @@
 #include <sys/dmu_tx.h>
 #include <sys/dsl_pool.h>
 #include <sys/metaslab.h>
+#include <sys/brt.h>
 #include <sys/trace_zfs.h>
 #include <sys/abd.h>
 
@@ -478,6 +479,27 @@ zil_claim_log_block(zilog_t *zilog, const blkptr_t *bp, void *tx,
 	    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE | ZIO_FLAG_SCRUB)));
 }
 
+/*
+ * A clone record refers to blocks which it does not own.  Until it has
+ * been replayed they must not be freed, even if the files they belong to
+ * are, so hold an extra BRT reference on each of them; it is dropped
+ * again by zil_free_log_record() when the log is destroyed.
+ */
+static int
+zil_claim_clone_range(zilog_t *zilog, const lr_t *lrc, void *tx,
+    uint64_t first_txg)
+{
+	const lr_clone_range_t *lr = (const lr_clone_range_t *)lrc;
+
+	if (tx == NULL || lrc->lrc_txg < first_txg)
+		return (0);
+
+	for (uint64_t i = 0; i < lr->lr_nbps; i++)
+		brt_pending_add(zilog->zl_spa, &lr->lr_bps[i], tx);
+
+	return (0);
+}
+
 static int
 zil_claim_log_record(zilog_t *zilog, const lr_t *lrc, void *tx,
     uint64_t first_txg)
@@ -485,6 +507,9 @@ zil_claim_log_record(zilog_t *zilog, const lr_t *lrc, void *tx,
 	lr_write_t *lr = (lr_write_t *)lrc;
 	int error;
 
+	if (lrc->lrc_txtype == TX_CLONE_RANGE)
+		return (zil_claim_clone_range(zilog, lrc, tx, first_txg));
+
 	if (lrc->lrc_txtype != TX_WRITE)
 		return (0);
 
@@ -522,6 +547,21 @@ zil_free_log_record(zilog_t *zilog, const lr_t *lrc, void *tx,
 	lr_write_t *lr = (lr_write_t *)lrc;
 	blkptr_t *bp = &lr->lr_blkptr;
 
+	if (claim_txg != 0 && lrc->lrc_txtype == TX_CLONE_RANGE &&
+	    lrc->lrc_txg >= claim_txg) {
+		const lr_clone_range_t *lrcr = (const lr_clone_range_t *)lrc;
+
+		/* Drop the references taken by zil_claim_clone_range(). */
+		for (uint64_t i = 0; i < lrcr->lr_nbps; i++) {
+			if (!BP_IS_HOLE(&lrcr->lr_bps[i]) &&
+			    !BP_IS_EMBEDDED(&lrcr->lr_bps[i])) {
+				zio_free(zilog->zl_spa, dmu_tx_get_txg(tx),
+				    &lrcr->lr_bps[i]);
+			}
+		}
+		return (0);
+	}
+
 	/*
 	 * If we previously claimed it, we need to free it.
 	 */
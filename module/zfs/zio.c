@@ -38,9 +38,11 @@
 #include <sys/zio_impl.h>
 #include <sys/zio_compress.h>
 #include <sys/zio_checksum.h>
+#include <sys/zfs_pattern.h>
 #include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/blkptr.h>
 #include <sys/zfeature.h>
 #include <sys/dsl_scan.h>
@@ -231,6 +233,7 @@ zio_init(void)
 	zio_inject_init();
 
 	lz4_init();
+	zfs_pattern_init();
 }
 
 void
@@ -275,6 +278,7 @@ zio_fini(void)
 	zio_inject_fini();
 
 	lz4_fini();
+	zfs_pattern_fini();
 }
 
 /*
@@ -1153,7 +1157,8 @@ zio_rewrite(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp, abd_t *data,
 }
 
 void
-zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
+zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite,
+    boolean_t brtwrite)
 {
 	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
 	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
@@ -1163,10 +1168,14 @@ zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
 	/*
 	 * We must reset the io_prop to match the values that existed
 	 * when the bp was first written by dmu_sync() keeping in mind
-	 * that nopwrite and dedup are mutually exclusive.
+	 * that nopwrite and dedup are mutually exclusive.  A block clone
+	 * (brtwrite) references an existing block and is never deduped.
 	 */
-	zio->io_prop.zp_dedup = nopwrite ? B_FALSE : zio->io_prop.zp_dedup;
+	ASSERT(!nopwrite || !brtwrite);
+	zio->io_prop.zp_dedup = (nopwrite || brtwrite) ?
+	    B_FALSE : zio->io_prop.zp_dedup;
 	zio->io_prop.zp_nopwrite = nopwrite;
+	zio->io_prop.zp_brtwrite = brtwrite;
 	zio->io_prop.zp_copies = copies;
 	zio->io_bp_override = bp;
 }
@@ -1222,6 +1231,13 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	if (BP_IS_EMBEDDED(bp))
 		return (NULL);
 
+	/*
+	 * A block which has been cloned is only freed once the last of its
+	 * references goes away; until then just drop one from the BRT.
+	 */
+	if (brt_entry_decref(spa, bp))
+		return (NULL);
+
 	metaslab_check_free(spa, bp);
 	arc_freed(spa, bp);
 	dsl_scan_freed(spa, bp);
@@ -1576,6 +1592,27 @@ zio_write_bp_init(zio_t *zio)
 		*bp = *zio->io_bp_override;
 		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
 
+		/*
+		 * A block clone references a block which already exists (its
+		 * extra reference is recorded in the BRT), so there is
+		 * nothing to write.  Cloned holes are treated like any other
+		 * hole we write; see zio_write_compress().
+		 */
+		if (zp->zp_brtwrite) {
+			if (BP_IS_HOLE(bp)) {
+				BP_ZERO(bp);
+				if (zio->io_bp_orig.blk_birth != 0 &&
+				    spa_feature_is_active(zio->io_spa,
+				    SPA_FEATURE_HOLE_BIRTH)) {
+					BP_SET_LSIZE(bp, zio->io_lsize);
+					BP_SET_TYPE(bp, zp->zp_type);
+					BP_SET_LEVEL(bp, zp->zp_level);
+					BP_SET_BIRTH(bp, zio->io_txg, 0);
+				}
+			}
+			return (zio);
+		}
+
 		if (BP_IS_EMBEDDED(bp))
 			return (zio);
 
@@ -1628,6 +1665,7 @@ zio_write_compress(zio_t *zio)
 	uint64_t lsize = zio->io_lsize;
 	uint64_t psize = zio->io_size;
 	int pass = 1;
+	uint64_t pattern;
 
 	/*
 	 * If our children haven't all reached the ready stage,
@@ -1682,8 +1720,37 @@ zio_write_compress(zio_t *zio)
 	if (compress != ZIO_COMPRESS_OFF &&
 	    !(zio->io_flags & ZIO_FLAG_RAW_COMPRESS)) {
 		void *cbuf = zio_buf_alloc(lsize);
-		psize = zio_compress_data(compress, zio->io_abd, cbuf, lsize,
-		    zp->zp_complevel);
+		psize = zio_compress_data_abortable(compress, zio->io_abd,
+		    cbuf, lsize, zp->zp_complevel, &zio->io_compress_aborted);
+
+		/*
+		 * A block that is one 64-bit word repeated over and over,
+		 * as VM images have plenty of, may still not fit in an
+		 * embedded block pointer with the configured algorithm;
+		 * LZ4 for example spends a length byte per 255 bytes of
+		 * match.  Deflate stores such blocks far more compactly
+		 * (up to 32K fits), so try gzip for those.  It needs no
+		 * pool feature, and the compression algorithm is recorded
+		 * per block pointer.
+		 */
+		if (psize > BPE_PAYLOAD_SIZE && !zp->zp_dedup &&
+		    !zp->zp_encrypt && zp->zp_level == 0 &&
+		    !DMU_OT_HAS_FILL(zp->zp_type) &&
+		    spa_feature_is_enabled(spa, SPA_FEATURE_EMBEDDED_DATA) &&
+		    zfs_pattern_abd(zio->io_abd, lsize, &pattern)) {
+			void *pbuf = zio_buf_alloc(lsize);
+			size_t pattern_psize = zio_compress_data(
+			    ZIO_COMPRESS_GZIP_6, zio->io_abd, pbuf, lsize, 0);
+			if (pattern_psize <= BPE_PAYLOAD_SIZE) {
+				zio_buf_free(cbuf, lsize);
+				cbuf = pbuf;
+				psize = pattern_psize;
+				compress = ZIO_COMPRESS_GZIP_6;
+			} else {
+				zio_buf_free(pbuf, lsize);
+			}
+		}
+
 		if (psize == 0 || psize >= lsize) {
 			compress = ZIO_COMPRESS_OFF;
 			zio_buf_free(cbuf, lsize);
@@ -3758,11 +3825,16 @@ zio_vdev_io_start(zio_t *zio)
 	 * However, indirect vdevs point off to other vdevs which may have
 	 * DTL's, so we never bypass them.  The child i/os on concrete vdevs
 	 * will be properly bypassed instead.
+	 *
+	 * A distributed spare stores its data on the other children of its
+	 * dRAID vdev, whose DTLs do not cover the repairs made to the spare.
+	 * The repair writes are therefore never bypassed on dRAID vdevs.
 	 */
 	if ((zio->io_flags & ZIO_FLAG_IO_REPAIR) &&
 	    !(zio->io_flags & ZIO_FLAG_SELF_HEAL) &&
 	    zio->io_txg != 0 &&	/* not a delegated i/o */
 	    vd->vdev_ops != &vdev_indirect_ops &&
+	    vd->vdev_top->vdev_ops != &vdev_draid_ops &&
 	    !vdev_dtl_contains(vd, DTL_PARTIAL, zio->io_txg, 1)) {
 		ASSERT(zio->io_type == ZIO_TYPE_WRITE);
 		zio_vdev_io_bypass(zio);
@@ -3772,11 +3844,18 @@ zio_vdev_io_start(zio_t *zio)
 	if (vd->vdev_ops->vdev_op_leaf && (zio->io_type == ZIO_TYPE_READ ||
 	    zio->io_type == ZIO_TYPE_WRITE || zio->io_type == ZIO_TYPE_TRIM)) {
 
-		if (zio->io_type == ZIO_TYPE_READ && vdev_cache_read(zio))
-			return (zio);
+		/*
+		 * I/O to a distributed spare is cached and queued by the
+		 * children it is issued to, see vdev_draid_spare_issue().
+		 */
+		if (vd->vdev_ops != &vdev_draid_spare_ops) {
+			if (zio->io_type == ZIO_TYPE_READ &&
+			    vdev_cache_read(zio))
+				return (zio);
 
-		if ((zio = vdev_queue_io(zio)) == NULL)
-			return (NULL);
+			if ((zio = vdev_queue_io(zio)) == NULL)
+				return (NULL);
+		}
 
 		if (!vdev_accessible(vd, zio)) {
 			zio->io_error = SET_ERROR(ENXIO);
@@ -3809,10 +3888,12 @@ zio_vdev_io_done(zio_t *zio)
 
 	if (vd != NULL && vd->vdev_ops->vdev_op_leaf) {
 
-		vdev_queue_io_done(zio);
+		if (vd->vdev_ops != &vdev_draid_spare_ops) {
+			vdev_queue_io_done(zio);
 
-		if (zio->io_type == ZIO_TYPE_WRITE)
-			vdev_cache_write(zio);
+			if (zio->io_type == ZIO_TYPE_WRITE)
+				vdev_cache_write(zio);
+		}
 
 		if (zio_injection_enabled && zio->io_error == 0)
 			zio->io_error = zio_handle_device_injections(vd, zio,
@@ -38,6 +38,7 @@
 #include <sys/zfeature.h>
 #include <sys/zio.h>
 #include <sys/zio_compress.h>
+#include <sys/zfs_pattern.h>
 #include <sys/zstd/zstd.h>
 
 /*
@@ -46,6 +47,17 @@
  */
 unsigned long zio_decompress_fail_fraction = 0;
 
+/*
+ * When writing with an expensive compression setting (any gzip level, lz4-2
+ * and above, or zstd level 3 and above), first probe the block with LZ4 and
+ * then zstd-1.  If neither cheap pass reaches the 12.5% savings threshold
+ * the block is written uncompressed without running the configured
+ * compressor, which saves a lot of CPU on already-compressed data.  Blocks
+ * smaller than zfs_compress_early_abort_size are always compressed in full.
+ */
+int zfs_compress_early_abort = 1;
+unsigned int zfs_compress_early_abort_size = 128 * 1024;
+
 /*
  * Compression vectors.
  */
@@ -110,24 +122,46 @@ zio_compress_select(spa_t *spa, enum zio_compress child,
 	return (result);
 }
 
-/*ARGSUSED*/
-static int
-zio_compress_zeroed_cb(void *data, size_t len, void *private)
+/*
+ * Returns true if the configured compressor is costly enough that probing
+ * the block with the cheap ones first is worthwhile.
+ */
+static boolean_t
+zio_compress_is_expensive(enum zio_compress c, uint8_t complevel)
 {
-	uint64_t *end = (uint64_t *)((char *)data + len);
-	for (uint64_t *word = (uint64_t *)data; word < end; word++)
-		if (*word != 0)
-			return (1);
+	if (c >= ZIO_COMPRESS_GZIP_1 && c <= ZIO_COMPRESS_GZIP_9)
+		return (B_TRUE);
 
-	return (0);
+	if (c == ZIO_COMPRESS_LZ4)
+		return (complevel >= ZIO_LZ4_LEVEL_HC_MIN &&
+		    complevel <= ZIO_LZ4_LEVEL_MAX);
+
+	return (c == ZIO_COMPRESS_ZSTD && complevel >= ZIO_ZSTD_LEVEL_3 &&
+	    complevel <= ZIO_ZSTD_LEVEL_MAX);
 }
 
-size_t
-zio_compress_data(enum zio_compress c, abd_t *src, void *dst, size_t s_len,
-    uint8_t level)
+/*
+ * Probe the block with LZ4, then zstd-1.  Returns B_TRUE if either of them
+ * gets below d_len, i.e. the block is worth the configured compressor.
+ * dst is only used as scratch space.
+ */
+static boolean_t
+zio_compress_probe(void *src, void *dst, size_t s_len, size_t d_len)
+{
+	if (lz4_compress_zfs(src, dst, s_len, d_len, 0) <= d_len)
+		return (B_TRUE);
+
+	return (zfs_zstd_compress(src, dst, s_len, d_len,
+	    ZIO_ZSTD_LEVEL_1) <= d_len);
+}
+
+static size_t
+zio_compress_data_impl(enum zio_compress c, abd_t *src, void *dst,
+    size_t s_len, uint8_t level, boolean_t *aborted)
 {
 	size_t c_len, d_len;
 	uint8_t complevel;
+	uint64_t pattern;
 	zio_compress_info_t *ci = &zio_compress_table[c];
 
 	ASSERT((uint_t)c < ZIO_COMPRESS_FUNCTIONS);
@@ -137,7 +171,7 @@ zio_compress_data(enum zio_compress c, abd_t *src, void *dst, size_t s_len,
 	 * If the data is all zeroes, we don't even need to allocate
 	 * a block for it.  We indicate this by returning zero size.
 	 */
-	if (abd_iterate_func(src, 0, s_len, zio_compress_zeroed_cb, NULL) == 0)
+	if (zfs_pattern_abd(src, s_len, &pattern) && pattern == 0)
 		return (0);
 
 	if (c == ZIO_COMPRESS_EMPTY)
@@ -159,10 +193,31 @@ zio_compress_data(enum zio_compress c, abd_t *src, void *dst, size_t s_len,
 			complevel = level;
 
 		ASSERT3U(complevel, !=, ZIO_COMPLEVEL_INHERIT);
+	} else if (c == ZIO_COMPRESS_LZ4) {
+		/*
+		 * Unlike zstd, lz4 blocks don't record the level they were
+		 * written with, and every level decodes the same way.  Blocks
+		 * without a known level just use the default compressor.
+		 */
+		if (level == ZIO_COMPLEVEL_INHERIT ||
+		    level == ZIO_COMPLEVEL_DEFAULT)
+			complevel = ZIO_LZ4_LEVEL_DEFAULT;
+		else
+			complevel = level;
 	}
 
 	/* No compression algorithms can read from ABDs directly */
 	void *tmp = abd_borrow_buf_copy(src, s_len);
+
+	if (aborted != NULL && zfs_compress_early_abort != 0 &&
+	    s_len >= zfs_compress_early_abort_size &&
+	    zio_compress_is_expensive(c, complevel) &&
+	    !zio_compress_probe(tmp, dst, s_len, d_len)) {
+		abd_return_buf(src, tmp, s_len);
+		*aborted = B_TRUE;
+		return (s_len);
+	}
+
 	c_len = ci->ci_compress(tmp, dst, s_len, d_len, complevel);
 	abd_return_buf(src, tmp, s_len);
 
@@ -173,6 +228,27 @@ zio_compress_data(enum zio_compress c, abd_t *src, void *dst, size_t s_len,
 	return (c_len);
 }
 
+size_t
+zio_compress_data(enum zio_compress c, abd_t *src, void *dst, size_t s_len,
+    uint8_t level)
+{
+	return (zio_compress_data_impl(c, src, dst, s_len, level, NULL));
+}
+
+/*
+ * Like zio_compress_data(), but may give up early on incompressible data
+ * (see zfs_compress_early_abort), in which case *aborted is set.  Only
+ * suitable for new writes: callers that must reproduce the exact on-disk
+ * compressed block (e.g. the ARC) have to use zio_compress_data().
+ */
+size_t
+zio_compress_data_abortable(enum zio_compress c, abd_t *src, void *dst,
+    size_t s_len, uint8_t level, boolean_t *aborted)
+{
+	*aborted = B_FALSE;
+	return (zio_compress_data_impl(c, src, dst, s_len, level, aborted));
+}
+
 int
 zio_decompress_data_buf(enum zio_compress c, void *src, void *dst,
     size_t s_len, size_t d_len, uint8_t *level)
@@ -218,3 +294,11 @@ zio_compress_to_feature(enum zio_compress comp)
 	}
 	return (SPA_FEATURE_NONE);
 }
+
+/* BEGIN CSTYLED */
+ZFS_MODULE_PARAM(zfs, zfs_, compress_early_abort, INT, ZMOD_RW,
+	"Probe with cheap compressors before expensive ones");
+
+ZFS_MODULE_PARAM(zfs, zfs_, compress_early_abort_size, UINT, ZMOD_RW,
+	"Minimum block size for compression early abort");
+/* END CSTYLED */
@@ -549,6 +549,7 @@ zil_replay_func_t *zvol_replay_vector[TX_MAX_TYPE] = {
 	zvol_replay_err,	/* TX_MKDIR_ATTR */
 	zvol_replay_err,	/* TX_MKDIR_ACL_ATTR */
 	zvol_replay_err,	/* TX_WRITE2 */
+	zvol_replay_err,	/* TX_CLONE_RANGE */
 };
 
 /*
@@ -787,6 +788,7 @@ zvol_setup_zv(zvol_state_t *zv)
 		ops->zv_set_disk_ro(zv, 0);
 		zv->zv_flags &= ~ZVOL_RDONLY;
 	}
+	dataset_kstats_attach(&zv->zv_kstat, os);
 	return (0);
 }
 
@@ -0,0 +1,399 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * This is just to keep the compiler happy about sys/time.h not declaring
+ * gettimeofday due to -D_KERNEL (we can do this since we're actually
+ * running in userspace, but we need -D_KERNEL for the remaining BLAKE3 code).
+ */
+#ifdef	_KERNEL
+#undef	_KERNEL
+#endif
+
+#include <sys/blake3.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/note.h>
+#include <sys/time.h>
+#include <sys/stdtypes.h>
+
+/*
+ * Test vectors in the format of the official BLAKE3 test vectors: the
+ * input is the repeating byte sequence 0, 1, ..., 250 of the given length,
+ * and the key of the keyed hash is the 32-byte test_key below.  The
+ * lengths exercise partial blocks, partial chunks and trees of chunks
+ * which are both narrower and wider than the SIMD implementations.
+ */
+static const uint8_t	test_key[BLAKE3_KEY_LEN] =
+	"whats the Elvish word for friend";
+
+typedef struct {
+	size_t	input_len;
+	uint8_t	hash[BLAKE3_OUT_LEN];
+	uint8_t	keyed_hash[BLAKE3_OUT_LEN];
+} blake3_test_t;
+
+static const blake3_test_t blake3_tests[] = {
+	{
+		0,
+		{
+			0xaf, 0x13, 0x49, 0xb9, 0xf5, 0xf9, 0xa1, 0xa6,
+			0xa0, 0x40, 0x4d, 0xea, 0x36, 0xdc, 0xc9, 0x49,
+			0x9b, 0xcb, 0x25, 0xc9, 0xad, 0xc1, 0x12, 0xb7,
+			0xcc, 0x9a, 0x93, 0xca, 0xe4, 0x1f, 0x32, 0x62
+		},
+		{
+			0x92, 0xb2, 0xb7, 0x56, 0x04, 0xed, 0x3c, 0x76,
+			0x1f, 0x9d, 0x6f, 0x62, 0x39, 0x2c, 0x8a, 0x92,
+			0x27, 0xad, 0x0e, 0xa3, 0xf0, 0x95, 0x73, 0xe7,
+			0x83, 0xf1, 0x49, 0x8a, 0x4e, 0xd6, 0x0d, 0x26
+		}
+	},
+	{
+		1,
+		{
+			0x2d, 0x3a, 0xde, 0xdf, 0xf1, 0x1b, 0x61, 0xf1,
+			0x4c, 0x88, 0x6e, 0x35, 0xaf, 0xa0, 0x36, 0x73,
+			0x6d, 0xcd, 0x87, 0xa7, 0x4d, 0x27, 0xb5, 0xc1,
+			0x51, 0x02, 0x25, 0xd0, 0xf5, 0x92, 0xe2, 0x13
+		},
+		{
+			0x6d, 0x78, 0x78, 0xdf, 0xff, 0x2f, 0x48, 0x56,
+			0x35, 0xd3, 0x90, 0x13, 0x27, 0x8a, 0xe1, 0x4f,
+			0x14, 0x54, 0xb8, 0xc0, 0xa3, 0xa2, 0xd3, 0x4b,
+			0xc1, 0xab, 0x38, 0x22, 0x8a, 0x80, 0xc9, 0x5b
+		}
+	},
+	{
+		63,
+		{
+			0xe9, 0xbc, 0x37, 0xa5, 0x94, 0xda, 0xad, 0x83,
+			0xbe, 0x94, 0x70, 0xdf, 0x7f, 0x7b, 0x37, 0x98,
+			0x29, 0x7c, 0x3d, 0x83, 0x4c, 0xe8, 0x0b, 0xa8,
+			0x5d, 0x6e, 0x20, 0x76, 0x27, 0xb7, 0xdb, 0x7b
+		},
+		{
+			0xbb, 0x1e, 0xb5, 0xd4, 0xaf, 0xa7, 0x93, 0xc1,
+			0xeb, 0xdd, 0x9f, 0xb0, 0x8d, 0xef, 0x6c, 0x36,
+			0xd1, 0x00, 0x96, 0x98, 0x6a, 0xe0, 0xcf, 0xe1,
+			0x48, 0xcd, 0x10, 0x11, 0x70, 0xce, 0x37, 0xae
+		}
+	},
+	{
+		64,
+		{
+			0x4e, 0xed, 0x71, 0x41, 0xea, 0x4a, 0x5c, 0xd4,
+			0xb7, 0x88, 0x60, 0x6b, 0xd2, 0x3f, 0x46, 0xe2,
+			0x12, 0xaf, 0x9c, 0xac, 0xeb, 0xac, 0xdc, 0x7d,
+			0x1f, 0x4c, 0x6d, 0xc7, 0xf2, 0x51, 0x1b, 0x98
+		},
+		{
+			0xba, 0x8c, 0xed, 0x36, 0xf3, 0x27, 0x70, 0x0d,
+			0x21, 0x3f, 0x12, 0x0b, 0x1a, 0x20, 0x7a, 0x3b,
+			0x8c, 0x04, 0x33, 0x05, 0x28, 0x58, 0x6f, 0x41,
+			0x4d, 0x09, 0xf2, 0xf7, 0xd9, 0xcc, 0xb7, 0xe6
+		}
+	},
+	{
+		65,
+		{
+			0xde, 0x1e, 0x5f, 0xa0, 0xbe, 0x70, 0xdf, 0x6d,
+			0x2b, 0xe8, 0xff, 0xfd, 0x0e, 0x99, 0xce, 0xaa,
+			0x8e, 0xb6, 0xe8, 0xc9, 0x3a, 0x63, 0xf2, 0xd8,
+			0xd1, 0xc3, 0x0e, 0xcb, 0x6b, 0x26, 0x3d, 0xee
+		},
+		{
+			0xc0, 0xa4, 0xed, 0xef, 0xa2, 0xd2, 0xac, 0xcb,
+			0x92, 0x77, 0xc3, 0x71, 0xac, 0x12, 0xfc, 0xdb,
+			0xb5, 0x29, 0x88, 0xa8, 0x6e, 0xdc, 0x54, 0xf0,
+			0x71, 0x6e, 0x15, 0x91, 0xb4, 0x32, 0x6e, 0x72
+		}
+	},
+	{
+		1023,
+		{
+			0x10, 0x10, 0x89, 0x70, 0xee, 0xda, 0x3e, 0xb9,
+			0x32, 0xba, 0xac, 0x14, 0x28, 0xc7, 0xa2, 0x16,
+			0x3b, 0x0e, 0x92, 0x4c, 0x9a, 0x9e, 0x25, 0xb3,
+			0x5b, 0xba, 0x72, 0xb2, 0x8f, 0x70, 0xbd, 0x11
+		},
+		{
+			0xc9, 0x51, 0xec, 0xdf, 0x03, 0x28, 0x8d, 0x0f,
+			0xcc, 0x96, 0xee, 0x34, 0x13, 0x56, 0x3d, 0x8a,
+			0x6d, 0x35, 0x89, 0x54, 0x7f, 0x2c, 0x2f, 0xb3,
+			0x6d, 0x97, 0x86, 0x47, 0x0f, 0x1b, 0x9d, 0x6e
+		}
+	},
+	{
+		1024,
+		{
+			0x42, 0x21, 0x47, 0x39, 0xf0, 0x95, 0xa4, 0x06,
+			0xf3, 0xfc, 0x83, 0xde, 0xb8, 0x89, 0x74, 0x4a,
+			0xc0, 0x0d, 0xf8, 0x31, 0xc1, 0x0d, 0xaa, 0x55,
+			0x18, 0x9b, 0x5d, 0x12, 0x1c, 0x85, 0x5a, 0xf7
+		},
+		{
+			0x75, 0xc4, 0x6f, 0x6f, 0x3d, 0x9e, 0xb4, 0xf5,
+			0x5e, 0xca, 0xae, 0xe4, 0x80, 0xdb, 0x73, 0x2e,
+			0x6c, 0x21, 0x05, 0x54, 0x6f, 0x1e, 0x67, 0x50,
+			0x03, 0x68, 0x7c, 0x31, 0x71, 0x9c, 0x7b, 0xa4
+		}
+	},
+	{
+		1025,
+		{
+			0xd0, 0x02, 0x78, 0xae, 0x47, 0xeb, 0x27, 0xb3,
+			0x4f, 0xae, 0xcf, 0x67, 0xb4, 0xfe, 0x26, 0x3f,
+			0x82, 0xd5, 0x41, 0x29, 0x16, 0xc1, 0xff, 0xd9,
+			0x7c, 0x8c, 0xb7, 0xfb, 0x81, 0x4b, 0x84, 0x44
+		},
+		{
+			0x35, 0x7d, 0xc5, 0x5d, 0xe0, 0xc7, 0xe3, 0x82,
+			0xc9, 0x00, 0xfd, 0x6e, 0x32, 0x0a, 0xcc, 0x04,
+			0x14, 0x6b, 0xe0, 0x1d, 0xb6, 0xa8, 0xce, 0x72,
+			0x10, 0xb7, 0x18, 0x9b, 0xd6, 0x64, 0xea, 0x69
+		}
+	},
+	{
+		2048,
+		{
+			0xe7, 0x76, 0xb6, 0x02, 0x8c, 0x7c, 0xd2, 0x2a,
+			0x4d, 0x0b, 0xa1, 0x82, 0xa8, 0xbf, 0x62, 0x20,
+			0x5d, 0x2e, 0xf5, 0x76, 0x46, 0x7e, 0x83, 0x8e,
+			0xd6, 0xf2, 0x52, 0x9b, 0x85, 0xfb, 0xa2, 0x4a
+		},
+		{
+			0x87, 0x9c, 0xf1, 0xfa, 0x2e, 0xa0, 0xe7, 0x91,
+			0x26, 0xcb, 0x10, 0x63, 0x61, 0x7a, 0x05, 0xb6,
+			0xad, 0x9d, 0x0b, 0x69, 0x6d, 0x0d, 0x75, 0x7c,
+			0xf0, 0x53, 0x43, 0x9f, 0x60, 0xa9, 0x9d, 0xd1
+		}
+	},
+	{
+		2049,
+		{
+			0x5f, 0x4d, 0x72, 0xf4, 0x0d, 0x7a, 0x5f, 0x82,
+			0xb1, 0x5c, 0xa2, 0xb2, 0xe4, 0x4b, 0x1d, 0xe3,
+			0xc2, 0xef, 0x86, 0xc4, 0x26, 0xc9, 0x5c, 0x1a,
+			0xf0, 0xb6, 0x87, 0x95, 0x22, 0x56, 0x30, 0x30
+		},
+		{
+			0x9f, 0x29, 0x70, 0x09, 0x02, 0xf7, 0xc8, 0x6e,
+			0x51, 0x4d, 0xdc, 0x4d, 0xf1, 0xe3, 0x04, 0x9f,
+			0x25, 0x8b, 0x24, 0x72, 0xb6, 0xdd, 0x52, 0x67,
+			0xf6, 0x1b, 0xf1, 0x39, 0x83, 0xb7, 0x8d, 0xd5
+		}
+	},
+	{
+		3072,
+		{
+			0xb9, 0x8c, 0xb0, 0xff, 0x36, 0x23, 0xbe, 0x03,
+			0x32, 0x6b, 0x37, 0x3d, 0xe6, 0xb9, 0x09, 0x52,
+			0x18, 0x51, 0x3e, 0x64, 0xf1, 0xee, 0x2e, 0xdd,
+			0x25, 0x25, 0xc7, 0xad, 0x1e, 0x5c, 0xff, 0xd2
+		},
+		{
+			0x04, 0x4a, 0x0e, 0x7b, 0x17, 0x2a, 0x31, 0x2d,
+			0xc0, 0x2a, 0x4c, 0x9a, 0x81, 0x8c, 0x03, 0x6f,
+			0xfa, 0x27, 0x76, 0x36, 0x8d, 0x7f, 0x52, 0x82,
+			0x68, 0xd2, 0xe6, 0xb5, 0xdf, 0x19, 0x17, 0x70
+		}
+	},
+	{
+		4096,
+		{
+			0x01, 0x50, 0x94, 0x01, 0x3f, 0x57, 0xa5, 0x27,
+			0x7b, 0x59, 0xd8, 0x47, 0x5c, 0x05, 0x01, 0x04,
+			0x2c, 0x0b, 0x64, 0x2e, 0x53, 0x1b, 0x0a, 0x1c,
+			0x8f, 0x58, 0xd2, 0x16, 0x32, 0x29, 0xe9, 0x69
+		},
+		{
+			0xbe, 0xfc, 0x66, 0x0a, 0xea, 0x2f, 0x17, 0x18,
+			0x88, 0x4c, 0xd8, 0xde, 0xb9, 0x90, 0x28, 0x11,
+			0xd3, 0x32, 0xf4, 0xfc, 0x4a, 0x38, 0xcf, 0x7c,
+			0x73, 0x00, 0xd5, 0x97, 0xa0, 0x81, 0xbf, 0xc0
+		}
+	},
+	{
+		8192,
+		{
+			0xaa, 0xe7, 0x92, 0x48, 0x4c, 0x8e, 0xfe, 0x4f,
+			0x19, 0xe2, 0xca, 0x7d, 0x37, 0x1d, 0x8c, 0x46,
+			0x7f, 0xfb, 0x10, 0x74, 0x8d, 0x8a, 0x5a, 0x1a,
+			0xe5, 0x79, 0x94, 0x8f, 0x71, 0x8a, 0x2a, 0x63
+		},
+		{
+			0xdc, 0x96, 0x37, 0xc8, 0x84, 0x5a, 0x77, 0x0b,
+			0x4c, 0xbf, 0x76, 0xb8, 0xda, 0xec, 0x0e, 0xeb,
+			0xf7, 0xdc, 0x2e, 0xac, 0x11, 0x49, 0x85, 0x17,
+			0xf0, 0x8d, 0x44, 0xc8, 0xfc, 0x00, 0xd5, 0x8a
+		}
+	},
+	{
+		16385,
+		{
+			0x1d, 0xab, 0xe2, 0x16, 0xbe, 0x25, 0x78, 0x83,
+			0x02, 0x63, 0xb0, 0x49, 0xde, 0x16, 0x39, 0xf3,
+			0x9f, 0x05, 0xa4, 0xda, 0x61, 0x6b, 0x9b, 0x78,
+			0xc7, 0xa5, 0xe4, 0xe4, 0x16, 0x62, 0xfd, 0x1f
+		},
+		{
+			0x9f, 0x1e, 0x87, 0x50, 0xb4, 0x85, 0x57, 0x6a,
+			0xa8, 0xaf, 0x42, 0xe4, 0x03, 0xbf, 0xb3, 0x40,
+			0x66, 0x5b, 0x45, 0xa9, 0x52, 0x79, 0x9d, 0x01,
+			0x55, 0x75, 0x6c, 0x99, 0x4d, 0xb7, 0xdf, 0xd2
+		}
+	},
+	{
+		31744,
+		{
+			0x62, 0xb6, 0x96, 0x0e, 0x1a, 0x44, 0xbc, 0xc1,
+			0xeb, 0x1a, 0x61, 0x1a, 0x8d, 0x62, 0x35, 0xb6,
+			0xb4, 0xb7, 0x8f, 0x32, 0xe7, 0xab, 0xc4, 0xfb,
+			0x4c, 0x6c, 0xdc, 0xce, 0x94, 0x89, 0x5c, 0x47
+		},
+		{
+			0xef, 0xa5, 0x3b, 0x38, 0x9a, 0xb6, 0x7c, 0x59,
+			0x3d, 0xba, 0x62, 0x4d, 0x89, 0x8d, 0x0f, 0x73,
+			0x53, 0xab, 0x99, 0xe4, 0xac, 0x9d, 0x42, 0x30,
+			0x2e, 0xe6, 0x4c, 0xbf, 0x99, 0x39, 0xa4, 0x19
+		}
+	},
+	{
+		102400,
+		{
+			0xbc, 0x3e, 0x3d, 0x41, 0xa1, 0x14, 0x6b, 0x06,
+			0x9a, 0xbf, 0xfa, 0xd3, 0xc0, 0xd4, 0x48, 0x60,
+			0xcf, 0x66, 0x43, 0x90, 0xaf, 0xce, 0x4d, 0x96,
+			0x61, 0xf7, 0x90, 0x2e, 0x79, 0x43, 0xe0, 0x85
+		},
+		{
+			0x1c, 0x35, 0xd1, 0xa5, 0x81, 0x10, 0x83, 0xfd,
+			0x71, 0x19, 0xf5, 0xd5, 0xd1, 0xba, 0x02, 0x7b,
+			0x4d, 0x01, 0xc0, 0xc6, 0xc4, 0x9f, 0xb6, 0xff,
+			0x2c, 0xf7, 0x53, 0x93, 0xea, 0x5d, 0xb4, 0xa7
+		}
+	}
+};
+
+/* The implementations to test, those not supported are skipped */
+static const char *blake3_impls[] = {
+	"generic", "sse2", "sse41", "avx2", "avx512", "cycle", "fastest"
+};
+
+#ifndef	ARRAY_SIZE
+#define	ARRAY_SIZE(x)	(sizeof (x) / sizeof (x[0]))
+#endif
+
+#define	BLAKE3_MAX_INPUT	102400
+#define	BLAKE3_PERF_BLOCK	131072
+
+int
+main(int argc, char *argv[])
+{
+	boolean_t	failed = B_FALSE;
+	uint64_t	cpu_mhz = 0;
+	uint8_t		*input, *block;
+	int		i, j;
+
+	if (argc == 2)
+		cpu_mhz = atoi(argv[1]);
+
+	input = malloc(BLAKE3_MAX_INPUT);
+	block = calloc(1, BLAKE3_PERF_BLOCK);
+	if (input == NULL || block == NULL)
+		return (1);
+
+	for (i = 0; i < BLAKE3_MAX_INPUT; i++)
+		input[i] = i % 251;
+
+	blake3_impl_init();
+
+	(void) printf("Running algorithm correctness tests:\n");
+	for (i = 0; i < ARRAY_SIZE(blake3_impls); i++) {
+		if (blake3_impl_set(blake3_impls[i]) != 0)
+			continue;
+
+		for (j = 0; j < ARRAY_SIZE(blake3_tests); j++) {
+			const blake3_test_t *t = &blake3_tests[j];
+			BLAKE3_CTX	ctx;
+			uint8_t		digest[BLAKE3_OUT_LEN];
+			uint8_t		keyed[BLAKE3_OUT_LEN];
+			size_t		half = t->input_len / 2;
+
+			Blake3_Init(&ctx);
+			Blake3_Update(&ctx, input, t->input_len);
+			Blake3_Final(&ctx, digest);
+
+			/* feed the keyed hash in two pieces */
+			Blake3_InitKeyed(&ctx, test_key);
+			Blake3_Update(&ctx, input, half);
+			Blake3_Update(&ctx, input + half, t->input_len - half);
+			Blake3_Final(&ctx, keyed);
+
+			(void) printf("BLAKE3/%s\tMessage: %zu bytes\t"
+			    "Result: ", blake3_impls[i], t->input_len);
+			if (bcmp(digest, t->hash, BLAKE3_OUT_LEN) == 0 &&
+			    bcmp(keyed, t->keyed_hash, BLAKE3_OUT_LEN) == 0) {
+				(void) printf("OK\n");
+			} else {
+				(void) printf("FAILED!\n");
+				failed = B_TRUE;
+			}
+		}
+	}
+	if (failed)
+		return (1);
+
+	(void) printf("Running performance tests (hashing 1024 MiB of "
+	    "data):\n");
+	for (i = 0; i < ARRAY_SIZE(blake3_impls); i++) {
+		BLAKE3_CTX	ctx;
+		uint8_t		digest[BLAKE3_OUT_LEN];
+		uint64_t	delta;
+		double		cpb = 0;
+		struct timeval	start, end;
+
+		if (blake3_impl_set(blake3_impls[i]) != 0)
+			continue;
+
+		(void) gettimeofday(&start, NULL);
+		Blake3_Init(&ctx);
+		for (j = 0; j < 8192; j++)
+			Blake3_Update(&ctx, block, BLAKE3_PERF_BLOCK);
+		Blake3_Final(&ctx, digest);
+		(void) gettimeofday(&end, NULL);
+		delta = (end.tv_sec * 1000000llu + end.tv_usec) -
+		    (start.tv_sec * 1000000llu + start.tv_usec);
+		if (cpu_mhz != 0) {
+			cpb = (cpu_mhz * 1e6 * ((double)delta /
+			    1000000)) / (8192 * 128 * 1024);
+		}
+		(void) printf("BLAKE3/%s\t%llu us (%.02f CPB)\n",
+		    blake3_impls[i], (u_longlong_t)delta, cpb);
+	}
+
+	free(input);
+	free(block);
+
+	return (0);
+}
@@ -172,15 +172,39 @@ const uint8_t	sha512_256_test_digests[][32] = {
 	}
 };
 
+/* The implementations to test, those not supported are skipped */
+static const char *sha2_impls[] = {
+	"generic", "x86_64", "shani", "cycle", "fastest"
+};
+
+#ifndef	ARRAY_SIZE
+#define	ARRAY_SIZE(x)	(sizeof (x) / sizeof (x[0]))
+#endif
+
+#define	SHA2_LONG_INPUT	100000
+
 int
 main(int argc, char *argv[])
 {
 	boolean_t	failed = B_FALSE;
 	uint64_t	cpu_mhz = 0;
+	uint8_t		*input;
+	uint8_t		long_digest[2][SHA512_DIGEST_LENGTH];
+	boolean_t	sha256, sha512;
+	int		i;
 
 	if (argc == 2)
 		cpu_mhz = atoi(argv[1]);
 
+	input = malloc(SHA2_LONG_INPUT);
+	if (input == NULL)
+		return (1);
+
+	for (i = 0; i < SHA2_LONG_INPUT; i++)
+		input[i] = (i * 7919) >> 3;
+
+	sha2_impl_init();
+
 #define	SHA2_ALGO_TEST(_m, mode, diglen, testdigest)			\
 	do {								\
 		SHA2_CTX		ctx;				\
@@ -188,8 +212,8 @@ main(int argc, char *argv[])
 		SHA2Init(SHA ## mode ## _MECH_INFO_TYPE, &ctx);		\
 		SHA2Update(&ctx, _m, strlen(_m));			\
 		SHA2Final(digest, &ctx);				\
-		(void) printf("SHA%-9sMessage: " #_m			\
-		    "\tResult: ", #mode);				\
+		(void) printf("SHA%-9s%-9sMessage: " #_m		\
+		    "\tResult: ", #mode, sha2_impls[i]);		\
 		if (bcmp(digest, testdigest, diglen / 8) == 0) {	\
 			(void) printf("OK\n");				\
 		} else {						\
@@ -199,6 +223,36 @@ main(int argc, char *argv[])
 		NOTE(CONSTCOND)						\
 	} while (0)
 
+/*
+ * Hash a long input in pieces of odd sizes, so that the multi-block
+ * transforms are used on unaligned data, and compare the result with
+ * the one of the first (generic) implementation.
+ */
+#define	SHA2_LONG_TEST(mode, diglen, ref)				\
+	do {								\
+		SHA2_CTX		ctx;				\
+		uint8_t			digest[diglen / 8];		\
+		size_t			off, len;			\
+		SHA2Init(SHA ## mode ## _MECH_INFO_TYPE, &ctx);		\
+		for (off = 0; off < SHA2_LONG_INPUT; off += len) {	\
+			len = MIN(off % 3001 + 1, SHA2_LONG_INPUT - off); \
+			SHA2Update(&ctx, input + off, len);		\
+		}							\
+		SHA2Final(digest, &ctx);				\
+		(void) printf("SHA%-9s%-9sMessage: long\tResult: ", #mode, \
+		    sha2_impls[i]);					\
+		if (i == 0) {						\
+			bcopy(digest, ref, diglen / 8);			\
+			(void) printf("OK\n");				\
+		} else if (bcmp(digest, ref, diglen / 8) == 0) {	\
+			(void) printf("OK\n");				\
+		} else {						\
+			(void) printf("FAILED!\n");			\
+			failed = B_TRUE;				\
+		}							\
+		NOTE(CONSTCOND)						\
+	} while (0)
+
 #define	SHA2_PERF_TEST(mode, diglen)					\
 	do {								\
 		SHA2_CTX	ctx;					\
@@ -206,12 +260,12 @@ main(int argc, char *argv[])
 		uint8_t		block[131072];				\
 		uint64_t	delta;					\
 		double		cpb = 0;				\
-		int		i;					\
+		int		j;					\
 		struct timeval	start, end;				\
 		bzero(block, sizeof (block));				\
 		(void) gettimeofday(&start, NULL);			\
 		SHA2Init(SHA ## mode ## _MECH_INFO_TYPE, &ctx);		\
-		for (i = 0; i < 8192; i++)				\
+		for (j = 0; j < 8192; j++)				\
 			SHA2Update(&ctx, block, sizeof (block));	\
 		SHA2Final(digest, &ctx);				\
 		(void) gettimeofday(&end, NULL);			\
@@ -221,30 +275,55 @@ main(int argc, char *argv[])
 			cpb = (cpu_mhz * 1e6 * ((double)delta /		\
 			    1000000)) / (8192 * 128 * 1024);		\
 		}							\
-		(void) printf("SHA%-9s%llu us (%.02f CPB)\n", #mode,	\
-		    (u_longlong_t)delta, cpb);				\
+		(void) printf("SHA%-9s%-9s%llu us (%.02f CPB)\n", #mode, \
+		    sha2_impls[i], (u_longlong_t)delta, cpb);		\
 		NOTE(CONSTCOND)						\
 	} while (0)
 
 	(void) printf("Running algorithm correctness tests:\n");
-	SHA2_ALGO_TEST(test_msg0, 256, 256, sha256_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg1, 256, 256, sha256_test_digests[1]);
-	SHA2_ALGO_TEST(test_msg0, 384, 384, sha384_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 384, 384, sha384_test_digests[2]);
-	SHA2_ALGO_TEST(test_msg0, 512, 512, sha512_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 512, 512, sha512_test_digests[2]);
-	SHA2_ALGO_TEST(test_msg0, 512_224, 224, sha512_224_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 512_224, 224, sha512_224_test_digests[2]);
-	SHA2_ALGO_TEST(test_msg0, 512_256, 256, sha512_256_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 512_256, 256, sha512_256_test_digests[2]);
+	for (i = 0; i < ARRAY_SIZE(sha2_impls); i++) {
+		sha256 = (sha256_impl_set(sha2_impls[i]) == 0);
+		sha512 = (sha512_impl_set(sha2_impls[i]) == 0);
+
+		if (sha256) {
+			SHA2_ALGO_TEST(test_msg0, 256, 256,
+			    sha256_test_digests[0]);
+			SHA2_ALGO_TEST(test_msg1, 256, 256,
+			    sha256_test_digests[1]);
+			SHA2_LONG_TEST(256, 256, long_digest[0]);
+		}
+		if (sha512) {
+			SHA2_ALGO_TEST(test_msg0, 384, 384,
+			    sha384_test_digests[0]);
+			SHA2_ALGO_TEST(test_msg2, 384, 384,
+			    sha384_test_digests[2]);
+			SHA2_ALGO_TEST(test_msg0, 512, 512,
+			    sha512_test_digests[0]);
+			SHA2_ALGO_TEST(test_msg2, 512, 512,
+			    sha512_test_digests[2]);
+			SHA2_ALGO_TEST(test_msg0, 512_224, 224,
+			    sha512_224_test_digests[0]);
+			SHA2_ALGO_TEST(test_msg2, 512_224, 224,
+			    sha512_224_test_digests[2]);
+			SHA2_ALGO_TEST(test_msg0, 512_256, 256,
+			    sha512_256_test_digests[0]);
+			SHA2_ALGO_TEST(test_msg2, 512_256, 256,
+			    sha512_256_test_digests[2]);
+			SHA2_LONG_TEST(512, 512, long_digest[1]);
+		}
+	}
 
 	if (failed)
 		return (1);
 
 	(void) printf("Running performance tests (hashing 1024 MiB of "
 	    "data):\n");
-	SHA2_PERF_TEST(256, 256);
-	SHA2_PERF_TEST(512, 512);
+	for (i = 0; i < ARRAY_SIZE(sha2_impls); i++) {
+		if (sha256_impl_set(sha2_impls[i]) == 0)
+			SHA2_PERF_TEST(256, 256);
+		if (sha512_impl_set(sha2_impls[i]) == 0)
+			SHA2_PERF_TEST(512, 512);
+	}
 
 	return (0);
 }